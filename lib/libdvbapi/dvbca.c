@@ -29,13 +29,26 @@
 #include <errno.h>
 #include <linux/dvb/ca.h>
 #include "dvbca.h"
+#include "dvbvirtual.h"
+#include "dvbvirtual_int.h"
 
 
+/* ioctl() on either a real CA device or an emulated one */
+static int dvbca_ioctl(int fd, unsigned long request, void *arg)
+{
+	if (dvbcamemu_is_ca(fd))
+		return dvbcamemu_ca_ioctl(fd, request, arg);
+	return ioctl(fd, request, arg);
+}
+
 int dvbca_open(int adapter, int cadevice)
 {
 	char filename[PATH_MAX+1];
 	int fd;
 
+	if (dvbvirtual_is_virtual(adapter))
+		return dvbvirtual_open_ca(adapter, cadevice);
+
 	sprintf(filename, "/dev/dvb/adapter%i/ca%i", adapter, cadevice);
 	if ((fd = open(filename, O_RDWR)) < 0) {
 		// if that failed, try a flat /dev structure
@@ -48,7 +61,7 @@ int dvbca_open(int adapter, int cadevice)
 
 int dvbca_reset(int fd, uint8_t slot)
 {
-	return ioctl(fd, CA_RESET, (1 << slot));
+	return dvbca_ioctl(fd, CA_RESET, (void *) (unsigned long) (1 << slot));
 }
 
 int dvbca_get_interface_type(int fd, uint8_t slot)
@@ -56,7 +69,7 @@ int dvbca_get_interface_type(int fd, uint8_t slot)
 	ca_slot_info_t info;
 
 	info.num = slot;
-	if (ioctl(fd, CA_GET_SLOT_INFO, &info))
+	if (dvbca_ioctl(fd, CA_GET_SLOT_INFO, &info))
 		return -1;
 
 	if (info.type & CA_CI_LINK)
@@ -72,7 +85,7 @@ int dvbca_get_cam_state(int fd, uint8_t slot)
 	ca_slot_info_t info;
 
 	info.num = slot;
-	if (ioctl(fd, CA_GET_SLOT_INFO, &info))
+	if (dvbca_ioctl(fd, CA_GET_SLOT_INFO, &info))
 		return -1;
 
 	if (info.flags == 0)
@@ -85,38 +98,56 @@ int dvbca_get_cam_state(int fd, uint8_t slot)
 	return -1;
 }
 
+// messages are assembled on the stack unless they are bigger than this
+#define LINK_STACKBUF_SIZE 4096
+
 int dvbca_link_write(int fd, uint8_t slot, uint8_t connection_id,
 		     uint8_t *data, uint16_t data_length)
 {
-	uint8_t *buf = malloc(data_length + 2);
-	if (buf == NULL)
-		return -1;
+	uint8_t stackbuf[LINK_STACKBUF_SIZE + 2];
+	uint8_t *buf = stackbuf;
+
+	// one write() per message: the device takes the header and data together
+	if (data_length > LINK_STACKBUF_SIZE) {
+		buf = malloc(data_length + 2);
+		if (buf == NULL)
+			return -1;
+	}
 
 	buf[0] = slot;
 	buf[1] = connection_id;
 	memcpy(buf+2, data, data_length);
 
 	int result = write(fd, buf, data_length+2);
-	free(buf);
+	if (buf != stackbuf)
+		free(buf);
 	return result;
 }
 
 int dvbca_link_read(int fd, uint8_t *slot, uint8_t *connection_id,
 		     uint8_t *data, uint16_t data_length)
 {
+	uint8_t stackbuf[LINK_STACKBUF_SIZE + 2];
+	uint8_t *buf = stackbuf;
 	int size;
 
-	uint8_t *buf = malloc(data_length + 2);
-	if (buf == NULL)
-		return -1;
+	if (data_length > LINK_STACKBUF_SIZE) {
+		buf = malloc(data_length + 2);
+		if (buf == NULL)
+			return -1;
+	}
 
-	if ((size = read(fd, buf, data_length+2)) < 2)
+	if ((size = read(fd, buf, data_length+2)) < 2) {
+		if (buf != stackbuf)
+			free(buf);
 		return -1;
+	}
 
 	*slot = buf[0];
 	*connection_id = buf[1];
 	memcpy(data, buf+2, size-2);
-	free(buf);
+	if (buf != stackbuf)
+		free(buf);
 
 	return size - 2;
 }
@@ -133,7 +164,7 @@ int dvbca_hlci_write(int fd, uint8_t *data, uint16_t data_length)
 
 	memcpy(msg.msg, data, data_length);
 
-	return ioctl(fd, CA_SEND_MSG, &msg);
+	return dvbca_ioctl(fd, CA_SEND_MSG, &msg);
 }
 
 int dvbca_hlci_read(int fd, uint32_t app_tag, uint8_t *data,
@@ -150,7 +181,7 @@ int dvbca_hlci_read(int fd, uint32_t app_tag, uint8_t *data,
 	msg.msg[1] = app_tag >> 8;
 	msg.msg[2] = app_tag;
 
-	int status = ioctl(fd, CA_GET_MSG, &msg);
+	int status = dvbca_ioctl(fd, CA_GET_MSG, &msg);
 	if (status < 0) return status;
 
 	if (msg.length > data_length) msg.length = data_length;
@@ -0,0 +1,1053 @@
+/*
+ * libdvbapi - a software CAM speaking the EN 50221 link layer protocol
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <linux/dvb/ca.h>
+#include "dvbcamemu.h"
+#include "dvbvirtual_int.h"
+
+#define DVBCAMEMU_MAX_CONNECTIONS 16
+
+/* largest message the host can write: dvbca_link_write() takes a 16 bit length */
+#define DVBCAMEMU_MAX_HOST_MESSAGE (65535 + 2)
+
+/* data sent to the host per T_DATA TPDU; longer SPDUs are split with T_DATA_MORE */
+#define DVBCAMEMU_TPDU_DATA 1024
+
+/* transport layer tags (EN 50221 A.4.1.13) */
+#define T_SB			0x80
+#define T_RCV			0x81
+#define T_CREATE_T_C		0x82
+#define T_C_T_C_REPLY		0x83
+#define T_DELETE_T_C		0x84
+#define T_D_T_C_REPLY		0x85
+#define T_DATA_LAST		0xA0
+#define T_DATA_MORE		0xA1
+
+/* session layer tags (EN 50221 7.2.7) */
+#define ST_SESSION_NUMBER	0x90
+#define ST_OPEN_SESSION_REQ	0x91
+#define ST_OPEN_SESSION_RES	0x92
+#define ST_CREATE_SESSION	0x93
+#define ST_CREATE_SESSION_RES	0x94
+#define ST_CLOSE_SESSION_REQ	0x95
+#define ST_CLOSE_SESSION_RES	0x96
+
+#define S_STATUS_OPEN		0x00
+#define S_STATUS_CLOSE_NO_RES	0xF0
+
+/* application layer tags (EN 50221 8.8.1) */
+#define TAG_PROFILE_ENQUIRY	0x9f8010
+#define TAG_PROFILE		0x9f8011
+#define TAG_PROFILE_CHANGE	0x9f8012
+#define TAG_APP_INFO_ENQUIRY	0x9f8020
+#define TAG_APP_INFO		0x9f8021
+#define TAG_ENTER_MENU		0x9f8022
+#define TAG_CA_INFO_ENQUIRY	0x9f8030
+#define TAG_CA_INFO		0x9f8031
+#define TAG_CA_PMT		0x9f8032
+#define TAG_CA_PMT_REPLY	0x9f8033
+#define TAG_DATE_TIME_ENQUIRY	0x9f8440
+#define TAG_DATE_TIME		0x9f8441
+#define TAG_CLOSE_MMI		0x9f8800
+#define TAG_DISPLAY_REPLY	0x9f8802
+#define TAG_TEXT_LAST		0x9f8803
+#define TAG_MENU_LAST		0x9f8809
+#define TAG_MENU_ANSWER		0x9f880b
+
+#define CA_PMT_CMD_ID_QUERY	0x03
+
+#define DVBCAMEMU_MENU_STRING	"dvbcamemu"
+
+/* the resources a module opens sessions to, and their resource ids */
+enum dvbcamemu_resource {
+	RES_RM,
+	RES_AI,
+	RES_CA,
+	RES_MMI,
+	RES_DATETIME,
+	RES_COUNT,
+};
+
+static const uint32_t dvbcamemu_resource_ids[RES_COUNT] = {
+	0x00010041,
+	0x00020041,
+	0x00030041,
+	0x00400041,
+	0x00240041,
+};
+
+enum dvbcamemu_session_state {
+	SESSION_IDLE,
+	SESSION_OPENING,
+	SESSION_OPEN,
+};
+
+/**
+ * An SPDU waiting to be collected by the host with T_RCV. sent counts the
+ * bytes already handed over in T_DATA_MORE TPDUs.
+ */
+struct dvbcamemu_message {
+	struct dvbcamemu_message *next;
+	uint32_t length;
+	uint32_t sent;
+	uint8_t data[0];
+};
+
+struct dvbcamemu_connection {
+	int active;
+
+	/* an SPDU arriving in T_DATA_MORE fragments */
+	uint8_t *rx;
+	uint32_t rx_length;
+	uint32_t rx_size;
+
+	struct dvbcamemu_message *tx_head;
+	struct dvbcamemu_message *tx_tail;
+};
+
+struct dvbcamemu_session {
+	enum dvbcamemu_session_state state;
+	uint16_t session_number;
+	uint8_t connection_id;
+};
+
+struct dvbcamemu_slot {
+	struct dvbcamemu_connection connections[DVBCAMEMU_MAX_CONNECTIONS];
+	struct dvbcamemu_session sessions[RES_COUNT];
+
+	/* connection the module opens its sessions on, 0 => none yet */
+	uint8_t connection_id;
+};
+
+struct dvbcamemu {
+	int fd;
+	int host_fd;
+	ino_t host_ino;
+	int slot_count;
+	struct dvbcamemu_slot *slots;
+
+	pthread_mutex_t lock;
+	pthread_t thread;
+	volatile int closed;
+	struct dvbcamemu_stats stats;
+
+	uint8_t *rx_buf;
+	struct dvbcamemu *next;
+};
+
+/* every emulator, so dvbca_*() can recognise their descriptors */
+static pthread_mutex_t dvbcamemu_global_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct dvbcamemu *dvbcamemu_list;
+static volatile int dvbcamemu_active;
+
+static void *dvbcamemu_thread(void *arg);
+
+
+static int dvbcamemu_asn_1_encode(uint32_t length, uint8_t *buf)
+{
+	if (length < 0x80) {
+		buf[0] = length;
+		return 1;
+	}
+	if (length < 0x100) {
+		buf[0] = 0x81;
+		buf[1] = length;
+		return 2;
+	}
+	buf[0] = 0x82;
+	buf[1] = length >> 8;
+	buf[2] = length;
+	return 3;
+}
+
+static int dvbcamemu_asn_1_decode(uint32_t *length, uint8_t *buf, uint32_t buf_len)
+{
+	int count;
+	int i;
+
+	if (buf_len < 1)
+		return -1;
+	if (!(buf[0] & 0x80)) {
+		*length = buf[0];
+		return 1;
+	}
+
+	count = buf[0] & 0x7f;
+	if ((count == 0) || (count > 2) || ((uint32_t) count + 1 > buf_len))
+		return -1;
+	*length = 0;
+	for(i=0; i < count; i++)
+		*length = (*length << 8) | buf[i + 1];
+	return count + 1;
+}
+
+
+
+/* ---------------------------------------------------------------------- */
+/* outgoing messages */
+
+static uint8_t *dvbcamemu_queue(struct dvbcamemu_slot *slot, uint8_t connection_id,
+				uint32_t length)
+{
+	struct dvbcamemu_connection *conn = &slot->connections[connection_id];
+	struct dvbcamemu_message *msg;
+
+	msg = (struct dvbcamemu_message *) malloc(sizeof(struct dvbcamemu_message) + length);
+	if (msg == NULL)
+		return NULL;
+	msg->next = NULL;
+	msg->length = length;
+	msg->sent = 0;
+
+	if (conn->tx_tail)
+		conn->tx_tail->next = msg;
+	else
+		conn->tx_head = msg;
+	conn->tx_tail = msg;
+
+	return msg->data;
+}
+
+/**
+ * Queue an APDU on a session, returning where its body of body_length bytes
+ * should be written.
+ */
+static uint8_t *dvbcamemu_queue_apdu(struct dvbcamemu_slot *slot, enum dvbcamemu_resource res,
+				     uint32_t tag, uint32_t body_length)
+{
+	struct dvbcamemu_session *s = &slot->sessions[res];
+	uint8_t length_field[3];
+	int length_field_len;
+	uint8_t *buf;
+
+	if (s->state != SESSION_OPEN)
+		return NULL;
+
+	length_field_len = dvbcamemu_asn_1_encode(body_length, length_field);
+	buf = dvbcamemu_queue(slot, s->connection_id, 4 + 3 + length_field_len + body_length);
+	if (buf == NULL)
+		return NULL;
+
+	buf[0] = ST_SESSION_NUMBER;
+	buf[1] = 2;
+	buf[2] = s->session_number >> 8;
+	buf[3] = s->session_number;
+	buf[4] = tag >> 16;
+	buf[5] = tag >> 8;
+	buf[6] = tag;
+	memcpy(buf + 7, length_field, length_field_len);
+
+	return buf + 7 + length_field_len;
+}
+
+static void dvbcamemu_open_session(struct dvbcamemu_slot *slot, enum dvbcamemu_resource res)
+{
+	struct dvbcamemu_session *s = &slot->sessions[res];
+	uint32_t resource_id = dvbcamemu_resource_ids[res];
+	uint8_t *buf;
+
+	if ((s->state != SESSION_IDLE) || (slot->connection_id == 0))
+		return;
+	if ((buf = dvbcamemu_queue(slot, slot->connection_id, 6)) == NULL)
+		return;
+
+	buf[0] = ST_OPEN_SESSION_REQ;
+	buf[1] = 4;
+	buf[2] = resource_id >> 24;
+	buf[3] = resource_id >> 16;
+	buf[4] = resource_id >> 8;
+	buf[5] = resource_id;
+
+	s->state = SESSION_OPENING;
+	s->connection_id = slot->connection_id;
+}
+
+static void dvbcamemu_reset_connection(struct dvbcamemu_slot *slot, uint8_t connection_id)
+{
+	struct dvbcamemu_connection *conn = &slot->connections[connection_id];
+	struct dvbcamemu_message *msg;
+	int i;
+
+	while(conn->tx_head) {
+		msg = conn->tx_head;
+		conn->tx_head = msg->next;
+		free(msg);
+	}
+	free(conn->rx);
+	memset(conn, 0, sizeof(struct dvbcamemu_connection));
+
+	for(i=0; i < RES_COUNT; i++) {
+		if (slot->sessions[i].connection_id == connection_id)
+			memset(&slot->sessions[i], 0, sizeof(struct dvbcamemu_session));
+	}
+	if (slot->connection_id == connection_id)
+		slot->connection_id = 0;
+}
+
+
+
+/* ---------------------------------------------------------------------- */
+/* resources */
+
+static void dvbcamemu_send_menu(struct dvbcamemu_slot *slot)
+{
+	static const char *texts[3 + DVBCAMEMU_MENU_ITEMS] = {
+		DVBCAMEMU_MENU_STRING, "Emulated module", "Select an item",
+		"Subscription status", "Entitlements", "Software version",
+	};
+	uint32_t length = 1;
+	uint8_t *buf;
+	int i;
+
+	for(i=0; i < 3 + DVBCAMEMU_MENU_ITEMS; i++)
+		length += 4 + strlen(texts[i]);
+	if ((buf = dvbcamemu_queue_apdu(slot, RES_MMI, TAG_MENU_LAST, length)) == NULL)
+		return;
+
+	*buf++ = DVBCAMEMU_MENU_ITEMS;
+	for(i=0; i < 3 + DVBCAMEMU_MENU_ITEMS; i++) {
+		*buf++ = TAG_TEXT_LAST >> 16;
+		*buf++ = (TAG_TEXT_LAST >> 8) & 0xff;
+		*buf++ = TAG_TEXT_LAST & 0xff;
+		*buf++ = strlen(texts[i]);
+		memcpy(buf, texts[i], strlen(texts[i]));
+		buf += strlen(texts[i]);
+	}
+}
+
+/* a session to one of our resources has just been opened by the host */
+static void dvbcamemu_session_opened(struct dvbcamemu_slot *slot, enum dvbcamemu_resource res)
+{
+	uint8_t *buf;
+
+	switch(res) {
+	case RES_MMI:
+		dvbcamemu_send_menu(slot);
+		break;
+
+	case RES_DATETIME:
+		if ((buf = dvbcamemu_queue_apdu(slot, RES_DATETIME, TAG_DATE_TIME_ENQUIRY, 1)) != NULL)
+			buf[0] = 0;
+		break;
+
+	default:
+		break;
+	}
+}
+
+static int dvbcamemu_rm_apdu(struct dvbcamemu_slot *slot, uint32_t tag,
+			     uint8_t *data, uint32_t data_length)
+{
+	uint32_t resource_id;
+	int i;
+
+	switch(tag) {
+	case TAG_PROFILE_ENQUIRY:
+		// we provide no resources ourselves
+		dvbcamemu_queue_apdu(slot, RES_RM, TAG_PROFILE, 0);
+		break;
+
+	case TAG_PROFILE_CHANGE:
+		dvbcamemu_queue_apdu(slot, RES_RM, TAG_PROFILE_ENQUIRY, 0);
+		break;
+
+	case TAG_PROFILE:
+		// the host's resources: connect to the ones we use
+		if (data_length & 3)
+			return -1;
+		for(; data_length; data += 4, data_length -= 4) {
+			resource_id = (data[0] << 24) | (data[1] << 16) | (data[2] << 8) | data[3];
+			for(i=RES_AI; i < RES_COUNT; i++) {
+				if ((i != RES_MMI) &&
+				    ((resource_id >> 6) == (dvbcamemu_resource_ids[i] >> 6)))
+					dvbcamemu_open_session(slot, i);
+			}
+		}
+		break;
+
+	default:
+		return -1;
+	}
+
+	return 0;
+}
+
+static int dvbcamemu_ai_apdu(struct dvbcamemu_slot *slot, uint32_t tag)
+{
+	uint8_t *buf;
+
+	switch(tag) {
+	case TAG_APP_INFO_ENQUIRY:
+		buf = dvbcamemu_queue_apdu(slot, RES_AI, TAG_APP_INFO,
+					   6 + strlen(DVBCAMEMU_MENU_STRING));
+		if (buf == NULL)
+			break;
+		buf[0] = 0x01;		// conditional access
+		buf[1] = 0x00;
+		buf[2] = 0x00;
+		buf[3] = 0x00;
+		buf[4] = 0x00;
+		buf[5] = strlen(DVBCAMEMU_MENU_STRING);
+		memcpy(buf + 6, DVBCAMEMU_MENU_STRING, strlen(DVBCAMEMU_MENU_STRING));
+		break;
+
+	case TAG_ENTER_MENU:
+		if (slot->sessions[RES_MMI].state == SESSION_OPEN)
+			dvbcamemu_send_menu(slot);
+		else
+			dvbcamemu_open_session(slot, RES_MMI);
+		break;
+
+	default:
+		return -1;
+	}
+
+	return 0;
+}
+
+/**
+ * Process a ca_pmt. Programs and streams with CA descriptors are reported
+ * as descramblable when the host queries them.
+ */
+static int dvbcamemu_ca_pmt(struct dvbcamemu *emu, struct dvbcamemu_slot *slot,
+			    uint8_t *data, uint32_t data_length)
+{
+	uint32_t pos;
+	uint32_t info_length;
+	uint32_t streams = 0;
+	int query = 0;
+	int program_ca = 0;
+	uint8_t *buf;
+
+	emu->stats.ca_pmts++;
+
+	// validate it, and see if a reply is wanted
+	if (data_length < 6)
+		return -1;
+	info_length = ((data[4] & 0x0f) << 8) | data[5];
+	if (6 + info_length > data_length)
+		return -1;
+	if (info_length) {
+		query |= data[6] == CA_PMT_CMD_ID_QUERY;
+		program_ca = info_length > 1;
+	}
+	for(pos = 6 + info_length; pos < data_length; pos += 5 + info_length) {
+		if (pos + 5 > data_length)
+			return -1;
+		info_length = ((data[pos + 3] & 0x0f) << 8) | data[pos + 4];
+		if (pos + 5 + info_length > data_length)
+			return -1;
+		if (info_length)
+			query |= data[pos + 5] == CA_PMT_CMD_ID_QUERY;
+		streams++;
+	}
+	if (!query)
+		return 0;
+
+	buf = dvbcamemu_queue_apdu(slot, RES_CA, TAG_CA_PMT_REPLY, 4 + (streams * 3));
+	if (buf == NULL)
+		return 0;
+	buf[0] = data[1];
+	buf[1] = data[2];
+	buf[2] = data[3];
+	buf[3] = program_ca ? 0x81 : 0x00;
+	buf += 4;
+
+	info_length = ((data[4] & 0x0f) << 8) | data[5];
+	for(pos = 6 + info_length; pos < data_length; pos += 5 + info_length) {
+		info_length = ((data[pos + 3] & 0x0f) << 8) | data[pos + 4];
+		buf[0] = data[pos + 1] | 0xe0;
+		buf[1] = data[pos + 2];
+		buf[2] = (program_ca || (info_length > 1)) ? 0x81 : 0x00;
+		buf += 3;
+	}
+	emu->stats.ca_pmt_replies++;
+
+	return 0;
+}
+
+static int dvbcamemu_ca_apdu(struct dvbcamemu *emu, struct dvbcamemu_slot *slot, uint32_t tag,
+			     uint8_t *data, uint32_t data_length)
+{
+	uint8_t *buf;
+
+	switch(tag) {
+	case TAG_CA_INFO_ENQUIRY:
+		if ((buf = dvbcamemu_queue_apdu(slot, RES_CA, TAG_CA_INFO, 4)) == NULL)
+			break;
+		buf[0] = DVBCAMEMU_CA_SYSTEM_ID_1 >> 8;
+		buf[1] = DVBCAMEMU_CA_SYSTEM_ID_1 & 0xff;
+		buf[2] = DVBCAMEMU_CA_SYSTEM_ID_2 >> 8;
+		buf[3] = DVBCAMEMU_CA_SYSTEM_ID_2 & 0xff;
+		break;
+
+	case TAG_CA_PMT:
+		return dvbcamemu_ca_pmt(emu, slot, data, data_length);
+
+	default:
+		return -1;
+	}
+
+	return 0;
+}
+
+static int dvbcamemu_mmi_apdu(struct dvbcamemu *emu, struct dvbcamemu_slot *slot, uint32_t tag)
+{
+	uint8_t *buf;
+
+	switch(tag) {
+	case TAG_MENU_ANSWER:
+		emu->stats.menu_answers++;
+		if ((buf = dvbcamemu_queue_apdu(slot, RES_MMI, TAG_CLOSE_MMI, 1)) != NULL)
+			buf[0] = 0x00;	// immediately
+		break;
+
+	case TAG_CLOSE_MMI:
+	case TAG_DISPLAY_REPLY:
+		break;
+
+	default:
+		return -1;
+	}
+
+	return 0;
+}
+
+static int dvbcamemu_apdu(struct dvbcamemu *emu, struct dvbcamemu_slot *slot,
+			  enum dvbcamemu_resource res, uint8_t *data, uint32_t data_length)
+{
+	uint32_t tag;
+	uint32_t length;
+	int length_field_len;
+
+	if (data_length < 4)
+		return -1;
+	tag = (data[0] << 16) | (data[1] << 8) | data[2];
+	if ((length_field_len = dvbcamemu_asn_1_decode(&length, data + 3, data_length - 3)) < 0)
+		return -1;
+	if (3 + length_field_len + length > data_length)
+		return -1;
+	data += 3 + length_field_len;
+
+	switch(res) {
+	case RES_RM:
+		return dvbcamemu_rm_apdu(slot, tag, data, length);
+	case RES_AI:
+		return dvbcamemu_ai_apdu(slot, tag);
+	case RES_CA:
+		return dvbcamemu_ca_apdu(emu, slot, tag, data, length);
+	case RES_MMI:
+		return dvbcamemu_mmi_apdu(emu, slot, tag);
+	case RES_DATETIME:
+		if (tag != TAG_DATE_TIME)
+			return -1;
+		emu->stats.date_times++;
+		return 0;
+	default:
+		return -1;
+	}
+}
+
+
+
+/* ---------------------------------------------------------------------- */
+/* session layer */
+
+static int dvbcamemu_find_session(struct dvbcamemu_slot *slot, uint16_t session_number)
+{
+	int i;
+
+	for(i=0; i < RES_COUNT; i++) {
+		if ((slot->sessions[i].state == SESSION_OPEN) &&
+		    (slot->sessions[i].session_number == session_number))
+			return i;
+	}
+	return -1;
+}
+
+static int dvbcamemu_spdu(struct dvbcamemu *emu, struct dvbcamemu_slot *slot,
+			  uint8_t connection_id, uint8_t *data, uint32_t data_length)
+{
+	uint32_t resource_id;
+	uint16_t session_number;
+	uint8_t *buf;
+	int res;
+
+	if ((data_length < 2) || (data[1] + 2U > data_length))
+		return -1;
+
+	switch(data[0]) {
+	case ST_SESSION_NUMBER:
+		if (data[1] != 2)
+			return -1;
+		session_number = (data[2] << 8) | data[3];
+		if ((res = dvbcamemu_find_session(slot, session_number)) < 0)
+			return -1;
+		return dvbcamemu_apdu(emu, slot, res, data + 4, data_length - 4);
+
+	case ST_OPEN_SESSION_RES:
+		if (data[1] != 7)
+			return -1;
+		resource_id = (data[3] << 24) | (data[4] << 16) | (data[5] << 8) | data[6];
+		for(res=0; res < RES_COUNT; res++) {
+			if ((slot->sessions[res].state == SESSION_OPENING) &&
+			    ((resource_id >> 6) == (dvbcamemu_resource_ids[res] >> 6)))
+				break;
+		}
+		if (res == RES_COUNT)
+			return -1;
+		if (data[2] != S_STATUS_OPEN) {
+			slot->sessions[res].state = SESSION_IDLE;
+			return 0;
+		}
+		slot->sessions[res].state = SESSION_OPEN;
+		slot->sessions[res].session_number = (data[7] << 8) | data[8];
+		emu->stats.sessions++;
+		dvbcamemu_session_opened(slot, res);
+		return 0;
+
+	case ST_CREATE_SESSION:
+		// the host wants one of our resources, and we have none
+		if (data[1] != 6)
+			return -1;
+		if ((buf = dvbcamemu_queue(slot, connection_id, 9)) == NULL)
+			return 0;
+		buf[0] = ST_CREATE_SESSION_RES;
+		buf[1] = 7;
+		buf[2] = S_STATUS_CLOSE_NO_RES;
+		memcpy(buf + 3, data + 2, 6);
+		return 0;
+
+	case ST_CLOSE_SESSION_REQ:
+		if (data[1] != 2)
+			return -1;
+		session_number = (data[2] << 8) | data[3];
+		res = dvbcamemu_find_session(slot, session_number);
+		if ((buf = dvbcamemu_queue(slot, connection_id, 5)) != NULL) {
+			buf[0] = ST_CLOSE_SESSION_RES;
+			buf[1] = 3;
+			buf[2] = (res < 0) ? S_STATUS_CLOSE_NO_RES : S_STATUS_OPEN;
+			buf[3] = data[2];
+			buf[4] = data[3];
+		}
+		if (res >= 0)
+			memset(&slot->sessions[res], 0, sizeof(struct dvbcamemu_session));
+		return 0;
+
+	case ST_CLOSE_SESSION_RES:
+		if (data[1] != 3)
+			return -1;
+		session_number = (data[3] << 8) | data[4];
+		if ((res = dvbcamemu_find_session(slot, session_number)) >= 0)
+			memset(&slot->sessions[res], 0, sizeof(struct dvbcamemu_session));
+		return 0;
+
+	default:
+		return -1;
+	}
+}
+
+
+
+/* ---------------------------------------------------------------------- */
+/* transport layer */
+
+static int dvbcamemu_rx_append(struct dvbcamemu_connection *conn, uint8_t *data, uint32_t length)
+{
+	uint8_t *tmp;
+	uint32_t size;
+
+	if (conn->rx_length + length > conn->rx_size) {
+		size = conn->rx_size ? conn->rx_size : 1024;
+		while(size < conn->rx_length + length)
+			size *= 2;
+		if ((tmp = (uint8_t *) realloc(conn->rx, size)) == NULL)
+			return -1;
+		conn->rx = tmp;
+		conn->rx_size = size;
+	}
+	memcpy(conn->rx + conn->rx_length, data, length);
+	conn->rx_length += length;
+	return 0;
+}
+
+/**
+ * Process one TPDU from the host, building the response in reply: an
+ * optional R_TPDU followed by the module's status.
+ *
+ * @return Length of the response.
+ */
+static int dvbcamemu_tpdu(struct dvbcamemu *emu, struct dvbcamemu_slot *slot,
+			  uint8_t *tpdu, uint32_t tpdu_length, uint8_t *reply)
+{
+	struct dvbcamemu_connection *conn;
+	struct dvbcamemu_message *msg;
+	uint8_t tag = tpdu[0];
+	uint8_t connection_id;
+	uint32_t length;
+	uint32_t chunk;
+	int length_field_len;
+	int pos = 0;
+	int err = 0;
+
+	emu->stats.tpdus++;
+
+	if ((tpdu_length < 3) ||
+	    ((length_field_len = dvbcamemu_asn_1_decode(&length, tpdu + 1, tpdu_length - 1)) < 0) ||
+	    (length < 1) || (1 + length_field_len + length > tpdu_length)) {
+		emu->stats.errors++;
+		return 0;
+	}
+	connection_id = tpdu[1 + length_field_len];
+	if ((connection_id == 0) || (connection_id >= DVBCAMEMU_MAX_CONNECTIONS)) {
+		emu->stats.errors++;
+		return 0;
+	}
+	conn = &slot->connections[connection_id];
+	tpdu += 2 + length_field_len;
+	length--;
+
+	switch(tag) {
+	case T_CREATE_T_C:
+		dvbcamemu_reset_connection(slot, connection_id);
+		conn->active = 1;
+		reply[pos++] = T_C_T_C_REPLY;
+		reply[pos++] = 1;
+		reply[pos++] = connection_id;
+
+		// the module starts by connecting to the resource manager
+		if (slot->connection_id == 0) {
+			slot->connection_id = connection_id;
+			dvbcamemu_open_session(slot, RES_RM);
+		}
+		break;
+
+	case T_DELETE_T_C:
+		dvbcamemu_reset_connection(slot, connection_id);
+		reply[pos++] = T_D_T_C_REPLY;
+		reply[pos++] = 1;
+		reply[pos++] = connection_id;
+		break;
+
+	case T_DATA_MORE:
+		if (!conn->active || dvbcamemu_rx_append(conn, tpdu, length))
+			err = 1;
+		break;
+
+	case T_DATA_LAST:
+		if (!conn->active) {
+			err = 1;
+		} else if (conn->rx_length) {
+			if (dvbcamemu_rx_append(conn, tpdu, length) ||
+			    dvbcamemu_spdu(emu, slot, connection_id, conn->rx, conn->rx_length))
+				err = 1;
+			conn->rx_length = 0;
+		} else if (length) {
+			err = dvbcamemu_spdu(emu, slot, connection_id, tpdu, length) != 0;
+		} else {
+			emu->stats.polls++;
+		}
+		break;
+
+	case T_RCV:
+		if (!conn->active || ((msg = conn->tx_head) == NULL)) {
+			err = 1;
+			break;
+		}
+		chunk = msg->length - msg->sent;
+		if (chunk > DVBCAMEMU_TPDU_DATA)
+			chunk = DVBCAMEMU_TPDU_DATA;
+		reply[pos++] = (msg->sent + chunk < msg->length) ? T_DATA_MORE : T_DATA_LAST;
+		pos += dvbcamemu_asn_1_encode(chunk + 1, reply + pos);
+		reply[pos++] = connection_id;
+		memcpy(reply + pos, msg->data + msg->sent, chunk);
+		pos += chunk;
+
+		msg->sent += chunk;
+		if (msg->sent == msg->length) {
+			conn->tx_head = msg->next;
+			if (conn->tx_head == NULL)
+				conn->tx_tail = NULL;
+			free(msg);
+		}
+		break;
+
+	default:
+		err = 1;
+		break;
+	}
+	if (err)
+		emu->stats.errors++;
+
+	// every response ends with the module status
+	reply[pos++] = T_SB;
+	reply[pos++] = 2;
+	reply[pos++] = connection_id;
+	reply[pos++] = conn->tx_head ? 0x80 : 0x00;
+	return pos;
+}
+
+static void *dvbcamemu_thread(void *arg)
+{
+	struct dvbcamemu *emu = (struct dvbcamemu *) arg;
+	uint8_t reply[2 + 5 + DVBCAMEMU_TPDU_DATA + 4];
+	int size;
+	int length;
+
+	while(1) {
+		size = read(emu->fd, emu->rx_buf, DVBCAMEMU_MAX_HOST_MESSAGE);
+		if (size < 0) {
+			if (errno == EINTR)
+				continue;
+			break;
+		}
+		if (size == 0)
+			break;
+
+		pthread_mutex_lock(&emu->lock);
+		if ((size < 2) || (emu->rx_buf[0] >= emu->slot_count)) {
+			emu->stats.errors++;
+			pthread_mutex_unlock(&emu->lock);
+			continue;
+		}
+		reply[0] = emu->rx_buf[0];
+		reply[1] = emu->rx_buf[1];
+		length = dvbcamemu_tpdu(emu, &emu->slots[emu->rx_buf[0]],
+					emu->rx_buf + 2, size - 2, reply + 2);
+		pthread_mutex_unlock(&emu->lock);
+
+		if (length &&
+		    (send(emu->fd, reply, length + 2, MSG_NOSIGNAL) != length + 2))
+			break;
+	}
+
+	// the host has gone away
+	emu->closed = 1;
+	return NULL;
+}
+
+
+
+/* ---------------------------------------------------------------------- */
+/* public interface */
+
+struct dvbcamemu *dvbcamemu_create(int slots, int *fd)
+{
+	struct dvbcamemu *emu;
+	struct stat st;
+	int sv[2];
+
+	if ((slots < 1) || (slots > 255))
+		return NULL;
+
+	emu = (struct dvbcamemu *) malloc(sizeof(struct dvbcamemu));
+	if (emu == NULL)
+		return NULL;
+	memset(emu, 0, sizeof(struct dvbcamemu));
+	emu->slot_count = slots;
+	emu->slots = (struct dvbcamemu_slot *) calloc(slots, sizeof(struct dvbcamemu_slot));
+	emu->rx_buf = (uint8_t *) malloc(DVBCAMEMU_MAX_HOST_MESSAGE);
+	if ((emu->slots == NULL) || (emu->rx_buf == NULL))
+		goto error;
+
+	// a CA device returns one message per read(), so keep the boundaries
+	if (socketpair(AF_UNIX, SOCK_SEQPACKET, 0, sv))
+		goto error;
+	emu->host_fd = sv[0];
+	emu->fd = sv[1];
+	fstat(emu->host_fd, &st);
+	emu->host_ino = st.st_ino;
+	pthread_mutex_init(&emu->lock, NULL);
+
+	if (pthread_create(&emu->thread, NULL, dvbcamemu_thread, emu)) {
+		pthread_mutex_destroy(&emu->lock);
+		close(sv[0]);
+		close(sv[1]);
+		goto error;
+	}
+
+	pthread_mutex_lock(&dvbcamemu_global_lock);
+	emu->next = dvbcamemu_list;
+	dvbcamemu_list = emu;
+	dvbcamemu_active = 1;
+	pthread_mutex_unlock(&dvbcamemu_global_lock);
+
+	*fd = emu->host_fd;
+	return emu;
+
+error:
+	free(emu->rx_buf);
+	free(emu->slots);
+	free(emu);
+	return NULL;
+}
+
+void dvbcamemu_destroy(struct dvbcamemu *emu)
+{
+	struct dvbcamemu **pos;
+	int i, j;
+
+	pthread_mutex_lock(&dvbcamemu_global_lock);
+	for(pos = &dvbcamemu_list; *pos; pos = &(*pos)->next) {
+		if (*pos == emu) {
+			*pos = emu->next;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&dvbcamemu_global_lock);
+
+	// wakes the thread if it is waiting for the host
+	shutdown(emu->fd, SHUT_RDWR);
+	pthread_join(emu->thread, NULL);
+	close(emu->fd);
+
+	for(i=0; i < emu->slot_count; i++) {
+		for(j=1; j < DVBCAMEMU_MAX_CONNECTIONS; j++)
+			dvbcamemu_reset_connection(&emu->slots[i], j);
+	}
+	pthread_mutex_destroy(&emu->lock);
+	free(emu->rx_buf);
+	free(emu->slots);
+	free(emu);
+}
+
+int dvbcamemu_reset(struct dvbcamemu *emu, uint8_t slot)
+{
+	int i;
+
+	if (slot >= emu->slot_count)
+		return -1;
+
+	pthread_mutex_lock(&emu->lock);
+	for(i=1; i < DVBCAMEMU_MAX_CONNECTIONS; i++)
+		dvbcamemu_reset_connection(&emu->slots[slot], i);
+	pthread_mutex_unlock(&emu->lock);
+
+	return 0;
+}
+
+void dvbcamemu_get_stats(struct dvbcamemu *emu, struct dvbcamemu_stats *stats)
+{
+	pthread_mutex_lock(&emu->lock);
+	memcpy(stats, &emu->stats, sizeof(struct dvbcamemu_stats));
+	pthread_mutex_unlock(&emu->lock);
+}
+
+
+
+/* ---------------------------------------------------------------------- */
+/* hooks for dvbca.c and dvbvirtual.c */
+
+int dvbcamemu_closed(struct dvbcamemu *emu)
+{
+	return emu->closed;
+}
+
+/**
+ * Find the emulator behind a host descriptor. Must be called with
+ * dvbcamemu_global_lock held.
+ */
+static struct dvbcamemu *dvbcamemu_find(int fd)
+{
+	struct dvbcamemu *emu;
+	struct stat st;
+
+	if (fstat(fd, &st))
+		return NULL;
+	for(emu = dvbcamemu_list; emu; emu = emu->next) {
+		if ((emu->host_fd == fd) && (emu->host_ino == st.st_ino))
+			return emu;
+	}
+	return NULL;
+}
+
+int dvbcamemu_is_ca(int fd)
+{
+	int result;
+
+	if (!dvbcamemu_active)
+		return 0;
+
+	pthread_mutex_lock(&dvbcamemu_global_lock);
+	result = dvbcamemu_find(fd) != NULL;
+	pthread_mutex_unlock(&dvbcamemu_global_lock);
+
+	return result;
+}
+
+int dvbcamemu_ca_ioctl(int fd, unsigned long request, void *arg)
+{
+	struct dvbcamemu *emu;
+	ca_slot_info_t *info;
+	ca_caps_t *caps;
+	unsigned long slots;
+	int result = 0;
+	int i;
+
+	pthread_mutex_lock(&dvbcamemu_global_lock);
+	if ((emu = dvbcamemu_find(fd)) == NULL) {
+		pthread_mutex_unlock(&dvbcamemu_global_lock);
+		errno = EBADF;
+		return -1;
+	}
+
+	switch(request) {
+	case CA_RESET:
+		slots = (unsigned long) arg;
+		for(i=0; i < emu->slot_count; i++) {
+			if (slots & (1UL << i))
+				dvbcamemu_reset(emu, i);
+		}
+		break;
+
+	case CA_GET_CAP:
+		caps = (ca_caps_t *) arg;
+		memset(caps, 0, sizeof(ca_caps_t));
+		caps->slot_num = emu->slot_count;
+		caps->slot_type = CA_CI_LINK;
+		break;
+
+	case CA_GET_SLOT_INFO:
+		info = (ca_slot_info_t *) arg;
+		if ((info->num < 0) || (info->num >= emu->slot_count)) {
+			errno = EINVAL;
+			result = -1;
+			break;
+		}
+		info->type = CA_CI_LINK;
+		info->flags = CA_CI_MODULE_PRESENT | CA_CI_MODULE_READY;
+		break;
+
+	default:
+		// no high level interface
+		errno = ENOTTY;
+		result = -1;
+		break;
+	}
+	pthread_mutex_unlock(&dvbcamemu_global_lock);
+
+	return result;
+}
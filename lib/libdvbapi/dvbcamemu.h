@@ -0,0 +1,130 @@
+/*
+ * libdvbapi - a software CAM speaking the EN 50221 link layer protocol
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ */
+
+#ifndef LIBDVBCAMEMU_H
+#define LIBDVBCAMEMU_H 1
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include <stdint.h>
+
+/**
+ * A CAM emulator stands in for a CA device with link layer interface
+ * modules in one or more slots. It hands out a descriptor which behaves
+ * like one returned by dvbca_open(): dvbca_link_write() and
+ * dvbca_link_read() exchange TPDUs with the emulated modules, it can be
+ * poll()ed, and dvbca_reset(), dvbca_get_interface_type() and
+ * dvbca_get_cam_state() work on it. An EN 50221 host stack can therefore
+ * be run against it unmodified.
+ *
+ * Each module implements the module side of the transport and session
+ * layers and of these resources:
+ *
+ *   resource manager      profile enquiry/reply/change; once the host has
+ *                         listed its resources the module opens sessions
+ *                         to application information, conditional access
+ *                         support and date-time
+ *   application info      answers application_info_enq; enter_menu opens
+ *                         an MMI session and sends a menu
+ *   conditional access    answers ca_info_enq; accepts any ca_pmt and
+ *                         answers queries with ca_pmt_reply, reporting
+ *                         every program and stream with a CA descriptor
+ *                         as descramblable
+ *   MMI                   a menu of DVBCAMEMU_MENU_ITEMS items; any
+ *                         menu_answ closes the MMI
+ *   date-time             requests the time once
+ *
+ * Virtual adapters with a "cam" directive (see dvbvirtual.h) use the
+ * emulator for their CA device.
+ */
+
+/**
+ * The CA system ids reported in ca_info.
+ */
+#define DVBCAMEMU_CA_SYSTEM_ID_1 0x0b00
+#define DVBCAMEMU_CA_SYSTEM_ID_2 0x0100
+
+/**
+ * The number of items in the emulated CAM menu.
+ */
+#define DVBCAMEMU_MENU_ITEMS 3
+
+/**
+ * Counters of what the emulated modules have seen, over all slots.
+ */
+struct dvbcamemu_stats {
+	unsigned long tpdus;		/* TPDUs received from the host */
+	unsigned long polls;		/* of which were empty T_DATA_LAST polls */
+	unsigned long sessions;		/* sessions opened */
+	unsigned long ca_pmts;		/* ca_pmt objects received */
+	unsigned long ca_pmt_replies;	/* ca_pmt_reply objects sent */
+	unsigned long menu_answers;	/* menu_answ objects received */
+	unsigned long date_times;	/* date_time objects received */
+	unsigned long errors;		/* malformed or unexpected messages */
+};
+
+/**
+ * Opaque type representing a CAM emulator.
+ */
+struct dvbcamemu;
+
+/**
+ * Create a CAM emulator. Every slot contains a module which is ready to
+ * be talked to.
+ *
+ * @param slots Number of slots.
+ * @param fd Where to store the descriptor the host stack should use. It
+ * belongs to the caller, who must close it; the emulator sees this as the
+ * host going away.
+ * @return The emulator, or NULL on failure.
+ */
+extern struct dvbcamemu *dvbcamemu_create(int slots, int *fd);
+
+/**
+ * Destroy a CAM emulator. The host descriptor is not closed.
+ *
+ * @param emu The emulator.
+ */
+extern void dvbcamemu_destroy(struct dvbcamemu *emu);
+
+/**
+ * Reset the module in a slot, dropping its transport connections and
+ * sessions, as dvbca_reset() does.
+ *
+ * @param emu The emulator.
+ * @param slot Slot to reset.
+ * @return 0 on success, -1 if there is no such slot.
+ */
+extern int dvbcamemu_reset(struct dvbcamemu *emu, uint8_t slot);
+
+/**
+ * Read the counters of an emulator.
+ *
+ * @param emu The emulator.
+ * @param stats Where to store them.
+ */
+extern void dvbcamemu_get_stats(struct dvbcamemu *emu, struct dvbcamemu_stats *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // LIBDVBCAMEMU_H
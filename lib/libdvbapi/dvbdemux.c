@@ -29,6 +29,17 @@
 #include <errno.h>
 #include <linux/dvb/dmx.h>
 #include "dvbdemux.h"
+#include "dvbvirtual.h"
+#include "dvbvirtual_int.h"
+
+
+/* ioctl() on either a real demux device or a virtual one */
+static int dvbdemux_ioctl(int fd, unsigned long request, void *arg)
+{
+	if (dvbvirtual_is_demux(fd))
+		return dvbvirtual_demux_ioctl(fd, request, arg);
+	return ioctl(fd, request, arg);
+}
 
 
 int dvbdemux_open_demux(int adapter, int demuxdevice, int nonblocking)
@@ -37,6 +48,9 @@ int dvbdemux_open_demux(int adapter, int demuxdevice, int nonblocking)
 	int flags = O_RDWR;
 	int fd;
 
+	if (dvbvirtual_is_virtual(adapter))
+		return dvbvirtual_open_demux(adapter, demuxdevice, nonblocking);
+
 	if (nonblocking)
 		flags |= O_NONBLOCK;
 
@@ -56,6 +70,9 @@ int dvbdemux_open_dvr(int adapter, int dvrdevice, int readonly, int nonblocking)
 	int flags = O_RDWR;
 	int fd;
 
+	if (dvbvirtual_is_virtual(adapter))
+		return dvbvirtual_open_dvr(adapter, dvrdevice, nonblocking);
+
 	if (readonly)
 		flags = O_RDONLY;
 	if (nonblocking)
@@ -89,7 +106,7 @@ int dvbdemux_set_section_filter(int fd, int pid,
 	if (checkcrc)
 		sctfilter.flags |= DMX_CHECK_CRC;
 
-	return ioctl(fd, DMX_SET_FILTER, &sctfilter);
+	return dvbdemux_ioctl(fd, DMX_SET_FILTER, &sctfilter);
 }
 
 int dvbdemux_set_pes_filter(int fd, int pid,
@@ -166,7 +183,7 @@ int dvbdemux_set_pes_filter(int fd, int pid,
 	if (start)
 		filter.flags |= DMX_IMMEDIATE_START;
 
-	return ioctl(fd, DMX_SET_PES_FILTER, &filter);
+	return dvbdemux_ioctl(fd, DMX_SET_PES_FILTER, &filter);
 }
 
 int dvbdemux_set_pid_filter(int fd, int pid,
@@ -222,17 +239,17 @@ int dvbdemux_set_pid_filter(int fd, int pid,
 	if (start)
 		filter.flags |= DMX_IMMEDIATE_START;
 
-	return ioctl(fd, DMX_SET_PES_FILTER, &filter);
+	return dvbdemux_ioctl(fd, DMX_SET_PES_FILTER, &filter);
 }
 
 int dvbdemux_start(int fd)
 {
-	return ioctl(fd, DMX_START);
+	return dvbdemux_ioctl(fd, DMX_START, NULL);
 }
 
 int dvbdemux_stop(int fd)
 {
-	return ioctl(fd, DMX_STOP);
+	return dvbdemux_ioctl(fd, DMX_STOP, NULL);
 }
 
 int dvbdemux_get_stc(int fd, uint64_t *stc)
@@ -241,7 +258,7 @@ int dvbdemux_get_stc(int fd, uint64_t *stc)
 	int result;
 
 	memset(stc, 0, sizeof(_stc));
-	if ((result = ioctl(fd, DMX_GET_STC, &_stc)) != 0) {
+	if ((result = dvbdemux_ioctl(fd, DMX_GET_STC, &_stc)) != 0) {
 		return result;
 	}
 
@@ -251,5 +268,5 @@ int dvbdemux_get_stc(int fd, uint64_t *stc)
 
 int dvbdemux_set_buffer(int fd, int bufsize)
 {
-	return ioctl(fd, DMX_SET_BUFFER_SIZE, bufsize);
+	return dvbdemux_ioctl(fd, DMX_SET_BUFFER_SIZE, (void *) (unsigned long) bufsize);
 }
@@ -28,6 +28,7 @@
 #include <sys/ioctl.h>
 #include <sys/time.h>
 #include <sys/poll.h>
+#include <time.h>
 #include <fcntl.h>
 #include <unistd.h>
 #include <ctype.h>
@@ -35,9 +36,15 @@
 #include <linux/dvb/frontend.h>
 #include <libdvbmisc/dvbmisc.h>
 #include "dvbfe.h"
+#include "dvbvirtual.h"
+#include "dvbvirtual_int.h"
 
 int verbose = 0;
 
+/* longest we sleep between status reads, for drivers which do not queue
+ * status change events */
+#define DVBFE_STATUS_POLL_MS 100
+
 static int dvbfe_spectral_inversion_to_kapi[][2] =
 {
 	{ DVBFE_INVERSION_OFF, INVERSION_OFF },
@@ -157,14 +164,44 @@ struct dvbfe_handle {
 	int fd;
 	enum dvbfe_type type;
 	char *name;
+	struct dvbfe_tune_timing timing;
+	struct dvbvirtual_frontend *virt;
 };
 
+/* ioctl() on either a real frontend device or a virtual one */
+static int dvbfe_ioctl(struct dvbfe_handle *fehandle, unsigned long request, void *arg)
+{
+	if (fehandle->virt)
+		return dvbvirtual_fe_ioctl(fehandle->virt, request, arg);
+	return ioctl(fehandle->fd, request, arg);
+}
+
+static long long dvbfe_now_ms(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (long long) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static void dvbfe_note_status(struct dvbfe_tune_timing *timing,
+			      fe_status_t status, int elapsed)
+{
+	if ((status & FE_HAS_CARRIER) && (timing->carrier_ms < 0))
+		timing->carrier_ms = elapsed;
+	if ((status & FE_HAS_SYNC) && (timing->sync_ms < 0))
+		timing->sync_ms = elapsed;
+	if ((status & FE_HAS_LOCK) && (timing->lock_ms < 0))
+		timing->lock_ms = elapsed;
+}
+
 struct dvbfe_handle *dvbfe_open(int adapter, int frontend, int readonly)
 {
 	char filename[PATH_MAX+1];
 	struct dvbfe_handle *fehandle;
 	int fd;
 	struct dvb_frontend_info info;
+	struct dvbvirtual_frontend *virt = NULL;
 
 	//  flags
 	int flags = O_RDWR;
@@ -172,26 +209,35 @@ struct dvbfe_handle *dvbfe_open(int adapter, int frontend, int readonly)
 		flags = O_RDONLY;
 	}
 
-	// open it (try normal /dev structure first)
-	sprintf(filename, "/dev/dvb/adapter%i/frontend%i", adapter, frontend);
-	if ((fd = open(filename, flags)) < 0) {
-		// if that failed, try a flat /dev structure
-		sprintf(filename, "/dev/dvb%i.frontend%i", adapter, frontend);
-		if ((fd = open(filename, flags)) < 0) {
+	if (dvbvirtual_is_virtual(adapter)) {
+		// virtual adapters are served from TS captures
+		if ((virt = dvbvirtual_open_frontend(adapter, frontend)) == NULL)
 			return NULL;
+		fd = dvbvirtual_frontend_fd(virt);
+		dvbvirtual_fe_ioctl(virt, FE_GET_INFO, &info);
+	} else {
+		// open it (try normal /dev structure first)
+		sprintf(filename, "/dev/dvb/adapter%i/frontend%i", adapter, frontend);
+		if ((fd = open(filename, flags)) < 0) {
+			// if that failed, try a flat /dev structure
+			sprintf(filename, "/dev/dvb%i.frontend%i", adapter, frontend);
+			if ((fd = open(filename, flags)) < 0) {
+				return NULL;
+			}
 		}
-	}
 
-	// determine fe type
-	if (ioctl(fd, FE_GET_INFO, &info)) {
-		close(fd);
-		return NULL;
+		// determine fe type
+		if (ioctl(fd, FE_GET_INFO, &info)) {
+			close(fd);
+			return NULL;
+		}
 	}
 
 	// setup structure
 	fehandle = (struct dvbfe_handle*) malloc(sizeof(struct dvbfe_handle));
 	memset(fehandle, 0, sizeof(struct dvbfe_handle));
 	fehandle->fd = fd;
+	fehandle->virt = virt;
 	switch(info.type) {
 	case FE_QPSK:
 		fehandle->type = DVBFE_TYPE_DVBS;
@@ -217,7 +263,10 @@ struct dvbfe_handle *dvbfe_open(int adapter, int frontend, int readonly)
 
 void dvbfe_close(struct dvbfe_handle *fehandle)
 {
-	close(fehandle->fd);
+	if (fehandle->virt)
+		dvbvirtual_close_frontend(fehandle->virt);
+	else
+		close(fehandle->fd);
 	free(fehandle->name);
 	free(fehandle);
 }
@@ -238,12 +287,12 @@ extern int dvbfe_get_info(struct dvbfe_handle *fehandle,
 	switch(querytype) {
 	case DVBFE_INFO_QUERYTYPE_IMMEDIATE:
 		if (querymask & DVBFE_INFO_LOCKSTATUS) {
-			if (!ioctl(fehandle->fd, FE_READ_STATUS, &kevent.status)) {
+			if (!dvbfe_ioctl(fehandle, FE_READ_STATUS, &kevent.status)) {
 				returnval |= DVBFE_INFO_LOCKSTATUS;
 			}
 		}
 		if (querymask & DVBFE_INFO_FEPARAMS) {
-			if (!ioctl(fehandle->fd, FE_GET_FRONTEND, &kevent.parameters)) {
+			if (!dvbfe_ioctl(fehandle, FE_GET_FRONTEND, &kevent.parameters)) {
 				returnval |= DVBFE_INFO_FEPARAMS;
 			}
 		}
@@ -267,7 +316,7 @@ extern int dvbfe_get_info(struct dvbfe_handle *fehandle,
 		if (ok &&
 		    ((querymask & DVBFE_INFO_LOCKSTATUS) ||
 		     (querymask & DVBFE_INFO_FEPARAMS))) {
-			if (!ioctl(fehandle->fd, FE_GET_EVENT, &kevent)) {
+			if (!dvbfe_ioctl(fehandle, FE_GET_EVENT, &kevent)) {
 				if (querymask & DVBFE_INFO_LOCKSTATUS)
 					returnval |= DVBFE_INFO_LOCKSTATUS;
 				if (querymask & DVBFE_INFO_FEPARAMS)
@@ -328,19 +377,19 @@ extern int dvbfe_get_info(struct dvbfe_handle *fehandle,
 	}
 
 	if (querymask & DVBFE_INFO_BER) {
-		if (!ioctl(fehandle->fd, FE_READ_BER, &result->ber))
+		if (!dvbfe_ioctl(fehandle, FE_READ_BER, &result->ber))
 			returnval |= DVBFE_INFO_BER;
 	}
 	if (querymask & DVBFE_INFO_SIGNAL_STRENGTH) {
-		if (!ioctl(fehandle->fd, FE_READ_SIGNAL_STRENGTH, &result->signal_strength))
+		if (!dvbfe_ioctl(fehandle, FE_READ_SIGNAL_STRENGTH, &result->signal_strength))
 			returnval |= DVBFE_INFO_SIGNAL_STRENGTH;
 	}
 	if (querymask & DVBFE_INFO_SNR) {
-		if (!ioctl(fehandle->fd, FE_READ_SNR, &result->snr))
+		if (!dvbfe_ioctl(fehandle, FE_READ_SNR, &result->snr))
 			returnval |= DVBFE_INFO_SNR;
 	}
 	if (querymask & DVBFE_INFO_UNCORRECTED_BLOCKS) {
-		if (!ioctl(fehandle->fd, FE_READ_UNCORRECTED_BLOCKS, &result->ucblocks))
+		if (!dvbfe_ioctl(fehandle, FE_READ_UNCORRECTED_BLOCKS, &result->ucblocks))
 			returnval |= DVBFE_INFO_UNCORRECTED_BLOCKS;
 	}
 
@@ -354,7 +403,7 @@ int dvbfe_set(struct dvbfe_handle *fehandle,
 {
 	struct dvb_frontend_parameters kparams;
 	int res;
-	struct timeval endtime;
+	long long start, now;
 	fe_status_t status;
 
 	kparams.frequency = params->frequency;
@@ -392,8 +441,16 @@ int dvbfe_set(struct dvbfe_handle *fehandle,
 		return -EINVAL;
 	}
 
-	// set it and check for error
-	res = ioctl(fehandle->fd, FE_SET_FRONTEND, &kparams);
+	// reset timing
+	fehandle->timing.carrier_ms = -1;
+	fehandle->timing.sync_ms = -1;
+	fehandle->timing.lock_ms = -1;
+	fehandle->timing.total_ms = 0;
+	fehandle->timing.events = 0;
+	start = dvbfe_now_ms();
+
+	// set it and check for error (this also flushes the event queue)
+	res = dvbfe_ioctl(fehandle, FE_SET_FRONTEND, &kparams);
 	if (res)
 		return res;
 
@@ -402,18 +459,17 @@ int dvbfe_set(struct dvbfe_handle *fehandle,
 		return 0;
 	}
 
-	/* calculate timeout */
-	if (timeout > 0) {
-		gettimeofday(&endtime, NULL);
-		timeout *= 1000;
-		endtime.tv_sec += timeout / 1000000;
-		endtime.tv_usec += timeout % 1000000;
-	}
-
-	/* wait for a lock */
+	/* wait for a lock, woken by status change events */
+	status = 0;
 	while(1) {
+		struct pollfd pollfd;
+		int wait = DVBFE_STATUS_POLL_MS;
+
+		now = dvbfe_now_ms();
+
 		/* has it locked? */
-		if (!ioctl(fehandle->fd, FE_READ_STATUS, &status)) {
+		if (!dvbfe_ioctl(fehandle, FE_READ_STATUS, &status)) {
+			dvbfe_note_status(&fehandle->timing, status, now - start);
 			if (status & FE_HAS_LOCK) {
 				break;
 			}
@@ -421,17 +477,29 @@ int dvbfe_set(struct dvbfe_handle *fehandle,
 
 		/* check for timeout */
 		if (timeout > 0) {
-			struct timeval curtime;
-			gettimeofday(&curtime, NULL);
-			if ((curtime.tv_sec > endtime.tv_sec) ||
-			    ((curtime.tv_sec == endtime.tv_sec) && (curtime.tv_usec >= endtime.tv_usec))) {
+			if (now - start >= timeout)
 				break;
-			}
+			if (start + timeout - now < wait)
+				wait = start + timeout - now;
 		}
 
-		/* delay for a bit */
-		usleep(100000);
+		pollfd.fd = fehandle->fd;
+		pollfd.events = POLLIN | POLLPRI;
+		if ((poll(&pollfd, 1, wait) > 0) &&
+		    (pollfd.revents & (POLLIN | POLLPRI))) {
+			struct dvb_frontend_event kevent;
+
+			/* EOVERFLOW just means older events were lost */
+			if (!dvbfe_ioctl(fehandle, FE_GET_EVENT, &kevent)) {
+				fehandle->timing.events++;
+				dvbfe_note_status(&fehandle->timing, kevent.status,
+						  dvbfe_now_ms() - start);
+			} else if (errno != EOVERFLOW) {
+				usleep(wait * 1000);
+			}
+		}
 	}
+	fehandle->timing.total_ms = dvbfe_now_ms() - start;
 
 	/* exit */
 	if (status & FE_HAS_LOCK)
@@ -439,6 +507,12 @@ int dvbfe_set(struct dvbfe_handle *fehandle,
 	return -ETIMEDOUT;
 }
 
+void dvbfe_get_tune_timing(struct dvbfe_handle *fehandle,
+			   struct dvbfe_tune_timing *timing)
+{
+	*timing = fehandle->timing;
+}
+
 int dvbfe_get_pollfd(struct dvbfe_handle *handle)
 {
 	return handle->fd;
@@ -450,10 +524,10 @@ int dvbfe_set_22k_tone(struct dvbfe_handle *fehandle, enum dvbfe_sec_tone_mode t
 
 	switch (tone) {
 	case DVBFE_SEC_TONE_OFF:
-		ret = ioctl(fehandle->fd, FE_SET_TONE, SEC_TONE_OFF);
+		ret = dvbfe_ioctl(fehandle, FE_SET_TONE, (void *) (unsigned long) SEC_TONE_OFF);
 		break;
 	case DVBFE_SEC_TONE_ON:
-		ret = ioctl(fehandle->fd, FE_SET_TONE, SEC_TONE_ON);
+		ret = dvbfe_ioctl(fehandle, FE_SET_TONE, (void *) (unsigned long) SEC_TONE_ON);
 		break;
 	default:
 		print(verbose, ERROR, 1, "Invalid command !");
@@ -471,10 +545,10 @@ int dvbfe_set_tone_data_burst(struct dvbfe_handle *fehandle, enum dvbfe_sec_mini
 
 	switch (minicmd) {
 	case DVBFE_SEC_MINI_A:
-		ret = ioctl(fehandle->fd, FE_DISEQC_SEND_BURST, SEC_MINI_A);
+		ret = dvbfe_ioctl(fehandle, FE_DISEQC_SEND_BURST, (void *) (unsigned long) SEC_MINI_A);
 		break;
 	case DVBFE_SEC_MINI_B:
-		ret = ioctl(fehandle->fd, FE_DISEQC_SEND_BURST, SEC_MINI_B);
+		ret = dvbfe_ioctl(fehandle, FE_DISEQC_SEND_BURST, (void *) (unsigned long) SEC_MINI_B);
 		break;
 	default:
 		print(verbose, ERROR, 1, "Invalid command");
@@ -492,13 +566,13 @@ int dvbfe_set_voltage(struct dvbfe_handle *fehandle, enum dvbfe_sec_voltage volt
 
 	switch (voltage) {
 	case DVBFE_SEC_VOLTAGE_OFF:
-		ret = ioctl(fehandle->fd, FE_SET_VOLTAGE, SEC_VOLTAGE_OFF);
+		ret = dvbfe_ioctl(fehandle, FE_SET_VOLTAGE, (void *) (unsigned long) SEC_VOLTAGE_OFF);
 		break;
 	case DVBFE_SEC_VOLTAGE_13:
-		ret = ioctl(fehandle->fd, FE_SET_VOLTAGE, SEC_VOLTAGE_13);
+		ret = dvbfe_ioctl(fehandle, FE_SET_VOLTAGE, (void *) (unsigned long) SEC_VOLTAGE_13);
 		break;
 	case DVBFE_SEC_VOLTAGE_18:
-		ret = ioctl(fehandle->fd, FE_SET_VOLTAGE, SEC_VOLTAGE_18);
+		ret = dvbfe_ioctl(fehandle, FE_SET_VOLTAGE, (void *) (unsigned long) SEC_VOLTAGE_18);
 		break;
 	default:
 		print(verbose, ERROR, 1, "Invalid command");
@@ -514,10 +588,10 @@ int dvbfe_set_high_lnb_voltage(struct dvbfe_handle *fehandle, int on)
 {
 	switch (on) {
 	case 0:
-		ioctl(fehandle->fd, FE_ENABLE_HIGH_LNB_VOLTAGE, 0);
+		dvbfe_ioctl(fehandle, FE_ENABLE_HIGH_LNB_VOLTAGE, (void *) (unsigned long) 0);
 		break;
 	default:
-		ioctl(fehandle->fd, FE_ENABLE_HIGH_LNB_VOLTAGE, 1);
+		dvbfe_ioctl(fehandle, FE_ENABLE_HIGH_LNB_VOLTAGE, (void *) (unsigned long) 1);
 		break;
 	}
 	return 0;
@@ -527,7 +601,7 @@ int dvbfe_do_dishnetworks_legacy_command(struct dvbfe_handle *fehandle, unsigned
 {
 	int ret = 0;
 
-	ret = ioctl(fehandle->fd, FE_DISHNETWORK_SEND_LEGACY_CMD, cmd);
+	ret = dvbfe_ioctl(fehandle, FE_DISHNETWORK_SEND_LEGACY_CMD, (void *) (unsigned long) cmd);
 	if (ret == -1)
 		print(verbose, ERROR, 1, "IOCTL failed");
 
@@ -545,7 +619,7 @@ int dvbfe_do_diseqc_command(struct dvbfe_handle *fehandle, uint8_t *data, uint8_
 	diseqc_message.msg_len = len;
 	memcpy(diseqc_message.msg, data, len);
 
-	ret = ioctl(fehandle->fd, FE_DISEQC_SEND_MASTER_CMD, &diseqc_message);
+	ret = dvbfe_ioctl(fehandle, FE_DISEQC_SEND_MASTER_CMD, &diseqc_message);
 	if (ret == -1)
 		print(verbose, ERROR, 1, "IOCTL failed");
 
@@ -563,7 +637,7 @@ int dvbfe_diseqc_read(struct dvbfe_handle *fehandle, int timeout, unsigned char
 	reply.timeout = timeout;
 	reply.msg_len = len;
 
-	if ((result = ioctl(fehandle->fd, FE_DISEQC_RECV_SLAVE_REPLY, reply)) != 0)
+	if ((result = dvbfe_ioctl(fehandle, FE_DISEQC_RECV_SLAVE_REPLY, &reply)) != 0)
 		return result;
 
 	if (reply.msg_len < len)
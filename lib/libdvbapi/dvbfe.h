@@ -209,6 +209,19 @@ enum dvbfe_info_querytype {
 };
 
 
+/**
+ * Timing of the last dvbfe_set() call, in milliseconds since the tuning
+ * parameters were handed to the frontend. A stage that was not reached
+ * before dvbfe_set() returned is -1.
+ */
+struct dvbfe_tune_timing {
+	int carrier_ms;				/* FE_HAS_CARRIER first seen */
+	int sync_ms;				/* FE_HAS_SYNC first seen */
+	int lock_ms;				/* FE_HAS_LOCK first seen */
+	int total_ms;				/* time spent waiting in dvbfe_set() */
+	int events;				/* status change events received */
+};
+
 /**
  * Frontend handle datatype.
  */
@@ -243,6 +256,10 @@ extern void dvbfe_close(struct dvbfe_handle *handle);
  * number of milliseconds to wait for a lock.
  * @return 0 on locked (or if timeout==0 and everything else worked), or
  * nonzero on failure (including no lock).
+ *
+ * The lock wait is driven by the frontend's status change events, so this
+ * returns as soon as the frontend reports FE_HAS_LOCK. Per-stage timings are
+ * available afterwards through dvbfe_get_tune_timing().
  */
 extern int dvbfe_set(struct dvbfe_handle *fehandle,
 		     struct dvbfe_parameters *params,
@@ -264,6 +281,15 @@ extern int dvbfe_get_info(struct dvbfe_handle *fehandle,
 			  enum dvbfe_info_querytype querytype,
 			  int timeout);
 
+/**
+ * Retrieve the timing of the last dvbfe_set() call on this handle.
+ *
+ * @param fehandle Handle opened with dvbfe_open().
+ * @param timing Where to put the timing.
+ */
+extern void dvbfe_get_tune_timing(struct dvbfe_handle *fehandle,
+				  struct dvbfe_tune_timing *timing);
+
 /**
  * Get a file descriptor for polling for lock status changes.
  *
@@ -0,0 +1,1386 @@
+/*
+ * libdvbapi - a virtual DVB adapter backed by transport stream captures
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ */
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/param.h>
+#include <sys/ioctl.h>
+#include <sys/poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/eventfd.h>
+#include <linux/dvb/frontend.h>
+#include <linux/dvb/dmx.h>
+#include <libdvbmisc/dvbmisc.h>
+#include "dvbfe.h"
+#include "dvbcamemu.h"
+#include "dvbvirtual.h"
+#include "dvbvirtual_int.h"
+
+extern int verbose;
+
+#define DVBVIRTUAL_MAX_ADAPTERS 16
+
+/* packets read from the capture at once */
+#define DVBVIRTUAL_CHUNK_PACKETS 64
+
+/* how long the feeder waits for a reader with a full buffer before
+ * dropping its data */
+#define DVBVIRTUAL_STALL_MS 20
+
+#define TS_PACKET_SIZE 188
+#define TS_ALL_PIDS 0x2000
+#define MAX_SECTION_SIZE 4096
+
+enum dvbvirtual_filter_type {
+	FILTER_NONE,
+	FILTER_SECTION,
+	FILTER_PES,
+	FILTER_DVR,
+};
+
+struct dvbvirtual_transponder {
+	uint32_t frequency;
+	char polarization;		/* 0 => any */
+	char *filename;
+
+	struct dvbvirtual_transponder *next;
+};
+
+struct dvbvirtual_config {
+	enum dvbfe_type type;
+	uint32_t lof_lo;
+	uint32_t lof_hi;
+	uint64_t rate;
+	int loop;
+	int cam_slots;
+
+	struct dvbvirtual_transponder *transponders;
+};
+
+/**
+ * A demux or dvr descriptor handed out to the application. app_fd is one
+ * end of a socketpair, fd is the end the feeder writes to. Section filters
+ * use SOCK_SEQPACKET so each read() returns one section, as on hardware;
+ * everything else uses SOCK_STREAM.
+ */
+struct dvbvirtual_filter {
+	int app_fd;
+	ino_t app_ino;
+	int fd;
+	int socktype;
+
+	enum dvbvirtual_filter_type type;
+	int started;
+	uint16_t pid;
+	int output;
+
+	/* section filtering */
+	uint8_t filter[DMX_FILTER_SIZE];
+	uint8_t maskandmode[DMX_FILTER_SIZE];
+	uint8_t maskandnotmode[DMX_FILTER_SIZE];
+	int notmode;
+	int checkcrc;
+	int oneshot;
+
+	/* section reassembly */
+	uint8_t section[MAX_SECTION_SIZE + 3];
+	int section_len;
+	int continuity;
+	int synced;
+
+	/* tail of a TS packet a stream socket could only partly accept */
+	uint8_t pending[TS_PACKET_SIZE];
+	int pending_len;
+	int overflow;
+
+	struct dvbvirtual_filter *next;
+};
+
+/**
+ * A CA device handed out to the application: the host end of a CAM
+ * emulator.
+ */
+struct dvbvirtual_ca {
+	struct dvbcamemu *emu;
+
+	struct dvbvirtual_ca *next;
+};
+
+struct dvbvirtual_adapter {
+	int adapter;
+	struct dvbvirtual_config *config;
+	int own_config;
+
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	pthread_t thread;
+	int running;
+
+	/* frontend state */
+	struct dvb_frontend_parameters params;
+	fe_status_t status;
+	fe_sec_tone_mode_t tone;
+	fe_sec_voltage_t voltage;
+	struct dvbvirtual_transponder *tuned;
+	int generation;
+
+	/* demux state */
+	struct dvbvirtual_filter *filters;
+	uint64_t stc;
+	int delivered;
+	int dropped;
+
+	/* CA state */
+	struct dvbvirtual_ca *cas;
+};
+
+struct dvbvirtual_frontend {
+	struct dvbvirtual_adapter *adapter;
+	int fd;
+};
+
+static pthread_mutex_t dvbvirtual_global_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct dvbvirtual_adapter *dvbvirtual_adapters[DVBVIRTUAL_MAX_ADAPTERS];
+static struct dvbvirtual_config *dvbvirtual_env_config;
+static int dvbvirtual_env_checked;
+static volatile int dvbvirtual_active;
+static uint32_t dvbvirtual_crc_table[256];
+
+static void *dvbvirtual_feeder(void *arg);
+
+
+static void dvbvirtual_crc_init(void)
+{
+	uint32_t i, j, crc;
+
+	for(i=0; i < 256; i++) {
+		crc = i << 24;
+		for(j=0; j < 8; j++)
+			crc = (crc << 1) ^ ((crc & 0x80000000) ? 0x04c11db7 : 0);
+		dvbvirtual_crc_table[i] = crc;
+	}
+}
+
+static uint32_t dvbvirtual_crc32(const uint8_t *buf, int len)
+{
+	uint32_t crc = 0xffffffff;
+
+	while(len--)
+		crc = (crc << 8) ^ dvbvirtual_crc_table[((crc >> 24) ^ *buf++) & 0xff];
+	return crc;
+}
+
+static long long dvbvirtual_now_us(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (long long) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static void dvbvirtual_free_config(struct dvbvirtual_config *config)
+{
+	struct dvbvirtual_transponder *t;
+
+	while(config->transponders) {
+		t = config->transponders;
+		config->transponders = t->next;
+		free(t->filename);
+		free(t);
+	}
+	free(config);
+}
+
+static struct dvbvirtual_config *dvbvirtual_load_config(const char *filename)
+{
+	struct dvbvirtual_config *config;
+	struct dvbvirtual_transponder *t, **tail;
+	char line[PATH_MAX + 64];
+	char arg1[PATH_MAX + 1];
+	char arg2[PATH_MAX + 1];
+	char dir[PATH_MAX + 1];
+	unsigned long long rate;
+	uint32_t frequency;
+	char *tmp;
+	FILE *f;
+	int count;
+	int lineno = 0;
+
+	if ((f = fopen(filename, "r")) == NULL) {
+		print(verbose, ERROR, 1, "Unable to open %s", filename);
+		return NULL;
+	}
+
+	// relative capture filenames are relative to the configuration file
+	strncpy(dir, filename, PATH_MAX);
+	dir[PATH_MAX] = 0;
+	if ((tmp = strrchr(dir, '/')) != NULL)
+		tmp[1] = 0;
+	else
+		dir[0] = 0;
+
+	config = (struct dvbvirtual_config *) malloc(sizeof(struct dvbvirtual_config));
+	if (config == NULL) {
+		fclose(f);
+		return NULL;
+	}
+	memset(config, 0, sizeof(struct dvbvirtual_config));
+	config->type = -1;
+	config->lof_lo = 9750000;
+	config->lof_hi = 10600000;
+	config->loop = 1;
+	tail = &config->transponders;
+
+	while(fgets(line, sizeof(line), f)) {
+		lineno++;
+		if ((tmp = strchr(line, '#')) != NULL)
+			*tmp = 0;
+
+		if (sscanf(line, " type %s", arg1) == 1) {
+			if (!strcmp(arg1, "DVBS"))
+				config->type = DVBFE_TYPE_DVBS;
+			else if (!strcmp(arg1, "DVBC"))
+				config->type = DVBFE_TYPE_DVBC;
+			else if (!strcmp(arg1, "DVBT"))
+				config->type = DVBFE_TYPE_DVBT;
+			else if (!strcmp(arg1, "ATSC"))
+				config->type = DVBFE_TYPE_ATSC;
+			else
+				goto error;
+		} else if (!strncmp(line + strspn(line, " \t"), "lnb", 3)) {
+			if (sscanf(line, " lnb %u %u", &config->lof_lo, &config->lof_hi) != 2)
+				goto error;
+		} else if (sscanf(line, " rate %llu", &rate) == 1) {
+			config->rate = rate;
+		} else if (sscanf(line, " loop %i", &config->loop) == 1) {
+			;
+		} else if (sscanf(line, " cam %i", &config->cam_slots) == 1) {
+			if ((config->cam_slots < 0) || (config->cam_slots > 255))
+				goto error;
+		} else if ((count = sscanf(line, " %u %s %s", &frequency, arg1, arg2)) >= 2) {
+			t = (struct dvbvirtual_transponder *) malloc(sizeof(struct dvbvirtual_transponder));
+			if (t == NULL)
+				goto error;
+			memset(t, 0, sizeof(struct dvbvirtual_transponder));
+			t->frequency = frequency;
+
+			tmp = arg1;
+			if (count == 3) {
+				if ((strlen(arg1) != 1) || !strchr("hvlr", arg1[0])) {
+					free(t);
+					goto error;
+				}
+				t->polarization = arg1[0];
+				tmp = arg2;
+			}
+			t->filename = (char *) malloc(strlen(dir) + strlen(tmp) + 1);
+			if (t->filename == NULL) {
+				free(t);
+				goto error;
+			}
+			if (tmp[0] == '/')
+				strcpy(t->filename, tmp);
+			else
+				sprintf(t->filename, "%s%s", dir, tmp);
+
+			*tail = t;
+			tail = &t->next;
+		} else if (line[strspn(line, " \t\r\n")] != 0) {
+			goto error;
+		}
+	}
+	fclose(f);
+
+	if ((int) config->type == -1) {
+		print(verbose, ERROR, 1, "%s: no frontend type given", filename);
+		dvbvirtual_free_config(config);
+		return NULL;
+	}
+	return config;
+
+error:
+	print(verbose, ERROR, 1, "%s:%i: invalid line", filename, lineno);
+	fclose(f);
+	dvbvirtual_free_config(config);
+	return NULL;
+}
+
+static struct dvbvirtual_adapter *dvbvirtual_new_adapter(int adapter,
+							 struct dvbvirtual_config *config,
+							 int own_config)
+{
+	struct dvbvirtual_adapter *ad;
+
+	ad = (struct dvbvirtual_adapter *) malloc(sizeof(struct dvbvirtual_adapter));
+	if (ad == NULL)
+		return NULL;
+	memset(ad, 0, sizeof(struct dvbvirtual_adapter));
+	ad->adapter = adapter;
+	ad->config = config;
+	ad->own_config = own_config;
+	ad->tone = SEC_TONE_OFF;
+	ad->voltage = SEC_VOLTAGE_OFF;
+	pthread_mutex_init(&ad->lock, NULL);
+	pthread_cond_init(&ad->cond, NULL);
+
+	ad->running = 1;
+	if (pthread_create(&ad->thread, NULL, dvbvirtual_feeder, ad)) {
+		pthread_cond_destroy(&ad->cond);
+		pthread_mutex_destroy(&ad->lock);
+		free(ad);
+		return NULL;
+	}
+
+	dvbvirtual_active = 1;
+	return ad;
+}
+
+/**
+ * Look up a virtual adapter, creating it from $DVBAPI_VIRTUAL if needed.
+ * Must be called with dvbvirtual_global_lock held.
+ */
+static struct dvbvirtual_adapter *dvbvirtual_lookup(int adapter)
+{
+	char *filename;
+
+	if ((adapter < 0) || (adapter >= DVBVIRTUAL_MAX_ADAPTERS))
+		return NULL;
+
+	if (!dvbvirtual_env_checked) {
+		dvbvirtual_env_checked = 1;
+		dvbvirtual_crc_init();
+		if ((filename = getenv("DVBAPI_VIRTUAL")) != NULL)
+			dvbvirtual_env_config = dvbvirtual_load_config(filename);
+	}
+
+	if ((dvbvirtual_adapters[adapter] == NULL) && dvbvirtual_env_config)
+		dvbvirtual_adapters[adapter] =
+			dvbvirtual_new_adapter(adapter, dvbvirtual_env_config, 0);
+
+	return dvbvirtual_adapters[adapter];
+}
+
+static struct dvbvirtual_adapter *dvbvirtual_get_adapter(int adapter)
+{
+	struct dvbvirtual_adapter *ad;
+
+	pthread_mutex_lock(&dvbvirtual_global_lock);
+	ad = dvbvirtual_lookup(adapter);
+	pthread_mutex_unlock(&dvbvirtual_global_lock);
+
+	return ad;
+}
+
+int dvbvirtual_attach(int adapter, const char *config)
+{
+	struct dvbvirtual_config *cfg;
+	int result = -1;
+
+	pthread_mutex_lock(&dvbvirtual_global_lock);
+	if (dvbvirtual_lookup(adapter) != NULL)
+		goto exit;
+	if ((adapter < 0) || (adapter >= DVBVIRTUAL_MAX_ADAPTERS))
+		goto exit;
+	if ((cfg = dvbvirtual_load_config(config)) == NULL)
+		goto exit;
+	if ((dvbvirtual_adapters[adapter] = dvbvirtual_new_adapter(adapter, cfg, 1)) == NULL) {
+		dvbvirtual_free_config(cfg);
+		goto exit;
+	}
+	result = 0;
+
+exit:
+	pthread_mutex_unlock(&dvbvirtual_global_lock);
+	return result;
+}
+
+void dvbvirtual_detach(int adapter)
+{
+	struct dvbvirtual_adapter *ad;
+	struct dvbvirtual_filter *f;
+	struct dvbvirtual_ca *ca;
+
+	pthread_mutex_lock(&dvbvirtual_global_lock);
+	if ((adapter < 0) || (adapter >= DVBVIRTUAL_MAX_ADAPTERS) ||
+	    ((ad = dvbvirtual_adapters[adapter]) == NULL) || !ad->own_config) {
+		pthread_mutex_unlock(&dvbvirtual_global_lock);
+		return;
+	}
+	dvbvirtual_adapters[adapter] = NULL;
+	pthread_mutex_unlock(&dvbvirtual_global_lock);
+
+	pthread_mutex_lock(&ad->lock);
+	ad->running = 0;
+	pthread_cond_broadcast(&ad->cond);
+	pthread_mutex_unlock(&ad->lock);
+	pthread_join(ad->thread, NULL);
+
+	while(ad->filters) {
+		f = ad->filters;
+		ad->filters = f->next;
+		if (f->fd >= 0)
+			close(f->fd);
+		free(f);
+	}
+	while(ad->cas) {
+		ca = ad->cas;
+		ad->cas = ca->next;
+		dvbcamemu_destroy(ca->emu);
+		free(ca);
+	}
+	pthread_cond_destroy(&ad->cond);
+	pthread_mutex_destroy(&ad->lock);
+	dvbvirtual_free_config(ad->config);
+	free(ad);
+}
+
+int dvbvirtual_is_virtual(int adapter)
+{
+	return dvbvirtual_get_adapter(adapter) != NULL;
+}
+
+
+
+/* ---------------------------------------------------------------------- */
+/* frontend */
+
+struct dvbvirtual_frontend *dvbvirtual_open_frontend(int adapter, int frontend)
+{
+	struct dvbvirtual_adapter *ad;
+	struct dvbvirtual_frontend *fe;
+
+	if ((ad = dvbvirtual_get_adapter(adapter)) == NULL)
+		return NULL;
+	if (frontend != 0) {
+		errno = ENODEV;
+		return NULL;
+	}
+
+	fe = (struct dvbvirtual_frontend *) malloc(sizeof(struct dvbvirtual_frontend));
+	if (fe == NULL)
+		return NULL;
+	fe->adapter = ad;
+	if ((fe->fd = eventfd(0, EFD_NONBLOCK)) < 0) {
+		free(fe);
+		return NULL;
+	}
+
+	return fe;
+}
+
+void dvbvirtual_close_frontend(struct dvbvirtual_frontend *fe)
+{
+	close(fe->fd);
+	free(fe);
+}
+
+int dvbvirtual_frontend_fd(struct dvbvirtual_frontend *fe)
+{
+	return fe->fd;
+}
+
+static int dvbvirtual_polarization_ok(char polarization, fe_sec_voltage_t voltage)
+{
+	switch(polarization) {
+	case 'h':
+	case 'l':
+		return voltage == SEC_VOLTAGE_18;
+	case 'v':
+	case 'r':
+		return voltage == SEC_VOLTAGE_13;
+	}
+	return 1;
+}
+
+/**
+ * Find the capture for the frequency the frontend was just tuned to.
+ * Must be called with the adapter lock held.
+ */
+static struct dvbvirtual_transponder *dvbvirtual_find_transponder(struct dvbvirtual_adapter *ad)
+{
+	struct dvbvirtual_config *config = ad->config;
+	struct dvbvirtual_transponder *t;
+	uint32_t frequency = ad->params.frequency;
+	uint32_t tolerance = 1000000;
+	int check_polarization = 0;
+
+	if (config->type == DVBFE_TYPE_DVBS) {
+		tolerance = 2000;
+		if (ad->voltage != SEC_VOLTAGE_OFF) {
+			if (ad->tone == SEC_TONE_ON)
+				frequency += config->lof_hi;
+			else
+				frequency += config->lof_lo;
+			check_polarization = 1;
+		}
+	}
+
+	for(t = config->transponders; t; t = t->next) {
+		if (abs((int) (t->frequency - frequency)) > (int) tolerance)
+			continue;
+		if (check_polarization && !dvbvirtual_polarization_ok(t->polarization, ad->voltage))
+			continue;
+		return t;
+	}
+
+	return NULL;
+}
+
+int dvbvirtual_fe_ioctl(struct dvbvirtual_frontend *fe, unsigned long request, void *arg)
+{
+	struct dvbvirtual_adapter *ad = fe->adapter;
+	uint64_t count;
+	int result = 0;
+
+	pthread_mutex_lock(&ad->lock);
+	switch(request) {
+	case FE_GET_INFO:
+	{
+		struct dvb_frontend_info *info = (struct dvb_frontend_info *) arg;
+
+		memset(info, 0, sizeof(struct dvb_frontend_info));
+		snprintf(info->name, sizeof(info->name), "Virtual frontend (adapter %i)", ad->adapter);
+		switch(ad->config->type) {
+		case DVBFE_TYPE_DVBS:
+			info->type = FE_QPSK;
+			info->frequency_min = 950000;
+			info->frequency_max = 2150000;
+			break;
+		case DVBFE_TYPE_DVBC:
+			info->type = FE_QAM;
+			info->frequency_min = 51000000;
+			info->frequency_max = 858000000;
+			break;
+		case DVBFE_TYPE_DVBT:
+			info->type = FE_OFDM;
+			info->frequency_min = 51000000;
+			info->frequency_max = 858000000;
+			break;
+		case DVBFE_TYPE_ATSC:
+			info->type = FE_ATSC;
+			info->frequency_min = 54000000;
+			info->frequency_max = 858000000;
+			break;
+		}
+		info->caps = FE_CAN_INVERSION_AUTO | FE_CAN_FEC_AUTO | FE_CAN_QAM_AUTO |
+			     FE_CAN_TRANSMISSION_MODE_AUTO | FE_CAN_GUARD_INTERVAL_AUTO |
+			     FE_CAN_HIERARCHY_AUTO;
+		break;
+	}
+
+	case FE_SET_FRONTEND:
+		memcpy(&ad->params, arg, sizeof(struct dvb_frontend_parameters));
+		ad->tuned = dvbvirtual_find_transponder(ad);
+		ad->status = 0;
+		if (ad->tuned)
+			ad->status = FE_HAS_SIGNAL | FE_HAS_CARRIER | FE_HAS_VITERBI |
+				     FE_HAS_SYNC | FE_HAS_LOCK;
+		ad->generation++;
+		pthread_cond_broadcast(&ad->cond);
+
+		// this flushes the event queue; a lock is reported at once
+		while(read(fe->fd, &count, sizeof(count)) > 0)
+			;
+		if (ad->status) {
+			count = 1;
+			if (write(fe->fd, &count, sizeof(count)) < 0)
+				result = -1;
+		}
+		break;
+
+	case FE_GET_FRONTEND:
+		memcpy(arg, &ad->params, sizeof(struct dvb_frontend_parameters));
+		break;
+
+	case FE_GET_EVENT:
+	{
+		struct dvb_frontend_event *event = (struct dvb_frontend_event *) arg;
+
+		if (read(fe->fd, &count, sizeof(count)) != sizeof(count)) {
+			errno = EWOULDBLOCK;
+			result = -1;
+			break;
+		}
+		event->status = ad->status;
+		memcpy(&event->parameters, &ad->params, sizeof(struct dvb_frontend_parameters));
+		break;
+	}
+
+	case FE_READ_STATUS:
+		*((fe_status_t *) arg) = ad->status;
+		break;
+
+	case FE_READ_BER:
+	case FE_READ_UNCORRECTED_BLOCKS:
+		*((uint32_t *) arg) = 0;
+		break;
+
+	case FE_READ_SIGNAL_STRENGTH:
+	case FE_READ_SNR:
+		*((uint16_t *) arg) = (ad->status & FE_HAS_LOCK) ? 0xffff : 0;
+		break;
+
+	case FE_SET_TONE:
+		ad->tone = (fe_sec_tone_mode_t) (long) arg;
+		break;
+
+	case FE_SET_VOLTAGE:
+		ad->voltage = (fe_sec_voltage_t) (long) arg;
+		break;
+
+	case FE_DISEQC_SEND_MASTER_CMD:
+	case FE_DISEQC_SEND_BURST:
+	case FE_ENABLE_HIGH_LNB_VOLTAGE:
+	case FE_DISHNETWORK_SEND_LEGACY_CMD:
+		break;
+
+	case FE_DISEQC_RECV_SLAVE_REPLY:
+		errno = EOPNOTSUPP;
+		result = -1;
+		break;
+
+	default:
+		errno = ENOTTY;
+		result = -1;
+		break;
+	}
+	pthread_mutex_unlock(&ad->lock);
+
+	return result;
+}
+
+
+
+/* ---------------------------------------------------------------------- */
+/* demux */
+
+static void dvbvirtual_reset_filter(struct dvbvirtual_filter *f)
+{
+	f->section_len = 0;
+	f->continuity = -1;
+	f->synced = 0;
+	f->pending_len = 0;
+}
+
+/**
+ * Reset a filter the application has reprogrammed or restarted.
+ */
+static void dvbvirtual_flush_filter(struct dvbvirtual_filter *f)
+{
+	uint8_t buf[4096];
+
+	dvbvirtual_reset_filter(f);
+
+	// like the kernel, drop anything the application has not read yet
+	while (recv(f->app_fd, buf, sizeof(buf), MSG_DONTWAIT) > 0)
+		;
+}
+
+/**
+ * Remove the entry for a descriptor number the application has closed.
+ * Must be called with the adapter lock held.
+ */
+static void dvbvirtual_remove_filter(struct dvbvirtual_adapter *ad, struct dvbvirtual_filter *f)
+{
+	struct dvbvirtual_filter **pf;
+
+	for(pf = &ad->filters; *pf; pf = &(*pf)->next) {
+		if (*pf == f) {
+			*pf = f->next;
+			break;
+		}
+	}
+	if (f->fd >= 0)
+		close(f->fd);
+	free(f);
+}
+
+static int dvbvirtual_socketpair(int socktype, int sv[2], ino_t *app_ino)
+{
+	struct stat st;
+
+	if (socketpair(AF_UNIX, socktype, 0, sv))
+		return -1;
+	fcntl(sv[1], F_SETFL, O_NONBLOCK);
+	shutdown(sv[1], SHUT_RD);
+	fstat(sv[0], &st);
+	*app_ino = st.st_ino;
+	return 0;
+}
+
+static int dvbvirtual_new_filter(int adapter, enum dvbvirtual_filter_type type,
+				 int socktype, int nonblocking)
+{
+	struct dvbvirtual_adapter *ad;
+	struct dvbvirtual_filter *f, *cur, *next;
+	int sv[2];
+
+	if ((ad = dvbvirtual_get_adapter(adapter)) == NULL) {
+		errno = ENODEV;
+		return -1;
+	}
+
+	f = (struct dvbvirtual_filter *) malloc(sizeof(struct dvbvirtual_filter));
+	if (f == NULL)
+		return -1;
+	memset(f, 0, sizeof(struct dvbvirtual_filter));
+	if (dvbvirtual_socketpair(socktype, sv, &f->app_ino)) {
+		free(f);
+		return -1;
+	}
+	if (nonblocking)
+		fcntl(sv[0], F_SETFL, O_NONBLOCK);
+	f->app_fd = sv[0];
+	f->fd = sv[1];
+	f->socktype = socktype;
+	f->type = type;
+	f->started = (type == FILTER_DVR);
+	dvbvirtual_reset_filter(f);
+
+	pthread_mutex_lock(&ad->lock);
+	// anything still registered under this number was closed by the application
+	for(cur = ad->filters; cur; cur = next) {
+		next = cur->next;
+		if (cur->app_fd == f->app_fd)
+			dvbvirtual_remove_filter(ad, cur);
+	}
+	f->next = ad->filters;
+	ad->filters = f;
+	pthread_mutex_unlock(&ad->lock);
+
+	return f->app_fd;
+}
+
+int dvbvirtual_open_demux(int adapter, int demuxdevice, int nonblocking)
+{
+	if (demuxdevice != 0) {
+		errno = ENODEV;
+		return -1;
+	}
+	return dvbvirtual_new_filter(adapter, FILTER_NONE, SOCK_SEQPACKET, nonblocking);
+}
+
+int dvbvirtual_open_dvr(int adapter, int dvrdevice, int nonblocking)
+{
+	if (dvrdevice != 0) {
+		errno = ENODEV;
+		return -1;
+	}
+	return dvbvirtual_new_filter(adapter, FILTER_DVR, SOCK_STREAM, nonblocking);
+}
+
+/**
+ * Find the entry for an application descriptor, locking its adapter. Entries
+ * whose descriptor number has since been reused for something else are
+ * dropped.
+ */
+static struct dvbvirtual_filter *dvbvirtual_find_filter(int fd, struct dvbvirtual_adapter **pad)
+{
+	struct dvbvirtual_adapter *ad;
+	struct dvbvirtual_filter *f;
+	struct stat st;
+	int i;
+
+	if (!dvbvirtual_active)
+		return NULL;
+	if (fstat(fd, &st))
+		return NULL;
+
+	pthread_mutex_lock(&dvbvirtual_global_lock);
+	for(i=0; i < DVBVIRTUAL_MAX_ADAPTERS; i++) {
+		if ((ad = dvbvirtual_adapters[i]) == NULL)
+			continue;
+
+		pthread_mutex_lock(&ad->lock);
+		for(f = ad->filters; f; f = f->next) {
+			if (f->app_fd != fd)
+				continue;
+			if (f->app_ino != st.st_ino) {
+				dvbvirtual_remove_filter(ad, f);
+				break;
+			}
+			pthread_mutex_unlock(&dvbvirtual_global_lock);
+			*pad = ad;
+			return f;
+		}
+		pthread_mutex_unlock(&ad->lock);
+	}
+	pthread_mutex_unlock(&dvbvirtual_global_lock);
+
+	return NULL;
+}
+
+int dvbvirtual_is_demux(int fd)
+{
+	struct dvbvirtual_adapter *ad;
+
+	if (dvbvirtual_find_filter(fd, &ad) == NULL)
+		return 0;
+	pthread_mutex_unlock(&ad->lock);
+	return 1;
+}
+
+/**
+ * Swap the socket behind an application descriptor for one of a different
+ * type, keeping the descriptor number and its blocking mode.
+ */
+static int dvbvirtual_set_socktype(struct dvbvirtual_filter *f, int socktype)
+{
+	int sv[2];
+	int flags;
+	ino_t app_ino;
+
+	if (f->socktype == socktype)
+		return 0;
+
+	flags = fcntl(f->app_fd, F_GETFL);
+	if (dvbvirtual_socketpair(socktype, sv, &app_ino))
+		return -1;
+	if (dup2(sv[0], f->app_fd) < 0) {
+		close(sv[0]);
+		close(sv[1]);
+		return -1;
+	}
+	close(sv[0]);
+	if (flags & O_NONBLOCK)
+		fcntl(f->app_fd, F_SETFL, O_NONBLOCK);
+
+	close(f->fd);
+	f->fd = sv[1];
+	f->app_ino = app_ino;
+	f->socktype = socktype;
+	f->pending_len = 0;
+	return 0;
+}
+
+int dvbvirtual_demux_ioctl(int fd, unsigned long request, void *arg)
+{
+	struct dvbvirtual_adapter *ad;
+	struct dvbvirtual_filter *f;
+	int result = 0;
+	int i;
+
+	if ((f = dvbvirtual_find_filter(fd, &ad)) == NULL) {
+		errno = EBADF;
+		return -1;
+	}
+
+	switch(request) {
+	case DMX_SET_FILTER:
+	{
+		struct dmx_sct_filter_params *params = (struct dmx_sct_filter_params *) arg;
+
+		if ((f->type == FILTER_DVR) || dvbvirtual_set_socktype(f, SOCK_SEQPACKET)) {
+			errno = EINVAL;
+			result = -1;
+			break;
+		}
+		f->type = FILTER_SECTION;
+		f->pid = params->pid;
+		f->notmode = 0;
+		for(i=0; i < DMX_FILTER_SIZE; i++) {
+			uint8_t mode = ~params->filter.mode[i];
+
+			f->filter[i] = params->filter.filter[i] & params->filter.mask[i];
+			f->maskandmode[i] = params->filter.mask[i] & mode;
+			f->maskandnotmode[i] = params->filter.mask[i] & ~mode;
+			f->notmode |= f->maskandnotmode[i];
+		}
+		f->checkcrc = (params->flags & DMX_CHECK_CRC) ? 1 : 0;
+		f->oneshot = (params->flags & DMX_ONESHOT) ? 1 : 0;
+		f->started = (params->flags & DMX_IMMEDIATE_START) ? 1 : 0;
+		dvbvirtual_flush_filter(f);
+		break;
+	}
+
+	case DMX_SET_PES_FILTER:
+	{
+		struct dmx_pes_filter_params *params = (struct dmx_pes_filter_params *) arg;
+
+		if ((f->type == FILTER_DVR) || dvbvirtual_set_socktype(f, SOCK_STREAM)) {
+			errno = EINVAL;
+			result = -1;
+			break;
+		}
+		f->type = FILTER_PES;
+		f->pid = params->pid;
+		f->output = params->output;
+		f->started = (params->flags & DMX_IMMEDIATE_START) ? 1 : 0;
+		dvbvirtual_flush_filter(f);
+		break;
+	}
+
+	case DMX_START:
+		if (f->type == FILTER_NONE) {
+			errno = EINVAL;
+			result = -1;
+			break;
+		}
+		f->started = 1;
+		dvbvirtual_flush_filter(f);
+		break;
+
+	case DMX_STOP:
+		if (f->type != FILTER_DVR)
+			f->started = 0;
+		break;
+
+	case DMX_SET_BUFFER_SIZE:
+	{
+		int size = (int) (long) arg;
+
+		setsockopt(f->fd, SOL_SOCKET, SO_SNDBUF, &size, sizeof(size));
+		break;
+	}
+
+	case DMX_GET_STC:
+	{
+		struct dmx_stc *stc = (struct dmx_stc *) arg;
+
+		stc->base = 1;
+		stc->stc = ad->stc;
+		break;
+	}
+
+	default:
+		errno = ENOTTY;
+		result = -1;
+		break;
+	}
+
+	pthread_cond_broadcast(&ad->cond);
+	pthread_mutex_unlock(&ad->lock);
+	return result;
+}
+
+
+
+/* ---------------------------------------------------------------------- */
+/* CA */
+
+int dvbvirtual_open_ca(int adapter, int cadevice)
+{
+	struct dvbvirtual_adapter *ad;
+	struct dvbvirtual_ca *ca, **pos;
+	int fd;
+
+	if ((ad = dvbvirtual_get_adapter(adapter)) == NULL) {
+		errno = ENODEV;
+		return -1;
+	}
+	if ((cadevice != 0) || (ad->config->cam_slots == 0)) {
+		errno = ENODEV;
+		return -1;
+	}
+
+	ca = (struct dvbvirtual_ca *) malloc(sizeof(struct dvbvirtual_ca));
+	if (ca == NULL)
+		return -1;
+	if ((ca->emu = dvbcamemu_create(ad->config->cam_slots, &fd)) == NULL) {
+		free(ca);
+		return -1;
+	}
+
+	pthread_mutex_lock(&ad->lock);
+	// emulators whose descriptor the application has closed are finished with
+	for(pos = &ad->cas; *pos; ) {
+		if (dvbcamemu_closed((*pos)->emu)) {
+			struct dvbvirtual_ca *tmp = *pos;
+			*pos = tmp->next;
+			dvbcamemu_destroy(tmp->emu);
+			free(tmp);
+		} else {
+			pos = &(*pos)->next;
+		}
+	}
+	ca->next = ad->cas;
+	ad->cas = ca;
+	pthread_mutex_unlock(&ad->lock);
+
+	return fd;
+}
+
+/* ---------------------------------------------------------------------- */
+/* feeder */
+
+/**
+ * Deliver data to a filter's reader. Stream sockets may take only part of a
+ * packet; the rest is kept and sent first next time so the stream stays
+ * packet aligned.
+ */
+static void dvbvirtual_send(struct dvbvirtual_adapter *ad, struct dvbvirtual_filter *f,
+			    const uint8_t *data, int len)
+{
+	struct pollfd pollfd;
+	int res;
+
+	if (f->fd < 0)
+		return;
+
+	if (f->pending_len) {
+		res = send(f->fd, f->pending, f->pending_len, MSG_DONTWAIT | MSG_NOSIGNAL);
+		if (res > 0) {
+			memmove(f->pending, f->pending + res, f->pending_len - res);
+			f->pending_len -= res;
+		}
+		if (f->pending_len) {
+			ad->dropped++;
+			return;
+		}
+	}
+
+	res = send(f->fd, data, len, MSG_DONTWAIT | MSG_NOSIGNAL);
+	if ((res < 0) && (errno == EAGAIN) && !f->overflow) {
+		// give the reader a moment before treating it as overflowed
+		pollfd.fd = f->fd;
+		pollfd.events = POLLOUT;
+		poll(&pollfd, 1, DVBVIRTUAL_STALL_MS);
+		res = send(f->fd, data, len, MSG_DONTWAIT | MSG_NOSIGNAL);
+	}
+
+	if (res < 0) {
+		if (errno == EAGAIN) {
+			f->overflow = 1;
+			ad->dropped++;
+		} else {
+			// the application has closed it
+			close(f->fd);
+			f->fd = -1;
+			f->started = 0;
+		}
+		return;
+	}
+
+	f->overflow = 0;
+	ad->delivered++;
+	if (res < len) {
+		memcpy(f->pending, data + res, len - res);
+		f->pending_len = len - res;
+	}
+}
+
+static int dvbvirtual_section_match(struct dvbvirtual_filter *f)
+{
+	int i, pos, len = f->section_len;
+	uint8_t xor, notmatch = 0;
+
+	for(i=0; i < DMX_FILTER_SIZE; i++) {
+		// filter byte 0 is the table_id, the rest skip the section length
+		pos = i ? i + 2 : 0;
+		if (pos >= len) {
+			if (f->maskandmode[i] | f->maskandnotmode[i])
+				return 0;
+			continue;
+		}
+		xor = f->filter[i] ^ f->section[pos];
+		if (xor & f->maskandmode[i])
+			return 0;
+		notmatch |= xor & f->maskandnotmode[i];
+	}
+	if (f->notmode && !notmatch)
+		return 0;
+
+	return 1;
+}
+
+static void dvbvirtual_section_done(struct dvbvirtual_adapter *ad, struct dvbvirtual_filter *f)
+{
+	if (!dvbvirtual_section_match(f))
+		return;
+	if (f->checkcrc && (f->section[1] & 0x80) &&
+	    dvbvirtual_crc32(f->section, f->section_len))
+		return;
+
+	dvbvirtual_send(ad, f, f->section, f->section_len);
+	if (f->oneshot)
+		f->started = 0;
+}
+
+static void dvbvirtual_section_data(struct dvbvirtual_adapter *ad, struct dvbvirtual_filter *f,
+				    const uint8_t *data, int len)
+{
+	int need, total;
+
+	while((len > 0) && f->started) {
+		if (f->section_len < 3) {
+			// stuffing: the rest of the packet is padding
+			if ((f->section_len == 0) && (data[0] == 0xff)) {
+				f->synced = 0;
+				return;
+			}
+			need = 3 - f->section_len;
+		} else {
+			total = 3 + (((f->section[1] & 0x0f) << 8) | f->section[2]);
+			need = total - f->section_len;
+		}
+		if (need > len)
+			need = len;
+		memcpy(f->section + f->section_len, data, need);
+		f->section_len += need;
+		data += need;
+		len -= need;
+
+		if (f->section_len < 3)
+			continue;
+		total = 3 + (((f->section[1] & 0x0f) << 8) | f->section[2]);
+		if (total > MAX_SECTION_SIZE) {
+			f->section_len = 0;
+			f->synced = 0;
+			return;
+		}
+		if (f->section_len == total) {
+			dvbvirtual_section_done(ad, f);
+			f->section_len = 0;
+		}
+	}
+}
+
+static void dvbvirtual_section_packet(struct dvbvirtual_adapter *ad, struct dvbvirtual_filter *f,
+				      const uint8_t *packet, const uint8_t *payload, int len)
+{
+	int continuity = packet[3] & 0x0f;
+	int pointer;
+
+	// duplicate packets are ignored, lost ones lose the current section
+	if (f->continuity >= 0) {
+		if (continuity == f->continuity)
+			return;
+		if (continuity != ((f->continuity + 1) & 0x0f)) {
+			f->section_len = 0;
+			f->synced = 0;
+		}
+	}
+	f->continuity = continuity;
+
+	if (packet[1] & 0x40) {
+		pointer = payload[0];
+		payload++;
+		len--;
+		if (pointer >= len) {
+			f->section_len = 0;
+			f->synced = 0;
+			return;
+		}
+
+		// the end of the previous section
+		if (f->synced && f->section_len)
+			dvbvirtual_section_data(ad, f, payload, pointer);
+		payload += pointer;
+		len -= pointer;
+
+		f->section_len = 0;
+		f->synced = 1;
+	} else if (!f->synced) {
+		return;
+	}
+
+	dvbvirtual_section_data(ad, f, payload, len);
+}
+
+/**
+ * Route one TS packet to every started filter. Must be called with the
+ * adapter lock held.
+ */
+static void dvbvirtual_dispatch(struct dvbvirtual_adapter *ad, const uint8_t *packet)
+{
+	struct dvbvirtual_filter *f, *dvr;
+	int pid = ((packet[1] & 0x1f) << 8) | packet[2];
+	int afc = (packet[3] >> 4) & 3;
+	const uint8_t *payload = packet + 4;
+	int len = TS_PACKET_SIZE - 4;
+
+	if (packet[1] & 0x80)
+		return;
+
+	if (afc & 2) {
+		// note the PCR for DMX_GET_STC
+		if ((packet[4] >= 7) && (packet[5] & 0x10))
+			ad->stc = ((uint64_t) packet[6] << 25) | (packet[7] << 17) |
+				  (packet[8] << 9) | (packet[9] << 1) | (packet[10] >> 7);
+		payload += 1 + packet[4];
+		len -= 1 + packet[4];
+	}
+	if (!(afc & 1) || (len < 0))
+		len = 0;
+
+	for(f = ad->filters; f; f = f->next) {
+		if (!f->started || (f->fd < 0))
+			continue;
+
+		switch(f->type) {
+		case FILTER_SECTION:
+			if ((f->pid == pid) && (len > 0))
+				dvbvirtual_section_packet(ad, f, packet, payload, len);
+			break;
+
+		case FILTER_PES:
+			if ((f->pid != pid) && (f->pid != TS_ALL_PIDS))
+				break;
+
+			switch(f->output) {
+			case DMX_OUT_TAP:
+				if (len > 0)
+					dvbvirtual_send(ad, f, payload, len);
+				break;
+
+			case DMX_OUT_TS_TAP:
+				for(dvr = ad->filters; dvr; dvr = dvr->next) {
+					if (dvr->type == FILTER_DVR)
+						dvbvirtual_send(ad, dvr, packet, TS_PACKET_SIZE);
+				}
+				break;
+
+#ifdef DMX_OUT_TSDEMUX_TAP
+			case DMX_OUT_TSDEMUX_TAP:
+				dvbvirtual_send(ad, f, packet, TS_PACKET_SIZE);
+				break;
+#endif
+			}
+			break;
+
+		default:
+			break;
+		}
+	}
+}
+
+/**
+ * @return 1 if there is a started filter which could receive data.
+ */
+static int dvbvirtual_wanted(struct dvbvirtual_adapter *ad)
+{
+	struct dvbvirtual_filter *f;
+
+	for(f = ad->filters; f; f = f->next) {
+		if (f->started && (f->fd >= 0) &&
+		    ((f->type == FILTER_SECTION) || (f->type == FILTER_PES)))
+			return 1;
+	}
+	return 0;
+}
+
+static void dvbvirtual_restart(struct dvbvirtual_adapter *ad)
+{
+	struct dvbvirtual_filter *f;
+
+	for(f = ad->filters; f; f = f->next)
+		dvbvirtual_reset_filter(f);
+}
+
+static void *dvbvirtual_feeder(void *arg)
+{
+	struct dvbvirtual_adapter *ad = (struct dvbvirtual_adapter *) arg;
+	uint8_t buf[TS_PACKET_SIZE * DVBVIRTUAL_CHUNK_PACKETS];
+	int buflen = 0;
+	int fd = -1;
+	int generation = -1;
+	int ended = 0;
+	long long start_us = 0;
+	uint64_t fed = 0;
+	off_t offset = 0;
+	int pos, res;
+
+	pthread_mutex_lock(&ad->lock);
+	while(ad->running) {
+		// retuned? switch to the new transponder's capture
+		if (generation != ad->generation) {
+			generation = ad->generation;
+			if (fd >= 0)
+				close(fd);
+			fd = -1;
+			ended = 0;
+			buflen = 0;
+			offset = 0;
+			fed = 0;
+			start_us = dvbvirtual_now_us();
+			dvbvirtual_restart(ad);
+			if (ad->tuned && ((fd = open(ad->tuned->filename, O_RDONLY)) < 0))
+				print(verbose, ERROR, 1, "Unable to open %s", ad->tuned->filename);
+		}
+
+		if ((fd < 0) || ended || !dvbvirtual_wanted(ad)) {
+			pthread_cond_wait(&ad->cond, &ad->lock);
+			continue;
+		}
+
+		pthread_mutex_unlock(&ad->lock);
+		res = read(fd, buf + buflen, sizeof(buf) - buflen);
+		pthread_mutex_lock(&ad->lock);
+		if (generation != ad->generation)
+			continue;
+
+		if (res <= 0) {
+			if ((res == 0) && ad->config->loop && offset) {
+				// carousel: start the capture again
+				lseek(fd, 0, SEEK_SET);
+				buflen = 0;
+				offset = 0;
+				dvbvirtual_restart(ad);
+			} else {
+				ended = 1;
+			}
+			continue;
+		}
+		offset += res;
+		buflen += res;
+
+		ad->delivered = 0;
+		ad->dropped = 0;
+		pos = 0;
+		while((buflen - pos) >= TS_PACKET_SIZE) {
+			if (buf[pos] != 0x47) {
+				pos++;
+				continue;
+			}
+			dvbvirtual_dispatch(ad, buf + pos);
+			pos += TS_PACKET_SIZE;
+		}
+		memmove(buf, buf + pos, buflen - pos);
+		buflen -= pos;
+		fed += pos;
+
+		// pace to the configured rate, or back off if nobody is reading
+		if (ad->config->rate) {
+			long long due = start_us + (long long) ((fed * 8 * 1000000) / ad->config->rate);
+			long long now = dvbvirtual_now_us();
+
+			if (due > now) {
+				pthread_mutex_unlock(&ad->lock);
+				usleep(due - now);
+				pthread_mutex_lock(&ad->lock);
+			}
+		} else if (ad->dropped && !ad->delivered) {
+			pthread_mutex_unlock(&ad->lock);
+			usleep(DVBVIRTUAL_STALL_MS * 1000);
+			pthread_mutex_lock(&ad->lock);
+		}
+	}
+	pthread_mutex_unlock(&ad->lock);
+
+	if (fd >= 0)
+		close(fd);
+	return NULL;
+}
@@ -0,0 +1,99 @@
+/*
+ * libdvbapi - a virtual DVB adapter backed by transport stream captures
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ */
+
+#ifndef LIBDVBVIRTUAL_H
+#define LIBDVBVIRTUAL_H 1
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/**
+ * A virtual adapter replaces /dev/dvb/adapterN with a set of recorded
+ * transport stream files, one per transponder. The dvbfe_* and dvbdemux_*
+ * calls behave as they do on hardware: dvbfe_set() locks if the requested
+ * frequency matches one of the captures, and the section and PID filters
+ * are applied in user space to the capture of the tuned transponder. The
+ * descriptors returned by dvbdemux_open_demux() and dvbdemux_open_dvr()
+ * can be read() and poll()ed as usual.
+ *
+ * The capture is fed as fast as the readers consume it, so a scan runs
+ * faster than real time. A filter whose reader stops reading loses data,
+ * just as a hardware demux buffer overflows.
+ *
+ * If the environment variable DVBAPI_VIRTUAL names a configuration file,
+ * every adapter is virtual and uses that file, so existing tools can be
+ * run unmodified. Otherwise adapters can be made virtual individually with
+ * dvbvirtual_attach().
+ *
+ * The configuration file contains one directive per line; '#' starts a
+ * comment:
+ *
+ *   type DVBS|DVBC|DVBT|ATSC          frontend type (required)
+ *   lnb <lof_lo> <lof_hi>             DVB-S only: LNB oscillators used to
+ *                                     convert the tuned IF back to a
+ *                                     transponder frequency, in kHz
+ *                                     (default: universal, 9750000 10600000)
+ *   rate <bits per second>            pace the feed (default 0: unpaced)
+ *   loop 0|1                          restart each capture at its end, as
+ *                                     a broadcast carousel would (default 1)
+ *   cam <slots>                       give the adapter a CA device with
+ *                                     an emulated link layer CAM in each
+ *                                     of <slots> slots (see dvbcamemu.h;
+ *                                     default 0: no CA device)
+ *   <frequency> [h|v|l|r] <file>      a transponder and its TS capture;
+ *                                     relative paths are relative to the
+ *                                     configuration file
+ *
+ * Frequencies are in the units dvbfe_set() uses for the frontend type. For
+ * DVB-S, the transponder frequency is recovered from the IF using the 22kHz
+ * tone and LNB voltage last set, and the polarization is matched against
+ * the voltage; if no voltage was ever set the IF is used as is.
+ */
+
+/**
+ * Make an adapter virtual.
+ *
+ * @param adapter Index of the adapter.
+ * @param config Filename of the configuration file describing the captures.
+ * @return 0 on success, or -1 on failure.
+ */
+extern int dvbvirtual_attach(int adapter, const char *config);
+
+/**
+ * Remove a virtual adapter created with dvbvirtual_attach(). Any descriptors
+ * still open on it will see end of file.
+ *
+ * @param adapter Index of the adapter.
+ */
+extern void dvbvirtual_detach(int adapter);
+
+/**
+ * Determine if an adapter is virtual.
+ *
+ * @param adapter Index of the adapter.
+ * @return 1 if it is, 0 if not.
+ */
+extern int dvbvirtual_is_virtual(int adapter);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // LIBDVBVIRTUAL_H
@@ -0,0 +1,60 @@
+/*
+ * libdvbapi - a virtual DVB adapter backed by transport stream captures
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ */
+
+#ifndef LIBDVBVIRTUAL_INT_H
+#define LIBDVBVIRTUAL_INT_H 1
+
+/*
+ * Hooks used by dvbfe.c, dvbdemux.c and dvbca.c to route a virtual adapter's
+ * devices to the emulation. Not installed.
+ */
+
+struct dvbvirtual_frontend;
+
+extern struct dvbvirtual_frontend *dvbvirtual_open_frontend(int adapter, int frontend);
+extern void dvbvirtual_close_frontend(struct dvbvirtual_frontend *fe);
+extern int dvbvirtual_frontend_fd(struct dvbvirtual_frontend *fe);
+
+/* emulates ioctl() on the frontend device: returns -1 and sets errno on error */
+extern int dvbvirtual_fe_ioctl(struct dvbvirtual_frontend *fe, unsigned long request, void *arg);
+
+extern int dvbvirtual_open_demux(int adapter, int demuxdevice, int nonblocking);
+extern int dvbvirtual_open_dvr(int adapter, int dvrdevice, int nonblocking);
+extern int dvbvirtual_is_demux(int fd);
+
+/* emulates ioctl() on a demux device: returns -1 and sets errno on error */
+extern int dvbvirtual_demux_ioctl(int fd, unsigned long request, void *arg);
+
+extern int dvbvirtual_open_ca(int adapter, int cadevice);
+
+/*
+ * Hooks used by dvbca.c and dvbvirtual.c for CA devices served by a CAM
+ * emulator (dvbcamemu.c).
+ */
+
+struct dvbcamemu;
+
+extern int dvbcamemu_is_ca(int fd);
+
+/* emulates ioctl() on a CA device: returns -1 and sets errno on error */
+extern int dvbcamemu_ca_ioctl(int fd, unsigned long request, void *arg);
+
+/* returns 1 once the host has closed the emulator's descriptor */
+extern int dvbcamemu_closed(struct dvbcamemu *emu);
+
+#endif
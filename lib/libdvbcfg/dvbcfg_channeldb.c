@@ -0,0 +1,421 @@
+/*
+ * dvbcfg - support for linuxtv configuration files
+ * indexed zap channel database
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#include "dvbcfg_channeldb.h"
+
+#define DVBCFG_CHANNELDB_MAGIC   0x44564243	/* "DVBC" */
+#define DVBCFG_CHANNELDB_VERSION 1
+
+/*
+ * Cache file layout: the header, padded to 64 bytes, then the channels, then
+ * the name index, then the service index. It is only ever read back by the
+ * build that wrote it, so everything is in host byte order and layout.
+ */
+struct dvbcfg_channeldb_header {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t channel_size;
+	uint32_t count;
+	uint32_t index_size;
+	uint32_t reserved;
+
+	/* the channel file this was built from */
+	uint64_t source_size;
+	uint64_t source_ino;
+	int64_t source_mtime_sec;
+	int64_t source_mtime_nsec;
+};
+
+#define DVBCFG_CHANNELDB_HEADER_SIZE 64
+
+struct dvbcfg_channeldb {
+	const struct dvbcfg_zapchannel *channels;
+	uint32_t count;
+
+	/* open addressed; entries are channel index + 1, 0 is empty */
+	const uint32_t *name_index;
+	const uint32_t *service_index;
+	uint32_t index_size;		/* a power of two */
+
+	/* either mapped from the cache... */
+	void *map;
+	size_t map_size;
+
+	/* ... or built here */
+	struct dvbcfg_zapchannel *alloc_channels;
+	uint32_t alloc_count;
+	uint32_t *alloc_index;
+};
+
+static uint32_t dvbcfg_channeldb_hash_name(const char *name)
+{
+	uint32_t hash = 2166136261U;
+
+	while (*name) {
+		hash ^= (uint8_t) *name++;
+		hash *= 16777619;
+	}
+
+	return hash;
+}
+
+static uint32_t dvbcfg_channeldb_hash_service(uint32_t frequency, int service_id)
+{
+	uint32_t hash = frequency * 0x9e3779b1U;
+
+	hash ^= (uint32_t) service_id + (hash >> 16);
+	return hash * 0x85ebca6bU;
+}
+
+static size_t dvbcfg_channeldb_file_size(uint32_t count, uint32_t index_size)
+{
+	return DVBCFG_CHANNELDB_HEADER_SIZE +
+		(count * sizeof(struct dvbcfg_zapchannel)) +
+		(2 * index_size * sizeof(uint32_t));
+}
+
+static int dvbcfg_channeldb_append(struct dvbcfg_zapchannel *channel, void *private_data)
+{
+	struct dvbcfg_channeldb *db = private_data;
+	struct dvbcfg_zapchannel *tmp;
+
+	if (db->count == db->alloc_count) {
+		uint32_t alloc_count = db->alloc_count ? db->alloc_count * 2 : 256;
+
+		tmp = realloc(db->alloc_channels, alloc_count * sizeof(struct dvbcfg_zapchannel));
+		if (tmp == NULL)
+			return 1;
+		db->alloc_channels = tmp;
+		db->alloc_count = alloc_count;
+	}
+
+	memcpy(&db->alloc_channels[db->count++], channel, sizeof(struct dvbcfg_zapchannel));
+	return 0;
+}
+
+static int dvbcfg_channeldb_build_index(struct dvbcfg_channeldb *db)
+{
+	uint32_t *name_index;
+	uint32_t *service_index;
+	uint32_t mask;
+	uint32_t i;
+
+	/* keep the tables at most half full */
+	db->index_size = 16;
+	while (db->index_size < (db->count * 2))
+		db->index_size *= 2;
+	mask = db->index_size - 1;
+
+	db->alloc_index = calloc(db->index_size * 2, sizeof(uint32_t));
+	if (db->alloc_index == NULL)
+		return -1;
+	name_index = db->alloc_index;
+	service_index = db->alloc_index + db->index_size;
+
+	/* only the first of any duplicates is indexed */
+	for (i = 0; i < db->count; i++) {
+		const struct dvbcfg_zapchannel *channel = &db->alloc_channels[i];
+		uint32_t pos;
+
+		pos = dvbcfg_channeldb_hash_name(channel->name) & mask;
+		while (name_index[pos] &&
+		       strcmp(db->alloc_channels[name_index[pos] - 1].name, channel->name))
+			pos = (pos + 1) & mask;
+		if (!name_index[pos])
+			name_index[pos] = i + 1;
+
+		pos = dvbcfg_channeldb_hash_service(channel->fe_params.frequency,
+						    channel->service_id) & mask;
+		while (service_index[pos] &&
+		       ((db->alloc_channels[service_index[pos] - 1].fe_params.frequency !=
+			 channel->fe_params.frequency) ||
+			(db->alloc_channels[service_index[pos] - 1].service_id !=
+			 channel->service_id)))
+			pos = (pos + 1) & mask;
+		if (!service_index[pos])
+			service_index[pos] = i + 1;
+	}
+
+	db->channels = db->alloc_channels;
+	db->name_index = name_index;
+	db->service_index = service_index;
+	return 0;
+}
+
+static void dvbcfg_channeldb_header_source(struct dvbcfg_channeldb_header *header,
+					   struct stat *st)
+{
+	header->source_size = st->st_size;
+	header->source_ino = st->st_ino;
+	header->source_mtime_sec = st->st_mtim.tv_sec;
+	header->source_mtime_nsec = st->st_mtim.tv_nsec;
+}
+
+/* lookups index straight into the mapped cache, so check it holds together */
+static int dvbcfg_channeldb_check_cache(struct dvbcfg_channeldb *db)
+{
+	uint32_t names = 0;
+	uint32_t services = 0;
+	uint32_t i;
+
+	for (i = 0; i < db->count; i++) {
+		if (memchr(db->channels[i].name, 0, sizeof(db->channels[i].name)) == NULL)
+			return -1;
+	}
+
+	/* probes stop at an empty slot, so the tables must not be full */
+	for (i = 0; i < db->index_size; i++) {
+		if ((db->name_index[i] > db->count) || (db->service_index[i] > db->count))
+			return -1;
+		if (db->name_index[i])
+			names++;
+		if (db->service_index[i])
+			services++;
+	}
+	if ((names > db->count) || (services > db->count))
+		return -1;
+
+	return 0;
+}
+
+static int dvbcfg_channeldb_map_cache(struct dvbcfg_channeldb *db,
+				      const char *cache_filename,
+				      struct stat *source_st)
+{
+	struct dvbcfg_channeldb_header source;
+	const struct dvbcfg_channeldb_header *header;
+	struct stat st;
+	uint8_t *map;
+	int fd;
+
+	if ((fd = open(cache_filename, O_RDONLY)) < 0)
+		return -1;
+	if (fstat(fd, &st) || (st.st_size < DVBCFG_CHANNELDB_HEADER_SIZE)) {
+		close(fd);
+		return -1;
+	}
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED)
+		return -1;
+
+	/* is it ours, and for this version of the channel file? */
+	header = (const struct dvbcfg_channeldb_header *) map;
+	memset(&source, 0, sizeof(source));
+	dvbcfg_channeldb_header_source(&source, source_st);
+	if ((header->magic != DVBCFG_CHANNELDB_MAGIC) ||
+	    (header->version != DVBCFG_CHANNELDB_VERSION) ||
+	    (header->channel_size != sizeof(struct dvbcfg_zapchannel)) ||
+	    (header->index_size == 0) ||
+	    (header->index_size & (header->index_size - 1)) ||
+	    (((uint64_t) header->count * 2) > header->index_size) ||
+	    ((size_t) st.st_size != dvbcfg_channeldb_file_size(header->count, header->index_size)) ||
+	    (header->source_size != source.source_size) ||
+	    (header->source_ino != source.source_ino) ||
+	    (header->source_mtime_sec != source.source_mtime_sec) ||
+	    (header->source_mtime_nsec != source.source_mtime_nsec)) {
+		munmap(map, st.st_size);
+		return -1;
+	}
+
+	db->map = map;
+	db->map_size = st.st_size;
+	db->count = header->count;
+	db->index_size = header->index_size;
+	db->channels = (const struct dvbcfg_zapchannel *)
+		(map + DVBCFG_CHANNELDB_HEADER_SIZE);
+	db->name_index = (const uint32_t *) (db->channels + db->count);
+	db->service_index = db->name_index + db->index_size;
+
+	/* on failure leave the database empty, for the channel file to fill */
+	if (dvbcfg_channeldb_check_cache(db)) {
+		munmap(map, st.st_size);
+		memset(db, 0, sizeof(struct dvbcfg_channeldb));
+		return -1;
+	}
+	return 0;
+}
+
+static void dvbcfg_channeldb_write_cache(struct dvbcfg_channeldb *db,
+					 const char *cache_filename,
+					 struct stat *source_st)
+{
+	union {
+		struct dvbcfg_channeldb_header header;
+		uint8_t raw[DVBCFG_CHANNELDB_HEADER_SIZE];
+	} buf;
+	struct dvbcfg_channeldb_header *header = &buf.header;
+	size_t tmp_length = strlen(cache_filename) + 8;
+	char *tmp_filename;
+	FILE *f;
+	int fd;
+
+	/* write it beside the old one, then replace it in one go */
+	if ((tmp_filename = malloc(tmp_length)) == NULL)
+		return;
+	snprintf(tmp_filename, tmp_length, "%s.XXXXXX", cache_filename);
+	if ((fd = mkstemp(tmp_filename)) < 0) {
+		free(tmp_filename);
+		return;
+	}
+	fchmod(fd, 0644);
+	if ((f = fdopen(fd, "w")) == NULL) {
+		close(fd);
+		goto error;
+	}
+
+	memset(&buf, 0, sizeof(buf));
+	header->magic = DVBCFG_CHANNELDB_MAGIC;
+	header->version = DVBCFG_CHANNELDB_VERSION;
+	header->channel_size = sizeof(struct dvbcfg_zapchannel);
+	header->count = db->count;
+	header->index_size = db->index_size;
+	dvbcfg_channeldb_header_source(header, source_st);
+
+	if ((fwrite(buf.raw, sizeof(buf.raw), 1, f) != 1) ||
+	    (db->count &&
+	     (fwrite(db->channels, sizeof(struct dvbcfg_zapchannel), db->count, f) != db->count)) ||
+	    (fwrite(db->alloc_index, sizeof(uint32_t), db->index_size * 2, f) != db->index_size * 2)) {
+		fclose(f);
+		goto error;
+	}
+	if (fclose(f))
+		goto error;
+	if (rename(tmp_filename, cache_filename))
+		goto error;
+
+	free(tmp_filename);
+	return;
+
+error:
+	unlink(tmp_filename);
+	free(tmp_filename);
+}
+
+struct dvbcfg_channeldb *dvbcfg_channeldb_load(const char *filename,
+					       const char *cache_filename)
+{
+	struct dvbcfg_channeldb *db;
+	struct stat st;
+	FILE *f;
+
+	db = calloc(1, sizeof(struct dvbcfg_channeldb));
+	if (db == NULL)
+		return NULL;
+
+	/* stat the file we are about to read, so a later change invalidates the cache */
+	if ((f = fopen(filename, "r")) == NULL) {
+		free(db);
+		return NULL;
+	}
+	if (fstat(fileno(f), &st)) {
+		fclose(f);
+		free(db);
+		return NULL;
+	}
+
+	/* use the cache if it is still valid */
+	if (cache_filename && !dvbcfg_channeldb_map_cache(db, cache_filename, &st)) {
+		fclose(f);
+		return db;
+	}
+
+	/* otherwise parse the file */
+	if (dvbcfg_zapchannel_parse(f, dvbcfg_channeldb_append, db) ||
+	    dvbcfg_channeldb_build_index(db)) {
+		fclose(f);
+		dvbcfg_channeldb_free(db);
+		return NULL;
+	}
+	fclose(f);
+
+	if (cache_filename)
+		dvbcfg_channeldb_write_cache(db, cache_filename, &st);
+
+	return db;
+}
+
+void dvbcfg_channeldb_free(struct dvbcfg_channeldb *db)
+{
+	if (db->map)
+		munmap(db->map, db->map_size);
+	free(db->alloc_channels);
+	free(db->alloc_index);
+	free(db);
+}
+
+int dvbcfg_channeldb_count(struct dvbcfg_channeldb *db)
+{
+	return db->count;
+}
+
+const struct dvbcfg_zapchannel *dvbcfg_channeldb_get(struct dvbcfg_channeldb *db,
+						     int index)
+{
+	if ((index < 0) || ((uint32_t) index >= db->count))
+		return NULL;
+
+	return &db->channels[index];
+}
+
+const struct dvbcfg_zapchannel *dvbcfg_channeldb_find_name(struct dvbcfg_channeldb *db,
+							   const char *name)
+{
+	uint32_t mask = db->index_size - 1;
+	uint32_t pos = dvbcfg_channeldb_hash_name(name) & mask;
+
+	while (db->name_index[pos]) {
+		const struct dvbcfg_zapchannel *channel = &db->channels[db->name_index[pos] - 1];
+
+		if (!strcmp(channel->name, name))
+			return channel;
+		pos = (pos + 1) & mask;
+	}
+
+	return NULL;
+}
+
+const struct dvbcfg_zapchannel *dvbcfg_channeldb_find_service(struct dvbcfg_channeldb *db,
+							      uint32_t frequency,
+							      int service_id)
+{
+	uint32_t mask = db->index_size - 1;
+	uint32_t pos = dvbcfg_channeldb_hash_service(frequency, service_id) & mask;
+
+	while (db->service_index[pos]) {
+		const struct dvbcfg_zapchannel *channel = &db->channels[db->service_index[pos] - 1];
+
+		if ((channel->fe_params.frequency == frequency) &&
+		    (channel->service_id == service_id))
+			return channel;
+		pos = (pos + 1) & mask;
+	}
+
+	return NULL;
+}
@@ -0,0 +1,107 @@
+/*
+ * dvbcfg - support for linuxtv configuration files
+ * indexed zap channel database
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+#ifndef DVBCFG_CHANNELDB_H
+#define DVBCFG_CHANNELDB_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <libdvbcfg/dvbcfg_zapchannel.h>
+
+/**
+ * A channel database is a linuxtv channel file parsed once into an array,
+ * with hash indexes by name and by (frequency, service id). Lookups cost
+ * a hash probe instead of a reparse of the whole file.
+ *
+ * The database may optionally be persisted to a cache file. The cache is
+ * tied to the channel file's size, inode and modification time; while those
+ * are unchanged, loading the database just maps the cache.
+ *
+ * Where a channel file has several entries with the same name, or with the
+ * same frequency and service id, lookups return the first, as a search with
+ * dvbcfg_zapchannel_parse() would.
+ */
+struct dvbcfg_channeldb;
+
+/**
+ * Load a linuxtv channel file.
+ *
+ * @param filename Linuxtv channel file.
+ * @param cache_filename Cache file to use, or NULL for none. If the cache is
+ * missing or stale, the channel file is parsed and the cache rewritten; failing
+ * to write it is not an error.
+ * @return The database, or NULL on failure.
+ */
+extern struct dvbcfg_channeldb *dvbcfg_channeldb_load(const char *filename,
+						      const char *cache_filename);
+
+/**
+ * Free a channel database.
+ *
+ * @param db The database.
+ */
+extern void dvbcfg_channeldb_free(struct dvbcfg_channeldb *db);
+
+/**
+ * Get the number of channels in a database.
+ *
+ * @param db The database.
+ * @return The number of channels.
+ */
+extern int dvbcfg_channeldb_count(struct dvbcfg_channeldb *db);
+
+/**
+ * Get a channel by position, in channel file order.
+ *
+ * @param db The database.
+ * @param index Position, from 0 to dvbcfg_channeldb_count() - 1.
+ * @return The channel, or NULL if index is out of range.
+ */
+extern const struct dvbcfg_zapchannel *dvbcfg_channeldb_get(struct dvbcfg_channeldb *db,
+							    int index);
+
+/**
+ * Find a channel by name.
+ *
+ * @param db The database.
+ * @param name The channel name.
+ * @return The channel, or NULL if there is none with that name.
+ */
+extern const struct dvbcfg_zapchannel *dvbcfg_channeldb_find_name(struct dvbcfg_channeldb *db,
+								  const char *name);
+
+/**
+ * Find a channel by frequency and service id.
+ *
+ * @param db The database.
+ * @param frequency The frequency, as in fe_params.frequency (so in kHz for DVB-S).
+ * @param service_id The service id.
+ * @return The channel, or NULL if there is none.
+ */
+extern const struct dvbcfg_zapchannel *dvbcfg_channeldb_find_service(struct dvbcfg_channeldb *db,
+								     uint32_t frequency,
+								     int service_id);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* DVBCFG_CHANNELDB_H */
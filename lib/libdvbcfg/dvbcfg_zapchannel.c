@@ -124,6 +124,9 @@ int dvbcfg_zapchannel_parse(FILE *file, dvbcfg_zapcallback callback, void *priva
 		char *line_pos = line_buf;
 		struct dvbcfg_zapchannel tmp;
 
+		/* fields the frontend type does not use are left zeroed */
+		memset(&tmp, 0, sizeof(tmp));
+
 		/* remove newline and comments (started with hashes) */
 		while ((*line_tmp != '\0') && (*line_tmp != '\n') && (*line_tmp != '#'))
 			line_tmp++;
@@ -63,9 +63,24 @@ struct ca_pmt_stream {
 	struct ca_pmt_stream *next;
 };
 
+// a PMT section is at most 1024 bytes, and each stream takes at least 5 of
+// them and each descriptor at least 2, so the lists built while formatting
+// a CA PMT always fit in these - no need to go to the heap for them
+#define CA_PMT_MAX_STREAMS 205
+#define CA_PMT_MAX_DESCRIPTORS 512
+
+struct ca_pmt_nodes {
+	struct ca_pmt_stream streams[CA_PMT_MAX_STREAMS];
+	struct ca_pmt_descriptor descriptors[CA_PMT_MAX_DESCRIPTORS];
+	int streams_used;
+	int descriptors_used;
+};
+
 static int en50221_ca_extract_pmt_descriptors(struct mpeg_pmt_section *pmt,
+					      struct ca_pmt_nodes *nodes,
 					      struct ca_pmt_descriptor **outdescriptors);
 static int en50221_ca_extract_streams(struct mpeg_pmt_section *pmt,
+				      struct ca_pmt_nodes *nodes,
 				      struct ca_pmt_stream **outstreams);
 static void en50221_ca_try_move_pmt_descriptors(struct ca_pmt_descriptor **pmt_descriptors,
 						struct ca_pmt_stream **pmt_streams);
@@ -209,13 +224,15 @@ int en50221_ca_format_pmt(struct mpeg_pmt_section *pmt, uint8_t * data,
 	uint32_t total_required_length = 0;
 	struct ca_pmt_descriptor *cur_d;
 	struct ca_pmt_stream *cur_s;
-	int result = -1;
+	struct ca_pmt_nodes nodes;
 
 	// extract the descriptors and streams
-	if (en50221_ca_extract_pmt_descriptors(pmt, &pmt_descriptors))
-		goto cleanup;
-	if (en50221_ca_extract_streams(pmt, &pmt_streams))
-		goto cleanup;
+	nodes.streams_used = 0;
+	nodes.descriptors_used = 0;
+	if (en50221_ca_extract_pmt_descriptors(pmt, &nodes, &pmt_descriptors))
+		return -1;
+	if (en50221_ca_extract_streams(pmt, &nodes, &pmt_streams))
+		return -1;
 
 	// try and merge them if we have no PMT descriptors
 	if ((pmt_descriptors == NULL) && move_ca_descriptors) {
@@ -230,7 +247,7 @@ int en50221_ca_format_pmt(struct mpeg_pmt_section *pmt, uint8_t * data,
 
 	// ensure we were supplied with enough data
 	if (total_required_length > data_length) {
-		goto cleanup;
+		return -1;
 	}
 	// format the start of the PMT
 	uint32_t data_pos = 0;
@@ -276,35 +293,7 @@ int en50221_ca_format_pmt(struct mpeg_pmt_section *pmt, uint8_t * data,
 		}
 		cur_s = cur_s->next;
 	}
-	result = data_pos;
-
-
-      cleanup:
-	// free the PMT descriptors
-	cur_d = pmt_descriptors;
-	while (cur_d) {
-		struct ca_pmt_descriptor *next = cur_d->next;
-		free(cur_d);
-		cur_d = next;
-	}
-
-	// free the streams
-	cur_s = pmt_streams;
-	while (cur_s) {
-		struct ca_pmt_stream *next_s = cur_s->next;
-
-		// free the stream descriptors
-		cur_d = cur_s->descriptors;
-		while (cur_d) {
-			struct ca_pmt_descriptor *next_d = cur_d->next;
-			free(cur_d);
-			cur_d = next_d;
-		}
-
-		free(cur_s);
-		cur_s = next_s;
-	}
-	return result;
+	return data_pos;
 }
 
 
@@ -314,21 +303,20 @@ int en50221_ca_format_pmt(struct mpeg_pmt_section *pmt, uint8_t * data,
 
 
 static int en50221_ca_extract_pmt_descriptors(struct mpeg_pmt_section *pmt,
+					      struct ca_pmt_nodes *nodes,
 					      struct ca_pmt_descriptor **outdescriptors)
 {
 	struct ca_pmt_descriptor *descriptors = NULL;
 	struct ca_pmt_descriptor *descriptors_tail = NULL;
-	struct ca_pmt_descriptor *cur_d;
 
 	struct descriptor *cur_descriptor;
 	mpeg_pmt_section_descriptors_for_each(pmt, cur_descriptor) {
 		if (cur_descriptor->tag == dtag_mpeg_ca) {
 			// create a new structure for this one
+			if (nodes->descriptors_used == CA_PMT_MAX_DESCRIPTORS)
+				return -1;
 			struct ca_pmt_descriptor *new_d =
-			    malloc(sizeof(struct ca_pmt_descriptor));
-			if (new_d == NULL) {
-				goto error_exit;
-			}
+			    &nodes->descriptors[nodes->descriptors_used++];
 			new_d->descriptor = (uint8_t *) cur_descriptor;
 			new_d->length = cur_descriptor->len + 2;
 			new_d->next = NULL;
@@ -344,35 +332,24 @@ static int en50221_ca_extract_pmt_descriptors(struct mpeg_pmt_section *pmt,
 	}
 	*outdescriptors = descriptors;
 	return 0;
-
-error_exit:
-	cur_d = descriptors;
-	while (cur_d) {
-		struct ca_pmt_descriptor *next = cur_d->next;
-		free(cur_d);
-		cur_d = next;
-	}
-	return -1;
 }
 
 static int en50221_ca_extract_streams(struct mpeg_pmt_section *pmt,
+				      struct ca_pmt_nodes *nodes,
 				      struct ca_pmt_stream **outstreams)
 {
 	struct ca_pmt_stream *streams = NULL;
 	struct ca_pmt_stream *streams_tail = NULL;
 	struct mpeg_pmt_stream *cur_stream;
 	struct descriptor *cur_descriptor;
-	struct ca_pmt_stream *cur_s;
 
 	mpeg_pmt_section_streams_for_each(pmt, cur_stream) {
 		struct ca_pmt_descriptor *descriptors_tail = NULL;
 
 		// create a new structure
-		struct ca_pmt_stream *new_s =
-		    malloc(sizeof(struct ca_pmt_stream));
-		if (new_s == NULL) {
-			goto exit_cleanup;
-		}
+		if (nodes->streams_used == CA_PMT_MAX_STREAMS)
+			return -1;
+		struct ca_pmt_stream *new_s = &nodes->streams[nodes->streams_used++];
 		new_s->stream_type = cur_stream->stream_type;
 		new_s->pid = cur_stream->pid;
 		new_s->descriptors = NULL;
@@ -392,11 +369,10 @@ static int en50221_ca_extract_streams(struct mpeg_pmt_section *pmt,
 						     cur_descriptor) {
 			if (cur_descriptor->tag == dtag_mpeg_ca) {
 				// create a new structure
+				if (nodes->descriptors_used == CA_PMT_MAX_DESCRIPTORS)
+					return -1;
 				struct ca_pmt_descriptor *new_d =
-				    malloc(sizeof(struct ca_pmt_descriptor));
-				if (new_d == NULL) {
-					goto exit_cleanup;
-				}
+				    &nodes->descriptors[nodes->descriptors_used++];
 				new_d->descriptor =
 				    (uint8_t *) cur_descriptor;
 				new_d->length = cur_descriptor->len + 2;
@@ -415,25 +391,6 @@ static int en50221_ca_extract_streams(struct mpeg_pmt_section *pmt,
 	}
 	*outstreams = streams;
 	return 0;
-
-exit_cleanup:
-	// free the streams
-	cur_s = streams;
-	while (cur_s) {
-		struct ca_pmt_stream *next_s = cur_s->next;
-
-		// free the stream descriptors
-		struct ca_pmt_descriptor *cur_d = cur_s->descriptors;
-		while (cur_d) {
-			struct ca_pmt_descriptor *next_d = cur_d->next;
-			free(cur_d);
-			cur_d = next_d;
-		}
-
-		free(cur_s);
-		cur_s = next_s;
-	}
-	return -1;
 }
 
 static void en50221_ca_try_move_pmt_descriptors(struct ca_pmt_descriptor **pmt_descriptors,
@@ -481,15 +438,9 @@ static void en50221_ca_try_move_pmt_descriptors(struct ca_pmt_descriptor **pmt_d
 	first_stream->descriptors = NULL;
 	first_stream->descriptors_count = 0;
 
-	// now free up all the descriptors in the other streams
+	// now drop all the descriptors in the other streams
 	cur_stream = first_stream->next;
 	while (cur_stream) {
-		struct ca_pmt_descriptor *cur_descriptor = cur_stream->descriptors;
-		while (cur_descriptor) {
-			struct ca_pmt_descriptor *next = cur_descriptor->next;
-			free(cur_descriptor);
-			cur_descriptor = next;
-		}
 		cur_stream->descriptors = NULL;
 		cur_stream->descriptors_count = 0;
 		cur_stream = cur_stream->next;
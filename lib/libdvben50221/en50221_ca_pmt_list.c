@@ -0,0 +1,313 @@
+/*
+    en50221 encoder An implementation for libdvb
+    CA PMT list management for descrambling several programs on one CAM
+
+    This library is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation; either version 2.1 of
+    the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+*/
+
+#include <string.h>
+#include <pthread.h>
+#include <libdvbmisc/dvbmisc.h>
+#include "en50221_ca_pmt_list.h"
+
+// largest CA PMT we will format
+#define CA_PMT_MAX_SIZE 4096
+
+struct en50221_ca_pmt_program {
+	uint16_t program_number;
+
+	/* the CA PMT for the latest PMT version, formatted once */
+	int version;			/* version_number | current_next << 5 */
+	uint8_t *ca_pmt;
+	uint32_t ca_pmt_length;
+
+	int on_cam;			/* the CAM has this program in its list */
+	int sent;			/* ... and has the current ca_pmt */
+
+	struct en50221_ca_pmt_program *next;
+};
+
+struct en50221_ca_pmt_list {
+	struct en50221_app_ca *ca;
+	int move_ca_descriptors;
+	uint8_t ca_pmt_cmd_id;
+
+	int session_number;
+	int on_cam_count;
+
+	/* in the order they were added */
+	struct en50221_ca_pmt_program *programs;
+	struct en50221_ca_pmt_program *programs_tail;
+	int count;
+
+	pthread_mutex_t lock;
+};
+
+
+struct en50221_ca_pmt_list *en50221_ca_pmt_list_create(struct en50221_app_ca *ca,
+						       int move_ca_descriptors,
+						       uint8_t ca_pmt_cmd_id)
+{
+	struct en50221_ca_pmt_list *list = NULL;
+
+	// create structure and set it up
+	list = malloc(sizeof(struct en50221_ca_pmt_list));
+	if (list == NULL) {
+		return NULL;
+	}
+	memset(list, 0, sizeof(struct en50221_ca_pmt_list));
+	list->ca = ca;
+	list->move_ca_descriptors = move_ca_descriptors;
+	list->ca_pmt_cmd_id = ca_pmt_cmd_id;
+	list->session_number = -1;
+
+	pthread_mutex_init(&list->lock, NULL);
+
+	// done
+	return list;
+}
+
+void en50221_ca_pmt_list_destroy(struct en50221_ca_pmt_list *list)
+{
+	struct en50221_ca_pmt_program *program;
+
+	while (list->programs) {
+		program = list->programs;
+		list->programs = program->next;
+		free(program->ca_pmt);
+		free(program);
+	}
+
+	pthread_mutex_destroy(&list->lock);
+	free(list);
+}
+
+/**
+ * Send a program's cached CA PMT with the given list management. Must be
+ * called with the list lock held.
+ */
+static int en50221_ca_pmt_list_send(struct en50221_ca_pmt_list *list,
+				    struct en50221_ca_pmt_program *program,
+				    uint8_t ca_pmt_list_management)
+{
+	program->ca_pmt[0] = ca_pmt_list_management;
+	if (en50221_app_ca_pmt(list->ca, list->session_number,
+			       program->ca_pmt, program->ca_pmt_length)) {
+		print(LOG_LEVEL, ERROR, 1, "Failed to send CA PMT for program %i\n",
+		      program->program_number);
+		program->sent = 0;
+		return -1;
+	}
+
+	if (!program->on_cam)
+		list->on_cam_count++;
+	program->on_cam = 1;
+	program->sent = 1;
+
+	return 0;
+}
+
+/**
+ * Replace the command ids in a formatted CA PMT, both the program's and
+ * those of its streams.
+ */
+static void en50221_ca_pmt_list_set_cmd_id(uint8_t *ca_pmt, uint32_t ca_pmt_length,
+					   uint8_t ca_pmt_cmd_id)
+{
+	uint32_t info_length;
+	uint32_t pos;
+
+	info_length = ((ca_pmt[4] & 0x0f) << 8) | ca_pmt[5];
+	if (info_length)
+		ca_pmt[6] = ca_pmt_cmd_id;
+
+	for (pos = 6 + info_length; pos + 5 <= ca_pmt_length; pos += 5 + info_length) {
+		info_length = ((ca_pmt[pos + 3] & 0x0f) << 8) | ca_pmt[pos + 4];
+		if (info_length)
+			ca_pmt[pos + 5] = ca_pmt_cmd_id;
+	}
+}
+
+int en50221_ca_pmt_list_set_session(struct en50221_ca_pmt_list *list,
+				    int session_number)
+{
+	struct en50221_ca_pmt_program *program;
+	int result = 0;
+
+	// a new session knows nothing, even if it reuses the old one's number
+	pthread_mutex_lock(&list->lock);
+	list->session_number = session_number;
+	list->on_cam_count = 0;
+	for (program = list->programs; program; program = program->next) {
+		program->on_cam = 0;
+		program->sent = 0;
+	}
+	if (session_number == -1) {
+		pthread_mutex_unlock(&list->lock);
+		return 0;
+	}
+
+	// so it gets the lot in one go
+	for (program = list->programs; program; program = program->next) {
+		uint8_t ca_pmt_list_management = CA_LIST_MANAGEMENT_MORE;
+
+		if (list->count == 1)
+			ca_pmt_list_management = CA_LIST_MANAGEMENT_ONLY;
+		else if (program == list->programs)
+			ca_pmt_list_management = CA_LIST_MANAGEMENT_FIRST;
+		else if (program->next == NULL)
+			ca_pmt_list_management = CA_LIST_MANAGEMENT_LAST;
+
+		if (en50221_ca_pmt_list_send(list, program, ca_pmt_list_management))
+			result = -1;
+	}
+	pthread_mutex_unlock(&list->lock);
+
+	return result;
+}
+
+int en50221_ca_pmt_list_set(struct en50221_ca_pmt_list *list,
+			    struct mpeg_pmt_section *pmt)
+{
+	struct en50221_ca_pmt_program *program;
+	uint16_t program_number = mpeg_pmt_section_program_number(pmt);
+	int version = pmt->head.version_number | (pmt->head.current_next_indicator << 5);
+	uint8_t buf[CA_PMT_MAX_SIZE];
+	uint8_t *tmp;
+	int size;
+	int result = 0;
+
+	pthread_mutex_lock(&list->lock);
+	for (program = list->programs; program; program = program->next) {
+		if (program->program_number == program_number)
+			break;
+	}
+
+	// nothing to do if we have seen this version
+	if (program && (program->version == version)) {
+		if ((list->session_number != -1) && !program->sent)
+			goto send;
+		pthread_mutex_unlock(&list->lock);
+		return 0;
+	}
+
+	// format the CA PMT for this version
+	if ((size = en50221_ca_format_pmt(pmt, buf, sizeof(buf), list->move_ca_descriptors,
+					  CA_LIST_MANAGEMENT_ONLY, list->ca_pmt_cmd_id)) < 0) {
+		print(LOG_LEVEL, ERROR, 1, "Failed to format CA PMT for program %i\n",
+		      program_number);
+		pthread_mutex_unlock(&list->lock);
+		return -1;
+	}
+
+	if (program) {
+		if ((tmp = realloc(program->ca_pmt, size)) == NULL) {
+			// leave the old version in place
+			pthread_mutex_unlock(&list->lock);
+			return -1;
+		}
+	} else {
+		program = malloc(sizeof(struct en50221_ca_pmt_program));
+		tmp = malloc(size);
+		if ((program == NULL) || (tmp == NULL)) {
+			free(program);
+			free(tmp);
+			pthread_mutex_unlock(&list->lock);
+			return -1;
+		}
+		memset(program, 0, sizeof(struct en50221_ca_pmt_program));
+		program->program_number = program_number;
+
+		if (list->programs_tail)
+			list->programs_tail->next = program;
+		else
+			list->programs = program;
+		list->programs_tail = program;
+		list->count++;
+	}
+	memcpy(tmp, buf, size);
+	program->ca_pmt = tmp;
+	program->ca_pmt_length = size;
+	program->version = version;
+	program->sent = 0;
+
+	if (list->session_number == -1) {
+		pthread_mutex_unlock(&list->lock);
+		return 0;
+	}
+
+send:
+	if (program->on_cam)
+		result = en50221_ca_pmt_list_send(list, program, CA_LIST_MANAGEMENT_UPDATE);
+	else if (list->on_cam_count == 0)
+		result = en50221_ca_pmt_list_send(list, program, CA_LIST_MANAGEMENT_ONLY);
+	else
+		result = en50221_ca_pmt_list_send(list, program, CA_LIST_MANAGEMENT_ADD);
+	pthread_mutex_unlock(&list->lock);
+
+	return result;
+}
+
+int en50221_ca_pmt_list_remove(struct en50221_ca_pmt_list *list,
+			       uint16_t program_number)
+{
+	struct en50221_ca_pmt_program *program;
+	struct en50221_ca_pmt_program *prev = NULL;
+	int result = 0;
+
+	pthread_mutex_lock(&list->lock);
+	for (program = list->programs; program; program = program->next) {
+		if (program->program_number == program_number)
+			break;
+		prev = program;
+	}
+	if (program == NULL) {
+		pthread_mutex_unlock(&list->lock);
+		return -1;
+	}
+
+	// unlink it
+	if (prev)
+		prev->next = program->next;
+	else
+		list->programs = program->next;
+	if (list->programs_tail == program)
+		list->programs_tail = prev;
+	list->count--;
+
+	// tell the CAM to stop descrambling it
+	if (program->on_cam && (list->session_number != -1)) {
+		en50221_ca_pmt_list_set_cmd_id(program->ca_pmt, program->ca_pmt_length,
+					       CA_PMT_CMD_ID_NOT_SELECTED);
+		result = en50221_ca_pmt_list_send(list, program, CA_LIST_MANAGEMENT_UPDATE);
+		list->on_cam_count--;
+	}
+	pthread_mutex_unlock(&list->lock);
+
+	free(program->ca_pmt);
+	free(program);
+	return result;
+}
+
+int en50221_ca_pmt_list_count(struct en50221_ca_pmt_list *list)
+{
+	int count;
+
+	pthread_mutex_lock(&list->lock);
+	count = list->count;
+	pthread_mutex_unlock(&list->lock);
+
+	return count;
+}
@@ -0,0 +1,122 @@
+/*
+    en50221 encoder An implementation for libdvb
+    CA PMT list management for descrambling several programs on one CAM
+
+    This library is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation; either version 2.1 of
+    the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+*/
+
+#ifndef __EN50221_CA_PMT_LIST_H__
+#define __EN50221_CA_PMT_LIST_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <libdvben50221/en50221_app_ca.h>
+#include <libucsi/mpeg/pmt_section.h>
+
+/**
+ * A CA PMT list keeps the set of programs a CAM should descramble, for one
+ * slot's CA session, and sends the CAM only what changes:
+ *
+ *  - a program added to the list is sent with CA_LIST_MANAGEMENT_ADD (or
+ *    CA_LIST_MANAGEMENT_ONLY if the CAM has nothing else)
+ *  - a program whose PMT version changes is sent with
+ *    CA_LIST_MANAGEMENT_UPDATE
+ *  - a program removed from the list is sent with CA_LIST_MANAGEMENT_UPDATE
+ *    and CA_PMT_CMD_ID_NOT_SELECTED, so the other programs carry on
+ *    undisturbed
+ *  - when a new CA session is established, the whole list is sent with
+ *    CA_LIST_MANAGEMENT_FIRST/MORE/LAST (or ONLY)
+ *
+ * Each program's CA PMT is formatted once per PMT version and kept, so
+ * passing in a PMT whose version has not changed costs a lookup and sends
+ * nothing.
+ */
+
+/**
+ * Opaque type representing a CA PMT list.
+ */
+struct en50221_ca_pmt_list;
+
+/**
+ * Create a CA PMT list.
+ *
+ * @param ca CA resource to send the CA PMTs with.
+ * @param move_ca_descriptors Passed to en50221_ca_format_pmt().
+ * @param ca_pmt_cmd_id One of the CA_PMT_CMD_ID_* to send programs with,
+ * usually CA_PMT_CMD_ID_OK_DESCRAMBLING.
+ * @return The list, or NULL on failure.
+ */
+extern struct en50221_ca_pmt_list *en50221_ca_pmt_list_create(struct en50221_app_ca *ca,
+							      int move_ca_descriptors,
+							      uint8_t ca_pmt_cmd_id);
+
+/**
+ * Destroy a CA PMT list. Nothing is sent to the CAM.
+ *
+ * @param list The list.
+ */
+extern void en50221_ca_pmt_list_destroy(struct en50221_ca_pmt_list *list);
+
+/**
+ * Set the CA session the list is sent on. Call this whenever a CA session is
+ * established: the CAM is assumed to know none of the programs, so the whole
+ * list is sent to it.
+ *
+ * @param list The list.
+ * @param session_number The session number, or -1 if there is no CA session
+ * (for instance because the CAM was removed).
+ * @return 0 on success, -1 if sending failed.
+ */
+extern int en50221_ca_pmt_list_set_session(struct en50221_ca_pmt_list *list,
+					   int session_number);
+
+/**
+ * Add a program to the list, or update it if it is already there. The PMT
+ * is only formatted and sent if its version differs from the one last
+ * given for this program.
+ *
+ * @param list The list.
+ * @param pmt The program's PMT.
+ * @return 0 on success, -1 on failure.
+ */
+extern int en50221_ca_pmt_list_set(struct en50221_ca_pmt_list *list,
+				   struct mpeg_pmt_section *pmt);
+
+/**
+ * Remove a program from the list.
+ *
+ * @param list The list.
+ * @param program_number The program.
+ * @return 0 on success, -1 if sending failed or the program was not in the list.
+ */
+extern int en50221_ca_pmt_list_remove(struct en50221_ca_pmt_list *list,
+				      uint16_t program_number);
+
+/**
+ * Get the number of programs in the list.
+ *
+ * @param list The list.
+ * @return The number of programs.
+ */
+extern int en50221_ca_pmt_list_count(struct en50221_ca_pmt_list *list);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
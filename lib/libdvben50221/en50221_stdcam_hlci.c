@@ -197,9 +197,9 @@ static int hlci_send_datav(void *arg, uint16_t session_number,
 		data_size += vector[i].iov_len;
 	}
 
-	// allocate memory for it
-	uint8_t *buf = malloc(data_size);
-	if (buf == NULL) {
+	// an HLCI message holds at most 256 bytes anyway
+	uint8_t buf[256];
+	if (data_size > sizeof(buf)) {
 		return -1;
 	}
 	// merge the iovecs
@@ -209,8 +209,6 @@ static int hlci_send_datav(void *arg, uint16_t session_number,
 		pos += vector[i].iov_len;
 	}
 
-	// sendit and cleanup
-	int status = dvbca_hlci_write(hlci->cafd, buf, data_size);
-	free(buf);
-	return status;
+	// sendit
+	return dvbca_hlci_write(hlci->cafd, buf, data_size);
 }
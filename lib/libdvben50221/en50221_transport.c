@@ -23,11 +23,13 @@
 
 #include <stdio.h>
 #include <unistd.h>
+#include <errno.h>
 #include <string.h>
 #include <pthread.h>
 #include <fcntl.h>
 #include <sys/ioctl.h>
 #include <sys/poll.h>
+#include <sys/eventfd.h>
 #include <time.h>
 #include <libdvbmisc/dvbmisc.h>
 #include <libdvbapi/dvbca.h>
@@ -51,18 +53,28 @@
 #define T_DATA_MORE         0xA1	// convey data from higher      constructed h<->m
 				 // layers
 
+// messages are taken from a per-slot pool, so queueing one does not normally
+// touch the heap; only those too big for a pool buffer are malloced
+#define POOL_MESSAGES 16
+#define POOL_MESSAGE_SIZE 1024
+
 struct en50221_message {
 	struct en50221_message *next;
 	uint32_t length;
+	int pooled;
 	uint8_t data[0];
 };
 
+#define POOL_MESSAGE_STRIDE \
+	((sizeof(struct en50221_message) + POOL_MESSAGE_SIZE + 7) & ~7)
+
 struct en50221_connection {
 	uint32_t state;		// the current state: idle/in_delete/in_create/active
 	struct timeval tx_time;	// time last request was sent from host->module, or 0 if ok
 	struct timeval last_poll_time;	// time of last poll transmission
-	uint8_t *chain_buffer;	// used to save parts of chained packets
+	uint8_t *chain_buffer;	// used to save parts of chained packets - kept between chains
 	uint32_t buffer_length;
+	uint32_t buffer_size;
 
 	struct en50221_message *send_queue;
 	struct en50221_message *send_queue_tail;
@@ -73,22 +85,33 @@ struct en50221_slot {
 	uint8_t slot;		// CAM slot
 	struct en50221_connection *connections;
 
+	uint8_t *pool;
+	struct en50221_message *free_messages;
+
 	pthread_mutex_t slot_lock;
 
 	uint32_t response_timeout;
 	uint32_t poll_delay;
+
+	uint64_t deadline;	// event driven mode: when the slot next needs attention (ms), under event_lock
 };
 
 struct en50221_transport_layer {
 	uint8_t max_slots;
 	uint8_t max_connections_per_slot;
 	struct en50221_slot *slots;
-	struct pollfd *slot_pollfds;
+	struct pollfd *slot_pollfds;	// one per slot, then the wakeup_fd
 	int slots_changed;
 
 	pthread_mutex_t global_lock;
 	pthread_mutex_t setcallback_lock;
 
+	pthread_mutex_t event_lock;	// protects the fields below and the slot deadlines
+	int event_driven;
+	int max_wait;		// longest sleep in event driven mode (ms), or -1
+	int wakeup_fd;		// eventfd written when there is work for en50221_tl_poll()
+	int wakeup_pending;
+
 	int error;
 	int error_slot;
 
@@ -101,8 +124,17 @@ static int en50221_tl_process_data(struct en50221_transport_layer *tl,
 				   uint32_t data_length);
 static int en50221_tl_poll_tc(struct en50221_transport_layer *tl,
 			      uint8_t slot_id, uint8_t connection_id);
+static int en50221_tl_poll_slot(struct en50221_transport_layer *tl,
+				uint8_t slot_id, uint8_t *data, uint32_t data_size);
 static int en50221_tl_alloc_new_tc(struct en50221_transport_layer *tl,
 				   uint8_t slot_id);
+static void en50221_tl_kick(struct en50221_transport_layer *tl, int slot_id);
+static struct en50221_message *alloc_message(struct en50221_transport_layer *tl,
+					     uint8_t slot_id, uint32_t data_size);
+static void free_message(struct en50221_transport_layer *tl, uint8_t slot_id,
+			 struct en50221_message *msg);
+static int append_chain(struct en50221_connection *connection,
+			uint8_t *data, uint32_t data_length);
 static void queue_message(struct en50221_transport_layer *tl,
 			  uint8_t slot_id, uint8_t connection_id,
 			  struct en50221_message *msg);
@@ -155,17 +187,26 @@ struct en50221_transport_layer *en50221_tl_create(uint8_t max_slots,
 	tl->callback_arg = NULL;
 	tl->error_slot = 0;
 	tl->error = 0;
+	tl->event_driven = 0;
+	tl->max_wait = -1;
+	tl->wakeup_fd = -1;
+	tl->wakeup_pending = 0;
 	pthread_mutex_init(&tl->global_lock, NULL);
 	pthread_mutex_init(&tl->setcallback_lock, NULL);
+	pthread_mutex_init(&tl->event_lock, NULL);
 
 	// create the slots
 	tl->slots = malloc(sizeof(struct en50221_slot) * max_slots);
 	if (tl->slots == NULL)
 		goto error_exit;
+	memset(tl->slots, 0, sizeof(struct en50221_slot) * max_slots);
 
 	// set them up
 	for (i = 0; i < max_slots; i++) {
 		tl->slots[i].ca_hndl = -1;
+		tl->slots[i].deadline = UINT64_MAX;
+		tl->slots[i].pool = NULL;
+		tl->slots[i].free_messages = NULL;
 
 		// create the connections for this slot
 		tl->slots[i].connections =
@@ -184,17 +225,30 @@ struct en50221_transport_layer *en50221_tl_create(uint8_t max_slots,
 			tl->slots[i].connections[j].last_poll_time.tv_usec = 0;
 			tl->slots[i].connections[j].chain_buffer = NULL;
 			tl->slots[i].connections[j].buffer_length = 0;
+			tl->slots[i].connections[j].buffer_size = 0;
 			tl->slots[i].connections[j].send_queue = NULL;
 			tl->slots[i].connections[j].send_queue_tail = NULL;
 		}
+
+		// and its message pool
+		tl->slots[i].pool = malloc(POOL_MESSAGES * POOL_MESSAGE_STRIDE);
+		if (tl->slots[i].pool == NULL)
+			goto error_exit;
+		for (j = 0; j < POOL_MESSAGES; j++) {
+			struct en50221_message *msg = (struct en50221_message *)
+				(tl->slots[i].pool + (j * POOL_MESSAGE_STRIDE));
+			msg->pooled = 1;
+			msg->next = tl->slots[i].free_messages;
+			tl->slots[i].free_messages = msg;
+		}
 	}
 
 	// create the pollfds
-	tl->slot_pollfds = malloc(sizeof(struct pollfd) * max_slots);
+	tl->slot_pollfds = malloc(sizeof(struct pollfd) * (max_slots + 1));
 	if (tl->slot_pollfds == NULL) {
 		goto error_exit;
 	}
-	memset(tl->slot_pollfds, 0, sizeof(struct pollfd) * max_slots);
+	memset(tl->slot_pollfds, 0, sizeof(struct pollfd) * (max_slots + 1));
 
 	return tl;
 
@@ -221,7 +275,8 @@ void en50221_tl_destroy(struct en50221_transport_layer *tl)
 							tl->slots[i].connections[j].send_queue;
 						while (cur_msg) {
 							struct en50221_message *next_msg = cur_msg->next;
-							free(cur_msg);
+							if (!cur_msg->pooled)
+								free(cur_msg);
 							cur_msg = next_msg;
 						}
 						tl->slots[i].connections[j].send_queue = NULL;
@@ -230,12 +285,19 @@ void en50221_tl_destroy(struct en50221_transport_layer *tl)
 					free(tl->slots[i].connections);
 					pthread_mutex_destroy(&tl->slots[i].slot_lock);
 				}
+				if (tl->slots[i].pool) {
+					free(tl->slots[i].pool);
+				}
 			}
 			free(tl->slots);
 		}
 		if (tl->slot_pollfds) {
 			free(tl->slot_pollfds);
 		}
+		if (tl->wakeup_fd != -1) {
+			close(tl->wakeup_fd);
+		}
+		pthread_mutex_destroy(&tl->event_lock);
 		pthread_mutex_destroy(&tl->setcallback_lock);
 		pthread_mutex_destroy(&tl->global_lock);
 		free(tl);
@@ -277,6 +339,9 @@ int en50221_tl_register_slot(struct en50221_transport_layer *tl,
 
 	tl->slots_changed = 1;
 	pthread_mutex_unlock(&tl->global_lock);
+
+	// get en50221_tl_poll() to pick up the new fd
+	en50221_tl_kick(tl, slot_id);
 	return slot_id;
 }
 
@@ -305,12 +370,13 @@ void en50221_tl_destroy_slot(struct en50221_transport_layer *tl,
 		}
 		tl->slots[slot_id].connections[i].chain_buffer = NULL;
 		tl->slots[slot_id].connections[i].buffer_length = 0;
+		tl->slots[slot_id].connections[i].buffer_size = 0;
 
 		struct en50221_message *cur_msg =
 		    tl->slots[slot_id].connections[i].send_queue;
 		while (cur_msg) {
 			struct en50221_message *next_msg = cur_msg->next;
-			free(cur_msg);
+			free_message(tl, slot_id, cur_msg);
 			cur_msg = next_msg;
 		}
 		tl->slots[slot_id].connections[i].send_queue = NULL;
@@ -328,13 +394,128 @@ void en50221_tl_destroy_slot(struct en50221_transport_layer *tl,
 
 	tl->slots_changed = 1;
 	pthread_mutex_unlock(&tl->global_lock);
+
+	// stop polling the old fd
+	en50221_tl_kick(tl, -1);
+}
+
+int en50221_tl_set_event_driven(struct en50221_transport_layer *tl,
+				int enable, int max_wait)
+{
+	int i;
+
+	pthread_mutex_lock(&tl->event_lock);
+	if (enable && (tl->wakeup_fd == -1)) {
+		if ((tl->wakeup_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) < 0) {
+			tl->wakeup_fd = -1;
+			tl->error_slot = -1;
+			tl->error = EN50221ERR_OUTOFMEMORY;
+			pthread_mutex_unlock(&tl->event_lock);
+			return -1;
+		}
+		tl->slot_pollfds[tl->max_slots].fd = tl->wakeup_fd;
+		tl->slot_pollfds[tl->max_slots].events = POLLIN;
+	}
+	tl->event_driven = enable;
+	tl->max_wait = max_wait;
+
+	// the deadlines are not kept up to date otherwise, so look at every slot once
+	for (i = 0; i < tl->max_slots; i++)
+		tl->slots[i].deadline = 0;
+	pthread_mutex_unlock(&tl->event_lock);
+
+	// in case another thread is already sleeping in en50221_tl_poll()
+	en50221_tl_kick(tl, -1);
+	return 0;
+}
+
+void en50221_tl_wakeup(struct en50221_transport_layer *tl)
+{
+	en50221_tl_kick(tl, -1);
+}
+
+static uint64_t timeval_ms(struct timeval tv)
+{
+	return (tv.tv_sec * 1000ULL) + (tv.tv_usec / 1000);
+}
+
+static uint64_t now_ms(void)
+{
+	struct timeval now;
+
+	gettimeofday(&now, 0);
+	return timeval_ms(now);
+}
+
+// work out how long en50221_tl_poll() may sleep for: must be called with event_lock held
+static int en50221_tl_next_timeout(struct en50221_transport_layer *tl)
+{
+	uint64_t deadline = UINT64_MAX;
+	uint64_t now;
+	int slot_id;
+
+	for (slot_id = 0; slot_id < tl->max_slots; slot_id++) {
+		if (tl->slots[slot_id].deadline < deadline)
+			deadline = tl->slots[slot_id].deadline;
+	}
+	if (deadline == UINT64_MAX)
+		return tl->max_wait;
+
+	now = now_ms();
+	if (deadline <= now)
+		return 0;
+	if ((tl->max_wait >= 0) && ((deadline - now) > (uint64_t) tl->max_wait))
+		return tl->max_wait;
+	return deadline - now;
+}
+
+// when a slot next needs to be looked at if the module stays quiet - must be
+// called with the slot_lock held. This mirrors the checks in en50221_tl_poll_slot().
+static uint64_t en50221_tl_slot_deadline(struct en50221_transport_layer *tl,
+					 uint8_t slot_id)
+{
+	struct en50221_slot *slot = &tl->slots[slot_id];
+	uint64_t deadline = UINT64_MAX;
+	uint64_t next;
+	int j;
+
+	if (slot->ca_hndl == -1)
+		return UINT64_MAX;
+
+	for (j = 0; j < tl->max_connections_per_slot; j++) {
+		struct en50221_connection *conn = &slot->connections[j];
+
+		if (conn->state == T_STATE_IDLE)
+			continue;
+
+		if (conn->tx_time.tv_sec) {
+			// waiting for a response: the timeout
+			next = timeval_ms(conn->tx_time) + slot->response_timeout + 1;
+		} else if (conn->send_queue &&
+			   (conn->state & (T_STATE_IN_CREATION | T_STATE_ACTIVE | T_STATE_ACTIVE_DELETEQUEUED))) {
+			// something to send right now
+			return 0;
+		} else if (conn->state & T_STATE_ACTIVE) {
+			// the next poll of the module
+			next = timeval_ms(conn->last_poll_time) + slot->poll_delay + 1;
+		} else {
+			continue;
+		}
+
+		if (next < deadline)
+			deadline = next;
+	}
+
+	return deadline;
 }
 
 int en50221_tl_poll(struct en50221_transport_layer *tl)
 {
 	uint8_t data[4096];
 	int slot_id;
-	int j;
+	int nfds = tl->max_slots;
+	int timeout = 10;
+	uint64_t now = 0;
 
 	// make up pollfds if the slots have changed
 	pthread_mutex_lock(&tl->global_lock);
@@ -345,7 +526,7 @@ int en50221_tl_poll(struct en50221_transport_layer *tl)
 				tl->slot_pollfds[slot_id].events = POLLIN | POLLPRI | POLLERR;
 				tl->slot_pollfds[slot_id].revents = 0;
 			} else {
-				tl->slot_pollfds[slot_id].fd = 0;
+				tl->slot_pollfds[slot_id].fd = -1;
 				tl->slot_pollfds[slot_id].events = 0;
 				tl->slot_pollfds[slot_id].revents = 0;
 			}
@@ -354,157 +535,217 @@ int en50221_tl_poll(struct en50221_transport_layer *tl)
 	}
 	pthread_mutex_unlock(&tl->global_lock);
 
+	// in event driven mode we sleep until the next deadline, or until we are
+	// woken up because someone queued a message, instead of for a fixed time
+	pthread_mutex_lock(&tl->event_lock);
+	if (tl->event_driven) {
+		nfds++;
+		timeout = en50221_tl_next_timeout(tl);
+	}
+	pthread_mutex_unlock(&tl->event_lock);
+
 	// anything happened?
-	if (poll(tl->slot_pollfds, tl->max_slots, 10) < 0) {
+	if (poll(tl->slot_pollfds, nfds, timeout) < 0) {
+		if (errno == EINTR)
+			return 0;
 		tl->error_slot = -1;
 		tl->error = EN50221ERR_CAREAD;
 		return -1;
 	}
-	// go through all slots (even though poll may not have reported any events
+
+	if (nfds > tl->max_slots) {
+		if (tl->slot_pollfds[tl->max_slots].revents & POLLIN) {
+			uint64_t count;
+
+			pthread_mutex_lock(&tl->event_lock);
+			if (read(tl->wakeup_fd, &count, sizeof(count)) < 0) {
+				// nothing there: someone else got it
+			}
+			tl->wakeup_pending = 0;
+			pthread_mutex_unlock(&tl->event_lock);
+		}
+		now = now_ms();
+	}
+
 	for (slot_id = 0; slot_id < tl->max_slots; slot_id++) {
+		// in event driven mode, only visit the slots which need it
+		if ((nfds > tl->max_slots) &&
+		    !(tl->slot_pollfds[slot_id].revents & (POLLPRI | POLLIN | POLLERR))) {
+			pthread_mutex_lock(&tl->event_lock);
+			int due = tl->slots[slot_id].deadline <= now;
+			pthread_mutex_unlock(&tl->event_lock);
+			if (!due)
+				continue;
+		}
+
+		if (en50221_tl_poll_slot(tl, slot_id, data, sizeof(data)))
+			return -1;
+	}
+
+	return 0;
+}
+
+static int en50221_tl_poll_slot(struct en50221_transport_layer *tl,
+				uint8_t slot_id, uint8_t *data, uint32_t data_size)
+{
+	int j;
+
+	// check if this slot is still used and get its handle
+	pthread_mutex_lock(&tl->slots[slot_id].slot_lock);
+	if (tl->slots[slot_id].ca_hndl == -1) {
+		pthread_mutex_lock(&tl->event_lock);
+		tl->slots[slot_id].deadline = UINT64_MAX;
+		pthread_mutex_unlock(&tl->event_lock);
+		pthread_mutex_unlock(&tl->slots[slot_id].slot_lock);
+		return 0;
+	}
+	int ca_hndl = tl->slots[slot_id].ca_hndl;
 
-		// check if this slot is still used and get its handle
-		pthread_mutex_lock(&tl->slots[slot_id].slot_lock);
-		if (tl->slots[slot_id].ca_hndl == -1) {
+	if (tl->slot_pollfds[slot_id].revents & (POLLPRI | POLLIN)) {
+		// read data
+		uint8_t r_slot_id;
+		uint8_t connection_id;
+		int readcnt = dvbca_link_read(ca_hndl, &r_slot_id,
+					      &connection_id,
+					      data, data_size);
+		if (readcnt < 0) {
+			tl->error_slot = slot_id;
+			tl->error = EN50221ERR_CAREAD;
 			pthread_mutex_unlock(&tl->slots[slot_id].slot_lock);
-			continue;
+			return -1;
 		}
-		int ca_hndl = tl->slots[slot_id].ca_hndl;
-
-		if (tl->slot_pollfds[slot_id].revents & (POLLPRI | POLLIN)) {
-			// read data
-			uint8_t r_slot_id;
-			uint8_t connection_id;
-			int readcnt = dvbca_link_read(ca_hndl, &r_slot_id,
-						      &connection_id,
-						      data, sizeof(data));
-			if (readcnt < 0) {
-				tl->error_slot = slot_id;
-				tl->error = EN50221ERR_CAREAD;
-				pthread_mutex_unlock(&tl->slots[slot_id].slot_lock);
-				return -1;
-			}
-			// process it if we got some
-			if (readcnt > 0) {
-				if (tl->slots[slot_id].slot != r_slot_id) {
-					// this message is for an other CAM of the same CA
-					int new_slot_id;
-					for (new_slot_id = 0; new_slot_id < tl->max_slots; new_slot_id++) {
-						if ((tl->slots[new_slot_id].ca_hndl == ca_hndl) &&
-						    (tl->slots[new_slot_id].slot == r_slot_id))
-							break;
-					}
-					if (new_slot_id != tl->max_slots) {
-						// we found the requested CAM
-						pthread_mutex_lock(&tl->slots[new_slot_id].slot_lock);
-						if (en50221_tl_process_data(tl, new_slot_id, data, readcnt)) {
-							pthread_mutex_unlock(&tl->slots[new_slot_id].slot_lock);
-							pthread_mutex_unlock(&tl->slots[slot_id].slot_lock);
-							return -1;
-						}
+		// process it if we got some
+		if (readcnt > 0) {
+			if (tl->slots[slot_id].slot != r_slot_id) {
+				// this message is for an other CAM of the same CA
+				int new_slot_id;
+				for (new_slot_id = 0; new_slot_id < tl->max_slots; new_slot_id++) {
+					if ((tl->slots[new_slot_id].ca_hndl == ca_hndl) &&
+					    (tl->slots[new_slot_id].slot == r_slot_id))
+						break;
+				}
+				if (new_slot_id != tl->max_slots) {
+					// we found the requested CAM
+					pthread_mutex_lock(&tl->slots[new_slot_id].slot_lock);
+					if (en50221_tl_process_data(tl, new_slot_id, data, readcnt)) {
 						pthread_mutex_unlock(&tl->slots[new_slot_id].slot_lock);
-					} else {
-						tl->error = EN50221ERR_BADSLOTID;
 						pthread_mutex_unlock(&tl->slots[slot_id].slot_lock);
 						return -1;
 					}
-				} else
-				    if (en50221_tl_process_data(tl, slot_id, data, readcnt)) {
+					pthread_mutex_unlock(&tl->slots[new_slot_id].slot_lock);
+
+					// its timers will have changed
+					pthread_mutex_lock(&tl->event_lock);
+					tl->slots[new_slot_id].deadline = 0;
+					pthread_mutex_unlock(&tl->event_lock);
+				} else {
+					tl->error = EN50221ERR_BADSLOTID;
 					pthread_mutex_unlock(&tl->slots[slot_id].slot_lock);
 					return -1;
 				}
+			} else
+			    if (en50221_tl_process_data(tl, slot_id, data, readcnt)) {
+				pthread_mutex_unlock(&tl->slots[slot_id].slot_lock);
+				return -1;
 			}
-		} else if (tl->slot_pollfds[slot_id].revents & POLLERR) {
-			// an error was reported
-			tl->error_slot = slot_id;
-			tl->error = EN50221ERR_CAREAD;
-			pthread_mutex_unlock(&tl->slots[slot_id].slot_lock);
-			return -1;
 		}
-		// poll the connections on this slot + check for timeouts
-		for (j = 0; j < tl->max_connections_per_slot; j++) {
-			// ignore connection if idle
-			if (tl->slots[slot_id].connections[j].state == T_STATE_IDLE) {
-				continue;
-			}
-			// send queued data
-			if (tl->slots[slot_id].connections[j].state &
-				(T_STATE_IN_CREATION | T_STATE_ACTIVE | T_STATE_ACTIVE_DELETEQUEUED)) {
-				// send data if there is some to go and we're not waiting for a response already
-				if (tl->slots[slot_id].connections[j].send_queue &&
-				    (tl->slots[slot_id].connections[j].tx_time.tv_sec == 0)) {
-
-					// get the message
-					struct en50221_message *msg =
-						tl->slots[slot_id].connections[j].send_queue;
-					if (msg->next != NULL) {
-						tl->slots[slot_id].connections[j].send_queue = msg->next;
-					} else {
-						tl->slots[slot_id].connections[j].send_queue = NULL;
-						tl->slots[slot_id].connections[j].send_queue_tail = NULL;
-					}
+	} else if (tl->slot_pollfds[slot_id].revents & POLLERR) {
+		// an error was reported
+		tl->error_slot = slot_id;
+		tl->error = EN50221ERR_CAREAD;
+		pthread_mutex_unlock(&tl->slots[slot_id].slot_lock);
+		return -1;
+	}
+	// poll the connections on this slot + check for timeouts
+	for (j = 0; j < tl->max_connections_per_slot; j++) {
+		// ignore connection if idle
+		if (tl->slots[slot_id].connections[j].state == T_STATE_IDLE) {
+			continue;
+		}
+		// send queued data
+		if (tl->slots[slot_id].connections[j].state &
+			(T_STATE_IN_CREATION | T_STATE_ACTIVE | T_STATE_ACTIVE_DELETEQUEUED)) {
+			// send data if there is some to go and we're not waiting for a response already
+			if (tl->slots[slot_id].connections[j].send_queue &&
+			    (tl->slots[slot_id].connections[j].tx_time.tv_sec == 0)) {
+
+				// get the message
+				struct en50221_message *msg =
+					tl->slots[slot_id].connections[j].send_queue;
+				if (msg->next != NULL) {
+					tl->slots[slot_id].connections[j].send_queue = msg->next;
+				} else {
+					tl->slots[slot_id].connections[j].send_queue = NULL;
+					tl->slots[slot_id].connections[j].send_queue_tail = NULL;
+				}
 
-					// send the message
-					if (dvbca_link_write(tl->slots[slot_id].ca_hndl,
-					    		     tl->slots[slot_id].slot,
-							     j,
-							     msg->data, msg->length) < 0) {
-						free(msg);
-						pthread_mutex_unlock(&tl->slots[slot_id].slot_lock);
-						tl->error_slot = slot_id;
-						tl->error = EN50221ERR_CAWRITE;
-						print(LOG_LEVEL, ERROR, 1, "CAWrite failed");
-						return -1;
-					}
-					gettimeofday(&tl->slots[slot_id].connections[j].tx_time, 0);
+				// send the message
+				if (dvbca_link_write(tl->slots[slot_id].ca_hndl,
+				    		     tl->slots[slot_id].slot,
+						     j,
+						     msg->data, msg->length) < 0) {
+					free_message(tl, slot_id, msg);
+					pthread_mutex_unlock(&tl->slots[slot_id].slot_lock);
+					tl->error_slot = slot_id;
+					tl->error = EN50221ERR_CAWRITE;
+					print(LOG_LEVEL, ERROR, 1, "CAWrite failed");
+					return -1;
+				}
+				gettimeofday(&tl->slots[slot_id].connections[j].tx_time, 0);
 
-					// fixup connection state for T_DELETE_T_C
-					if (msg->length && (msg->data[0] == T_DELETE_T_C)) {
-						tl->slots[slot_id].connections[j].state = T_STATE_IN_DELETION;
-						if (tl->slots[slot_id].connections[j].chain_buffer) {
-							free(tl->slots[slot_id].connections[j].chain_buffer);
-						}
-						tl->slots[slot_id].connections[j].chain_buffer = NULL;
-						tl->slots[slot_id].connections[j].buffer_length = 0;
+				// fixup connection state for T_DELETE_T_C
+				if (msg->length && (msg->data[0] == T_DELETE_T_C)) {
+					tl->slots[slot_id].connections[j].state = T_STATE_IN_DELETION;
+					if (tl->slots[slot_id].connections[j].chain_buffer) {
+						free(tl->slots[slot_id].connections[j].chain_buffer);
 					}
-
-					free(msg);
+					tl->slots[slot_id].connections[j].chain_buffer = NULL;
+					tl->slots[slot_id].connections[j].buffer_length = 0;
+					tl->slots[slot_id].connections[j].buffer_size = 0;
 				}
+
+				free_message(tl, slot_id, msg);
 			}
-			// poll it if we're not expecting a reponse and the poll time has elapsed
-			if (tl->slots[slot_id].connections[j].state & T_STATE_ACTIVE) {
-				if ((tl->slots[slot_id].connections[j].tx_time.tv_sec == 0) &&
-				    (time_after(tl->slots[slot_id].connections[j].last_poll_time,
-				     		tl->slots[slot_id].poll_delay))) {
-
-					gettimeofday(&tl->slots[slot_id].connections[j].last_poll_time, 0);
-					if (en50221_tl_poll_tc(tl, slot_id, j)) {
-						pthread_mutex_unlock(&tl->slots[slot_id].slot_lock);
-						return -1;
-					}
+		}
+		// poll it if we're not expecting a reponse and the poll time has elapsed
+		if (tl->slots[slot_id].connections[j].state & T_STATE_ACTIVE) {
+			if ((tl->slots[slot_id].connections[j].tx_time.tv_sec == 0) &&
+			    (time_after(tl->slots[slot_id].connections[j].last_poll_time,
+			     		tl->slots[slot_id].poll_delay))) {
+
+				gettimeofday(&tl->slots[slot_id].connections[j].last_poll_time, 0);
+				if (en50221_tl_poll_tc(tl, slot_id, j)) {
+					pthread_mutex_unlock(&tl->slots[slot_id].slot_lock);
+					return -1;
 				}
 			}
+		}
 
-			// check for timeouts - in any state
-			if (tl->slots[slot_id].connections[j].tx_time.tv_sec &&
-			    (time_after(tl->slots[slot_id].connections[j].tx_time,
-			     		tl->slots[slot_id].response_timeout))) {
+		// check for timeouts - in any state
+		if (tl->slots[slot_id].connections[j].tx_time.tv_sec &&
+		    (time_after(tl->slots[slot_id].connections[j].tx_time,
+		     		tl->slots[slot_id].response_timeout))) {
 
-				if (tl->slots[slot_id].connections[j].state &
-				    (T_STATE_IN_CREATION |T_STATE_IN_DELETION)) {
-					tl->slots[slot_id].connections[j].state = T_STATE_IDLE;
-				} else if (tl->slots[slot_id].connections[j].state &
-					   (T_STATE_ACTIVE | T_STATE_ACTIVE_DELETEQUEUED)) {
-					tl->error_slot = slot_id;
-					tl->error = EN50221ERR_TIMEOUT;
-					pthread_mutex_unlock(&tl->slots[slot_id].slot_lock);
-					return -1;
-				}
+			if (tl->slots[slot_id].connections[j].state &
+			    (T_STATE_IN_CREATION |T_STATE_IN_DELETION)) {
+				tl->slots[slot_id].connections[j].state = T_STATE_IDLE;
+			} else if (tl->slots[slot_id].connections[j].state &
+				   (T_STATE_ACTIVE | T_STATE_ACTIVE_DELETEQUEUED)) {
+				tl->error_slot = slot_id;
+				tl->error = EN50221ERR_TIMEOUT;
+				pthread_mutex_unlock(&tl->slots[slot_id].slot_lock);
+				return -1;
 			}
 		}
-		pthread_mutex_unlock(&tl->slots[slot_id].slot_lock);
 	}
 
+	// work out when we next need to come back here
+	uint64_t deadline = en50221_tl_slot_deadline(tl, slot_id);
+	pthread_mutex_lock(&tl->event_lock);
+	tl->slots[slot_id].deadline = deadline;
+	pthread_mutex_unlock(&tl->event_lock);
+
+	pthread_mutex_unlock(&tl->slots[slot_id].slot_lock);
 	return 0;
 }
 
@@ -563,8 +804,7 @@ int en50221_tl_send_data(struct en50221_transport_layer *tl,
 		return -1;
 	}
 	// allocate msg structure
-	struct en50221_message *msg =
-	    malloc(sizeof(struct en50221_message) + data_size + 10);
+	struct en50221_message *msg = alloc_message(tl, slot_id, data_size + 10);
 	if (msg == NULL) {
 		tl->error_slot = slot_id;
 		tl->error = EN50221ERR_OUTOFMEMORY;
@@ -575,7 +815,7 @@ int en50221_tl_send_data(struct en50221_transport_layer *tl,
 	int length_field_len;
 	msg->data[0] = T_DATA_LAST;
 	if ((length_field_len = asn_1_encode(data_size + 1, msg->data + 1, 3)) < 0) {
-		free(msg);
+		free_message(tl, slot_id, msg);
 		tl->error_slot = slot_id;
 		tl->error = EN50221ERR_ASNENCODE;
 		pthread_mutex_unlock(&tl->slots[slot_id].slot_lock);
@@ -641,8 +881,7 @@ int en50221_tl_send_datav(struct en50221_transport_layer *tl,
 	}
 
 	// allocate msg structure
-	struct en50221_message *msg =
-	    malloc(sizeof(struct en50221_message) + data_size + 10);
+	struct en50221_message *msg = alloc_message(tl, slot_id, data_size + 10);
 	if (msg == NULL) {
 		tl->error_slot = slot_id;
 		tl->error = EN50221ERR_OUTOFMEMORY;
@@ -653,7 +892,7 @@ int en50221_tl_send_datav(struct en50221_transport_layer *tl,
 	int length_field_len;
 	msg->data[0] = T_DATA_LAST;
 	if ((length_field_len = asn_1_encode(data_size + 1, msg->data + 1, 3)) < 0) {
-		free(msg);
+		free_message(tl, slot_id, msg);
 		tl->error_slot = slot_id;
 		tl->error = EN50221ERR_ASNENCODE;
 		pthread_mutex_unlock(&tl->slots[slot_id].slot_lock);
@@ -701,8 +940,7 @@ int en50221_tl_new_tc(struct en50221_transport_layer *tl, uint8_t slot_id)
 		return -1;
 	}
 	// allocate msg structure
-	struct en50221_message *msg =
-	    malloc(sizeof(struct en50221_message) + 3);
+	struct en50221_message *msg = alloc_message(tl, slot_id, 3);
 	if (msg == NULL) {
 		tl->error_slot = slot_id;
 		tl->error = EN50221ERR_OUTOFMEMORY;
@@ -753,8 +991,7 @@ int en50221_tl_del_tc(struct en50221_transport_layer *tl, uint8_t slot_id,
 		return -1;
 	}
 	// allocate msg structure
-	struct en50221_message *msg =
-	    malloc(sizeof(struct en50221_message) + 3);
+	struct en50221_message *msg = alloc_message(tl, slot_id, 3);
 	if (msg == NULL) {
 		tl->error_slot = slot_id;
 		tl->error = EN50221ERR_OUTOFMEMORY;
@@ -987,6 +1224,7 @@ static int en50221_tl_handle_delete_tc(struct en50221_transport_layer *tl,
 		}
 		tl->slots[slot_id].connections[connection_id].chain_buffer = NULL;
 		tl->slots[slot_id].connections[connection_id].buffer_length = 0;
+		tl->slots[slot_id].connections[connection_id].buffer_size = 0;
 
 		// send the reply
 		uint8_t hdr[3];
@@ -1122,21 +1360,11 @@ static int en50221_tl_handle_data_more(struct en50221_transport_layer *tl,
 	// a chained data packet is coming in, save
 	// it to the buffer and wait for more
 	tl->slots[slot_id].connections[connection_id].tx_time.tv_sec = 0;
-	int new_data_length =
-	    tl->slots[slot_id].connections[connection_id].buffer_length + data_length;
-	uint8_t *new_data_buffer =
-	    realloc(tl->slots[slot_id].connections[connection_id].chain_buffer, new_data_length);
-	if (new_data_buffer == NULL) {
+	if (append_chain(&tl->slots[slot_id].connections[connection_id], data, data_length)) {
 		tl->error_slot = slot_id;
 		tl->error = EN50221ERR_OUTOFMEMORY;
 		return -1;
 	}
-	tl->slots[slot_id].connections[connection_id].chain_buffer = new_data_buffer;
-
-	memcpy(tl->slots[slot_id].connections[connection_id].chain_buffer +
-	       tl->slots[slot_id].connections[connection_id].buffer_length,
-	       data, data_length);
-	tl->slots[slot_id].connections[connection_id].buffer_length = new_data_length;
 
 	return 0;
 }
@@ -1158,14 +1386,23 @@ static int en50221_tl_handle_data_last(struct en50221_transport_layer *tl,
 		return -1;
 	}
 	// last package of a chain or single package comes in
-	tl->slots[slot_id].connections[connection_id].tx_time.tv_sec = 0;
-	if (tl->slots[slot_id].connections[connection_id].chain_buffer == NULL) {
-		// single package => dispatch immediately
-		pthread_mutex_lock(&tl->setcallback_lock);
-		en50221_tl_callback cb = tl->callback;
-		void *cb_arg = tl->callback_arg;
-		pthread_mutex_unlock(&tl->setcallback_lock);
+	struct en50221_connection *connection = &tl->slots[slot_id].connections[connection_id];
+	connection->tx_time.tv_sec = 0;
+	if (connection->buffer_length) {
+		if (append_chain(connection, data, data_length)) {
+			tl->error_slot = slot_id;
+			tl->error = EN50221ERR_OUTOFMEMORY;
+			return -1;
+		}
+	}
 
+	pthread_mutex_lock(&tl->setcallback_lock);
+	en50221_tl_callback cb = tl->callback;
+	void *cb_arg = tl->callback_arg;
+	pthread_mutex_unlock(&tl->setcallback_lock);
+
+	if (connection->buffer_length == 0) {
+		// single package => dispatch immediately
 		if (cb && data_length) {
 			pthread_mutex_unlock(&tl->slots[slot_id].
 					     slot_lock);
@@ -1173,38 +1410,30 @@ static int en50221_tl_handle_data_last(struct en50221_transport_layer *tl,
 			pthread_mutex_lock(&tl->slots[slot_id].slot_lock);
 		}
 	} else {
-		int new_data_length =
-		    tl->slots[slot_id].connections[connection_id].buffer_length + data_length;
-		uint8_t *new_data_buffer =
-		    realloc(tl->slots[slot_id].connections[connection_id].chain_buffer, new_data_length);
-		if (new_data_buffer == NULL) {
-			tl->error_slot = slot_id;
-			tl->error = EN50221ERR_OUTOFMEMORY;
-			return -1;
-		}
-
-		memcpy(new_data_buffer +
-		       tl->slots[slot_id].connections[connection_id].
-		       buffer_length, data, data_length);
-
-		// clean the buffer position
-		tl->slots[slot_id].connections[connection_id].chain_buffer = NULL;
-		tl->slots[slot_id].connections[connection_id].buffer_length = 0;
+		// take the chain while the slot is unlocked for the callback
+		uint8_t *chain_buffer = connection->chain_buffer;
+		uint32_t chain_length = connection->buffer_length;
+		uint32_t chain_size = connection->buffer_size;
+		connection->chain_buffer = NULL;
+		connection->buffer_length = 0;
+		connection->buffer_size = 0;
 
 		// tell the upper layers
-		pthread_mutex_lock(&tl->setcallback_lock);
-		en50221_tl_callback cb = tl->callback;
-		void *cb_arg = tl->callback_arg;
-		pthread_mutex_unlock(&tl->setcallback_lock);
 		if (cb && data_length) {
 			pthread_mutex_unlock(&tl->slots[slot_id].
 					     slot_lock);
-			cb(cb_arg, T_CALLBACK_REASON_DATA, new_data_buffer,
-			   new_data_length, slot_id, connection_id);
+			cb(cb_arg, T_CALLBACK_REASON_DATA, chain_buffer,
+			   chain_length, slot_id, connection_id);
 			pthread_mutex_lock(&tl->slots[slot_id].slot_lock);
 		}
 
-		free(new_data_buffer);
+		// and keep it for the next one
+		if (connection->chain_buffer == NULL) {
+			connection->chain_buffer = chain_buffer;
+			connection->buffer_size = chain_size;
+		} else {
+			free(chain_buffer);
+		}
 	}
 
 	return 0;
@@ -1275,7 +1504,6 @@ static int en50221_tl_alloc_new_tc(struct en50221_transport_layer *tl,
 	}
 	// set up the connection struct
 	tl->slots[slot_id].connections[conid].state = T_STATE_IN_CREATION;
-	tl->slots[slot_id].connections[conid].chain_buffer = NULL;
 	tl->slots[slot_id].connections[conid].buffer_length = 0;
 
 	return conid;
@@ -1293,4 +1521,76 @@ static void queue_message(struct en50221_transport_layer *tl,
 		tl->slots[slot_id].connections[connection_id].send_queue = msg;
 		tl->slots[slot_id].connections[connection_id].send_queue_tail = msg;
 	}
+
+	// get it sent without waiting for the next poll
+	en50221_tl_kick(tl, slot_id);
+}
+
+static struct en50221_message *alloc_message(struct en50221_transport_layer *tl,
+					     uint8_t slot_id, uint32_t data_size)
+{
+	struct en50221_message *msg = tl->slots[slot_id].free_messages;
+
+	if ((data_size > POOL_MESSAGE_SIZE) || (msg == NULL)) {
+		msg = malloc(sizeof(struct en50221_message) + data_size);
+		if (msg)
+			msg->pooled = 0;
+		return msg;
+	}
+
+	tl->slots[slot_id].free_messages = msg->next;
+	return msg;
+}
+
+static void free_message(struct en50221_transport_layer *tl, uint8_t slot_id,
+			 struct en50221_message *msg)
+{
+	if (!msg->pooled) {
+		free(msg);
+		return;
+	}
+
+	msg->next = tl->slots[slot_id].free_messages;
+	tl->slots[slot_id].free_messages = msg;
+}
+
+// append to a connection's chain buffer, growing it if need be
+static int append_chain(struct en50221_connection *connection,
+			uint8_t *data, uint32_t data_length)
+{
+	uint32_t new_data_length = connection->buffer_length + data_length;
+
+	if (new_data_length > connection->buffer_size) {
+		uint32_t new_size = connection->buffer_size ? connection->buffer_size : 1024;
+		while (new_size < new_data_length)
+			new_size *= 2;
+
+		uint8_t *new_data_buffer = realloc(connection->chain_buffer, new_size);
+		if (new_data_buffer == NULL)
+			return -1;
+		connection->chain_buffer = new_data_buffer;
+		connection->buffer_size = new_size;
+	}
+
+	memcpy(connection->chain_buffer + connection->buffer_length, data, data_length);
+	connection->buffer_length = new_data_length;
+	return 0;
+}
+
+// event driven mode: make en50221_tl_poll() look at a slot (or just
+// rebuild its pollfds if slot_id is -1) straight away
+static void en50221_tl_kick(struct en50221_transport_layer *tl, int slot_id)
+{
+	uint64_t one = 1;
+
+	pthread_mutex_lock(&tl->event_lock);
+	if (tl->event_driven) {
+		if (slot_id != -1)
+			tl->slots[slot_id].deadline = 0;
+		if (!tl->wakeup_pending) {
+			if (write(tl->wakeup_fd, &one, sizeof(one)) == sizeof(one))
+				tl->wakeup_pending = 1;
+		}
+	}
+	pthread_mutex_unlock(&tl->event_lock);
 }
@@ -131,6 +131,31 @@ extern void en50221_tl_destroy_slot(struct en50221_transport_layer *tl, uint8_t
  */
 extern int en50221_tl_poll(struct en50221_transport_layer *tl);
 
+/**
+ * Switch en50221_tl_poll() between its two modes. By default it waits a
+ * fixed 10ms for data from the modules and then looks at every slot. In event
+ * driven mode it instead sleeps until a module has data, a message has been
+ * queued by one of the send functions, or the nearest connection poll or
+ * response timeout is due, and only looks at the slots which need it.
+ *
+ * @param tl The en50221_transport_layer instance.
+ * @param enable 1 for event driven mode, 0 for the fixed interval.
+ * @param max_wait Longest time in ms en50221_tl_poll() may sleep for in event
+ * driven mode, or -1 for no limit. Callers which have to check other things
+ * regularly (such as whether a CAM has been inserted) should set this.
+ * @return 0 on success, or -1 on error.
+ */
+extern int en50221_tl_set_event_driven(struct en50221_transport_layer *tl,
+				       int enable, int max_wait);
+
+/**
+ * Make a call to en50221_tl_poll() which is sleeping in event driven mode
+ * return straight away - e.g. so the thread calling it can be shut down.
+ *
+ * @param tl The en50221_transport_layer instance.
+ */
+extern void en50221_tl_wakeup(struct en50221_transport_layer *tl);
+
 /**
  * Register the callback for data reception.
  *
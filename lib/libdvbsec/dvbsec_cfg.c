@@ -109,8 +109,10 @@ int dvbsec_cfg_load(FILE *f,
 
 		if (dvbcfg_issection(line, "sec")) {
 			if (insection) {
-				if (cb(arg, &tmpsec))
-					return 0;
+				if (cb(arg, &tmpsec)) {
+					insection = 0;
+					break;
+				}
 			}
 			insection = 1;
 			memset(&tmpsec, 0, sizeof(tmpsec));
@@ -169,10 +171,8 @@ int dvbsec_cfg_load(FILE *f,
 	}
 
 	// output the final section if there is one
-	if (insection) {
-		if (cb(arg, &tmpsec))
-			return 0;
-	}
+	if (insection)
+		cb(arg, &tmpsec);
 
 	if (linebuf)
 		free(linebuf);
@@ -44,6 +44,21 @@ struct huffbuff {
 	uint8_t cur_bit;
 };
 
+/*
+ * The trees are walked HUFFLUT_BITS at a time using a table per tree, built
+ * the first time the tree is used. Each entry gives the tree value reached
+ * from the root by the HUFFLUT_BITS bits of its index (most significant bit
+ * first), and how many of those bits it took. If no literal was reached, the
+ * value is the node the walk stopped at.
+ */
+#define HUFFLUT_BITS 8
+#define HUFFLUT_NBITS_SHIFT 8
+
+struct hufflut {
+	uint8_t built[128];
+	uint16_t entries[128][1 << HUFFLUT_BITS];
+};
+
 
 static struct hufftree_entry program_description_hufftree[][128] = {
 	{ {0x14, 0x15}, {0x9b, 0xd6}, {0xc9, 0xcf}, {0xd7, 0xc7}, {0x01, 0xa2},
@@ -532,6 +547,8 @@ static struct hufftree_entry program_title_hufftree[][128] = {
 	{ {0x9b, 0x9b}, },
 };
 
+static struct hufflut program_description_hufflut;
+static struct hufflut program_title_hufflut;
 
 
 static inline void huffbuff_init(struct huffbuff *hbuf, uint8_t *buf, uint32_t buf_len)
@@ -566,12 +583,69 @@ static inline int huffbuff_bits(struct huffbuff *hbuf, uint8_t nbits)
 	return result;
 }
 
+static inline uint8_t huffbuff_peek(struct huffbuff *hbuf)
+{
+	uint32_t window = hbuf->buf[hbuf->cur_byte] << 8;
+
+	if ((hbuf->cur_byte + 1) < hbuf->buf_len)
+		window |= hbuf->buf[hbuf->cur_byte + 1];
+
+	return (window << hbuf->cur_bit) >> 8;
+}
+
+static inline int huffbuff_skip(struct huffbuff *hbuf, uint8_t nbits)
+{
+	uint32_t bitpos = hbuf->cur_bit + nbits;
+
+	if (((hbuf->cur_byte << 3) + bitpos) > (hbuf->buf_len << 3))
+		return -1;
+
+	hbuf->cur_byte += bitpos >> 3;
+	hbuf->cur_bit = bitpos & 7;
+
+	return 0;
+}
+
+static void hufflut_build(struct hufflut *lut, struct hufftree_entry *tree, uint8_t treenum)
+{
+	uint32_t code;
+	uint8_t treeidx;
+	uint8_t treeval = 0;
+	int nbits;
+
+	for(code = 0; code < (1 << HUFFLUT_BITS); code++) {
+		treeidx = 0;
+		for(nbits = 1; nbits <= HUFFLUT_BITS; nbits++) {
+			if (code & (1 << (HUFFLUT_BITS - nbits)))
+				treeval = tree[treeidx].right_idx;
+			else
+				treeval = tree[treeidx].left_idx;
+
+			if (treeval & HUFFTREE_LITERAL_MASK)
+				break;
+			treeidx = treeval;
+		}
+		if (nbits > HUFFLUT_BITS)
+			nbits = HUFFLUT_BITS;
+
+		lut->entries[treenum][code] = (nbits << HUFFLUT_NBITS_SHIFT) | treeval;
+	}
+
+	lut->built[treenum] = 1;
+}
+
 static inline int append_unicode_char(uint8_t **destbuf, size_t *destbuflen, size_t *destbufpos,
 				      uint32_t c)
 {
 	uint8_t tmp[3];
 	int tmplen = 0;
 
+	// ascii, with room to spare: the common case
+	if ((c < 0x80) && ((*destbufpos + 1) < *destbuflen)) {
+		(*destbuf)[(*destbufpos)++] = c;
+		return 0;
+	}
+
 	// encode the unicode character first of all
 	if (c < 0x80) {
 		tmp[0] = c;
@@ -655,56 +729,64 @@ static int huffman_decode_uncompressed(struct huffbuff *hbuf,
 
 static int huffman_decode(uint8_t *src, size_t srclen,
 			  uint8_t **destbuf, size_t *destbuflen, size_t *destbufpos,
-			  struct hufftree_entry hufftree[][128])
+			  struct hufftree_entry hufftree[][128],
+			  struct hufflut *lut)
 {
 	struct huffbuff hbuf;
 	int bit;
-	struct hufftree_entry *tree = hufftree[0];
-	uint8_t treeidx = 0;
+	uint8_t treenum = 0;
+	uint8_t treeidx;
 	uint8_t treeval;
+	uint16_t entry;
 	int tmp;
 
 	huffbuff_init(&hbuf, src, srclen);
 
 	while(hbuf.cur_byte < hbuf.buf_len) {
-		// get the next bit
-		if ((bit = huffbuff_bits(&hbuf, 1)) < 0)
+		if (!lut->built[treenum])
+			hufflut_build(lut, hufftree[treenum], treenum);
+
+		// look up the next HUFFLUT_BITS bits
+		entry = lut->entries[treenum][huffbuff_peek(&hbuf)];
+		treeval = entry & 0xff;
+		if (huffbuff_skip(&hbuf, entry >> HUFFLUT_NBITS_SHIFT) < 0)
 			return *destbufpos;
 
-		if (!bit) {
-			treeval = tree[treeidx].left_idx;
-		} else {
-			treeval = tree[treeidx].right_idx;
+		// codes longer than the table are finished a bit at a time
+		while(!(treeval & HUFFTREE_LITERAL_MASK)) {
+			treeidx = treeval;
+			if ((bit = huffbuff_bits(&hbuf, 1)) < 0)
+				return *destbufpos;
+
+			if (!bit) {
+				treeval = hufftree[treenum][treeidx].left_idx;
+			} else {
+				treeval = hufftree[treenum][treeidx].right_idx;
+			}
 		}
 
-		if (treeval & HUFFTREE_LITERAL_MASK) {
-			switch(treeval & ~HUFFTREE_LITERAL_MASK) {
-			case HUFFSTRING_END:
-				return 0;
-
-			case HUFFSTRING_ESCAPE:
-				if ((tmp =
-					huffman_decode_uncompressed(&hbuf,
-							destbuf, destbuflen, destbufpos)) < 0)
-					return tmp;
-				if (tmp == 0)
-					return *destbufpos;
-
-				tree = hufftree[tmp];
-				treeidx = 0;
-				break;
+		switch(treeval & ~HUFFTREE_LITERAL_MASK) {
+		case HUFFSTRING_END:
+			return 0;
 
-			default:
-				// stash it
-				if (append_unicode_char(destbuf, destbuflen, destbufpos,
-				    			treeval & ~HUFFTREE_LITERAL_MASK))
-					return -1;
-				tree = hufftree[treeval & ~HUFFTREE_LITERAL_MASK];
-				treeidx = 0;
-				break;
-			}
-		} else {
-			treeidx = treeval;
+		case HUFFSTRING_ESCAPE:
+			if ((tmp =
+				huffman_decode_uncompressed(&hbuf,
+						destbuf, destbuflen, destbufpos)) < 0)
+				return tmp;
+			if (tmp == 0)
+				return *destbufpos;
+
+			treenum = tmp;
+			break;
+
+		default:
+			// stash it
+			if (append_unicode_char(destbuf, destbuflen, destbufpos,
+						treeval & ~HUFFTREE_LITERAL_MASK))
+				return -1;
+			treenum = treeval & ~HUFFTREE_LITERAL_MASK;
+			break;
 		}
 	}
 
@@ -731,12 +813,14 @@ int atsc_text_segment_decode(struct atsc_text_string_segment *segment,
 	case ATSC_TEXT_COMPRESS_PROGRAM_TITLE:
 		return huffman_decode(buf, segment->number_bytes,
 				      destbuf, destbufsize, destbufpos,
-				      program_title_hufftree);
+				      program_title_hufftree,
+				      &program_title_hufflut);
 
 	case ATSC_TEXT_COMPRESS_PROGRAM_DESCRIPTION:
 		return huffman_decode(buf, segment->number_bytes,
 				      destbuf, destbufsize, destbufpos,
-				      program_description_hufftree);
+				      program_description_hufftree,
+				      &program_description_hufflut);
 	}
 
 	return -1;
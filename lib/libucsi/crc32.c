@@ -19,6 +19,16 @@
  */
 
 #include <stdint.h>
+#include <stddef.h>
+#include "crc32.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define CRC32_HAVE_CLMUL 1
+#include <cpuid.h>
+#include <emmintrin.h>
+#include <tmmintrin.h>
+#include <wmmintrin.h>
+#endif
 
 uint32_t crc32tbl[] =
 {
@@ -87,3 +97,259 @@ uint32_t crc32tbl[] =
 	0xafb010b1, 0xab710d06, 0xa6322bdf, 0xa2f33668,
 	0xbcb4666d, 0xb8757bda, 0xb5365d03, 0xb1f740b4
 };
+
+#define CRC32_POLY 0x04c11db7
+
+static uint32_t crc32_dispatch(uint32_t crc, uint8_t *buf, size_t len);
+
+uint32_t (*crc32_impl)(uint32_t crc, uint8_t *buf, size_t len) = crc32_dispatch;
+
+static enum crc32_engine crc32_engine_selected = CRC32_ENGINE_AUTO;
+
+/* crc32slice[k][i] is the CRC of byte i followed by k zero bytes */
+static uint32_t crc32slice[8][256];
+static int crc32slice_ready;
+
+static void crc32_slice_init(void)
+{
+	int i, k;
+
+	if (crc32slice_ready)
+		return;
+
+	for (i = 0; i < 256; i++)
+		crc32slice[0][i] = crc32tbl[i];
+	for (k = 1; k < 8; k++) {
+		for (i = 0; i < 256; i++) {
+			uint32_t c = crc32slice[k-1][i];
+			crc32slice[k][i] = (c << 8) ^ crc32tbl[c >> 24];
+		}
+	}
+	crc32slice_ready = 1;
+}
+
+static uint32_t crc32_bytewise(uint32_t crc, uint8_t *buf, size_t len)
+{
+	size_t i;
+
+	for (i=0; i< len; i++) {
+		crc = (crc << 8) ^ crc32tbl[((crc >> 24) ^ buf[i]) & 0xff];
+	}
+
+	return crc;
+}
+
+static uint32_t crc32_slice8(uint32_t crc, uint8_t *buf, size_t len)
+{
+	while (len >= 8) {
+		crc ^= ((uint32_t) buf[0] << 24) | ((uint32_t) buf[1] << 16) |
+		       ((uint32_t) buf[2] << 8) | buf[3];
+		crc = crc32slice[7][crc >> 24] ^
+		      crc32slice[6][(crc >> 16) & 0xff] ^
+		      crc32slice[5][(crc >> 8) & 0xff] ^
+		      crc32slice[4][crc & 0xff] ^
+		      crc32slice[3][buf[4]] ^
+		      crc32slice[2][buf[5]] ^
+		      crc32slice[1][buf[6]] ^
+		      crc32slice[0][buf[7]];
+		buf += 8;
+		len -= 8;
+	}
+
+	return crc32_bytewise(crc, buf, len);
+}
+
+#ifdef CRC32_HAVE_CLMUL
+
+/* fold constants, each pair is { x^(n+64) mod P, x^n mod P } */
+static uint64_t crc32_fold512[2];
+static uint64_t crc32_fold128[2];
+static int crc32_clmul_state = -1;
+
+/**
+ * Calculate x^n mod P.
+ */
+static uint32_t crc32_xpow(unsigned int n)
+{
+	uint32_t r = 1;
+
+	while (n--)
+		r = (r & 0x80000000) ? (r << 1) ^ CRC32_POLY : (r << 1);
+	return r;
+}
+
+/**
+ * Check for CPU support and set up the fold constants.
+ *
+ * @return 1 if the clmul engine can be used, 0 if not.
+ */
+static int crc32_clmul_init(void)
+{
+	unsigned int eax, ebx, ecx, edx;
+
+	if (crc32_clmul_state != -1)
+		return crc32_clmul_state;
+
+	/* PCLMULQDQ and SSSE3 (for pshufb) */
+	if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx) ||
+	    !(ecx & (1 << 1)) || !(ecx & (1 << 9))) {
+		crc32_clmul_state = 0;
+		return 0;
+	}
+
+	crc32_slice_init();
+	crc32_fold512[0] = crc32_xpow(512 + 64);
+	crc32_fold512[1] = crc32_xpow(512);
+	crc32_fold128[0] = crc32_xpow(128 + 64);
+	crc32_fold128[1] = crc32_xpow(128);
+	crc32_clmul_state = 1;
+	return 1;
+}
+
+__attribute__((target("pclmul,ssse3")))
+static inline __m128i crc32_fold(__m128i x, __m128i k)
+{
+	return _mm_xor_si128(_mm_clmulepi64_si128(x, k, 0x11),
+			     _mm_clmulepi64_si128(x, k, 0x00));
+}
+
+/*
+ * The message is treated as one big polynomial, most significant bit first.
+ * Each 128 bit accumulator is multiplied forward by x^n mod P and xor-ed
+ * onto the block n bits further on; this keeps the value congruent mod P
+ * while never needing a full reduction inside the loop. The final 16 byte
+ * remainder is then reduced by running it through the table engine.
+ */
+__attribute__((target("pclmul,ssse3")))
+static uint32_t crc32_clmul(uint32_t crc, uint8_t *buf, size_t len)
+{
+	const __m128i bswap = _mm_set_epi8(0, 1, 2, 3, 4, 5, 6, 7,
+					   8, 9, 10, 11, 12, 13, 14, 15);
+	__m128i k512, k128;
+	__m128i x0, x1, x2, x3;
+	uint8_t tmp[16];
+
+	if (len < 128)
+		return crc32_slice8(crc, buf, len);
+
+	k512 = _mm_set_epi64x(crc32_fold512[0], crc32_fold512[1]);
+	k128 = _mm_set_epi64x(crc32_fold128[0], crc32_fold128[1]);
+
+	x0 = _mm_shuffle_epi8(_mm_loadu_si128((__m128i *) (buf +  0)), bswap);
+	x1 = _mm_shuffle_epi8(_mm_loadu_si128((__m128i *) (buf + 16)), bswap);
+	x2 = _mm_shuffle_epi8(_mm_loadu_si128((__m128i *) (buf + 32)), bswap);
+	x3 = _mm_shuffle_epi8(_mm_loadu_si128((__m128i *) (buf + 48)), bswap);
+	x0 = _mm_xor_si128(x0, _mm_set_epi32(crc, 0, 0, 0));
+	buf += 64;
+	len -= 64;
+
+	while (len >= 64) {
+		x0 = _mm_xor_si128(crc32_fold(x0, k512),
+			_mm_shuffle_epi8(_mm_loadu_si128((__m128i *) (buf +  0)), bswap));
+		x1 = _mm_xor_si128(crc32_fold(x1, k512),
+			_mm_shuffle_epi8(_mm_loadu_si128((__m128i *) (buf + 16)), bswap));
+		x2 = _mm_xor_si128(crc32_fold(x2, k512),
+			_mm_shuffle_epi8(_mm_loadu_si128((__m128i *) (buf + 32)), bswap));
+		x3 = _mm_xor_si128(crc32_fold(x3, k512),
+			_mm_shuffle_epi8(_mm_loadu_si128((__m128i *) (buf + 48)), bswap));
+		buf += 64;
+		len -= 64;
+	}
+
+	x1 = _mm_xor_si128(crc32_fold(x0, k128), x1);
+	x2 = _mm_xor_si128(crc32_fold(x1, k128), x2);
+	x3 = _mm_xor_si128(crc32_fold(x2, k128), x3);
+
+	while (len >= 16) {
+		x3 = _mm_xor_si128(crc32_fold(x3, k128),
+			_mm_shuffle_epi8(_mm_loadu_si128((__m128i *) buf), bswap));
+		buf += 16;
+		len -= 16;
+	}
+
+	_mm_storeu_si128((__m128i *) tmp, _mm_shuffle_epi8(x3, bswap));
+	crc = crc32_slice8(0, tmp, sizeof(tmp));
+
+	return crc32_slice8(crc, buf, len);
+}
+
+#endif
+
+uint32_t crc32_engine_calc(enum crc32_engine engine,
+			   uint32_t crc, uint8_t *buf, size_t len)
+{
+	switch(engine) {
+	case CRC32_ENGINE_AUTO:
+		return crc32(crc, buf, len);
+
+	case CRC32_ENGINE_BYTEWISE:
+		return crc32_bytewise(crc, buf, len);
+
+	case CRC32_ENGINE_SLICE8:
+		crc32_slice_init();
+		return crc32_slice8(crc, buf, len);
+
+	case CRC32_ENGINE_CLMUL:
+#ifdef CRC32_HAVE_CLMUL
+		if (!crc32_clmul_init())
+			return crc;
+		return crc32_clmul(crc, buf, len);
+#else
+		return crc;
+#endif
+	}
+
+	return crc;
+}
+
+int crc32_set_engine(enum crc32_engine engine)
+{
+	switch(engine) {
+	case CRC32_ENGINE_AUTO:
+#ifdef CRC32_HAVE_CLMUL
+		if (crc32_set_engine(CRC32_ENGINE_CLMUL) == 0)
+			return 0;
+#endif
+		return crc32_set_engine(CRC32_ENGINE_SLICE8);
+
+	case CRC32_ENGINE_BYTEWISE:
+		crc32_impl = crc32_bytewise;
+		break;
+
+	case CRC32_ENGINE_SLICE8:
+		crc32_slice_init();
+		crc32_impl = crc32_slice8;
+		break;
+
+	case CRC32_ENGINE_CLMUL:
+#ifdef CRC32_HAVE_CLMUL
+		if (!crc32_clmul_init())
+			return -1;
+		crc32_impl = crc32_clmul;
+		break;
+#else
+		return -1;
+#endif
+
+	default:
+		return -1;
+	}
+
+	crc32_engine_selected = engine;
+	return 0;
+}
+
+enum crc32_engine crc32_get_engine(void)
+{
+	if (crc32_engine_selected == CRC32_ENGINE_AUTO)
+		crc32_set_engine(CRC32_ENGINE_AUTO);
+
+	return crc32_engine_selected;
+}
+
+static uint32_t crc32_dispatch(uint32_t crc, uint8_t *buf, size_t len)
+{
+	crc32_set_engine(CRC32_ENGINE_AUTO);
+
+	return crc32_impl(crc, buf, len);
+}
@@ -22,6 +22,7 @@
 #define _UCSI_CRC32_H 1
 
 #include <stdint.h>
+#include <stddef.h>
 
 #ifdef __cplusplus
 extern "C"
@@ -32,6 +33,52 @@ extern "C"
 
 extern uint32_t crc32tbl[];
 
+/**
+ * Available CRC32 implementations.
+ */
+enum crc32_engine {
+	CRC32_ENGINE_AUTO,		/* best engine supported by this CPU */
+	CRC32_ENGINE_BYTEWISE,		/* one table lookup per byte */
+	CRC32_ENGINE_SLICE8,		/* eight table lookups per 8 bytes */
+	CRC32_ENGINE_CLMUL,		/* x86 PCLMULQDQ folding */
+};
+
+/**
+ * The currently selected CRC32 implementation. Do not call this directly,
+ * use crc32() instead.
+ */
+extern uint32_t (*crc32_impl)(uint32_t crc, uint8_t *buf, size_t len);
+
+/**
+ * Select the CRC32 implementation used by crc32(). The engine is chosen
+ * automatically on first use, so calling this is only necessary to force a
+ * particular implementation (e.g. for benchmarking).
+ *
+ * @param engine The engine to use.
+ * @return 0 on success, or -1 if the engine is not supported by this CPU.
+ */
+extern int crc32_set_engine(enum crc32_engine engine);
+
+/**
+ * Determine the CRC32 implementation crc32() will use.
+ *
+ * @return The engine in use (never CRC32_ENGINE_AUTO).
+ */
+extern enum crc32_engine crc32_get_engine(void);
+
+/**
+ * Calculate a CRC32 over a piece of data using a specific engine, regardless
+ * of the one currently selected.
+ *
+ * @param engine The engine to use.
+ * @param crc Current CRC value (use CRC32_INIT for first call).
+ * @param buf Buffer to calculate over.
+ * @param len Number of bytes.
+ * @return Calculated CRC, or crc unchanged if the engine is not supported.
+ */
+extern uint32_t crc32_engine_calc(enum crc32_engine engine,
+				  uint32_t crc, uint8_t *buf, size_t len);
+
 /**
  * Calculate a CRC32 over a piece of data.
  *
@@ -42,13 +89,7 @@ extern uint32_t crc32tbl[];
  */
 static inline uint32_t crc32(uint32_t crc, uint8_t* buf, size_t len)
 {
-	size_t i;
-
-	for (i=0; i< len; i++) {
-		crc = (crc << 8) ^ crc32tbl[((crc >> 24) ^ buf[i]) & 0xff];
-	}
-
-	return crc;
+	return crc32_impl(crc, buf, len);
 }
 
 #ifdef __cplusplus
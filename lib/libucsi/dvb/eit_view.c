@@ -0,0 +1,57 @@
+/*
+ * section and descriptor parser
+ *
+ * Copyright (C) 2005 Kenneth Aafloy (kenneth@linuxtv.org)
+ * Copyright (C) 2005 Andrew de Quincey (adq_dvb@lidskialf.net)
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ */
+
+#include <libucsi/dvb/eit_view.h>
+
+const struct dvb_eit_view *dvb_eit_view_decode(const struct section_ext_view *ext)
+{
+	const uint8_t *buf = (const uint8_t *) ext;
+	size_t pos = sizeof(struct dvb_eit_view);
+	size_t len = section_ext_view_length(ext);
+
+	if (len < sizeof(struct dvb_eit_view))
+		return NULL;
+
+	while (pos < len) {
+		const struct dvb_eit_event_view *event =
+			(const struct dvb_eit_event_view *) (buf + pos);
+		size_t loop_len;
+
+		if ((pos + sizeof(struct dvb_eit_event_view)) > len)
+			return NULL;
+
+		pos += sizeof(struct dvb_eit_event_view);
+		loop_len = dvb_eit_event_view_descriptors_loop_length(event);
+
+		if ((pos + loop_len) > len)
+			return NULL;
+
+		if (verify_descriptors((uint8_t *) buf + pos, loop_len))
+			return NULL;
+
+		pos += loop_len;
+	}
+
+	if (pos != len)
+		return NULL;
+
+	return (const struct dvb_eit_view *) ext;
+}
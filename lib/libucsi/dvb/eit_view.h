@@ -0,0 +1,199 @@
+/*
+ * section and descriptor parser - read-only EIT view
+ *
+ * Copyright (C) 2005 Kenneth Aafloy (kenneth@linuxtv.org)
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ */
+
+#ifndef _UCSI_DVB_EIT_VIEW_H
+#define _UCSI_DVB_EIT_VIEW_H 1
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include <libucsi/section_view.h>
+#include <libucsi/dvb/types.h>
+
+/**
+ * Read-only view of a dvb_eit_section.
+ */
+struct dvb_eit_view {
+	struct section_ext_view head; /* table_id_ext == service_id */
+	uint8_t data[6];
+
+	/* struct dvb_eit_event_view events[] */
+} __ucsi_packed;
+
+/**
+ * Read-only view of a dvb_eit_event.
+ */
+struct dvb_eit_event_view {
+	uint8_t data[12];
+
+	/* struct descriptor descriptors[] */
+} __ucsi_packed;
+
+/**
+ * Validate an EIT without modifying it.
+ *
+ * @param section The section_ext view.
+ * @return Pointer to the EIT view, or NULL on error.
+ */
+extern const struct dvb_eit_view *dvb_eit_view_decode(const struct section_ext_view *section);
+
+/**
+ * Accessors for the fields of an EIT.
+ */
+static inline uint16_t dvb_eit_view_service_id(const struct dvb_eit_view *eit)
+{
+	return section_ext_view_table_id_ext(&eit->head);
+}
+
+static inline uint16_t dvb_eit_view_transport_stream_id(const struct dvb_eit_view *eit)
+{
+	return ucsi_get16(eit->data);
+}
+
+static inline uint16_t dvb_eit_view_original_network_id(const struct dvb_eit_view *eit)
+{
+	return ucsi_get16(eit->data+2);
+}
+
+static inline uint8_t dvb_eit_view_segment_last_section_number(const struct dvb_eit_view *eit)
+{
+	return eit->data[4];
+}
+
+static inline uint8_t dvb_eit_view_last_table_id(const struct dvb_eit_view *eit)
+{
+	return eit->data[5];
+}
+
+/**
+ * Accessors for the fields of an EIT event entry. The start_time and
+ * duration are returned as pointers to the raw dvbdate_t/dvbduration_t
+ * bytes, which are stored identically on the wire and in decoded sections.
+ */
+static inline uint16_t dvb_eit_event_view_event_id(const struct dvb_eit_event_view *event)
+{
+	return ucsi_get16(event->data);
+}
+
+static inline const uint8_t *dvb_eit_event_view_start_time(const struct dvb_eit_event_view *event)
+{
+	return event->data+2;
+}
+
+static inline const uint8_t *dvb_eit_event_view_duration(const struct dvb_eit_event_view *event)
+{
+	return event->data+7;
+}
+
+static inline int dvb_eit_event_view_running_status(const struct dvb_eit_event_view *event)
+{
+	return event->data[10] >> 5;
+}
+
+static inline int dvb_eit_event_view_free_ca_mode(const struct dvb_eit_event_view *event)
+{
+	return (event->data[10] >> 4) & 0x01;
+}
+
+static inline uint16_t dvb_eit_event_view_descriptors_loop_length(const struct dvb_eit_event_view *event)
+{
+	return ucsi_get16(event->data+10) & 0x0fff;
+}
+
+/**
+ * Iterator for the events field in an EIT view.
+ *
+ * @param eit EIT view.
+ * @param pos Variable holding a pointer to the current dvb_eit_event_view.
+ */
+#define dvb_eit_view_events_for_each(eit, pos) \
+	for ((pos) = dvb_eit_view_events_first(eit); \
+	     (pos); \
+	     (pos) = dvb_eit_view_events_next(eit, pos))
+
+/**
+ * Iterator for the descriptors field in an EIT event view.
+ *
+ * @param event EIT event view.
+ * @param pos Variable holding a const pointer to the current descriptor.
+ */
+#define dvb_eit_event_view_descriptors_for_each(event, pos) \
+	for ((pos) = dvb_eit_event_view_descriptors_first(event); \
+	     (pos); \
+	     (pos) = dvb_eit_event_view_descriptors_next(event, pos))
+
+
+
+
+
+
+
+
+
+
+/******************************** PRIVATE CODE ********************************/
+static inline const struct dvb_eit_event_view *
+	dvb_eit_view_events_first(const struct dvb_eit_view *eit)
+{
+	size_t pos = sizeof(struct dvb_eit_view);
+
+	if (pos >= section_ext_view_length(&eit->head))
+		return NULL;
+
+	return (const struct dvb_eit_event_view *)((const uint8_t *) eit + pos);
+}
+
+static inline const struct dvb_eit_event_view *
+	dvb_eit_view_events_next(const struct dvb_eit_view *eit,
+				 const struct dvb_eit_event_view *pos)
+{
+	const uint8_t *end = (const uint8_t *) eit + section_ext_view_length(&eit->head);
+	const uint8_t *next = (const uint8_t *) pos + sizeof(struct dvb_eit_event_view) +
+			      dvb_eit_event_view_descriptors_loop_length(pos);
+
+	if (next >= end)
+		return NULL;
+
+	return (const struct dvb_eit_event_view *) next;
+}
+
+static inline const struct descriptor *
+	dvb_eit_event_view_descriptors_first(const struct dvb_eit_event_view *event)
+{
+	return view_first_descriptor((const uint8_t *) event + sizeof(struct dvb_eit_event_view),
+				     dvb_eit_event_view_descriptors_loop_length(event));
+}
+
+static inline const struct descriptor *
+	dvb_eit_event_view_descriptors_next(const struct dvb_eit_event_view *event,
+					    const struct descriptor *pos)
+{
+	return view_next_descriptor((const uint8_t *) event + sizeof(struct dvb_eit_event_view),
+				    dvb_eit_event_view_descriptors_loop_length(event),
+				    pos);
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,634 @@
+/*
+ * DVB EIT electronic programme guide store.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <libucsi/section_buf.h>
+#include <libucsi/dvb/epg_store.h>
+#include <libucsi/dvb/eit_view.h>
+#include <libucsi/dvb/descriptor.h>
+
+#define EPG_FIRST_TABLE_ID 0x4e
+#define EPG_LAST_TABLE_ID 0x6f
+#define EPG_TABLES (EPG_LAST_TABLE_ID - EPG_FIRST_TABLE_ID + 1)
+
+#define EPG_ARENA_BLOCK (64 * 1024)
+#define EPG_MIN_EVENTS 16
+#define EPG_MIN_HASH 256
+
+/* a string arena: strings are never freed individually */
+struct epg_arena_block {
+	struct epg_arena_block *next;
+	size_t size;
+	size_t used;
+	uint8_t data[];
+};
+
+/* what has been stored from one EIT sub-table of a service */
+struct epg_table_state {
+	int version;
+	uint8_t seen[32];	/* sections of the current version stored */
+	uint8_t stored[32];	/* sections which may have events in the store */
+};
+
+struct epg_service {
+	uint64_t key;
+
+	struct dvb_epg_event *events;	/* sorted by start time */
+	int count;
+	int alloc;
+
+	struct epg_table_state *tables[EPG_TABLES];
+};
+
+struct dvb_epg_store {
+	/* open addressed hash of services */
+	struct epg_service **services;
+	int services_size;
+	int services_used;
+
+	/* open addressed hash of interned strings */
+	struct dvb_epg_text **strings;
+	uint32_t *string_hashes;
+	int strings_size;
+	int strings_used;
+
+	struct epg_arena_block *arena;
+
+	struct dvb_epg_store_stats stats;
+};
+
+static inline uint64_t epg_key(uint16_t original_network_id, uint16_t transport_stream_id,
+			       uint16_t service_id)
+{
+	return ((uint64_t) original_network_id << 32) | ((uint32_t) transport_stream_id << 16) | service_id;
+}
+
+static inline uint32_t epg_hash_key(uint64_t key)
+{
+	key ^= key >> 29;
+	key *= 0xbf58476d1ce4e5b9ULL;
+	key ^= key >> 32;
+	return (uint32_t) key;
+}
+
+static inline uint32_t epg_hash_string(const uint8_t *buf, int len)
+{
+	uint32_t hash = 2166136261U;
+
+	while (len--) {
+		hash ^= *buf++;
+		hash *= 16777619U;
+	}
+	return hash;
+}
+
+static inline int epg_bcd(uint8_t bcd)
+{
+	return ((bcd >> 4) * 10) + (bcd & 0x0f);
+}
+
+/*
+ * dvbdate_to_unixtime() goes through mktime(), which is slow and assumes
+ * local time; EIT times are UTC, so convert them directly.
+ */
+static time_t epg_start_time(const uint8_t *dvbdate)
+{
+	int mjd = (dvbdate[0] << 8) | dvbdate[1];
+
+	return ((time_t) (mjd - 40587) * 86400) +
+		(epg_bcd(dvbdate[2]) * 3600) + (epg_bcd(dvbdate[3]) * 60) + epg_bcd(dvbdate[4]);
+}
+
+static uint32_t epg_duration(const uint8_t *dvbduration)
+{
+	return (epg_bcd(dvbduration[0]) * 3600) + (epg_bcd(dvbduration[1]) * 60) + epg_bcd(dvbduration[2]);
+}
+
+static void *epg_arena_alloc(struct dvb_epg_store *store, size_t size)
+{
+	struct epg_arena_block *block = store->arena;
+	void *result;
+
+	/* keep struct dvb_epg_text aligned */
+	size = (size + 1) & ~1;
+
+	if ((block == NULL) || ((block->used + size) > block->size)) {
+		size_t block_size = (size > EPG_ARENA_BLOCK) ? size : EPG_ARENA_BLOCK;
+
+		if ((block = malloc(sizeof(struct epg_arena_block) + block_size)) == NULL)
+			return NULL;
+		block->size = block_size;
+		block->used = 0;
+		block->next = store->arena;
+		store->arena = block;
+		store->stats.arena_bytes += sizeof(struct epg_arena_block) + block_size;
+	}
+
+	result = block->data + block->used;
+	block->used += size;
+	return result;
+}
+
+static int epg_strings_grow(struct dvb_epg_store *store)
+{
+	int size = store->strings_size ? store->strings_size * 2 : EPG_MIN_HASH;
+	struct dvb_epg_text **strings;
+	uint32_t *hashes;
+	int i;
+
+	strings = calloc(size, sizeof(struct dvb_epg_text *));
+	hashes = malloc(size * sizeof(uint32_t));
+	if ((strings == NULL) || (hashes == NULL)) {
+		free(strings);
+		free(hashes);
+		return -1;
+	}
+
+	for (i = 0; i < store->strings_size; i++) {
+		int pos;
+
+		if (store->strings[i] == NULL)
+			continue;
+		pos = store->string_hashes[i] & (size - 1);
+		while (strings[pos] != NULL)
+			pos = (pos + 1) & (size - 1);
+		strings[pos] = store->strings[i];
+		hashes[pos] = store->string_hashes[i];
+	}
+
+	free(store->strings);
+	free(store->string_hashes);
+	store->strings = strings;
+	store->string_hashes = hashes;
+	store->strings_size = size;
+	return 0;
+}
+
+static const struct dvb_epg_text *epg_intern(struct dvb_epg_store *store, const uint8_t *buf, int len)
+{
+	struct dvb_epg_text *text;
+	uint32_t hash;
+	int pos;
+
+	if (len == 0)
+		return NULL;
+	store->stats.string_refs++;
+
+	if ((store->strings_used * 4) >= (store->strings_size * 3)) {
+		if (epg_strings_grow(store))
+			return NULL;
+	}
+
+	hash = epg_hash_string(buf, len);
+	pos = hash & (store->strings_size - 1);
+	while ((text = store->strings[pos]) != NULL) {
+		if ((store->string_hashes[pos] == hash) && (text->len == len) &&
+		    !memcmp(text->data, buf, len))
+			return text;
+		pos = (pos + 1) & (store->strings_size - 1);
+	}
+
+	if ((text = epg_arena_alloc(store, sizeof(struct dvb_epg_text) + len)) == NULL)
+		return NULL;
+	text->len = len;
+	memcpy(text->data, buf, len);
+
+	store->strings[pos] = text;
+	store->string_hashes[pos] = hash;
+	store->strings_used++;
+	store->stats.strings++;
+	store->stats.string_bytes += sizeof(struct dvb_epg_text) + len;
+	return text;
+}
+
+static int epg_services_grow(struct dvb_epg_store *store)
+{
+	int size = store->services_size ? store->services_size * 2 : EPG_MIN_HASH;
+	struct epg_service **services;
+	int i;
+
+	if ((services = calloc(size, sizeof(struct epg_service *))) == NULL)
+		return -1;
+
+	for (i = 0; i < store->services_size; i++) {
+		int pos;
+
+		if (store->services[i] == NULL)
+			continue;
+		pos = epg_hash_key(store->services[i]->key) & (size - 1);
+		while (services[pos] != NULL)
+			pos = (pos + 1) & (size - 1);
+		services[pos] = store->services[i];
+	}
+
+	free(store->services);
+	store->services = services;
+	store->services_size = size;
+	return 0;
+}
+
+static struct epg_service *epg_find_service(struct dvb_epg_store *store, uint64_t key, int create)
+{
+	struct epg_service *service;
+	int pos;
+
+	if (store->services_size) {
+		pos = epg_hash_key(key) & (store->services_size - 1);
+		while ((service = store->services[pos]) != NULL) {
+			if (service->key == key)
+				return service;
+			pos = (pos + 1) & (store->services_size - 1);
+		}
+	}
+	if (!create)
+		return NULL;
+
+	if ((store->services_used * 2) >= store->services_size) {
+		if (epg_services_grow(store))
+			return NULL;
+	}
+	if ((service = calloc(1, sizeof(struct epg_service))) == NULL)
+		return NULL;
+	service->key = key;
+
+	pos = epg_hash_key(key) & (store->services_size - 1);
+	while (store->services[pos] != NULL)
+		pos = (pos + 1) & (store->services_size - 1);
+	store->services[pos] = service;
+	store->services_used++;
+	store->stats.index_bytes += sizeof(struct epg_service);
+	return service;
+}
+
+/* index of the first event starting at or after a time */
+static int epg_lower_bound(struct epg_service *service, time_t when)
+{
+	int lo = 0;
+	int hi = service->count;
+
+	while (lo < hi) {
+		int mid = (lo + hi) / 2;
+
+		if (service->events[mid].start < when)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+static int epg_insert_event(struct dvb_epg_store *store, struct epg_service *service,
+			    struct dvb_epg_event *event)
+{
+	int pos;
+
+	/* the same event may be carried by several sub-tables: the latest wins */
+	for (pos = epg_lower_bound(service, event->start);
+	     (pos < service->count) && (service->events[pos].start == event->start);
+	     pos++) {
+		if (service->events[pos].event_id == event->event_id) {
+			service->events[pos] = *event;
+			return 0;
+		}
+	}
+
+	if (service->count == service->alloc) {
+		int alloc = service->alloc ? service->alloc * 2 : EPG_MIN_EVENTS;
+		struct dvb_epg_event *events;
+
+		events = realloc(service->events, alloc * sizeof(struct dvb_epg_event));
+		if (events == NULL)
+			return -1;
+		store->stats.event_bytes += (alloc - service->alloc) * sizeof(struct dvb_epg_event);
+		service->events = events;
+		service->alloc = alloc;
+	}
+
+	memmove(service->events + pos + 1, service->events + pos,
+		(service->count - pos) * sizeof(struct dvb_epg_event));
+	service->events[pos] = *event;
+	service->count++;
+	store->stats.events++;
+	return 0;
+}
+
+static void epg_remove_section(struct dvb_epg_store *store, struct epg_service *service,
+			       int table_id, int section_number)
+{
+	int i, j;
+
+	for (i = 0, j = 0; i < service->count; i++) {
+		if ((service->events[i].table_id == table_id) &&
+		    (service->events[i].section_number == section_number))
+			continue;
+		if (i != j)
+			service->events[j] = service->events[i];
+		j++;
+	}
+	store->stats.events -= service->count - j;
+	service->count = j;
+}
+
+/* length of the character table selection at the start of a string */
+static int epg_charset_len(const uint8_t *buf, int len)
+{
+	if ((len == 0) || (buf[0] >= 0x20))
+		return 0;
+	if (buf[0] == 0x10)
+		return (len >= 3) ? 3 : len;
+	if (buf[0] == 0x1f)
+		return (len >= 2) ? 2 : len;
+	return 1;
+}
+
+static int epg_parse_event(struct dvb_epg_store *store, const struct dvb_eit_event_view *ev,
+			   struct dvb_epg_event *event)
+{
+	const struct descriptor *d;
+	struct dvb_short_event_descriptor *short_event = NULL;
+	uint8_t extended[DVB_MAX_SECTION_BYTES];
+	int extended_len = 0;
+	int extended_charset = 0;
+	const uint8_t *extended_lang = NULL;
+
+	memset(event, 0, sizeof(struct dvb_epg_event));
+	event->event_id = dvb_eit_event_view_event_id(ev);
+	event->start = epg_start_time(dvb_eit_event_view_start_time(ev));
+	event->duration = epg_duration(dvb_eit_event_view_duration(ev));
+	event->running_status = dvb_eit_event_view_running_status(ev);
+	event->free_ca_mode = dvb_eit_event_view_free_ca_mode(ev);
+
+	/* the codecs used here do not modify the data */
+	dvb_eit_event_view_descriptors_for_each(ev, d) {
+		switch(d->tag) {
+		case dtag_dvb_short_event:
+			if (short_event == NULL)
+				short_event = dvb_short_event_descriptor_codec((struct descriptor *) d);
+			break;
+
+		case dtag_dvb_extended_event:
+		{
+			struct dvb_extended_event_descriptor *dx;
+			struct dvb_extended_event_descriptor_part2 *part2;
+			uint8_t *text;
+			int skip;
+
+			dx = dvb_extended_event_descriptor_codec((struct descriptor *) d);
+			if (dx == NULL)
+				break;
+
+			// only keep the texts of the first language seen
+			if (extended_lang == NULL)
+				extended_lang = dx->language_code;
+			else if (memcmp(extended_lang, dx->language_code, sizeof(iso639lang_t)))
+				break;
+
+			// continuations repeating the character table of the first part drop it
+			part2 = dvb_extended_event_descriptor_part2(dx);
+			text = dvb_extended_event_descriptor_part2_text(part2);
+			skip = epg_charset_len(text, part2->text_length);
+			if (extended_len == 0)
+				extended_charset = skip;
+			else if ((skip != extended_charset) || memcmp(text, extended, skip))
+				skip = 0;
+			memcpy(extended + extended_len, text + skip, part2->text_length - skip);
+			extended_len += part2->text_length - skip;
+			break;
+		}
+		}
+	}
+
+	if (short_event != NULL) {
+		struct dvb_short_event_descriptor_part2 *part2;
+
+		memcpy(event->language_code, short_event->language_code, sizeof(iso639lang_t));
+		event->title = epg_intern(store, dvb_short_event_descriptor_event_name(short_event),
+					  short_event->event_name_length);
+		part2 = dvb_short_event_descriptor_part2(short_event);
+		event->text = epg_intern(store, dvb_short_event_descriptor_text(part2),
+					 part2->text_length);
+	}
+	event->extended = epg_intern(store, extended, extended_len);
+
+	return 0;
+}
+
+int dvb_epg_store_add_section(struct dvb_epg_store *store, const uint8_t *buf, size_t len)
+{
+	const struct section_view *section;
+	const struct section_ext_view *ext;
+	const struct dvb_eit_view *eit;
+	const struct dvb_eit_event_view *ev;
+	struct epg_service *service;
+	struct epg_table_state *table;
+	int table_id, version, section_number;
+	uint8_t mask;
+	uint64_t key;
+
+	store->stats.sections++;
+
+	if (((section = section_view_decode(buf, len)) == NULL) ||
+	    ((ext = section_ext_view_decode(section, 0)) == NULL) ||
+	    (section_ext_view_length(ext) < sizeof(struct dvb_eit_view))) {
+		store->stats.invalid++;
+		return -1;
+	}
+	table_id = section_ext_view_table_id(ext);
+	if ((table_id < EPG_FIRST_TABLE_ID) || (table_id > EPG_LAST_TABLE_ID)) {
+		store->stats.invalid++;
+		return -1;
+	}
+	if (!section_ext_view_current_next_indicator(ext))
+		return 0;
+
+	/* the fixed part of the header can be read before the events are verified */
+	eit = (const struct dvb_eit_view *) ext;
+	key = epg_key(dvb_eit_view_original_network_id(eit),
+		      dvb_eit_view_transport_stream_id(eit),
+		      dvb_eit_view_service_id(eit));
+	version = section_ext_view_version_number(ext);
+	section_number = section_ext_view_section_number(ext);
+	mask = 1 << (section_number & 7);
+
+	/* fast path: a repeat of a section already stored */
+	service = epg_find_service(store, key, 0);
+	if ((service != NULL) &&
+	    ((table = service->tables[table_id - EPG_FIRST_TABLE_ID]) != NULL) &&
+	    (table->version == version) &&
+	    (table->seen[section_number >> 3] & mask)) {
+		store->stats.unchanged++;
+		return 0;
+	}
+
+	if ((eit = dvb_eit_view_decode(ext)) == NULL) {
+		store->stats.invalid++;
+		return -1;
+	}
+
+	if (service == NULL) {
+		if ((service = epg_find_service(store, key, 1)) == NULL)
+			return -1;
+		store->stats.services++;
+	}
+	if ((table = service->tables[table_id - EPG_FIRST_TABLE_ID]) == NULL) {
+		if ((table = calloc(1, sizeof(struct epg_table_state))) == NULL)
+			return -1;
+		table->version = -1;
+		service->tables[table_id - EPG_FIRST_TABLE_ID] = table;
+		store->stats.index_bytes += sizeof(struct epg_table_state);
+	}
+	if (table->version != version) {
+		table->version = version;
+		memset(table->seen, 0, sizeof(table->seen));
+	}
+
+	/* replace whatever the previous version of this section held */
+	if (table->stored[section_number >> 3] & mask)
+		epg_remove_section(store, service, table_id, section_number);
+
+	dvb_eit_view_events_for_each(eit, ev) {
+		struct dvb_epg_event event;
+
+		epg_parse_event(store, ev, &event);
+		event.table_id = table_id;
+		event.section_number = section_number;
+		if (epg_insert_event(store, service, &event))
+			return -1;
+	}
+
+	table->seen[section_number >> 3] |= mask;
+	table->stored[section_number >> 3] |= mask;
+	return 1;
+}
+
+int dvb_epg_store_now_next(struct dvb_epg_store *store,
+			   uint16_t original_network_id,
+			   uint16_t transport_stream_id,
+			   uint16_t service_id,
+			   time_t when,
+			   const struct dvb_epg_event **now,
+			   const struct dvb_epg_event **next)
+{
+	struct epg_service *service;
+	int pos;
+
+	*now = NULL;
+	*next = NULL;
+
+	service = epg_find_service(store, epg_key(original_network_id, transport_stream_id, service_id), 0);
+	if ((service == NULL) || (service->count == 0))
+		return -1;
+
+	pos = epg_lower_bound(service, when + 1);
+	if (pos < service->count)
+		*next = &service->events[pos];
+	if ((pos > 0) &&
+	    ((service->events[pos - 1].start + (time_t) service->events[pos - 1].duration) > when))
+		*now = &service->events[pos - 1];
+
+	return 0;
+}
+
+int dvb_epg_store_window(struct dvb_epg_store *store,
+			 uint16_t original_network_id,
+			 uint16_t transport_stream_id,
+			 uint16_t service_id,
+			 time_t from, time_t to,
+			 const struct dvb_epg_event **events)
+{
+	struct epg_service *service;
+	int first, last;
+
+	*events = NULL;
+
+	service = epg_find_service(store, epg_key(original_network_id, transport_stream_id, service_id), 0);
+	if ((service == NULL) || (from >= to))
+		return 0;
+
+	first = epg_lower_bound(service, from);
+	if ((first > 0) &&
+	    ((service->events[first - 1].start + (time_t) service->events[first - 1].duration) > from))
+		first--;
+	last = epg_lower_bound(service, to);
+
+	if (first >= last)
+		return 0;
+	*events = &service->events[first];
+	return last - first;
+}
+
+void dvb_epg_store_expire(struct dvb_epg_store *store, time_t before)
+{
+	int i, j, k;
+
+	for (i = 0; i < store->services_size; i++) {
+		struct epg_service *service = store->services[i];
+
+		if (service == NULL)
+			continue;
+
+		for (j = 0, k = 0; j < service->count; j++) {
+			if ((service->events[j].start + (time_t) service->events[j].duration) <= before)
+				continue;
+			if (j != k)
+				service->events[k] = service->events[j];
+			k++;
+		}
+		store->stats.events -= service->count - k;
+		service->count = k;
+	}
+}
+
+void dvb_epg_store_get_stats(struct dvb_epg_store *store, struct dvb_epg_store_stats *stats)
+{
+	*stats = store->stats;
+	stats->index_bytes += (store->services_size * sizeof(struct epg_service *)) +
+			      (store->strings_size * (sizeof(struct dvb_epg_text *) + sizeof(uint32_t)));
+}
+
+struct dvb_epg_store *dvb_epg_store_create(void)
+{
+	return calloc(1, sizeof(struct dvb_epg_store));
+}
+
+void dvb_epg_store_destroy(struct dvb_epg_store *store)
+{
+	struct epg_arena_block *block, *next;
+	int i, j;
+
+	for (i = 0; i < store->services_size; i++) {
+		struct epg_service *service = store->services[i];
+
+		if (service == NULL)
+			continue;
+		for (j = 0; j < EPG_TABLES; j++)
+			free(service->tables[j]);
+		free(service->events);
+		free(service);
+	}
+	free(store->services);
+
+	for (block = store->arena; block; block = next) {
+		next = block->next;
+		free(block);
+	}
+	free(store->strings);
+	free(store->string_hashes);
+	free(store);
+}
@@ -0,0 +1,184 @@
+/*
+ * DVB EIT electronic programme guide store.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ */
+
+#ifndef _UCSI_DVB_EPG_STORE_H
+#define _UCSI_DVB_EPG_STORE_H 1
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include <stdint.h>
+#include <stddef.h>
+#include <time.h>
+#include <libucsi/types.h>
+
+/*
+ * An EPG built from DVB EIT sections (present/following and schedule, both
+ * actual and other TS). Events are held per service, keyed by
+ * (original_network_id, transport_stream_id, service_id), in an array
+ * sorted by start time, so "now/next" and "events in a time window" are
+ * binary searches. Titles and descriptions are interned: each distinct
+ * string is stored once in an arena, however many events use it.
+ *
+ * Each section is remembered by (service, table_id, version_number,
+ * section_number); a repeat of a section already stored is skipped after
+ * looking at its header. When a sub-table changes version, each of its
+ * sections replaces the events stored from the previous version of that
+ * section as it arrives.
+ */
+
+/**
+ * An interned string, in its original EN 300 468 encoding (including any
+ * character table prefix). Not NUL terminated.
+ */
+struct dvb_epg_text {
+	uint16_t len;
+	uint8_t data[];
+};
+
+/**
+ * An event.
+ */
+struct dvb_epg_event {
+	time_t start;				/* UTC, as a unix time */
+	const struct dvb_epg_text *title;	/* short_event event_name, or NULL */
+	const struct dvb_epg_text *text;	/* short_event text, or NULL */
+	const struct dvb_epg_text *extended;	/* extended_event texts, concatenated, or NULL */
+	uint32_t duration;			/* seconds */
+	uint16_t event_id;
+	uint8_t table_id;			/* EIT sub-table the event was taken from */
+	uint8_t section_number;
+	iso639lang_t language_code;		/* of the short_event descriptor */
+	uint8_t running_status;
+	uint8_t free_ca_mode;
+};
+
+/**
+ * Counters and memory use of a store.
+ */
+struct dvb_epg_store_stats {
+	uint64_t sections;          /* sections added */
+	uint64_t unchanged;         /* sections skipped as already stored */
+	uint64_t invalid;           /* sections discarded as malformed */
+	uint32_t services;          /* services with events */
+	uint32_t events;            /* events stored */
+	uint32_t strings;           /* distinct strings stored */
+	uint64_t string_refs;       /* strings looked up, including duplicates */
+	size_t string_bytes;        /* bytes of string data, including headers */
+	size_t arena_bytes;         /* bytes allocated for the string arena */
+	size_t event_bytes;         /* bytes allocated for event arrays */
+	size_t index_bytes;         /* bytes allocated for the service and string indexes */
+};
+
+/**
+ * Opaque store state.
+ */
+struct dvb_epg_store;
+
+/**
+ * Create an empty store.
+ *
+ * @return The new store, or NULL on error.
+ */
+extern struct dvb_epg_store *dvb_epg_store_create(void);
+
+/**
+ * Destroy a store. All events and strings retrieved from it become invalid.
+ *
+ * @param store The store.
+ */
+extern void dvb_epg_store_destroy(struct dvb_epg_store *store);
+
+/**
+ * Add an EIT section to the store. The CRC is not checked; the section is
+ * expected to come from a CRC checking demux filter. Sections whose
+ * current_next_indicator is clear are ignored.
+ *
+ * @param store The store.
+ * @param buf The section, in unmodified wire format.
+ * @param len Length of the section.
+ * @return 1 if the store was updated, 0 if the section was unchanged or
+ * ignored, or -1 if it was not a valid EIT section.
+ */
+extern int dvb_epg_store_add_section(struct dvb_epg_store *store, const uint8_t *buf, size_t len);
+
+/**
+ * Find the event running at a given time, and the one following it.
+ *
+ * @param store The store.
+ * @param original_network_id Key of the service.
+ * @param transport_stream_id Key of the service.
+ * @param service_id Key of the service.
+ * @param when The time.
+ * @param now Set to the running event, or NULL if there is none.
+ * @param next Set to the next event to start after when, or NULL if there is none.
+ * @return 0 on success, or -1 if the service has no events.
+ */
+extern int dvb_epg_store_now_next(struct dvb_epg_store *store,
+				  uint16_t original_network_id,
+				  uint16_t transport_stream_id,
+				  uint16_t service_id,
+				  time_t when,
+				  const struct dvb_epg_event **now,
+				  const struct dvb_epg_event **next);
+
+/**
+ * Find the events of a service which overlap a time window. They are
+ * returned as a contiguous array sorted by start time, which stays valid
+ * until the store is next modified.
+ *
+ * @param store The store.
+ * @param original_network_id Key of the service.
+ * @param transport_stream_id Key of the service.
+ * @param service_id Key of the service.
+ * @param from Start of the window.
+ * @param to End of the window (exclusive).
+ * @param events Set to the first event in the window.
+ * @return Number of events in the window.
+ */
+extern int dvb_epg_store_window(struct dvb_epg_store *store,
+				uint16_t original_network_id,
+				uint16_t transport_stream_id,
+				uint16_t service_id,
+				time_t from, time_t to,
+				const struct dvb_epg_event **events);
+
+/**
+ * Remove all events which ended before a given time. Strings are kept.
+ *
+ * @param store The store.
+ * @param before The time.
+ */
+extern void dvb_epg_store_expire(struct dvb_epg_store *store, time_t before);
+
+/**
+ * Retrieve the counters and memory use of a store.
+ *
+ * @param store The store.
+ * @param stats Where to put them.
+ */
+extern void dvb_epg_store_get_stats(struct dvb_epg_store *store,
+				    struct dvb_epg_store_stats *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
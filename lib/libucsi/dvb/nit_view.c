@@ -0,0 +1,78 @@
+/*
+ * section and descriptor parser
+ *
+ * Copyright (C) 2005 Kenneth Aafloy (kenneth@linuxtv.org)
+ * Copyright (C) 2005 Andrew de Quincey (adq_dvb@lidskialf.net)
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ */
+
+#include <libucsi/dvb/nit_view.h>
+
+const struct dvb_nit_view *dvb_nit_view_decode(const struct section_ext_view *ext)
+{
+	const uint8_t *buf = (const uint8_t *) ext;
+	const struct dvb_nit_view *nit = (const struct dvb_nit_view *) ext;
+	size_t pos = sizeof(struct dvb_nit_view);
+	size_t len = section_ext_view_length(ext);
+	size_t desc_len;
+	size_t loop_end;
+
+	if (len < sizeof(struct dvb_nit_view))
+		return NULL;
+
+	desc_len = dvb_nit_view_network_descriptors_length(nit);
+	if ((pos + desc_len) > len)
+		return NULL;
+
+	if (verify_descriptors((uint8_t *) buf + pos, desc_len))
+		return NULL;
+
+	pos += desc_len;
+
+	if ((pos + 2) > len)
+		return NULL;
+
+	loop_end = pos + 2 + (ucsi_get16(buf + pos) & 0x0fff);
+	pos += 2;
+
+	if (loop_end > len)
+		return NULL;
+	len = loop_end;
+
+	while (pos < len) {
+		const struct dvb_nit_transport_view *transport =
+			(const struct dvb_nit_transport_view *) (buf + pos);
+
+		if ((pos + sizeof(struct dvb_nit_transport_view)) > len)
+			return NULL;
+
+		pos += sizeof(struct dvb_nit_transport_view);
+		desc_len = dvb_nit_transport_view_descriptors_length(transport);
+
+		if ((pos + desc_len) > len)
+			return NULL;
+
+		if (verify_descriptors((uint8_t *) buf + pos, desc_len))
+			return NULL;
+
+		pos += desc_len;
+	}
+
+	if (pos != len)
+		return NULL;
+
+	return nit;
+}
@@ -0,0 +1,206 @@
+/*
+ * section and descriptor parser - read-only NIT view
+ *
+ * Copyright (C) 2005 Kenneth Aafloy (kenneth@linuxtv.org)
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ */
+
+#ifndef _UCSI_DVB_NIT_VIEW_H
+#define _UCSI_DVB_NIT_VIEW_H 1
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include <libucsi/section_view.h>
+
+/**
+ * Read-only view of a dvb_nit_section.
+ */
+struct dvb_nit_view {
+	struct section_ext_view head; /* table_id_ext == network_id */
+	uint8_t data[2];
+
+	/* struct descriptor descriptors[] */
+	/* uint8_t transport_stream_loop_length[2] */
+	/* struct dvb_nit_transport_view transports[] */
+} __ucsi_packed;
+
+/**
+ * Read-only view of a dvb_nit_transport.
+ */
+struct dvb_nit_transport_view {
+	uint8_t data[6];
+
+	/* struct descriptor descriptors[] */
+} __ucsi_packed;
+
+/**
+ * Validate a NIT without modifying it.
+ *
+ * @param section The section_ext view.
+ * @return Pointer to the NIT view, or NULL on error.
+ */
+extern const struct dvb_nit_view *dvb_nit_view_decode(const struct section_ext_view *section);
+
+/**
+ * Accessors for the fields of a NIT.
+ */
+static inline uint16_t dvb_nit_view_network_id(const struct dvb_nit_view *nit)
+{
+	return section_ext_view_table_id_ext(&nit->head);
+}
+
+static inline uint16_t dvb_nit_view_network_descriptors_length(const struct dvb_nit_view *nit)
+{
+	return ucsi_get16(nit->data) & 0x0fff;
+}
+
+static inline uint16_t dvb_nit_view_transport_stream_loop_length(const struct dvb_nit_view *nit)
+{
+	return ucsi_get16((const uint8_t *) nit + sizeof(struct dvb_nit_view) +
+			  dvb_nit_view_network_descriptors_length(nit)) & 0x0fff;
+}
+
+/**
+ * Accessors for the fields of a NIT transport entry.
+ */
+static inline uint16_t dvb_nit_transport_view_transport_stream_id(const struct dvb_nit_transport_view *t)
+{
+	return ucsi_get16(t->data);
+}
+
+static inline uint16_t dvb_nit_transport_view_original_network_id(const struct dvb_nit_transport_view *t)
+{
+	return ucsi_get16(t->data+2);
+}
+
+static inline uint16_t dvb_nit_transport_view_descriptors_length(const struct dvb_nit_transport_view *t)
+{
+	return ucsi_get16(t->data+4) & 0x0fff;
+}
+
+/**
+ * Iterator for the network descriptors field in a NIT view.
+ *
+ * @param nit NIT view.
+ * @param pos Variable holding a const pointer to the current descriptor.
+ */
+#define dvb_nit_view_descriptors_for_each(nit, pos) \
+	for ((pos) = dvb_nit_view_descriptors_first(nit); \
+	     (pos); \
+	     (pos) = dvb_nit_view_descriptors_next(nit, pos))
+
+/**
+ * Iterator for the transports field in a NIT view.
+ *
+ * @param nit NIT view.
+ * @param pos Variable holding a pointer to the current dvb_nit_transport_view.
+ */
+#define dvb_nit_view_transports_for_each(nit, pos) \
+	for ((pos) = dvb_nit_view_transports_first(nit); \
+	     (pos); \
+	     (pos) = dvb_nit_view_transports_next(nit, pos))
+
+/**
+ * Iterator for the descriptors field in a NIT transport view.
+ *
+ * @param transport NIT transport view.
+ * @param pos Variable holding a const pointer to the current descriptor.
+ */
+#define dvb_nit_transport_view_descriptors_for_each(transport, pos) \
+	for ((pos) = dvb_nit_transport_view_descriptors_first(transport); \
+	     (pos); \
+	     (pos) = dvb_nit_transport_view_descriptors_next(transport, pos))
+
+
+
+
+
+
+
+
+
+
+/******************************** PRIVATE CODE ********************************/
+static inline const struct descriptor *
+	dvb_nit_view_descriptors_first(const struct dvb_nit_view *nit)
+{
+	return view_first_descriptor((const uint8_t *) nit + sizeof(struct dvb_nit_view),
+				     dvb_nit_view_network_descriptors_length(nit));
+}
+
+static inline const struct descriptor *
+	dvb_nit_view_descriptors_next(const struct dvb_nit_view *nit,
+				      const struct descriptor *pos)
+{
+	return view_next_descriptor((const uint8_t *) nit + sizeof(struct dvb_nit_view),
+				    dvb_nit_view_network_descriptors_length(nit),
+				    pos);
+}
+
+static inline const uint8_t *dvb_nit_view_transports_start(const struct dvb_nit_view *nit)
+{
+	return (const uint8_t *) nit + sizeof(struct dvb_nit_view) +
+		dvb_nit_view_network_descriptors_length(nit) + 2;
+}
+
+static inline const struct dvb_nit_transport_view *
+	dvb_nit_view_transports_first(const struct dvb_nit_view *nit)
+{
+	if (dvb_nit_view_transport_stream_loop_length(nit) == 0)
+		return NULL;
+
+	return (const struct dvb_nit_transport_view *) dvb_nit_view_transports_start(nit);
+}
+
+static inline const struct dvb_nit_transport_view *
+	dvb_nit_view_transports_next(const struct dvb_nit_view *nit,
+				     const struct dvb_nit_transport_view *pos)
+{
+	const uint8_t *end = dvb_nit_view_transports_start(nit) +
+			     dvb_nit_view_transport_stream_loop_length(nit);
+	const uint8_t *next = (const uint8_t *) pos + sizeof(struct dvb_nit_transport_view) +
+			      dvb_nit_transport_view_descriptors_length(pos);
+
+	if (next >= end)
+		return NULL;
+
+	return (const struct dvb_nit_transport_view *) next;
+}
+
+static inline const struct descriptor *
+	dvb_nit_transport_view_descriptors_first(const struct dvb_nit_transport_view *t)
+{
+	return view_first_descriptor((const uint8_t *) t + sizeof(struct dvb_nit_transport_view),
+				     dvb_nit_transport_view_descriptors_length(t));
+}
+
+static inline const struct descriptor *
+	dvb_nit_transport_view_descriptors_next(const struct dvb_nit_transport_view *t,
+						const struct descriptor *pos)
+{
+	return view_next_descriptor((const uint8_t *) t + sizeof(struct dvb_nit_transport_view),
+				    dvb_nit_transport_view_descriptors_length(t),
+				    pos);
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,181 @@
+/*
+ * section and descriptor parser - read-only SDT view
+ *
+ * Copyright (C) 2005 Kenneth Aafloy (kenneth@linuxtv.org)
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ */
+
+#ifndef _UCSI_DVB_SDT_VIEW_H
+#define _UCSI_DVB_SDT_VIEW_H 1
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include <libucsi/section_view.h>
+
+/**
+ * Read-only view of a dvb_sdt_section.
+ */
+struct dvb_sdt_view {
+	struct section_ext_view head; /* table_id_ext == transport_stream_id */
+	uint8_t data[3];
+
+	/* struct dvb_sdt_service_view services[] */
+} __ucsi_packed;
+
+/**
+ * Read-only view of a dvb_sdt_service.
+ */
+struct dvb_sdt_service_view {
+	uint8_t data[5];
+
+	/* struct descriptor descriptors[] */
+} __ucsi_packed;
+
+/**
+ * Validate an SDT without modifying it.
+ *
+ * @param section The section_ext view.
+ * @return Pointer to the SDT view, or NULL on error.
+ */
+extern const struct dvb_sdt_view *dvb_sdt_view_decode(const struct section_ext_view *section);
+
+/**
+ * Accessors for the fields of an SDT.
+ */
+static inline uint16_t dvb_sdt_view_transport_stream_id(const struct dvb_sdt_view *sdt)
+{
+	return section_ext_view_table_id_ext(&sdt->head);
+}
+
+static inline uint16_t dvb_sdt_view_original_network_id(const struct dvb_sdt_view *sdt)
+{
+	return ucsi_get16(sdt->data);
+}
+
+/**
+ * Accessors for the fields of an SDT service entry.
+ */
+static inline uint16_t dvb_sdt_service_view_service_id(const struct dvb_sdt_service_view *svc)
+{
+	return ucsi_get16(svc->data);
+}
+
+static inline int dvb_sdt_service_view_eit_schedule_flag(const struct dvb_sdt_service_view *svc)
+{
+	return (svc->data[2] >> 1) & 0x01;
+}
+
+static inline int dvb_sdt_service_view_eit_present_following_flag(const struct dvb_sdt_service_view *svc)
+{
+	return svc->data[2] & 0x01;
+}
+
+static inline int dvb_sdt_service_view_running_status(const struct dvb_sdt_service_view *svc)
+{
+	return svc->data[3] >> 5;
+}
+
+static inline int dvb_sdt_service_view_free_ca_mode(const struct dvb_sdt_service_view *svc)
+{
+	return (svc->data[3] >> 4) & 0x01;
+}
+
+static inline uint16_t dvb_sdt_service_view_descriptors_loop_length(const struct dvb_sdt_service_view *svc)
+{
+	return ucsi_get16(svc->data+3) & 0x0fff;
+}
+
+/**
+ * Iterator for the services field in an SDT view.
+ *
+ * @param sdt SDT view.
+ * @param pos Variable holding a pointer to the current dvb_sdt_service_view.
+ */
+#define dvb_sdt_view_services_for_each(sdt, pos) \
+	for ((pos) = dvb_sdt_view_services_first(sdt); \
+	     (pos); \
+	     (pos) = dvb_sdt_view_services_next(sdt, pos))
+
+/**
+ * Iterator for the descriptors field in an SDT service view.
+ *
+ * @param service SDT service view.
+ * @param pos Variable holding a const pointer to the current descriptor.
+ */
+#define dvb_sdt_service_view_descriptors_for_each(service, pos) \
+	for ((pos) = dvb_sdt_service_view_descriptors_first(service); \
+	     (pos); \
+	     (pos) = dvb_sdt_service_view_descriptors_next(service, pos))
+
+
+
+
+
+
+
+
+
+
+/******************************** PRIVATE CODE ********************************/
+static inline const struct dvb_sdt_service_view *
+	dvb_sdt_view_services_first(const struct dvb_sdt_view *sdt)
+{
+	size_t pos = sizeof(struct dvb_sdt_view);
+
+	if (pos >= section_ext_view_length(&sdt->head))
+		return NULL;
+
+	return (const struct dvb_sdt_service_view *)((const uint8_t *) sdt + pos);
+}
+
+static inline const struct dvb_sdt_service_view *
+	dvb_sdt_view_services_next(const struct dvb_sdt_view *sdt,
+				   const struct dvb_sdt_service_view *pos)
+{
+	const uint8_t *end = (const uint8_t *) sdt + section_ext_view_length(&sdt->head);
+	const uint8_t *next = (const uint8_t *) pos + sizeof(struct dvb_sdt_service_view) +
+			      dvb_sdt_service_view_descriptors_loop_length(pos);
+
+	if (next >= end)
+		return NULL;
+
+	return (const struct dvb_sdt_service_view *) next;
+}
+
+static inline const struct descriptor *
+	dvb_sdt_service_view_descriptors_first(const struct dvb_sdt_service_view *svc)
+{
+	return view_first_descriptor((const uint8_t *) svc + sizeof(struct dvb_sdt_service_view),
+				     dvb_sdt_service_view_descriptors_loop_length(svc));
+}
+
+static inline const struct descriptor *
+	dvb_sdt_service_view_descriptors_next(const struct dvb_sdt_service_view *svc,
+					      const struct descriptor *pos)
+{
+	return view_next_descriptor((const uint8_t *) svc + sizeof(struct dvb_sdt_service_view),
+				    dvb_sdt_service_view_descriptors_loop_length(svc),
+				    pos);
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
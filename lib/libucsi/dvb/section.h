@@ -40,6 +40,9 @@ extern "C"
 #include <libucsi/dvb/tva_container_section.h>
 #include <libucsi/dvb/int_section.h>
 #include <libucsi/dvb/mpe_fec_section.h>
+#include <libucsi/dvb/eit_view.h>
+#include <libucsi/dvb/nit_view.h>
+#include <libucsi/dvb/sdt_view.h>
 
 /**
  * The following are not implemented just now.
@@ -0,0 +1,700 @@
+/*
+ * DVB text decoding (EN 300 468 Annex A).
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <iconv.h>
+#include <libucsi/dvb/text.h>
+
+/* character tables */
+enum {
+	CS_ISO6937 = 0,
+	CS_ISO8859_1 = 1,	/* ISO 8859-n is CS_ISO8859_1 + n - 1 */
+	CS_UTF16 = 16,
+	CS_EUCKR,
+	CS_GB2312,
+	CS_BIG5,
+	CS_UTF8,
+	CS_CUSTOM,		/* a default charset which is none of the above */
+	CS_COUNT,
+};
+
+static const char *charset_names[CS_COUNT] = {
+	"ISO_6937",
+	"ISO-8859-1", "ISO-8859-2", "ISO-8859-3", "ISO-8859-4", "ISO-8859-5",
+	"ISO-8859-6", "ISO-8859-7", "ISO-8859-8", "ISO-8859-9", "ISO-8859-10",
+	"ISO-8859-11", NULL, "ISO-8859-13", "ISO-8859-14", "ISO-8859-15",
+	"UTF-16BE",
+	"EUC-KR",
+	"GB2312",
+	"BIG5",
+	"UTF-8",
+	NULL,
+};
+
+/* a character, in UTF-8 */
+struct text_char {
+	uint8_t len;
+	uint8_t data[3];
+};
+
+/* EN 300 468 table 00: ISO 6937 plus the euro sign, from 0xa0 up */
+static const struct text_char iso6937_high[0x60] = {
+	[0xa0 - 0xa0] = { 2, {0xc2, 0xa0} },
+	[0xa1 - 0xa0] = { 2, {0xc2, 0xa1} },
+	[0xa2 - 0xa0] = { 2, {0xc2, 0xa2} },
+	[0xa3 - 0xa0] = { 2, {0xc2, 0xa3} },
+	[0xa4 - 0xa0] = { 3, {0xe2, 0x82, 0xac} }, /* euro sign, an addition to ISO 6937 */
+	[0xa5 - 0xa0] = { 2, {0xc2, 0xa5} },
+	[0xa6 - 0xa0] = { 0, {0} },
+	[0xa7 - 0xa0] = { 2, {0xc2, 0xa7} },
+	[0xa8 - 0xa0] = { 2, {0xc2, 0xa4} },
+	[0xa9 - 0xa0] = { 3, {0xe2, 0x80, 0x98} },
+	[0xaa - 0xa0] = { 3, {0xe2, 0x80, 0x9c} },
+	[0xab - 0xa0] = { 2, {0xc2, 0xab} },
+	[0xac - 0xa0] = { 3, {0xe2, 0x86, 0x90} },
+	[0xad - 0xa0] = { 3, {0xe2, 0x86, 0x91} },
+	[0xae - 0xa0] = { 3, {0xe2, 0x86, 0x92} },
+	[0xaf - 0xa0] = { 3, {0xe2, 0x86, 0x93} },
+	[0xb0 - 0xa0] = { 2, {0xc2, 0xb0} },
+	[0xb1 - 0xa0] = { 2, {0xc2, 0xb1} },
+	[0xb2 - 0xa0] = { 2, {0xc2, 0xb2} },
+	[0xb3 - 0xa0] = { 2, {0xc2, 0xb3} },
+	[0xb4 - 0xa0] = { 2, {0xc3, 0x97} },
+	[0xb5 - 0xa0] = { 2, {0xc2, 0xb5} },
+	[0xb6 - 0xa0] = { 2, {0xc2, 0xb6} },
+	[0xb7 - 0xa0] = { 2, {0xc2, 0xb7} },
+	[0xb8 - 0xa0] = { 2, {0xc3, 0xb7} },
+	[0xb9 - 0xa0] = { 3, {0xe2, 0x80, 0x99} },
+	[0xba - 0xa0] = { 3, {0xe2, 0x80, 0x9d} },
+	[0xbb - 0xa0] = { 2, {0xc2, 0xbb} },
+	[0xbc - 0xa0] = { 2, {0xc2, 0xbc} },
+	[0xbd - 0xa0] = { 2, {0xc2, 0xbd} },
+	[0xbe - 0xa0] = { 2, {0xc2, 0xbe} },
+	[0xbf - 0xa0] = { 2, {0xc2, 0xbf} },
+	[0xc0 - 0xa0] = { 0, {0} },
+	[0xc1 - 0xa0] = { 0, {0} },
+	[0xc2 - 0xa0] = { 0, {0} },
+	[0xc3 - 0xa0] = { 0, {0} },
+	[0xc4 - 0xa0] = { 0, {0} },
+	[0xc5 - 0xa0] = { 0, {0} },
+	[0xc6 - 0xa0] = { 0, {0} },
+	[0xc7 - 0xa0] = { 0, {0} },
+	[0xc8 - 0xa0] = { 0, {0} },
+	[0xc9 - 0xa0] = { 0, {0} },
+	[0xca - 0xa0] = { 0, {0} },
+	[0xcb - 0xa0] = { 0, {0} },
+	[0xcc - 0xa0] = { 0, {0} },
+	[0xcd - 0xa0] = { 0, {0} },
+	[0xce - 0xa0] = { 0, {0} },
+	[0xcf - 0xa0] = { 0, {0} },
+	[0xd0 - 0xa0] = { 3, {0xe2, 0x80, 0x94} },
+	[0xd1 - 0xa0] = { 2, {0xc2, 0xb9} },
+	[0xd2 - 0xa0] = { 2, {0xc2, 0xae} },
+	[0xd3 - 0xa0] = { 2, {0xc2, 0xa9} },
+	[0xd4 - 0xa0] = { 3, {0xe2, 0x84, 0xa2} },
+	[0xd5 - 0xa0] = { 3, {0xe2, 0x99, 0xaa} },
+	[0xd6 - 0xa0] = { 2, {0xc2, 0xac} },
+	[0xd7 - 0xa0] = { 2, {0xc2, 0xa6} },
+	[0xd8 - 0xa0] = { 0, {0} },
+	[0xd9 - 0xa0] = { 0, {0} },
+	[0xda - 0xa0] = { 0, {0} },
+	[0xdb - 0xa0] = { 0, {0} },
+	[0xdc - 0xa0] = { 3, {0xe2, 0x85, 0x9b} },
+	[0xdd - 0xa0] = { 3, {0xe2, 0x85, 0x9c} },
+	[0xde - 0xa0] = { 3, {0xe2, 0x85, 0x9d} },
+	[0xdf - 0xa0] = { 3, {0xe2, 0x85, 0x9e} },
+	[0xe0 - 0xa0] = { 3, {0xe2, 0x84, 0xa6} },
+	[0xe1 - 0xa0] = { 2, {0xc3, 0x86} },
+	[0xe2 - 0xa0] = { 2, {0xc3, 0x90} },
+	[0xe3 - 0xa0] = { 2, {0xc2, 0xaa} },
+	[0xe4 - 0xa0] = { 2, {0xc4, 0xa6} },
+	[0xe5 - 0xa0] = { 0, {0} },
+	[0xe6 - 0xa0] = { 2, {0xc4, 0xb2} },
+	[0xe7 - 0xa0] = { 2, {0xc4, 0xbf} },
+	[0xe8 - 0xa0] = { 2, {0xc5, 0x81} },
+	[0xe9 - 0xa0] = { 2, {0xc3, 0x98} },
+	[0xea - 0xa0] = { 2, {0xc5, 0x92} },
+	[0xeb - 0xa0] = { 2, {0xc2, 0xba} },
+	[0xec - 0xa0] = { 2, {0xc3, 0x9e} },
+	[0xed - 0xa0] = { 2, {0xc5, 0xa6} },
+	[0xee - 0xa0] = { 2, {0xc5, 0x8a} },
+	[0xef - 0xa0] = { 2, {0xc5, 0x89} },
+	[0xf0 - 0xa0] = { 2, {0xc4, 0xb8} },
+	[0xf1 - 0xa0] = { 2, {0xc3, 0xa6} },
+	[0xf2 - 0xa0] = { 2, {0xc4, 0x91} },
+	[0xf3 - 0xa0] = { 2, {0xc3, 0xb0} },
+	[0xf4 - 0xa0] = { 2, {0xc4, 0xa7} },
+	[0xf5 - 0xa0] = { 2, {0xc4, 0xb1} },
+	[0xf6 - 0xa0] = { 2, {0xc4, 0xb3} },
+	[0xf7 - 0xa0] = { 2, {0xc5, 0x80} },
+	[0xf8 - 0xa0] = { 2, {0xc5, 0x82} },
+	[0xf9 - 0xa0] = { 2, {0xc3, 0xb8} },
+	[0xfa - 0xa0] = { 2, {0xc5, 0x93} },
+	[0xfb - 0xa0] = { 2, {0xc3, 0x9f} },
+	[0xfc - 0xa0] = { 2, {0xc3, 0xbe} },
+	[0xfd - 0xa0] = { 2, {0xc5, 0xa7} },
+	[0xfe - 0xa0] = { 2, {0xc5, 0x8b} },
+	[0xff - 0xa0] = { 2, {0xc2, 0xad} },
+};
+
+/* the combining mark for each ISO 6937 diacritic from 0xc1, 0 if unused */
+static const uint16_t iso6937_combining[15] = {
+	0x0300, 0x0301, 0x0302, 0x0303, 0x0304, 0x0306, 0x0307, 0x0308,
+	0x0000, 0x030a, 0x0327, 0x0000, 0x030b, 0x0328, 0x030c,
+};
+
+struct text_table {
+	struct text_char chars[256];
+
+	/* ISO 6937 only: diacritic (0xc1-0xcf) followed by 0x20-0x7f */
+	struct text_char (*combined)[0x60];
+};
+
+struct dvb_text_decoder {
+	int flags;
+	int default_charset;
+	char *custom_charset;
+
+	/* conversion from UTF-8 to the output charset, unless that is UTF-8 */
+	iconv_t output;
+	int output_ascii;
+
+	/* built or opened on first use */
+	struct text_table *tables[CS_COUNT];
+	iconv_t converters[CS_COUNT];
+
+	/* UTF-8 intermediate for other output charsets */
+	char *scratch;
+	size_t scratch_size;
+};
+
+#define TEXT_HIGH_BITS 0x8080808080808080ULL
+#define TEXT_PRINTABLE_BIAS 0x6060606060606060ULL
+
+/*
+ * Are the next eight bytes all in 0x20-0x7f? Adding 0x60 to such a byte
+ * sets its top bit, and cannot carry into the next byte.
+ */
+static inline int text_printable8(const uint8_t *buf)
+{
+	uint64_t x;
+
+	memcpy(&x, buf, sizeof(x));
+	return !(x & TEXT_HIGH_BITS) &&
+	       (((x + TEXT_PRINTABLE_BIAS) & TEXT_HIGH_BITS) == TEXT_HIGH_BITS);
+}
+
+static int text_utf8_put(uint32_t cp, uint8_t *buf)
+{
+	if (cp < 0x80) {
+		buf[0] = cp;
+		return 1;
+	}
+	if (cp < 0x800) {
+		buf[0] = 0xc0 | (cp >> 6);
+		buf[1] = 0x80 | (cp & 0x3f);
+		return 2;
+	}
+	buf[0] = 0xe0 | (cp >> 12);
+	buf[1] = 0x80 | ((cp >> 6) & 0x3f);
+	buf[2] = 0x80 | (cp & 0x3f);
+	return 3;
+}
+
+/* convert a short sequence with iconv into a table entry */
+static void text_iconv_char(iconv_t cd, const uint8_t *in, size_t inlen, struct text_char *c)
+{
+	char buf[8];
+	char *inp = (char *) in;
+	char *outp = buf;
+	size_t outleft = sizeof(buf);
+
+	c->len = 0;
+	if (cd == (iconv_t) -1)
+		return;
+	iconv(cd, NULL, NULL, NULL, NULL);
+	if ((iconv(cd, &inp, &inlen, &outp, &outleft) == (size_t) -1) || inlen)
+		return;
+	if ((outp - buf) > (int) sizeof(c->data))
+		return;
+	c->len = outp - buf;
+	memcpy(c->data, buf, c->len);
+}
+
+static struct text_table *text_build_table(int charset)
+{
+	struct text_table *table;
+	iconv_t cd;
+	int c, base;
+
+	if ((table = calloc(1, sizeof(struct text_table))) == NULL)
+		return NULL;
+
+	/* C0 and C1 control codes are handled by the callers */
+	for (c = 0x20; c < 0x80; c++) {
+		table->chars[c].len = 1;
+		table->chars[c].data[0] = c;
+	}
+
+	if (charset == CS_ISO6937) {
+		uint8_t pair[2];
+
+		memcpy(table->chars + 0xa0, iso6937_high, sizeof(iso6937_high));
+
+		table->combined = calloc(15, sizeof(*table->combined));
+		if (table->combined == NULL) {
+			free(table);
+			return NULL;
+		}
+
+		/* precomposed if iconv knows one, else the base and a combining mark */
+		cd = iconv_open("UTF-8", charset_names[CS_ISO6937]);
+		for (c = 0xc1; c <= 0xcf; c++) {
+			for (base = 0x20; base < 0x80; base++) {
+				struct text_char *tc = &table->combined[c - 0xc1][base - 0x20];
+
+				pair[0] = c;
+				pair[1] = base;
+				text_iconv_char(cd, pair, 2, tc);
+				if (tc->len)
+					continue;
+				tc->len = 1;
+				tc->data[0] = base;
+				if (iso6937_combining[c - 0xc1])
+					tc->len += text_utf8_put(iso6937_combining[c - 0xc1], tc->data + 1);
+			}
+		}
+		if (cd != (iconv_t) -1)
+			iconv_close(cd);
+	} else if (charset == CS_ISO8859_1) {
+		for (c = 0xa0; c < 0x100; c++)
+			table->chars[c].len = text_utf8_put(c, table->chars[c].data);
+	} else {
+		uint8_t byte;
+
+		cd = iconv_open("UTF-8", charset_names[charset]);
+		for (c = 0xa0; c < 0x100; c++) {
+			byte = c;
+			text_iconv_char(cd, &byte, 1, &table->chars[c]);
+		}
+		if (cd != (iconv_t) -1)
+			iconv_close(cd);
+	}
+
+	return table;
+}
+
+/* returns the character to output for a control code, or 0 */
+static inline int text_control(struct dvb_text_decoder *decoder, int c, int *emphasis)
+{
+	switch(c) {
+	case 0x86:
+		if (decoder->flags & DVB_TEXT_EMPHASIS) {
+			*emphasis = 1;
+			return '*';
+		}
+		break;
+
+	case 0x87:
+		if ((decoder->flags & DVB_TEXT_EMPHASIS) && *emphasis) {
+			*emphasis = 0;
+			return '*';
+		}
+		break;
+
+	case 0x8a:
+		if (decoder->flags & DVB_TEXT_NEWLINES)
+			return '\n';
+		break;
+	}
+
+	return 0;
+}
+
+static size_t text_decode_table(struct dvb_text_decoder *decoder, struct text_table *table,
+				const uint8_t *in, size_t len, char *out, size_t max, int *ascii)
+{
+	const struct text_char *tc;
+	size_t i = 0;
+	size_t o = 0;
+	int emphasis = 0;
+	int c;
+
+	while (i < len) {
+		while (((i + 8) <= len) && ((o + 8) <= max) && text_printable8(in + i)) {
+			memcpy(out + o, in + i, 8);
+			i += 8;
+			o += 8;
+		}
+		if (i == len)
+			break;
+
+		c = in[i];
+		if ((c >= 0x20) && (c < 0x80)) {
+			if (o == max)
+				break;
+			out[o++] = c;
+			i++;
+			continue;
+		}
+		if (c < 0xa0) {
+			if ((c >= 0x80) && (c = text_control(decoder, c, &emphasis))) {
+				if (o == max)
+					break;
+				out[o++] = c;
+			}
+			i++;
+			continue;
+		}
+
+		*ascii = 0;
+		if (table->combined && (c >= 0xc1) && (c <= 0xcf)) {
+			/* a diacritic applies to the following letter */
+			if (((i + 1) == len) || (in[i + 1] < 0x20) || (in[i + 1] >= 0x80)) {
+				i++;
+				continue;
+			}
+			tc = &table->combined[c - 0xc1][in[i + 1] - 0x20];
+			i += 2;
+		} else {
+			tc = &table->chars[c];
+			i++;
+		}
+		if ((o + tc->len) > max)
+			break;
+		memcpy(out + o, tc->data, tc->len);
+		o += tc->len;
+	}
+
+	if (emphasis && (o < max))
+		out[o++] = '*';
+	return o;
+}
+
+static size_t text_decode_utf8(struct dvb_text_decoder *decoder,
+			       const uint8_t *in, size_t len, char *out, size_t max, int *ascii)
+{
+	size_t i = 0;
+	size_t o = 0;
+	int emphasis = 0;
+	int c, n;
+
+	while (i < len) {
+		while (((i + 8) <= len) && ((o + 8) <= max) && text_printable8(in + i)) {
+			memcpy(out + o, in + i, 8);
+			i += 8;
+			o += 8;
+		}
+		if (i == len)
+			break;
+
+		c = in[i];
+		if (c < 0x80) {
+			if (c >= 0x20) {
+				if (o == max)
+					break;
+				out[o++] = c;
+			}
+			i++;
+			continue;
+		}
+
+		/* the control codes are U+0080-U+009F */
+		if ((c == 0xc2) && ((i + 1) < len) && (in[i + 1] >= 0x80) && (in[i + 1] < 0xa0)) {
+			if ((c = text_control(decoder, in[i + 1], &emphasis))) {
+				if (o == max)
+					break;
+				out[o++] = c;
+			}
+			i += 2;
+			continue;
+		}
+
+		*ascii = 0;
+		if (c >= 0xf0)
+			n = 4;
+		else if (c >= 0xe0)
+			n = 3;
+		else if (c >= 0xc0)
+			n = 2;
+		else {
+			/* stray continuation byte */
+			i++;
+			continue;
+		}
+		if ((i + n) > len)
+			break;
+		if ((o + n) > max)
+			break;
+		memcpy(out + o, in + i, n);
+		i += n;
+		o += n;
+	}
+
+	if (emphasis && (o < max))
+		out[o++] = '*';
+	return o;
+}
+
+static size_t text_decode_iconv(struct dvb_text_decoder *decoder, int charset,
+				const uint8_t *in, size_t len, char *out, size_t max, int *ascii)
+{
+	iconv_t cd = decoder->converters[charset];
+	char *inp = (char *) in;
+	char *outp = out;
+	size_t inleft = len;
+	size_t outleft = max;
+
+	if (cd == (iconv_t) -1) {
+		const char *name = (charset == CS_CUSTOM) ? decoder->custom_charset : charset_names[charset];
+
+		if ((cd = iconv_open("UTF-8", name)) == (iconv_t) -1)
+			return 0;
+		decoder->converters[charset] = cd;
+	}
+
+	*ascii = 0;
+	iconv(cd, NULL, NULL, NULL, NULL);
+	while (inleft) {
+		if (iconv(cd, &inp, &inleft, &outp, &outleft) != (size_t) -1)
+			break;
+		if (errno != EILSEQ)
+			break;
+		/* skip what cannot be converted */
+		inp++;
+		inleft--;
+	}
+
+	return outp - out;
+}
+
+static int text_detect_charset(const uint8_t *in, size_t len, size_t *consumed, int def)
+{
+	*consumed = 0;
+	if ((len == 0) || (in[0] >= 0x20))
+		return def;
+
+	if (in[0] == 0x10) {
+		*consumed = (len < 3) ? len : 3;
+		if ((len >= 3) && (in[1] == 0) && (in[2] >= 1) && (in[2] <= 15) && (in[2] != 12))
+			return CS_ISO8859_1 + in[2] - 1;
+		return def;
+	}
+	if (in[0] == 0x1f) {
+		/* encoding_type_id: not supported */
+		*consumed = (len < 2) ? len : 2;
+		return def;
+	}
+
+	*consumed = 1;
+	if (((in[0] >= 0x01) && (in[0] <= 0x07)) || ((in[0] >= 0x09) && (in[0] <= 0x0b)))
+		return CS_ISO8859_1 + in[0] + 3;
+	switch(in[0]) {
+	case 0x11:
+		return CS_UTF16;
+	case 0x12:
+		return CS_EUCKR;
+	case 0x13:
+		return CS_GB2312;
+	case 0x14:
+		return CS_BIG5;
+	case 0x15:
+		return CS_UTF8;
+	}
+	return def;
+}
+
+/* map an iconv charset name onto one of the tables, ignoring case, '-', '_' and options */
+static int text_charset_by_name(const char *name)
+{
+	char buf[32];
+	int i = 0;
+
+	for (; *name && (*name != '/') && (i < (int) sizeof(buf) - 1); name++) {
+		if ((*name == '-') || (*name == '_'))
+			continue;
+		buf[i++] = tolower((unsigned char) *name);
+	}
+	buf[i] = 0;
+
+	if (!strcmp(buf, "iso6937"))
+		return CS_ISO6937;
+	if (!strcmp(buf, "utf8"))
+		return CS_UTF8;
+	if (!strncmp(buf, "iso8859", 7)) {
+		int n = atoi(buf + 7);
+		if ((n >= 1) && (n <= 15) && (n != 12))
+			return CS_ISO8859_1 + n - 1;
+	}
+	return CS_CUSTOM;
+}
+
+static size_t text_decode_utf8_out(struct dvb_text_decoder *decoder,
+				   const uint8_t *in, size_t len, char *out, size_t max, int *ascii)
+{
+	size_t consumed;
+	int charset;
+
+	*ascii = 1;
+	charset = text_detect_charset(in, len, &consumed, decoder->default_charset);
+	in += consumed;
+	len -= consumed;
+
+	switch(charset) {
+	case CS_UTF8:
+		return text_decode_utf8(decoder, in, len, out, max, ascii);
+
+	case CS_UTF16:
+	case CS_EUCKR:
+	case CS_GB2312:
+	case CS_BIG5:
+	case CS_CUSTOM:
+		return text_decode_iconv(decoder, charset, in, len, out, max, ascii);
+	}
+
+	if (decoder->tables[charset] == NULL) {
+		if ((decoder->tables[charset] = text_build_table(charset)) == NULL)
+			return 0;
+	}
+	return text_decode_table(decoder, decoder->tables[charset], in, len, out, max, ascii);
+}
+
+int dvb_text_decode(struct dvb_text_decoder *decoder,
+		    const uint8_t *in, size_t inlen,
+		    char *out, size_t outlen)
+{
+	char *inp, *outp;
+	size_t len, outleft;
+	int ascii;
+
+	if (outlen == 0)
+		return -1;
+
+	if (decoder->output == (iconv_t) -1) {
+		len = text_decode_utf8_out(decoder, in, inlen, out, outlen - 1, &ascii);
+		out[len] = 0;
+		return len;
+	}
+
+	/* decode to UTF-8, then convert that */
+	if (decoder->scratch_size < ((inlen * 3) + 1)) {
+		char *scratch = realloc(decoder->scratch, (inlen * 3) + 1);
+		if (scratch == NULL) {
+			out[0] = 0;
+			return 0;
+		}
+		decoder->scratch = scratch;
+		decoder->scratch_size = (inlen * 3) + 1;
+	}
+	len = text_decode_utf8_out(decoder, in, inlen, decoder->scratch, decoder->scratch_size, &ascii);
+
+	if (ascii && decoder->output_ascii) {
+		if (len > (outlen - 1))
+			len = outlen - 1;
+		memcpy(out, decoder->scratch, len);
+		out[len] = 0;
+		return len;
+	}
+
+	inp = decoder->scratch;
+	outp = out;
+	outleft = outlen - 1;
+	iconv(decoder->output, NULL, NULL, NULL, NULL);
+	while (len) {
+		if (iconv(decoder->output, &inp, &len, &outp, &outleft) != (size_t) -1)
+			break;
+		if (errno != EILSEQ)
+			break;
+		/* skip the whole UTF-8 character which cannot be converted */
+		do {
+			inp++;
+			len--;
+		} while (len && ((*inp & 0xc0) == 0x80));
+	}
+	*outp = 0;
+	return outp - out;
+}
+
+struct dvb_text_decoder *dvb_text_decoder_create(const char *output_charset,
+						 const char *default_charset,
+						 int flags)
+{
+	struct dvb_text_decoder *decoder;
+	int i;
+
+	if ((decoder = calloc(1, sizeof(struct dvb_text_decoder))) == NULL)
+		return NULL;
+	decoder->flags = flags;
+	decoder->output = (iconv_t) -1;
+	for (i = 0; i < CS_COUNT; i++)
+		decoder->converters[i] = (iconv_t) -1;
+
+	decoder->default_charset = CS_ISO6937;
+	if (default_charset != NULL) {
+		decoder->default_charset = text_charset_by_name(default_charset);
+		if (decoder->default_charset == CS_CUSTOM) {
+			if ((decoder->custom_charset = strdup(default_charset)) == NULL) {
+				dvb_text_decoder_destroy(decoder);
+				return NULL;
+			}
+		}
+	}
+
+	if ((output_charset != NULL) && (text_charset_by_name(output_charset) != CS_UTF8)) {
+		char a[] = "A";
+		char buf[8];
+		char *inp = a;
+		char *outp = buf;
+		size_t inleft = 1;
+		size_t outleft = sizeof(buf);
+
+		if ((decoder->output = iconv_open(output_charset, "UTF-8")) == (iconv_t) -1) {
+			dvb_text_decoder_destroy(decoder);
+			return NULL;
+		}
+
+		/* can ASCII be copied straight to the output? */
+		if ((iconv(decoder->output, &inp, &inleft, &outp, &outleft) != (size_t) -1) &&
+		    ((outp - buf) == 1) && (buf[0] == 'A'))
+			decoder->output_ascii = 1;
+	}
+
+	return decoder;
+}
+
+void dvb_text_decoder_destroy(struct dvb_text_decoder *decoder)
+{
+	int i;
+
+	for (i = 0; i < CS_COUNT; i++) {
+		if (decoder->tables[i] != NULL) {
+			free(decoder->tables[i]->combined);
+			free(decoder->tables[i]);
+		}
+		if (decoder->converters[i] != (iconv_t) -1)
+			iconv_close(decoder->converters[i]);
+	}
+	if (decoder->output != (iconv_t) -1)
+		iconv_close(decoder->output);
+	free(decoder->custom_charset);
+	free(decoder->scratch);
+	free(decoder);
+}
@@ -0,0 +1,101 @@
+/*
+ * DVB text decoding (EN 300 468 Annex A).
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ */
+
+#ifndef _UCSI_DVB_TEXT_H
+#define _UCSI_DVB_TEXT_H 1
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include <stdint.h>
+#include <stddef.h>
+
+/*
+ * Converts the text fields of DVB descriptors (service names, event titles
+ * and so on) to a given output charset. The character table selection at
+ * the start of each string is honoured; the single byte control codes are
+ * removed or rendered according to the decoder's flags.
+ *
+ * ISO 6937 (the DVB default, with the euro sign at 0xa4) and the ISO 8859
+ * tables are decoded with lookup tables, which are built on first use; the
+ * other tables go through iconv, whose handles are opened once and kept.
+ * Runs of printable ASCII are copied eight bytes at a time. A decoder is
+ * therefore meant to be created once and reused for every string; it must
+ * not be used by two threads at the same time.
+ */
+
+/**
+ * Flags for dvb_text_decoder_create().
+ */
+enum dvb_text_flags {
+	DVB_TEXT_EMPHASIS =	0x01,	/* render emphasis on/off (0x86/0x87) as '*' */
+	DVB_TEXT_NEWLINES =	0x02,	/* render CR/LF (0x8a) as '\n' */
+};
+
+/**
+ * Opaque decoder state.
+ */
+struct dvb_text_decoder;
+
+/**
+ * Create a decoder.
+ *
+ * @param output_charset iconv name of the charset to produce (e.g.
+ * "ISO-8859-1//TRANSLIT"), or NULL for UTF-8.
+ * @param default_charset iconv name of the charset of strings without a
+ * character table selection, or NULL for ISO 6937 as EN 300 468 specifies.
+ * @param flags Combination of DVB_TEXT_* flags.
+ * @return The new decoder, or NULL if the output charset is not supported.
+ */
+extern struct dvb_text_decoder *dvb_text_decoder_create(const char *output_charset,
+							const char *default_charset,
+							int flags);
+
+/**
+ * Destroy a decoder.
+ *
+ * @param decoder The decoder.
+ */
+extern void dvb_text_decoder_destroy(struct dvb_text_decoder *decoder);
+
+/**
+ * Decode a DVB string into a caller-provided buffer. The output is always
+ * NUL terminated; if the buffer is too small it is truncated on a character
+ * boundary. Characters which cannot be decoded are dropped.
+ *
+ * Decoding to UTF-8 needs at most 3 bytes per input byte, plus one for a
+ * closing emphasis mark and one for the terminator.
+ *
+ * @param decoder The decoder.
+ * @param in The string, including any character table selection.
+ * @param inlen Length of the string.
+ * @param out Where to put the result.
+ * @param outlen Size of out.
+ * @return Length of the result, excluding the terminator, or -1 if outlen is 0.
+ */
+extern int dvb_text_decode(struct dvb_text_decoder *decoder,
+			   const uint8_t *in, size_t inlen,
+			   char *out, size_t outlen);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
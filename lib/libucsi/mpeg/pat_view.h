@@ -0,0 +1,128 @@
+/*
+ * section and descriptor parser - read-only PAT view
+ *
+ * Copyright (C) 2005 Kenneth Aafloy (kenneth@linuxtv.org)
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ */
+
+#ifndef _UCSI_MPEG_PAT_VIEW_H
+#define _UCSI_MPEG_PAT_VIEW_H 1
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include <libucsi/section_view.h>
+
+/**
+ * Read-only view of an mpeg_pat_section.
+ */
+struct mpeg_pat_view {
+	struct section_ext_view head; /* table_id_ext == transport_stream_id */
+
+	/* struct mpeg_pat_program_view programs[] */
+} __ucsi_packed;
+
+/**
+ * Read-only view of an mpeg_pat_program.
+ */
+struct mpeg_pat_program_view {
+	uint8_t data[4];
+} __ucsi_packed;
+
+/**
+ * Validate a PAT without modifying it.
+ *
+ * @param section The section_ext view.
+ * @return Pointer to the PAT view, or NULL on error.
+ */
+extern const struct mpeg_pat_view *mpeg_pat_view_decode(const struct section_ext_view *section);
+
+/**
+ * Accessor for the transport_stream_id field of a PAT.
+ *
+ * @param pat PAT view.
+ * @return The transport_stream_id.
+ */
+static inline uint16_t mpeg_pat_view_transport_stream_id(const struct mpeg_pat_view *pat)
+{
+	return section_ext_view_table_id_ext(&pat->head);
+}
+
+/**
+ * Accessors for the fields of a PAT program entry.
+ */
+static inline uint16_t mpeg_pat_program_view_program_number(const struct mpeg_pat_program_view *program)
+{
+	return ucsi_get16(program->data);
+}
+
+static inline uint16_t mpeg_pat_program_view_pid(const struct mpeg_pat_program_view *program)
+{
+	return ucsi_get16(program->data+2) & 0x1fff;
+}
+
+/**
+ * Iterator for the programs field in a PAT view.
+ *
+ * @param pat PAT view.
+ * @param pos Variable holding a pointer to the current mpeg_pat_program_view.
+ */
+#define mpeg_pat_view_programs_for_each(pat, pos) \
+	for ((pos) = mpeg_pat_view_programs_first(pat); \
+	     (pos); \
+	     (pos) = mpeg_pat_view_programs_next(pat, pos))
+
+
+
+
+
+
+
+
+
+
+/******************************** PRIVATE CODE ********************************/
+static inline const struct mpeg_pat_program_view *
+	mpeg_pat_view_programs_first(const struct mpeg_pat_view *pat)
+{
+	size_t pos = sizeof(struct mpeg_pat_view);
+
+	if (pos >= section_ext_view_length(&pat->head))
+		return NULL;
+
+	return (const struct mpeg_pat_program_view *)((const uint8_t *) pat + pos);
+}
+
+static inline const struct mpeg_pat_program_view *
+	mpeg_pat_view_programs_next(const struct mpeg_pat_view *pat,
+				    const struct mpeg_pat_program_view *pos)
+{
+	const uint8_t *end = (const uint8_t *) pat + section_ext_view_length(&pat->head);
+	const uint8_t *next = (const uint8_t *) pos + sizeof(struct mpeg_pat_program_view);
+
+	if (next >= end)
+		return NULL;
+
+	return (const struct mpeg_pat_program_view *) next;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,67 @@
+/*
+ * section and descriptor parser
+ *
+ * Copyright (C) 2005 Kenneth Aafloy (kenneth@linuxtv.org)
+ * Copyright (C) 2005 Andrew de Quincey (adq_dvb@lidskialf.net)
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ */
+
+#include <libucsi/mpeg/pmt_view.h>
+
+const struct mpeg_pmt_view *mpeg_pmt_view_decode(const struct section_ext_view *ext)
+{
+	const uint8_t *buf = (const uint8_t *) ext;
+	const struct mpeg_pmt_view *pmt = (const struct mpeg_pmt_view *) ext;
+	size_t pos = sizeof(struct mpeg_pmt_view);
+	size_t len = section_ext_view_length(ext);
+	size_t info_len;
+
+	if (len < sizeof(struct mpeg_pmt_view))
+		return NULL;
+
+	info_len = mpeg_pmt_view_program_info_length(pmt);
+	if ((pos + info_len) > len)
+		return NULL;
+
+	if (verify_descriptors((uint8_t *) buf + pos, info_len))
+		return NULL;
+
+	pos += info_len;
+
+	while (pos < len) {
+		const struct mpeg_pmt_stream_view *stream =
+			(const struct mpeg_pmt_stream_view *) (buf + pos);
+
+		if ((pos + sizeof(struct mpeg_pmt_stream_view)) > len)
+			return NULL;
+
+		pos += sizeof(struct mpeg_pmt_stream_view);
+		info_len = mpeg_pmt_stream_view_es_info_length(stream);
+
+		if ((pos + info_len) > len)
+			return NULL;
+
+		if (verify_descriptors((uint8_t *) buf + pos, info_len))
+			return NULL;
+
+		pos += info_len;
+	}
+
+	if (pos != len)
+		return NULL;
+
+	return pmt;
+}
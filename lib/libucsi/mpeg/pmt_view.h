@@ -0,0 +1,199 @@
+/*
+ * section and descriptor parser - read-only PMT view
+ *
+ * Copyright (C) 2005 Kenneth Aafloy (kenneth@linuxtv.org)
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ */
+
+#ifndef _UCSI_MPEG_PMT_VIEW_H
+#define _UCSI_MPEG_PMT_VIEW_H 1
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include <libucsi/section_view.h>
+
+/**
+ * Read-only view of an mpeg_pmt_section.
+ */
+struct mpeg_pmt_view {
+	struct section_ext_view head; /* table_id_ext == program_number */
+	uint8_t data[4];
+
+	/* struct descriptor descriptors[] */
+	/* struct mpeg_pmt_stream_view streams[] */
+} __ucsi_packed;
+
+/**
+ * Read-only view of an mpeg_pmt_stream.
+ */
+struct mpeg_pmt_stream_view {
+	uint8_t data[5];
+
+	/* struct descriptor descriptors[] */
+} __ucsi_packed;
+
+/**
+ * Validate a PMT without modifying it.
+ *
+ * @param section The section_ext view.
+ * @return Pointer to the PMT view, or NULL on error.
+ */
+extern const struct mpeg_pmt_view *mpeg_pmt_view_decode(const struct section_ext_view *section);
+
+/**
+ * Accessors for the fields of a PMT.
+ */
+static inline uint16_t mpeg_pmt_view_program_number(const struct mpeg_pmt_view *pmt)
+{
+	return section_ext_view_table_id_ext(&pmt->head);
+}
+
+static inline uint16_t mpeg_pmt_view_pcr_pid(const struct mpeg_pmt_view *pmt)
+{
+	return ucsi_get16(pmt->data) & 0x1fff;
+}
+
+static inline uint16_t mpeg_pmt_view_program_info_length(const struct mpeg_pmt_view *pmt)
+{
+	return ucsi_get16(pmt->data+2) & 0x0fff;
+}
+
+/**
+ * Accessors for the fields of a PMT stream entry.
+ */
+static inline uint8_t mpeg_pmt_stream_view_stream_type(const struct mpeg_pmt_stream_view *stream)
+{
+	return stream->data[0];
+}
+
+static inline uint16_t mpeg_pmt_stream_view_pid(const struct mpeg_pmt_stream_view *stream)
+{
+	return ucsi_get16(stream->data+1) & 0x1fff;
+}
+
+static inline uint16_t mpeg_pmt_stream_view_es_info_length(const struct mpeg_pmt_stream_view *stream)
+{
+	return ucsi_get16(stream->data+3) & 0x0fff;
+}
+
+/**
+ * Iterator for the descriptors field in a PMT view.
+ *
+ * @param pmt PMT view.
+ * @param pos Variable holding a const pointer to the current descriptor.
+ */
+#define mpeg_pmt_view_descriptors_for_each(pmt, pos) \
+	for ((pos) = mpeg_pmt_view_descriptors_first(pmt); \
+	     (pos); \
+	     (pos) = mpeg_pmt_view_descriptors_next(pmt, pos))
+
+/**
+ * Iterator for the streams field in a PMT view.
+ *
+ * @param pmt PMT view.
+ * @param pos Variable holding a pointer to the current mpeg_pmt_stream_view.
+ */
+#define mpeg_pmt_view_streams_for_each(pmt, pos) \
+	for ((pos) = mpeg_pmt_view_streams_first(pmt); \
+	     (pos); \
+	     (pos) = mpeg_pmt_view_streams_next(pmt, pos))
+
+/**
+ * Iterator for the descriptors field in a PMT stream view.
+ *
+ * @param stream PMT stream view.
+ * @param pos Variable holding a const pointer to the current descriptor.
+ */
+#define mpeg_pmt_stream_view_descriptors_for_each(stream, pos) \
+	for ((pos) = mpeg_pmt_stream_view_descriptors_first(stream); \
+	     (pos); \
+	     (pos) = mpeg_pmt_stream_view_descriptors_next(stream, pos))
+
+
+
+
+
+
+
+
+
+
+/******************************** PRIVATE CODE ********************************/
+static inline const struct descriptor *
+	mpeg_pmt_view_descriptors_first(const struct mpeg_pmt_view *pmt)
+{
+	return view_first_descriptor((const uint8_t *) pmt + sizeof(struct mpeg_pmt_view),
+				     mpeg_pmt_view_program_info_length(pmt));
+}
+
+static inline const struct descriptor *
+	mpeg_pmt_view_descriptors_next(const struct mpeg_pmt_view *pmt,
+				       const struct descriptor *pos)
+{
+	return view_next_descriptor((const uint8_t *) pmt + sizeof(struct mpeg_pmt_view),
+				    mpeg_pmt_view_program_info_length(pmt),
+				    pos);
+}
+
+static inline const struct mpeg_pmt_stream_view *
+	mpeg_pmt_view_streams_first(const struct mpeg_pmt_view *pmt)
+{
+	size_t pos = sizeof(struct mpeg_pmt_view) + mpeg_pmt_view_program_info_length(pmt);
+
+	if (pos >= section_ext_view_length(&pmt->head))
+		return NULL;
+
+	return (const struct mpeg_pmt_stream_view *)((const uint8_t *) pmt + pos);
+}
+
+static inline const struct mpeg_pmt_stream_view *
+	mpeg_pmt_view_streams_next(const struct mpeg_pmt_view *pmt,
+				   const struct mpeg_pmt_stream_view *pos)
+{
+	const uint8_t *end = (const uint8_t *) pmt + section_ext_view_length(&pmt->head);
+	const uint8_t *next = (const uint8_t *) pos + sizeof(struct mpeg_pmt_stream_view) +
+			      mpeg_pmt_stream_view_es_info_length(pos);
+
+	if (next >= end)
+		return NULL;
+
+	return (const struct mpeg_pmt_stream_view *) next;
+}
+
+static inline const struct descriptor *
+	mpeg_pmt_stream_view_descriptors_first(const struct mpeg_pmt_stream_view *stream)
+{
+	return view_first_descriptor((const uint8_t *) stream + sizeof(struct mpeg_pmt_stream_view),
+				     mpeg_pmt_stream_view_es_info_length(stream));
+}
+
+static inline const struct descriptor *
+	mpeg_pmt_stream_view_descriptors_next(const struct mpeg_pmt_stream_view *stream,
+					      const struct descriptor *pos)
+{
+	return view_next_descriptor((const uint8_t *) stream + sizeof(struct mpeg_pmt_stream_view),
+				    mpeg_pmt_stream_view_es_info_length(stream),
+				    pos);
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -34,6 +34,8 @@ extern "C"
 #include <libucsi/mpeg/tsdt_section.h>
 #include <libucsi/mpeg/metadata_section.h>
 #include <libucsi/mpeg/datagram_section.h>
+#include <libucsi/mpeg/pat_view.h>
+#include <libucsi/mpeg/pmt_view.h>
 
 #define TRANSPORT_PAT_PID 0x00
 #define TRANSPORT_CAT_PID 0x01
@@ -0,0 +1,322 @@
+/*
+ * Multi-section PSI table assembler.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "psi_table.h"
+#include "crc32.h"
+
+#define PSI_TABLE_HASH_SIZE 256
+
+/* bytes compared on the fast path: everything up to last_section_number */
+#define PSI_TABLE_HEADER_BYTES 8
+
+struct psi_table_entry {
+	struct psi_table_entry *next;
+
+	struct psi_table table;
+	uint16_t *alloc;	/* allocated size of each section buffer */
+	int nsections;		/* entries in table.sections and alloc */
+
+	int valid;		/* table.version_number is meaningful */
+	int received_count;
+	uint8_t received[32];	/* bitmap of sections held */
+};
+
+struct psi_table_collector {
+	struct psi_table_entry *hash[PSI_TABLE_HASH_SIZE];
+	struct psi_table_entry *last;	/* most recently fed table */
+
+	int flags;
+	psi_table_callback callback;
+	void *arg;
+
+	struct psi_table_stats stats;
+};
+
+static inline int psi_table_hash(int pid, int table_id, int table_id_ext)
+{
+	return (pid ^ (table_id << 5) ^ table_id_ext ^ (table_id_ext >> 8)) & (PSI_TABLE_HASH_SIZE - 1);
+}
+
+static inline int psi_table_matches(struct psi_table_entry *e, int pid, int table_id, int table_id_ext)
+{
+	return (e->table.pid == pid) &&
+	       (e->table.table_id == table_id) &&
+	       (e->table.table_id_ext == table_id_ext);
+}
+
+static struct psi_table_entry *psi_table_find(struct psi_table_collector *c,
+					      int pid, int table_id, int table_id_ext)
+{
+	struct psi_table_entry *e;
+
+	if ((c->last != NULL) && psi_table_matches(c->last, pid, table_id, table_id_ext))
+		return c->last;
+
+	for (e = c->hash[psi_table_hash(pid, table_id, table_id_ext)]; e; e = e->next) {
+		if (psi_table_matches(e, pid, table_id, table_id_ext)) {
+			c->last = e;
+			return e;
+		}
+	}
+
+	return NULL;
+}
+
+static struct psi_table_entry *psi_table_add(struct psi_table_collector *c,
+					     int pid, int table_id, int table_id_ext)
+{
+	struct psi_table_entry *e;
+	int bucket = psi_table_hash(pid, table_id, table_id_ext);
+
+	if ((e = calloc(1, sizeof(struct psi_table_entry))) == NULL)
+		return NULL;
+	e->table.pid = pid;
+	e->table.table_id = table_id;
+	e->table.table_id_ext = table_id_ext;
+
+	e->next = c->hash[bucket];
+	c->hash[bucket] = e;
+	c->last = e;
+	return e;
+}
+
+static void psi_table_free(struct psi_table_entry *e)
+{
+	int i;
+
+	for (i = 0; i < e->nsections; i++)
+		free(e->table.sections[i].data);
+	free(e->table.sections);
+	free(e->alloc);
+	free(e);
+}
+
+/*
+ * Discard the sections held and start collecting a new version.
+ */
+static int psi_table_restart(struct psi_table_entry *e, int version, int last_section_number)
+{
+	int count = last_section_number + 1;
+
+	if (count > e->nsections) {
+		struct psi_table_section *sections;
+		uint16_t *alloc;
+
+		sections = realloc(e->table.sections, count * sizeof(struct psi_table_section));
+		if (sections == NULL)
+			return -1;
+		e->table.sections = sections;
+		alloc = realloc(e->alloc, count * sizeof(uint16_t));
+		if (alloc == NULL)
+			return -1;
+		e->alloc = alloc;
+
+		memset(e->table.sections + e->nsections, 0,
+		       (count - e->nsections) * sizeof(struct psi_table_section));
+		memset(e->alloc + e->nsections, 0, (count - e->nsections) * sizeof(uint16_t));
+		e->nsections = count;
+	}
+
+	e->table.version_number = version;
+	e->table.last_section_number = last_section_number;
+	e->valid = 1;
+	e->received_count = 0;
+	memset(e->received, 0, sizeof(e->received));
+	return 0;
+}
+
+static inline int psi_table_held(struct psi_table_entry *e, int section_number)
+{
+	return e->received[section_number >> 3] & (1 << (section_number & 7));
+}
+
+/*
+ * Is a section the same as the one held for its section_number? Only the
+ * header and the CRC are compared, which is enough for a carousel repeat.
+ */
+static inline int psi_table_same(struct psi_table_section *held, const uint8_t *buf, size_t len)
+{
+	return (held->len == len) &&
+	       !memcmp(held->data, buf, PSI_TABLE_HEADER_BYTES) &&
+	       !memcmp(held->data + len - 4, buf + len - 4, 4);
+}
+
+int psi_table_collector_feed(struct psi_table_collector *c, int pid,
+			     const uint8_t *buf, size_t len)
+{
+	struct psi_table_entry *e;
+	struct psi_table_section *section;
+	size_t section_len;
+	int table_id, table_id_ext, version, section_number, last_section_number;
+
+	c->stats.sections++;
+
+	/* header checks */
+	if ((len < PSI_TABLE_HEADER_BYTES + 4) || !(buf[1] & 0x80)) {
+		c->stats.invalid++;
+		return PSI_TABLE_INVALID;
+	}
+	section_len = (((buf[1] & 0x0f) << 8) | buf[2]) + 3;
+	if ((section_len > len) || (section_len < PSI_TABLE_HEADER_BYTES + 4)) {
+		c->stats.invalid++;
+		return PSI_TABLE_INVALID;
+	}
+	len = section_len;
+
+	table_id = buf[0];
+	table_id_ext = (buf[3] << 8) | buf[4];
+	version = (buf[5] >> 1) & 0x1f;
+	section_number = buf[6];
+	last_section_number = buf[7];
+	if (section_number > last_section_number) {
+		c->stats.invalid++;
+		return PSI_TABLE_INVALID;
+	}
+	if (!(buf[5] & 0x01)) {
+		c->stats.ignored++;
+		return PSI_TABLE_IGNORED;
+	}
+
+	if ((e = psi_table_find(c, pid, table_id, table_id_ext)) == NULL) {
+		if ((e = psi_table_add(c, pid, table_id, table_id_ext)) == NULL)
+			return PSI_TABLE_INVALID;
+	}
+
+	/* fast path: a repeat of a section we already hold */
+	if (e->valid &&
+	    (e->table.version_number == version) &&
+	    (e->table.last_section_number == last_section_number) &&
+	    psi_table_held(e, section_number)) {
+		if (psi_table_same(&e->table.sections[section_number], buf, len)) {
+			c->stats.repeats++;
+			return PSI_TABLE_REPEAT;
+		}
+	}
+
+	if ((c->flags & PSI_TABLE_CHECK_CRC) && crc32(CRC32_INIT, (uint8_t *) buf, len)) {
+		c->stats.crc_errors++;
+		return PSI_TABLE_INVALID;
+	}
+
+	/*
+	 * Anything else differing from what we hold means the table changed:
+	 * a new version, a new section count, or new content in a section
+	 * we already have (a broadcaster forgetting to bump the version).
+	 */
+	if (!e->valid ||
+	    (e->table.version_number != version) ||
+	    (e->table.last_section_number != last_section_number) ||
+	    psi_table_held(e, section_number)) {
+		if (e->valid)
+			c->stats.version_changes++;
+		if (psi_table_restart(e, version, last_section_number)) {
+			e->valid = 0;
+			return PSI_TABLE_INVALID;
+		}
+	}
+
+	/* store it */
+	section = &e->table.sections[section_number];
+	if (e->alloc[section_number] < len) {
+		uint8_t *data = realloc(section->data, len);
+		if (data == NULL)
+			return PSI_TABLE_INVALID;
+		section->data = data;
+		e->alloc[section_number] = len;
+	}
+	memcpy(section->data, buf, len);
+	section->len = len;
+	e->received[section_number >> 3] |= 1 << (section_number & 7);
+	e->received_count++;
+
+	if (e->received_count != last_section_number + 1)
+		return PSI_TABLE_SECTION;
+
+	c->stats.tables++;
+	c->callback(c->arg, &e->table);
+	return PSI_TABLE_COMPLETE;
+}
+
+struct psi_table_collector *psi_table_collector_create(int flags,
+						       psi_table_callback callback,
+						       void *arg)
+{
+	struct psi_table_collector *c;
+
+	if (callback == NULL)
+		return NULL;
+
+	if ((c = calloc(1, sizeof(struct psi_table_collector))) == NULL)
+		return NULL;
+	c->flags = flags;
+	c->callback = callback;
+	c->arg = arg;
+
+	return c;
+}
+
+void psi_table_collector_destroy(struct psi_table_collector *c)
+{
+	struct psi_table_entry *e, *next;
+	int i;
+
+	for (i = 0; i < PSI_TABLE_HASH_SIZE; i++) {
+		for (e = c->hash[i]; e; e = next) {
+			next = e->next;
+			psi_table_free(e);
+		}
+	}
+
+	free(c);
+}
+
+void psi_table_collector_forget(struct psi_table_collector *c, int pid,
+				int table_id, int table_id_ext)
+{
+	struct psi_table_entry *e;
+
+	if ((e = psi_table_find(c, pid, table_id, table_id_ext)) == NULL)
+		return;
+
+	/* keep the buffers, they will most likely be needed again */
+	e->valid = 0;
+	e->received_count = 0;
+	memset(e->received, 0, sizeof(e->received));
+}
+
+void psi_table_collector_reset(struct psi_table_collector *c)
+{
+	struct psi_table_entry *e, *next;
+	int i;
+
+	for (i = 0; i < PSI_TABLE_HASH_SIZE; i++) {
+		for (e = c->hash[i]; e; e = next) {
+			next = e->next;
+			psi_table_free(e);
+		}
+		c->hash[i] = NULL;
+	}
+	c->last = NULL;
+}
+
+const struct psi_table_stats *psi_table_collector_get_stats(struct psi_table_collector *c)
+{
+	return &c->stats;
+}
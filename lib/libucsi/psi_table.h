@@ -0,0 +1,168 @@
+/*
+ * Multi-section PSI table assembler.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ */
+
+#ifndef _UCSI_PSI_TABLE_H
+#define _UCSI_PSI_TABLE_H 1
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * Flags for psi_table_collector_create().
+ */
+enum psi_table_flags {
+	PSI_TABLE_CHECK_CRC =	0x01,	/* verify the CRC of each new section */
+};
+
+/**
+ * Results of psi_table_collector_feed().
+ */
+enum psi_table_result {
+	PSI_TABLE_INVALID = -1,		/* malformed section, or bad CRC */
+	PSI_TABLE_REPEAT = 0,		/* identical to a section already held */
+	PSI_TABLE_IGNORED = 1,		/* current_next_indicator not set */
+	PSI_TABLE_SECTION = 2,		/* new section stored, table incomplete */
+	PSI_TABLE_COMPLETE = 3,		/* new section completed the table */
+};
+
+/**
+ * One section of a table, in unmodified wire format.
+ */
+struct psi_table_section {
+	uint16_t len;		/* total length, including header and CRC */
+	uint8_t *data;
+};
+
+/**
+ * A complete table, as delivered to the callback.
+ */
+struct psi_table {
+	uint16_t pid;
+	uint8_t table_id;
+	uint16_t table_id_ext;
+	uint8_t version_number;
+	uint8_t last_section_number;
+	struct psi_table_section *sections;	/* last_section_number + 1 entries */
+};
+
+/**
+ * Counters maintained by the collector.
+ */
+struct psi_table_stats {
+	uint64_t sections;          /* sections fed */
+	uint64_t repeats;           /* sections dropped as unchanged repeats */
+	uint64_t ignored;           /* sections with current_next_indicator clear */
+	uint64_t tables;            /* complete tables delivered */
+	uint64_t version_changes;   /* times a held table was discarded for a new version */
+	uint64_t crc_errors;        /* sections discarded with a bad CRC */
+	uint64_t invalid;           /* sections discarded as malformed */
+};
+
+/**
+ * Callback invoked once for each complete new version of a table. The table
+ * and its section data are only valid for the duration of the callback and
+ * must not be modified; the in-place section codecs (section_codec() etc.)
+ * must be run on a copy. The callback may call psi_table_collector_forget()
+ * on the table it was given, e.g. to have it delivered again when it could
+ * not be processed.
+ *
+ * @param arg Private argument passed to psi_table_collector_create().
+ * @param table The complete table.
+ */
+typedef void (*psi_table_callback)(void *arg, struct psi_table *table);
+
+/**
+ * Opaque collector state.
+ */
+struct psi_table_collector;
+
+/**
+ * Create a new table collector. Tables are keyed by (pid, table_id,
+ * table_id_ext); sections without the section_syntax_indicator set are
+ * rejected.
+ *
+ * @param flags Combination of PSI_TABLE_* flags.
+ * @param callback Function to call with complete tables.
+ * @param arg Private argument for the callback.
+ * @return The new collector, or NULL on error.
+ */
+extern struct psi_table_collector *psi_table_collector_create(int flags,
+							      psi_table_callback callback,
+							      void *arg);
+
+/**
+ * Destroy a collector and all tables it holds.
+ *
+ * @param c The collector.
+ */
+extern void psi_table_collector_destroy(struct psi_table_collector *c);
+
+/**
+ * Feed a section into the collector. A section identical to one already
+ * held for the same table version is recognised by comparing its header
+ * and CRC only, and dropped without further work. A new version, or a
+ * change of content without a version change, discards the sections held
+ * so far. The callback is invoked before this function returns if the
+ * section completes the table.
+ *
+ * @param c The collector.
+ * @param pid The PID the section was received on.
+ * @param buf The section, in unmodified wire format.
+ * @param len Number of bytes in buf (at least the section length).
+ * @return One of the psi_table_result values.
+ */
+extern int psi_table_collector_feed(struct psi_table_collector *c, int pid,
+				    const uint8_t *buf, size_t len);
+
+/**
+ * Forget a table, so its current version is delivered again once it has
+ * been received in full.
+ *
+ * @param c The collector.
+ * @param pid The PID.
+ * @param table_id The table_id.
+ * @param table_id_ext The table_id_ext.
+ */
+extern void psi_table_collector_forget(struct psi_table_collector *c, int pid,
+				       int table_id, int table_id_ext);
+
+/**
+ * Forget all tables, e.g. after retuning.
+ *
+ * @param c The collector.
+ */
+extern void psi_table_collector_reset(struct psi_table_collector *c);
+
+/**
+ * Retrieve the counters of a collector.
+ *
+ * @param c The collector.
+ * @return Pointer to the counters.
+ */
+extern const struct psi_table_stats *psi_table_collector_get_stats(struct psi_table_collector *c);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
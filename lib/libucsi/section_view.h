@@ -0,0 +1,258 @@
+/*
+ * section and descriptor parser - read-only section views
+ *
+ * Copyright (C) 2005 Kenneth Aafloy (kenneth@linuxtv.org)
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ */
+
+#ifndef _UCSI_SECTION_VIEW_H
+#define _UCSI_SECTION_VIEW_H 1
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include <libucsi/section.h>
+
+/*
+ * The *_view API is an alternative to the *_codec functions for callers
+ * which cannot allow the section data to be modified: the codecs byteswap
+ * the data in place, whereas views never write to it. A view is simply a
+ * const pointer into the original wire data, which has been validated once
+ * by the relevant *_view_decode() function; all fields are then read through
+ * accessor functions. A buffer may therefore be decoded any number of
+ * times, shared read-only between threads, or used straight out of an
+ * mmap()ed file.
+ */
+
+/**
+ * Read-only view of a generic section header.
+ */
+struct section_view {
+	uint8_t data[3];
+} __ucsi_packed;
+
+/**
+ * Read-only view of a generic extended section header.
+ */
+struct section_ext_view {
+	uint8_t data[8];
+} __ucsi_packed;
+
+/**
+ * Validate a section in unmodified wire format.
+ *
+ * @param buf Pointer to the data.
+ * @param len Length of data.
+ * @return Pointer to the section view, or NULL if invalid.
+ */
+static inline const struct section_view *section_view_decode(const uint8_t *buf, size_t len)
+{
+	if (len < sizeof(struct section_view))
+		return NULL;
+
+	if (len != (ucsi_get16(buf+1) & 0x0fff) + 3U)
+		return NULL;
+
+	return (const struct section_view *) buf;
+}
+
+/**
+ * Retrieve the table_id of a section.
+ *
+ * @param section The section view.
+ * @return The table_id.
+ */
+static inline uint8_t section_view_table_id(const struct section_view *section)
+{
+	return section->data[0];
+}
+
+/**
+ * Retrieve the syntax_indicator of a section.
+ *
+ * @param section The section view.
+ * @return The syntax_indicator.
+ */
+static inline int section_view_syntax_indicator(const struct section_view *section)
+{
+	return section->data[1] >> 7;
+}
+
+/**
+ * Determine the total length of a section, including the header.
+ *
+ * @param section The section view.
+ * @return The length.
+ */
+static inline size_t section_view_length(const struct section_view *section)
+{
+	return (ucsi_get16(section->data+1) & 0x0fff) + sizeof(struct section_view);
+}
+
+/**
+ * Check the CRC of a section. The data is not modified.
+ *
+ * @param section The section view.
+ * @return Nonzero on error, or 0 if the CRC was correct.
+ */
+static inline int section_view_check_crc(const struct section_view *section)
+{
+	/* the crc check includes the crc value,
+	 * the result should therefore be zero.
+	 */
+	if (crc32(CRC32_INIT, (uint8_t *) section, section_view_length(section)))
+		return -1;
+	return 0;
+}
+
+/**
+ * Validate an extended section.
+ *
+ * @param section The section view.
+ * @param check_crc If 1, the CRC of the section will also be checked.
+ * @return Pointer to the section_ext view, or NULL if invalid.
+ */
+static inline const struct section_ext_view *
+	section_ext_view_decode(const struct section_view *section, int check_crc)
+{
+	if (section_view_syntax_indicator(section) == 0)
+		return NULL;
+
+	if (section_view_length(section) < sizeof(struct section_ext_view) + CRC_SIZE)
+		return NULL;
+
+	if (check_crc) {
+		if (section_view_check_crc(section))
+			return NULL;
+	}
+
+	return (const struct section_ext_view *) section;
+}
+
+/**
+ * Retrieve the generic section header of an extended section.
+ *
+ * @param section The section_ext view.
+ * @return The section view.
+ */
+static inline const struct section_view *
+	section_ext_view_head(const struct section_ext_view *section)
+{
+	return (const struct section_view *) section;
+}
+
+/**
+ * Determine the total length of an extended section, including the header,
+ * but omitting the CRC.
+ *
+ * @param section The section_ext view.
+ * @return The length.
+ */
+static inline size_t section_ext_view_length(const struct section_ext_view *section)
+{
+	return section_view_length(section_ext_view_head(section)) - CRC_SIZE;
+}
+
+/**
+ * Accessors for the extended section header fields.
+ */
+static inline uint8_t section_ext_view_table_id(const struct section_ext_view *section)
+{
+	return section->data[0];
+}
+
+static inline uint16_t section_ext_view_table_id_ext(const struct section_ext_view *section)
+{
+	return ucsi_get16(section->data+3);
+}
+
+static inline uint8_t section_ext_view_version_number(const struct section_ext_view *section)
+{
+	return (section->data[5] >> 1) & 0x1f;
+}
+
+static inline int section_ext_view_current_next_indicator(const struct section_ext_view *section)
+{
+	return section->data[5] & 0x01;
+}
+
+static inline uint8_t section_ext_view_section_number(const struct section_ext_view *section)
+{
+	return section->data[6];
+}
+
+static inline uint8_t section_ext_view_last_section_number(const struct section_ext_view *section)
+{
+	return section->data[7];
+}
+
+/**
+ * Retrieve the CRC stored in an extended section.
+ *
+ * @param section The section_ext view.
+ * @return The CRC value.
+ */
+static inline uint32_t section_ext_view_crc(const struct section_ext_view *section)
+{
+	return ucsi_get32((const uint8_t *) section + section_ext_view_length(section));
+}
+
+/**
+ * Retrieve pointer to the next descriptor in an unmodified descriptor loop.
+ *
+ * @param buf The buffer of descriptors.
+ * @param len Size of the buffer.
+ * @param pos Current descriptor.
+ * @return Pointer to next descriptor, or NULL if there are none.
+ */
+static inline const struct descriptor *
+	view_next_descriptor(const uint8_t *buf, size_t len, const struct descriptor *pos)
+{
+	const uint8_t *next;
+
+	if (pos == NULL)
+		return NULL;
+
+	next = (const uint8_t *) pos + 2 + pos->len;
+	if (next >= buf + len)
+		return NULL;
+
+	return (const struct descriptor *) next;
+}
+
+/**
+ * Retrieve pointer to the first descriptor in an unmodified descriptor loop.
+ *
+ * @param buf The buffer of descriptors.
+ * @param len Size of the buffer.
+ * @return Pointer to first descriptor, or NULL if there are none.
+ */
+static inline const struct descriptor *
+	view_first_descriptor(const uint8_t *buf, size_t len)
+{
+	if (len == 0)
+		return NULL;
+
+	return (const struct descriptor *) buf;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,326 @@
+/*
+ * Batched transport stream section demultiplexer.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include "ts_demux.h"
+
+struct ts_demux_pid {
+	unsigned char cstate;
+	struct section_buf *section;
+};
+
+struct ts_demux {
+	struct ts_demux_pid *pids[TRANSPORT_MAX_PIDS];
+
+	ts_demux_callback callback;
+	void *arg;
+
+	/* pending batch: section descriptors plus a copy of their data */
+	struct ts_demux_section *batch;
+	int batch_size;
+	int batch_count;
+	uint8_t *batch_data;
+	size_t batch_data_used;
+
+	/* partial packet left over from the previous feed */
+	uint8_t partial[TRANSPORT_PACKET_LENGTH];
+	size_t partial_len;
+	int synced;
+
+	struct ts_demux_stats stats;
+};
+
+static void ts_demux_flush(struct ts_demux *demux)
+{
+	if (demux->batch_count == 0)
+		return;
+
+	demux->stats.batches++;
+	demux->callback(demux->arg, demux->batch, demux->batch_count);
+	demux->batch_count = 0;
+	demux->batch_data_used = 0;
+}
+
+/**
+ * Copy a completed section into the batch, delivering the batch once it is
+ * full.
+ *
+ * @return 0 if the section's PID is still enabled, -1 if the batch callback
+ * removed it (in which case pidstate has been freed).
+ */
+static int ts_demux_queue_section(struct ts_demux *demux, int pid, struct ts_demux_pid *pidstate)
+{
+	struct section_buf *section = pidstate->section;
+	struct ts_demux_section *out;
+
+	/* copy first: the callback may free the section buffer */
+	out = demux->batch + demux->batch_count++;
+	out->pid = pid;
+	out->len = section->len;
+	out->data = demux->batch_data + demux->batch_data_used;
+	memcpy(out->data, section_buf_data(section), section->len);
+	demux->batch_data_used += section->len;
+	demux->stats.sections++;
+
+	/* every section fits in DVB_MAX_SECTION_BYTES, so only the count can fill up */
+	if (demux->batch_count == demux->batch_size) {
+		ts_demux_flush(demux);
+		if (demux->pids[pid] != pidstate)
+			return -1;
+	}
+
+	return 0;
+}
+
+static void ts_demux_packet(struct ts_demux *demux, const uint8_t *pkt)
+{
+	struct ts_demux_pid *pidstate;
+	const uint8_t *payload;
+	int payload_len;
+	int pdu_start;
+	int discontinuity = 0;
+	int used;
+	int section_status;
+	int pid;
+
+	demux->stats.packets++;
+
+	pid = ((pkt[1] & 0x1f) << 8) | pkt[2];
+	if ((pidstate = demux->pids[pid]) == NULL)
+		return;
+	demux->stats.filtered_packets++;
+
+	if (pkt[1] & 0x80) {
+		demux->stats.tei_errors++;
+		return;
+	}
+
+	/* locate the payload */
+	payload = pkt + sizeof(struct transport_packet);
+	if (pkt[3] & 0x20) {
+		int adaplength = *payload++;
+
+		if (adaplength > (TRANSPORT_PACKET_LENGTH - 5))
+			return;
+		if (adaplength)
+			discontinuity = payload[0] & transport_adaptation_flag_discontinuity;
+		payload += adaplength;
+	}
+	payload_len = (pkt + TRANSPORT_PACKET_LENGTH) - payload;
+
+	if (transport_packet_continuity_check((struct transport_packet *) pkt,
+					      discontinuity, &pidstate->cstate)) {
+		demux->stats.cc_errors++;
+		pidstate->cstate = 0;
+		section_buf_reset(pidstate->section);
+		return;
+	}
+
+	if (!(pkt[3] & 0x10))
+		return;
+
+	/* reassemble sections */
+	pdu_start = pkt[1] & 0x40;
+	while (payload_len) {
+		used = section_buf_add_transport_payload(pidstate->section,
+							 (uint8_t *) payload, payload_len,
+							 pdu_start, &section_status);
+		pdu_start = 0;
+		payload_len -= used;
+		payload += used;
+
+		if (section_status == 1) {
+			/* a batch callback may have removed this PID */
+			if (ts_demux_queue_section(demux, pid, pidstate))
+				return;
+			section_buf_reset(pidstate->section);
+		} else if (section_status < 0) {
+			demux->stats.section_errors++;
+			section_buf_reset(pidstate->section);
+		}
+	}
+}
+
+/**
+ * Find the next position where packets are aligned, i.e. two sync bytes
+ * TRANSPORT_PACKET_LENGTH apart (or a single sync byte at the very end).
+ */
+static size_t ts_demux_resync(const uint8_t *buf, size_t len)
+{
+	size_t pos;
+
+	for (pos = 0; pos < len; pos++) {
+		if (buf[pos] != TRANSPORT_PACKET_SYNC)
+			continue;
+		if ((pos + TRANSPORT_PACKET_LENGTH) >= len)
+			return pos;
+		if (buf[pos + TRANSPORT_PACKET_LENGTH] == TRANSPORT_PACKET_SYNC)
+			return pos;
+	}
+
+	return len;
+}
+
+void ts_demux_feed(struct ts_demux *demux, const uint8_t *buf, size_t len)
+{
+	size_t pos = 0;
+
+	/* complete any partial packet from last time */
+	if (demux->partial_len) {
+		size_t copy = TRANSPORT_PACKET_LENGTH - demux->partial_len;
+
+		if (copy > len)
+			copy = len;
+		memcpy(demux->partial + demux->partial_len, buf, copy);
+		demux->partial_len += copy;
+		pos = copy;
+
+		if (demux->partial_len < TRANSPORT_PACKET_LENGTH)
+			return;
+
+		ts_demux_packet(demux, demux->partial);
+		demux->partial_len = 0;
+	}
+
+	while (pos < len) {
+		if (buf[pos] != TRANSPORT_PACKET_SYNC) {
+			if (demux->synced)
+				demux->stats.sync_errors++;
+			demux->synced = 0;
+			pos += ts_demux_resync(buf + pos, len - pos);
+			continue;
+		}
+		demux->synced = 1;
+
+		if ((pos + TRANSPORT_PACKET_LENGTH) > len) {
+			demux->partial_len = len - pos;
+			memcpy(demux->partial, buf + pos, demux->partial_len);
+			break;
+		}
+
+		ts_demux_packet(demux, buf + pos);
+		pos += TRANSPORT_PACKET_LENGTH;
+	}
+
+	ts_demux_flush(demux);
+}
+
+struct ts_demux *ts_demux_create(int batch_size, ts_demux_callback callback, void *arg)
+{
+	struct ts_demux *demux;
+
+	if (callback == NULL)
+		return NULL;
+	if (batch_size <= 0)
+		batch_size = TS_DEMUX_DEFAULT_BATCH;
+
+	if ((demux = calloc(1, sizeof(struct ts_demux))) == NULL)
+		return NULL;
+	demux->callback = callback;
+	demux->arg = arg;
+	demux->batch_size = batch_size;
+
+	demux->batch = malloc(batch_size * sizeof(struct ts_demux_section));
+	demux->batch_data = malloc((size_t) batch_size * DVB_MAX_SECTION_BYTES);
+	if ((demux->batch == NULL) || (demux->batch_data == NULL)) {
+		ts_demux_destroy(demux);
+		return NULL;
+	}
+
+	return demux;
+}
+
+void ts_demux_destroy(struct ts_demux *demux)
+{
+	int pid;
+
+	for (pid = 0; pid < TRANSPORT_MAX_PIDS; pid++)
+		ts_demux_remove_pid(demux, pid);
+
+	free(demux->batch);
+	free(demux->batch_data);
+	free(demux);
+}
+
+int ts_demux_add_pid(struct ts_demux *demux, int pid, int max_section_size)
+{
+	struct ts_demux_pid *pidstate;
+
+	if ((pid < 0) || (pid >= TRANSPORT_MAX_PIDS))
+		return -EINVAL;
+	if (max_section_size == 0)
+		max_section_size = DVB_MAX_SECTION_BYTES;
+	if (max_section_size > DVB_MAX_SECTION_BYTES)
+		return -EINVAL;
+	if (demux->pids[pid] != NULL)
+		return 0;
+
+	pidstate = malloc(sizeof(struct ts_demux_pid));
+	if (pidstate == NULL)
+		return -ENOMEM;
+	pidstate->cstate = 0;
+	pidstate->section = malloc(sizeof(struct section_buf) + max_section_size);
+	if (pidstate->section == NULL) {
+		free(pidstate);
+		return -ENOMEM;
+	}
+	if (section_buf_init(pidstate->section, max_section_size)) {
+		free(pidstate->section);
+		free(pidstate);
+		return -EINVAL;
+	}
+
+	demux->pids[pid] = pidstate;
+	return 0;
+}
+
+void ts_demux_remove_pid(struct ts_demux *demux, int pid)
+{
+	if ((pid < 0) || (pid >= TRANSPORT_MAX_PIDS))
+		return;
+	if (demux->pids[pid] == NULL)
+		return;
+
+	free(demux->pids[pid]->section);
+	free(demux->pids[pid]);
+	demux->pids[pid] = NULL;
+}
+
+void ts_demux_reset(struct ts_demux *demux)
+{
+	int pid;
+
+	for (pid = 0; pid < TRANSPORT_MAX_PIDS; pid++) {
+		if (demux->pids[pid] == NULL)
+			continue;
+		demux->pids[pid]->cstate = 0;
+		section_buf_init(demux->pids[pid]->section, demux->pids[pid]->section->max);
+	}
+
+	demux->batch_count = 0;
+	demux->batch_data_used = 0;
+	demux->partial_len = 0;
+	demux->synced = 0;
+}
+
+const struct ts_demux_stats *ts_demux_get_stats(struct ts_demux *demux)
+{
+	return &demux->stats;
+}
@@ -0,0 +1,142 @@
+/*
+ * Batched transport stream section demultiplexer.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ */
+
+#ifndef _UCSI_TS_DEMUX_H
+#define _UCSI_TS_DEMUX_H 1
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include <stdint.h>
+#include <stddef.h>
+#include <libucsi/section_buf.h>
+#include <libucsi/transport_packet.h>
+
+/**
+ * Default number of sections delivered per callback.
+ */
+#define TS_DEMUX_DEFAULT_BATCH 64
+
+/**
+ * A completed section, as delivered to the callback.
+ */
+struct ts_demux_section {
+	uint16_t pid;     /* PID the section was received on */
+	uint16_t len;     /* total length of the section, including header and CRC */
+	uint8_t *data;    /* section data, in unmodified wire format */
+};
+
+/**
+ * Counters maintained by the demultiplexer.
+ */
+struct ts_demux_stats {
+	uint64_t packets;           /* packets processed, including unwanted PIDs */
+	uint64_t filtered_packets;  /* packets on PIDs with section reassembly */
+	uint64_t sections;          /* complete sections delivered */
+	uint64_t batches;           /* number of callbacks made */
+	uint64_t sync_errors;       /* times the packet sync was lost */
+	uint64_t tei_errors;        /* packets with transport_error_indicator set */
+	uint64_t cc_errors;         /* continuity errors on filtered PIDs */
+	uint64_t section_errors;    /* sections discarded as invalid */
+};
+
+/**
+ * Callback invoked with a batch of completed sections. The section data is
+ * only valid for the duration of the callback. The callback may add or remove
+ * PIDs.
+ *
+ * @param arg Private argument passed to ts_demux_create().
+ * @param sections Array of completed sections, in stream order.
+ * @param count Number of sections in the array.
+ */
+typedef void (*ts_demux_callback)(void *arg, struct ts_demux_section *sections, int count);
+
+/**
+ * Opaque demultiplexer state.
+ */
+struct ts_demux;
+
+/**
+ * Create a new demultiplexer.
+ *
+ * @param batch_size Maximum number of sections per callback (0 for the default).
+ * @param callback Function to call with completed sections.
+ * @param arg Private argument for the callback.
+ * @return The new ts_demux, or NULL on error.
+ */
+extern struct ts_demux *ts_demux_create(int batch_size, ts_demux_callback callback, void *arg);
+
+/**
+ * Destroy a demultiplexer. Any sections not yet delivered are discarded.
+ *
+ * @param demux The ts_demux to destroy.
+ */
+extern void ts_demux_destroy(struct ts_demux *demux);
+
+/**
+ * Enable section reassembly on a PID.
+ *
+ * @param demux The ts_demux.
+ * @param pid The PID.
+ * @param max_section_size Maximum size of sections on this PID (0 for DVB_MAX_SECTION_BYTES).
+ * @return 0 on success, nonzero on error.
+ */
+extern int ts_demux_add_pid(struct ts_demux *demux, int pid, int max_section_size);
+
+/**
+ * Disable section reassembly on a PID.
+ *
+ * @param demux The ts_demux.
+ * @param pid The PID.
+ */
+extern void ts_demux_remove_pid(struct ts_demux *demux, int pid);
+
+/**
+ * Feed transport stream data into the demultiplexer. The data need not start
+ * or end on a packet boundary; a partial trailing packet is kept until the
+ * next call. Completed sections are delivered in batches before this
+ * function returns.
+ *
+ * @param demux The ts_demux.
+ * @param buf The data.
+ * @param len Number of bytes of data.
+ */
+extern void ts_demux_feed(struct ts_demux *demux, const uint8_t *buf, size_t len);
+
+/**
+ * Reset all reassembly and continuity state, e.g. after retuning.
+ *
+ * @param demux The ts_demux.
+ */
+extern void ts_demux_reset(struct ts_demux *demux);
+
+/**
+ * Retrieve the counters of a demultiplexer.
+ *
+ * @param demux The ts_demux.
+ * @return Pointer to the counters.
+ */
+extern const struct ts_demux_stats *ts_demux_get_stats(struct ts_demux *demux);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
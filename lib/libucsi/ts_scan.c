@@ -0,0 +1,394 @@
+/*
+ * Vectorised transport stream packet header scanner.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "ts_scan.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define TS_SCAN_HAVE_X86 1
+#include <immintrin.h>
+#endif
+
+typedef size_t (*ts_scan_engine_fn)(const uint8_t *buf, size_t base, int stride, size_t n,
+				    struct ts_scan *scan, size_t idx, uint64_t *tei);
+
+static const int ts_scan_strides[] = {
+	TS_SCAN_STRIDE_188,
+	TS_SCAN_STRIDE_192,
+	TS_SCAN_STRIDE_204,
+};
+#define TS_SCAN_NUM_STRIDES (sizeof(ts_scan_strides) / sizeof(ts_scan_strides[0]))
+
+static inline uint32_t ts_scan_load32(const uint8_t *buf)
+{
+	uint32_t v;
+
+	memcpy(&v, buf, sizeof(v));
+	return v;
+}
+
+/*
+ * The engines below all decode n packet headers, starting at buf and spaced
+ * stride bytes apart, into the output arrays of the scanner starting at
+ * index idx. The offsets stored are relative to base. They stop at the first packet with a bad sync byte and return
+ * the number of packets decoded.
+ */
+
+static size_t ts_scan_scalar(const uint8_t *buf, size_t base, int stride, size_t n,
+			     struct ts_scan *scan, size_t idx, uint64_t *tei)
+{
+	size_t i;
+
+	for (i = 0; i < n; i++, idx++) {
+		const uint8_t *p = buf + i * stride;
+
+		if (p[0] != TRANSPORT_PACKET_SYNC)
+			break;
+
+		scan->offset[idx] = base + i * stride;
+		scan->pid[idx] = ((p[1] & 0x1f) << 8) | p[2];
+		scan->flags[idx] = (p[1] & 0xe0) | (p[3] >> 4);
+		scan->cc[idx] = p[3] & 0x0f;
+		if (p[1] & 0x80)
+			(*tei)++;
+	}
+
+	return i;
+}
+
+#ifdef TS_SCAN_HAVE_X86
+
+/*
+ * With headers loaded little-endian into 32 bit lanes, byte 0 (sync) is in
+ * bits 0-7, byte 1 in bits 8-15, byte 2 in bits 16-23 and byte 3 in 24-31.
+ */
+
+static inline __m128i ts_scan_sse2_load(const uint8_t *p, int stride)
+{
+	return _mm_set_epi32(ts_scan_load32(p + 3 * stride),
+			     ts_scan_load32(p + 2 * stride),
+			     ts_scan_load32(p + stride),
+			     ts_scan_load32(p));
+}
+
+/*
+ * Two vectors of four headers are processed per iteration, so that the
+ * narrowing packs produce a full register each time.
+ */
+__attribute__((target("sse2")))
+static size_t ts_scan_sse2(const uint8_t *buf, size_t base, int stride, size_t n,
+			   struct ts_scan *scan, size_t idx, uint64_t *tei)
+{
+	const __m128i m_ff = _mm_set1_epi32(0xff);
+	const __m128i m_sync = _mm_set1_epi32(TRANSPORT_PACKET_SYNC);
+	const __m128i m_pidhi = _mm_set1_epi32(0x1f00);
+	const __m128i m_flags = _mm_set1_epi32(0xe0);
+	const __m128i m_cc = _mm_set1_epi32(0x0f);
+	const __m128i strides = _mm_set_epi32(3 * stride, 2 * stride, stride, 0);
+	const __m128i stride4 = _mm_set1_epi32(4 * stride);
+	size_t i;
+
+	for (i = 0; (i + 8) <= n; i += 8, idx += 8) {
+		const uint8_t *p = buf + i * stride;
+		__m128i h0, h1, v0, v1, f, c;
+
+		h0 = ts_scan_sse2_load(p, stride);
+		h1 = ts_scan_sse2_load(p + 4 * stride, stride);
+		v0 = _mm_cmpeq_epi32(_mm_and_si128(h0, m_ff), m_sync);
+		v1 = _mm_cmpeq_epi32(_mm_and_si128(h1, m_ff), m_sync);
+		if (_mm_movemask_epi8(_mm_and_si128(v0, v1)) != 0xffff)
+			break;
+
+		/* offsets */
+		v0 = _mm_add_epi32(_mm_set1_epi32(base + i * stride), strides);
+		_mm_storeu_si128((__m128i *) (scan->offset + idx), v0);
+		_mm_storeu_si128((__m128i *) (scan->offset + idx + 4), _mm_add_epi32(v0, stride4));
+
+		/* pid */
+		v0 = _mm_or_si128(_mm_and_si128(h0, m_pidhi),
+				  _mm_and_si128(_mm_srli_epi32(h0, 16), m_ff));
+		v1 = _mm_or_si128(_mm_and_si128(h1, m_pidhi),
+				  _mm_and_si128(_mm_srli_epi32(h1, 16), m_ff));
+		_mm_storeu_si128((__m128i *) (scan->pid + idx), _mm_packs_epi32(v0, v1));
+
+		/* flags */
+		v0 = _mm_or_si128(_mm_and_si128(_mm_srli_epi32(h0, 8), m_flags),
+				  _mm_srli_epi32(h0, 28));
+		v1 = _mm_or_si128(_mm_and_si128(_mm_srli_epi32(h1, 8), m_flags),
+				  _mm_srli_epi32(h1, 28));
+		f = _mm_packs_epi32(v0, v1);
+
+		/* continuity counter */
+		v0 = _mm_and_si128(_mm_srli_epi32(h0, 24), m_cc);
+		v1 = _mm_and_si128(_mm_srli_epi32(h1, 24), m_cc);
+		c = _mm_packs_epi32(v0, v1);
+
+		/* flags in the low 8 bytes, continuity counters in the high 8 */
+		f = _mm_packus_epi16(f, c);
+		*tei += __builtin_popcount(_mm_movemask_epi8(f) & 0xff);
+		_mm_storel_epi64((__m128i *) (scan->flags + idx), f);
+		_mm_storel_epi64((__m128i *) (scan->cc + idx), _mm_unpackhi_epi64(f, f));
+	}
+
+	return i + ts_scan_scalar(buf + i * stride, base + i * stride, stride, n - i,
+				  scan, idx, tei);
+}
+
+__attribute__((target("avx2")))
+static size_t ts_scan_avx2(const uint8_t *buf, size_t base, int stride, size_t n,
+			   struct ts_scan *scan, size_t idx, uint64_t *tei)
+{
+	const __m256i m_ff = _mm256_set1_epi32(0xff);
+	const __m256i m_sync = _mm256_set1_epi32(TRANSPORT_PACKET_SYNC);
+	const __m256i m_pidhi = _mm256_set1_epi32(0x1f00);
+	const __m256i m_flags = _mm256_set1_epi32(0xe0);
+	const __m256i m_cc = _mm256_set1_epi32(0x0f);
+	const __m256i strides = _mm256_set_epi32(7 * stride, 6 * stride, 5 * stride, 4 * stride,
+						 3 * stride, 2 * stride, stride, 0);
+	/* gathers dword 0 of each 128 bit lane into the low 64 bits */
+	const __m256i m_lanes = _mm256_set_epi32(0, 0, 0, 0, 0, 0, 4, 0);
+	size_t i;
+
+	for (i = 0; (i + 8) <= n; i += 8, idx += 8) {
+		const uint8_t *p = buf + i * stride;
+		__m256i h, b3, v;
+
+		h = _mm256_i32gather_epi32((const int *) p, strides, 1);
+		v = _mm256_cmpeq_epi32(_mm256_and_si256(h, m_ff), m_sync);
+		if (_mm256_movemask_ps(_mm256_castsi256_ps(v)) != 0xff)
+			break;
+
+		/* offsets */
+		v = _mm256_add_epi32(_mm256_set1_epi32(base + i * stride), strides);
+		_mm256_storeu_si256((__m256i *) (scan->offset + idx), v);
+
+		/* pid */
+		v = _mm256_or_si256(_mm256_and_si256(h, m_pidhi),
+				    _mm256_and_si256(_mm256_srli_epi32(h, 16), m_ff));
+		v = _mm256_packs_epi32(v, v);
+		v = _mm256_permute4x64_epi64(v, 0x08);
+		_mm_storeu_si128((__m128i *) (scan->pid + idx), _mm256_castsi256_si128(v));
+
+		/* flags */
+		b3 = _mm256_srli_epi32(h, 24);
+		v = _mm256_or_si256(_mm256_and_si256(_mm256_srli_epi32(h, 8), m_flags),
+				    _mm256_srli_epi32(b3, 4));
+		*tei += __builtin_popcount(_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_slli_epi32(v, 24))));
+		v = _mm256_packs_epi32(v, v);
+		v = _mm256_packus_epi16(v, v);
+		v = _mm256_permutevar8x32_epi32(v, m_lanes);
+		_mm_storel_epi64((__m128i *) (scan->flags + idx), _mm256_castsi256_si128(v));
+
+		/* continuity counter */
+		v = _mm256_and_si256(b3, m_cc);
+		v = _mm256_packs_epi32(v, v);
+		v = _mm256_packus_epi16(v, v);
+		v = _mm256_permutevar8x32_epi32(v, m_lanes);
+		_mm_storel_epi64((__m128i *) (scan->cc + idx), _mm256_castsi256_si128(v));
+	}
+
+	return i + ts_scan_sse2(buf + i * stride, base + i * stride, stride, n - i,
+				scan, idx, tei);
+}
+
+#endif
+
+static ts_scan_engine_fn ts_scan_engine_get(enum ts_scan_engine engine)
+{
+	switch(engine) {
+	case TS_SCAN_ENGINE_AUTO:
+		return NULL;
+
+	case TS_SCAN_ENGINE_SCALAR:
+		return ts_scan_scalar;
+
+#ifdef TS_SCAN_HAVE_X86
+	case TS_SCAN_ENGINE_SSE2:
+		return ts_scan_sse2;
+
+	case TS_SCAN_ENGINE_AVX2:
+		return ts_scan_avx2;
+#else
+	default:
+		break;
+#endif
+	}
+
+	return NULL;
+}
+
+int ts_scan_engine_supported(enum ts_scan_engine engine)
+{
+	switch(engine) {
+	case TS_SCAN_ENGINE_AUTO:
+	case TS_SCAN_ENGINE_SCALAR:
+		return 1;
+
+#ifdef TS_SCAN_HAVE_X86
+	case TS_SCAN_ENGINE_SSE2:
+		return __builtin_cpu_supports("sse2");
+
+	case TS_SCAN_ENGINE_AVX2:
+		return __builtin_cpu_supports("avx2");
+#else
+	default:
+		break;
+#endif
+	}
+
+	return 0;
+}
+
+struct ts_scan *ts_scan_create(size_t max_packets, enum ts_scan_engine engine)
+{
+	struct ts_scan *scan;
+
+	if (engine == TS_SCAN_ENGINE_AUTO) {
+		/* without a gather instruction, assembling the header vectors
+		 * costs about as much as the scalar decode it replaces */
+		if (ts_scan_engine_supported(TS_SCAN_ENGINE_AVX2))
+			engine = TS_SCAN_ENGINE_AVX2;
+		else
+			engine = TS_SCAN_ENGINE_SCALAR;
+	}
+	if ((max_packets == 0) || !ts_scan_engine_supported(engine))
+		return NULL;
+
+	if ((scan = calloc(1, sizeof(struct ts_scan))) == NULL)
+		return NULL;
+	scan->engine = engine;
+	scan->max_packets = max_packets;
+	scan->offset = malloc(max_packets * sizeof(uint32_t));
+	scan->pid = malloc(max_packets * sizeof(uint16_t));
+	scan->flags = malloc(max_packets);
+	scan->cc = malloc(max_packets);
+	if ((scan->offset == NULL) || (scan->pid == NULL) ||
+	    (scan->flags == NULL) || (scan->cc == NULL)) {
+		ts_scan_destroy(scan);
+		return NULL;
+	}
+
+	return scan;
+}
+
+void ts_scan_destroy(struct ts_scan *scan)
+{
+	free(scan->offset);
+	free(scan->pid);
+	free(scan->flags);
+	free(scan->cc);
+	free(scan);
+}
+
+size_t ts_scan_find_sync(const uint8_t *buf, size_t len, int *stride)
+{
+	size_t pos;
+	unsigned int i;
+	int k;
+
+	*stride = 0;
+
+	for (pos = 0; pos < len; pos++) {
+		const uint8_t *p = memchr(buf + pos, TRANSPORT_PACKET_SYNC, len - pos);
+
+		if (p == NULL)
+			break;
+		pos = p - buf;
+
+		for (i = 0; i < TS_SCAN_NUM_STRIDES; i++) {
+			int s = ts_scan_strides[i];
+
+			/* not enough data to decide: ask for more */
+			if ((pos + (TS_SCAN_SYNC_CONFIRM - 1) * s) >= len)
+				return pos;
+
+			for (k = 1; k < TS_SCAN_SYNC_CONFIRM; k++) {
+				if (buf[pos + k * s] != TRANSPORT_PACKET_SYNC)
+					break;
+			}
+			if (k == TS_SCAN_SYNC_CONFIRM) {
+				*stride = s;
+				return pos;
+			}
+		}
+	}
+
+	return len;
+}
+
+size_t ts_scan_buffer(struct ts_scan *scan, const uint8_t *buf, size_t len)
+{
+	ts_scan_engine_fn fn = ts_scan_engine_get(scan->engine);
+	size_t pos = 0;
+	uint64_t tei = 0;
+
+	scan->count = 0;
+
+	/* skip the tail of a stride unit consumed by the previous call */
+	if (scan->pending_skip) {
+		pos = (scan->pending_skip < len) ? scan->pending_skip : len;
+		scan->pending_skip -= pos;
+	}
+
+	while (scan->count < scan->max_packets) {
+		size_t n;
+		size_t found;
+
+		if (scan->stride == 0) {
+			int stride;
+
+			if (pos >= len)
+				break;
+			size_t skip = ts_scan_find_sync(buf + pos, len - pos, &stride);
+
+			scan->skipped_bytes += skip;
+			pos += skip;
+			if (stride == 0)
+				break;
+			scan->stride = stride;
+		}
+
+		/* the final packet only needs to be complete, not its whole stride */
+		if ((pos + TRANSPORT_PACKET_LENGTH) > len)
+			break;
+		n = ((len - pos - TRANSPORT_PACKET_LENGTH) / scan->stride) + 1;
+		if (n > (scan->max_packets - scan->count))
+			n = scan->max_packets - scan->count;
+		if (n == 0)
+			break;
+
+		found = fn(buf + pos, pos, scan->stride, n, scan, scan->count, &tei);
+		scan->count += found;
+		pos += found * scan->stride;
+
+		if (found < n) {
+			scan->sync_losses++;
+			scan->stride = 0;
+		}
+	}
+
+	if (pos > len) {
+		scan->pending_skip = pos - len;
+		pos = len;
+	}
+
+	scan->packets += scan->count;
+	scan->tei_packets += tei;
+	return pos;
+}
@@ -0,0 +1,147 @@
+/*
+ * Vectorised transport stream packet header scanner.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ */
+
+#ifndef _UCSI_TS_SCAN_H
+#define _UCSI_TS_SCAN_H 1
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include <stdint.h>
+#include <stddef.h>
+#include <libucsi/transport_packet.h>
+
+/**
+ * Packet strides recognised by the scanner: plain TS, TS with a 4 byte
+ * timestamp (e.g. M2TS), and TS with 16 bytes of Reed-Solomon parity.
+ */
+#define TS_SCAN_STRIDE_188 188
+#define TS_SCAN_STRIDE_192 192
+#define TS_SCAN_STRIDE_204 204
+
+/**
+ * Number of consecutive sync bytes required to (re)acquire sync.
+ */
+#define TS_SCAN_SYNC_CONFIRM 4
+
+/**
+ * Bits in the per-packet flags array. The low nibble is a copy of the
+ * scrambling and adaptation field control bits from byte 3 of the header.
+ */
+enum ts_scan_flags {
+	ts_scan_flag_tei		= 0x80,
+	ts_scan_flag_pusi		= 0x40,
+	ts_scan_flag_priority		= 0x20,
+	ts_scan_flag_scrambling		= 0x0c,
+	ts_scan_flag_adaptation		= 0x02,
+	ts_scan_flag_payload		= 0x01,
+};
+
+/**
+ * Available scanner implementations.
+ */
+enum ts_scan_engine {
+	TS_SCAN_ENGINE_AUTO,
+	TS_SCAN_ENGINE_SCALAR,
+	TS_SCAN_ENGINE_SSE2,
+	TS_SCAN_ENGINE_AVX2,
+};
+
+/**
+ * Scanner state and output. The output is a structure of arrays with one
+ * entry per packet found by the last call to ts_scan_buffer().
+ */
+struct ts_scan {
+	int stride;                     /* detected packet stride, 0 if not in sync */
+	enum ts_scan_engine engine;     /* engine in use */
+
+	size_t max_packets;             /* capacity of the arrays below */
+	size_t count;                   /* number of packets in the arrays below */
+	uint32_t *offset;               /* offset of each packet's sync byte in the buffer */
+	uint16_t *pid;
+	uint8_t *flags;                 /* orred enum ts_scan_flags */
+	uint8_t *cc;                    /* continuity_counter */
+
+	/* counters */
+	uint64_t packets;               /* total packets found */
+	uint64_t tei_packets;           /* packets with transport_error_indicator set */
+	uint64_t sync_losses;           /* times sync was lost */
+	uint64_t skipped_bytes;         /* bytes discarded while out of sync */
+
+	/* private */
+	size_t pending_skip;
+};
+
+/**
+ * Create a new scanner.
+ *
+ * @param max_packets Maximum number of packets returned per ts_scan_buffer() call.
+ * @param engine Implementation to use (TS_SCAN_ENGINE_AUTO for the best available).
+ * @return The new ts_scan, or NULL on error (including an unsupported engine).
+ */
+extern struct ts_scan *ts_scan_create(size_t max_packets, enum ts_scan_engine engine);
+
+/**
+ * Destroy a scanner.
+ *
+ * @param scan The ts_scan to destroy.
+ */
+extern void ts_scan_destroy(struct ts_scan *scan);
+
+/**
+ * Scan a buffer of raw transport stream data. The packet headers found are
+ * stored in the scanner's arrays (scan->count entries). If the stream is not
+ * in sync, the buffer is searched for TS_SCAN_SYNC_CONFIRM sync bytes at one
+ * of the supported strides first.
+ *
+ * Any unconsumed data (a partial packet, more than max_packets packets, or
+ * too little data to confirm sync) should be presented again at the start
+ * of the next call.
+ *
+ * @param scan The ts_scan.
+ * @param buf The data.
+ * @param len Number of bytes of data.
+ * @return Number of bytes consumed.
+ */
+extern size_t ts_scan_buffer(struct ts_scan *scan, const uint8_t *buf, size_t len);
+
+/**
+ * Find the start of the first sync-aligned packet in a buffer.
+ *
+ * @param buf The data.
+ * @param len Number of bytes of data.
+ * @param stride Set to the detected stride on success.
+ * @return Offset of the first sync byte, or len if none was found.
+ */
+extern size_t ts_scan_find_sync(const uint8_t *buf, size_t len, int *stride);
+
+/**
+ * Check if an engine is supported by this CPU.
+ *
+ * @param engine The engine.
+ * @return 1 if supported, 0 if not.
+ */
+extern int ts_scan_engine_supported(enum ts_scan_engine engine);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
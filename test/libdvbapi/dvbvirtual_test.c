@@ -0,0 +1,257 @@
+/*
+ * Test the virtual adapter backend of libdvbapi.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ */
+
+#include <libdvbapi/dvbfe.h>
+#include <libdvbapi/dvbdemux.h>
+#include <libdvbapi/dvbvirtual.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/poll.h>
+#include <sys/time.h>
+
+#define ADAPTER 7
+#define FREQUENCY 506000000
+#define DATA_PID 0x200
+#define REPEATS 2000
+
+static char tsfile[] = "/tmp/dvbvirtual_test_XXXXXX";
+static char conffile[256];
+static int failures;
+
+static void check(int ok, const char *what)
+{
+	printf("%s: %s\n", ok ? "ok" : "FAILED", what);
+	if (!ok)
+		failures++;
+}
+
+static double now(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + (tv.tv_usec / 1000000.0);
+}
+
+static uint32_t crc32(const uint8_t *buf, int len)
+{
+	uint32_t crc = 0xffffffff;
+	int i;
+
+	while(len--) {
+		crc ^= *buf++ << 24;
+		for(i=0; i < 8; i++)
+			crc = (crc << 1) ^ ((crc & 0x80000000) ? 0x04c11db7 : 0);
+	}
+	return crc;
+}
+
+/* a PAT listing one program, in a single TS packet */
+static int make_pat(uint8_t *section, int version)
+{
+	uint32_t crc;
+
+	section[0] = 0x00;
+	section[1] = 0xb0;
+	section[2] = 13;
+	section[3] = 0x12;
+	section[4] = 0x34;
+	section[5] = 0xc1 | (version << 1);
+	section[6] = 0;
+	section[7] = 0;
+	section[8] = 0x00;
+	section[9] = 0x01;
+	section[10] = 0xe1;
+	section[11] = 0x00;
+	crc = crc32(section, 12);
+	section[12] = crc >> 24;
+	section[13] = crc >> 16;
+	section[14] = crc >> 8;
+	section[15] = crc;
+	return 16;
+}
+
+static void write_packet(FILE *f, int pid, int pusi, int cc, const uint8_t *payload, int len)
+{
+	uint8_t packet[188];
+
+	memset(packet, 0xff, sizeof(packet));
+	packet[0] = 0x47;
+	packet[1] = (pusi ? 0x40 : 0) | (pid >> 8);
+	packet[2] = pid;
+	packet[3] = 0x10 | (cc & 0x0f);
+	memcpy(packet + 4, payload, len);
+	fwrite(packet, 1, sizeof(packet), f);
+}
+
+static void make_capture(void)
+{
+	uint8_t payload[184];
+	FILE *f;
+	int fd, i, len;
+
+	if ((fd = mkstemp(tsfile)) < 0) {
+		perror("mkstemp");
+		exit(1);
+	}
+	f = fdopen(fd, "w");
+
+	for(i=0; i < REPEATS; i++) {
+		// a PAT with a good CRC, then one with a corrupted CRC
+		payload[0] = 0;
+		len = make_pat(payload + 1, 1);
+		write_packet(f, 0, 1, i * 2, payload, len + 1);
+		len = make_pat(payload + 1, 2);
+		payload[len] ^= 0xff;
+		write_packet(f, 0, 1, (i * 2) + 1, payload, len + 1);
+
+		// data packets carrying their sequence number
+		memset(payload, 0, sizeof(payload));
+		payload[0] = i >> 8;
+		payload[1] = i;
+		write_packet(f, DATA_PID, 0, i, payload, sizeof(payload));
+	}
+	fclose(f);
+
+	sprintf(conffile, "%s.conf", tsfile);
+	f = fopen(conffile, "w");
+	fprintf(f, "# test capture\ntype DVBT\n%u %s\n", FREQUENCY, tsfile);
+	fclose(f);
+}
+
+static int read_timeout(int fd, uint8_t *buf, int len, int timeout)
+{
+	struct pollfd pollfd;
+
+	pollfd.fd = fd;
+	pollfd.events = POLLIN;
+	if (poll(&pollfd, 1, timeout) != 1)
+		return -1;
+	return read(fd, buf, len);
+}
+
+int main(void)
+{
+	struct dvbfe_handle *fe;
+	struct dvbfe_parameters params;
+	struct dvbfe_info info;
+	struct dvbfe_tune_timing timing;
+	uint8_t filter[18], mask[18];
+	uint8_t buf[4096], expected[32];
+	int demux_fd, dvr_fd;
+	int i, len, count, inorder, first = -1;
+	double start;
+
+	make_capture();
+	check(dvbvirtual_attach(ADAPTER, conffile) == 0, "attach");
+	check(dvbvirtual_is_virtual(ADAPTER), "adapter is virtual");
+
+	// frontend
+	fe = dvbfe_open(ADAPTER, 0, 0);
+	check(fe != NULL, "open frontend");
+	if (fe == NULL)
+		return 1;
+	dvbfe_get_info(fe, 0, &info, DVBFE_INFO_QUERYTYPE_IMMEDIATE, 0);
+	check(info.type == DVBFE_TYPE_DVBT, "frontend type");
+
+	memset(&params, 0, sizeof(params));
+	params.frequency = FREQUENCY + 100000;
+	params.inversion = DVBFE_INVERSION_AUTO;
+	params.u.dvbt.bandwidth = DVBFE_DVBT_BANDWIDTH_8_MHZ;
+	check(dvbfe_set(fe, &params, 500) == 0, "lock on a captured frequency");
+	dvbfe_get_tune_timing(fe, &timing);
+	check(timing.lock_ms >= 0, "lock time recorded");
+	dvbfe_get_info(fe, DVBFE_INFO_LOCKSTATUS, &info, DVBFE_INFO_QUERYTYPE_IMMEDIATE, 0);
+	check(info.lock, "lock status");
+
+	// section filter with CRC checking: only the good PAT arrives
+	demux_fd = dvbdemux_open_demux(ADAPTER, 0, 0);
+	check(demux_fd >= 0, "open demux");
+	memset(filter, 0, sizeof(filter));
+	memset(mask, 0, sizeof(mask));
+	filter[0] = 0x00;
+	mask[0] = 0xff;
+	check(dvbdemux_set_section_filter(demux_fd, 0, filter, mask, 1, 1) == 0, "set section filter");
+	make_pat(expected, 1);
+	for(i=0; i < 10; i++) {
+		len = read_timeout(demux_fd, buf, sizeof(buf), 1000);
+		if ((len != 16) || memcmp(buf, expected, 16))
+			break;
+	}
+	check(i == 10, "sections read whole and CRC checked");
+
+	// a filter on the table_id_extension which does not match
+	filter[3] = 0x56;
+	mask[3] = 0xff;
+	check(dvbdemux_set_section_filter(demux_fd, 0, filter, mask, 1, 0) == 0, "reset section filter");
+	while(read_timeout(demux_fd, buf, sizeof(buf), 0) > 0)
+		;
+	check(read_timeout(demux_fd, buf, sizeof(buf), 200) < 0, "section filter mask applied");
+	close(demux_fd);
+
+	// PID filter to the dvr device, which must see every packet in order
+	dvr_fd = dvbdemux_open_dvr(ADAPTER, 0, 1, 0);
+	check(dvr_fd >= 0, "open dvr");
+	demux_fd = dvbdemux_open_demux(ADAPTER, 0, 0);
+	check(dvbdemux_set_pid_filter(demux_fd, DATA_PID, DVBDEMUX_INPUT_FRONTEND,
+				      DVBDEMUX_OUTPUT_DVR, 1) == 0, "set pid filter");
+	start = now();
+	count = 0;
+	inorder = 1;
+	len = 0;
+	while(count < REPEATS * 5) {
+		// a stream socket may split a packet between reads
+		i = read_timeout(dvr_fd, buf + len, (188 * 10) - len, 1000);
+		if (i <= 0)
+			break;
+		len += i;
+		for(i=0; i + 188 <= len; i += 188) {
+			int seq = (buf[i + 4] << 8) | buf[i + 5];
+			if (first < 0)
+				first = seq;
+			if ((buf[i] != 0x47) || (seq != ((first + count) % REPEATS)))
+				inorder = 0;
+			count++;
+		}
+		memmove(buf, buf + i, len - i);
+		len -= i;
+	}
+	check((count >= REPEATS * 5) && inorder, "dvr stream complete and in order");
+	printf("dvr: %i packets in %.3fs (%.1f Mbit/s)\n",
+	       count, now() - start, (count * 188 * 8) / ((now() - start) * 1000000.0));
+	close(demux_fd);
+	close(dvr_fd);
+
+	// a frequency with no capture does not lock
+	params.frequency = FREQUENCY + 8000000;
+	check(dvbfe_set(fe, &params, 100) != 0, "no lock on an empty frequency");
+
+	dvbfe_close(fe);
+	dvbvirtual_detach(ADAPTER);
+	unlink(tsfile);
+	unlink(conffile);
+
+	if (failures) {
+		printf("%i failures\n", failures);
+		return 1;
+	}
+	return 0;
+}
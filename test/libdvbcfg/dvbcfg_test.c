@@ -21,7 +21,12 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <stddef.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
 #include <libdvbcfg/dvbcfg_zapchannel.h>
+#include <libdvbcfg/dvbcfg_channeldb.h>
 
 void syntax(void);
 
@@ -31,9 +36,17 @@ int zappos = 0;
 
 int zapload_callback(struct dvbcfg_zapchannel *channel, void *private);
 int zapsave_callback(struct dvbcfg_zapchannel *channel, void *private);
+int channeldb_check(struct dvbcfg_channeldb *db);
+void channeldb_corrupt(const char *cache_filename, int how);
+
+// the channel array follows the cache header; see dvbcfg_channeldb.c
+#define CHANNELDB_HEADER_SIZE 64
+#define CHANNELDB_CORRUPTIONS 3
 
 int main(int argc, char *argv[])
 {
+	int i;
+
         if (argc != 4) {
                 syntax();
         }
@@ -56,6 +69,45 @@ int main(int argc, char *argv[])
 		dvbcfg_zapchannel_save(f, zapsave_callback, NULL);
 		fclose(f);
 
+	} else if (!strcmp(argv[1], "-channeldb")) {
+
+		FILE *f = fopen(argv[2], "r");
+		if (!f) {
+			fprintf(stderr, "Unable to load %s\n", argv[2]);
+			exit(1);
+		}
+		dvbcfg_zapchannel_parse(f, zapload_callback, NULL);
+		fclose(f);
+
+		// first load parses and writes the cache, the second maps it
+		unlink(argv[3]);
+		for(i=0; i<2; i++) {
+			struct dvbcfg_channeldb *db = dvbcfg_channeldb_load(argv[2], argv[3]);
+			if (db == NULL) {
+				fprintf(stderr, "Unable to load %s\n", argv[2]);
+				exit(1);
+			}
+			if (channeldb_check(db))
+				exit(1);
+			dvbcfg_channeldb_free(db);
+		}
+
+		// a damaged cache is ignored and rebuilt, not trusted
+		for(i=0; i<CHANNELDB_CORRUPTIONS; i++) {
+			struct dvbcfg_channeldb *db;
+
+			channeldb_corrupt(argv[3], i);
+			if ((db = dvbcfg_channeldb_load(argv[2], argv[3])) == NULL) {
+				fprintf(stderr, "Unable to load %s\n", argv[2]);
+				exit(1);
+			}
+			if (channeldb_check(db)) {
+				fprintf(stderr, "channeldb used a corrupt cache (%i)\n", i);
+				exit(1);
+			}
+			dvbcfg_channeldb_free(db);
+		}
+
 	} else {
                 syntax();
         }
@@ -92,9 +144,100 @@ int zapsave_callback(struct dvbcfg_zapchannel *channel, void *private)
 	return 0;
 }
 
+int channeldb_check(struct dvbcfg_channeldb *db)
+{
+	const struct dvbcfg_zapchannel *channel;
+	int i;
+
+	if (dvbcfg_channeldb_count(db) != zapcount) {
+		fprintf(stderr, "channeldb has %i channels, expected %i\n",
+			dvbcfg_channeldb_count(db), zapcount);
+		return 1;
+	}
+
+	for(i=0; i<zapcount; i++) {
+		if (memcmp(dvbcfg_channeldb_get(db, i), &channels[i], sizeof(struct dvbcfg_zapchannel))) {
+			fprintf(stderr, "channeldb channel %i differs\n", i);
+			return 1;
+		}
+
+		// duplicates resolve to the first, as with a search of the file
+		channel = dvbcfg_channeldb_find_name(db, channels[i].name);
+		if ((channel == NULL) || (channel > dvbcfg_channeldb_get(db, i)) ||
+		    strcmp(channel->name, channels[i].name)) {
+			fprintf(stderr, "channeldb lookup of %s failed\n", channels[i].name);
+			return 1;
+		}
+		channel = dvbcfg_channeldb_find_service(db, channels[i].fe_params.frequency,
+							channels[i].service_id);
+		if ((channel == NULL) || (channel > dvbcfg_channeldb_get(db, i)) ||
+		    (channel->fe_params.frequency != channels[i].fe_params.frequency) ||
+		    (channel->service_id != channels[i].service_id)) {
+			fprintf(stderr, "channeldb lookup of %u/%i failed\n",
+				channels[i].fe_params.frequency, channels[i].service_id);
+			return 1;
+		}
+	}
+
+	if (dvbcfg_channeldb_find_name(db, "no such channel") ||
+	    dvbcfg_channeldb_get(db, zapcount)) {
+		fprintf(stderr, "channeldb found a channel that does not exist\n");
+		return 1;
+	}
+
+	return 0;
+}
+
+void channeldb_corrupt(const char *cache_filename, int how)
+{
+	off_t index_pos = CHANNELDB_HEADER_SIZE + zapcount * sizeof(struct dvbcfg_zapchannel);
+	char name[sizeof(channels[0].name)];
+	uint32_t entry;
+	off_t index_size;
+	struct stat st;
+	int fd;
+	int j;
+
+	if (((fd = open(cache_filename, O_WRONLY)) < 0) || fstat(fd, &st)) {
+		fprintf(stderr, "Unable to write %s\n", cache_filename);
+		exit(1);
+	}
+	// the name and service indexes are the same size
+	index_size = (st.st_size - index_pos) / (2 * sizeof(uint32_t));
+
+	switch(how) {
+	case 0:
+		// a name which is not NUL terminated
+		memset(name, 'x', sizeof(name));
+		if (pwrite(fd, name, sizeof(name), CHANNELDB_HEADER_SIZE +
+			   offsetof(struct dvbcfg_zapchannel, name)) != sizeof(name))
+			exit(1);
+		break;
+
+	case 1:
+		// a name index entry pointing past the last channel
+		entry = zapcount + 1;
+		if (pwrite(fd, &entry, sizeof(entry), index_pos) != sizeof(entry))
+			exit(1);
+		break;
+
+	case 2:
+		// a full name index, where a lookup miss would never end
+		entry = 1;
+		for(j=0; j<index_size; j++) {
+			if (pwrite(fd, &entry, sizeof(entry), index_pos + j * sizeof(entry)) != sizeof(entry))
+				exit(1);
+		}
+		break;
+	}
+
+	close(fd);
+}
+
 void syntax()
 {
         fprintf(stderr,
-                "Syntax: dvbcfg_test <-zapchannel> <input filename> <output filename>\n");
+                "Syntax: dvbcfg_test <-zapchannel> <input filename> <output filename>\n"
+                "        dvbcfg_test <-channeldb> <input filename> <cache filename>\n");
         exit(1);
 }
@@ -0,0 +1,396 @@
+/*
+    en50221 encoder An implementation for libdvb
+    heap allocations per message on the CA PMT, MMI and date-time paths,
+    against a simulated module
+
+    This library is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation; either version 2.1 of
+    the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <libdvben50221/en50221_transport.h>
+#include <libdvben50221/en50221_app_ca.h>
+#include <libdvben50221/en50221_app_mmi.h>
+#include <libdvben50221/en50221_app_datetime.h>
+#include <libucsi/mpeg/section.h>
+#include <pthread.h>
+
+#define MESSAGES 1000
+#define WARMUP 10
+
+// the module end of the link speaks just enough of EN 50221 A.4.1 to
+// open a connection, answer polls and echo back whatever it is sent -
+// longer messages come back as a T_DATA_MORE/T_DATA_LAST chain
+#define T_SB                0x80
+#define T_RCV               0x81
+#define T_CREATE_T_C        0x82
+#define T_C_T_C_REPLY       0x83
+#define T_DATA_LAST         0xA0
+#define T_DATA_MORE         0xA1
+#define CHAIN_FRAGMENT      32
+
+void *modulethread_func(void* arg);
+void *stackthread_func(void* arg);
+void test_callback(void *arg, int reason,
+                   uint8_t *data, uint32_t data_length,
+                   uint8_t slot_id, uint8_t connection_id);
+int test_menu_callback(void *arg, uint8_t slot_id, uint16_t session_number,
+                       struct en50221_app_mmi_text *title,
+                       struct en50221_app_mmi_text *sub_title,
+                       struct en50221_app_mmi_text *bottom,
+                       uint32_t item_count, struct en50221_app_mmi_text *items,
+                       uint32_t item_raw_length, uint8_t *items_raw);
+
+int shutdown_threads = 0;
+unsigned long allocations = 0;
+
+struct en50221_transport_layer *tl;
+struct en50221_app_mmi *mmi;
+struct mpeg_pmt_section *pmt;
+int cam_slot_id;
+int cam_connection_id;
+
+pthread_mutex_t reply_lock = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t reply_cond = PTHREAD_COND_INITIALIZER;
+int connection_open = 0;
+int replies = 0;
+int menus = 0;
+
+// count every trip to the heap, from any thread
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t nmemb, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+extern void __libc_free(void *ptr);
+
+void *malloc(size_t size)
+{
+    __sync_fetch_and_add(&allocations, 1);
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t nmemb, size_t size)
+{
+    __sync_fetch_and_add(&allocations, 1);
+    return __libc_calloc(nmemb, size);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+    __sync_fetch_and_add(&allocations, 1);
+    return __libc_realloc(ptr, size);
+}
+
+void free(void *ptr)
+{
+    __libc_free(ptr);
+}
+
+// a PMT with a video and an audio stream, each with a CA descriptor
+uint8_t pmt_section[] = {
+    0x02, 0xb0, 0x29, 0x00, 0x01, 0xc1, 0x00, 0x00,
+    0xe1, 0x00, 0xf0, 0x06, 0x09, 0x04, 0x06, 0x04, 0xe1, 0x10,
+    0x02, 0xe1, 0x00, 0xf0, 0x06, 0x09, 0x04, 0x06, 0x04, 0xe1, 0x11,
+    0x04, 0xe1, 0x01, 0xf0, 0x06, 0x09, 0x04, 0x06, 0x04, 0xe1, 0x11,
+    0x00, 0x00, 0x00, 0x00,
+};
+
+// a menu_last() with a title, subtitle, bottom line and two items
+uint8_t menu[] = {
+    0x9f, 0x88, 0x09, 0x2c, 0x02,
+    0x9f, 0x88, 0x03, 0x08, 'C', 'A', ' ', 'M', 'e', 'n', 'u', ' ',
+    0x9f, 0x88, 0x03, 0x00,
+    0x9f, 0x88, 0x03, 0x04, 'E', 'x', 'i', 't',
+    0x9f, 0x88, 0x03, 0x04, 'I', 'n', 'f', 'o',
+    0x9f, 0x88, 0x03, 0x07, 'S', 'e', 't', 't', 'i', 'n', 'g',
+};
+
+static int send_data(void *arg, uint16_t session_number,
+                     uint8_t *data, uint16_t data_length)
+{
+    (void) arg;
+    (void) session_number;
+
+    return en50221_tl_send_data(tl, cam_slot_id, cam_connection_id, data, data_length);
+}
+
+static int send_datav(void *arg, uint16_t session_number,
+                      struct iovec *vector, int iov_count)
+{
+    (void) arg;
+    (void) session_number;
+
+    return en50221_tl_send_datav(tl, cam_slot_id, cam_connection_id, vector, iov_count);
+}
+
+// send with the given function, wait for the echo, and report the allocations
+static void measure(const char *what, int (*send)(void *arg), void *arg)
+{
+    unsigned long start = 0;
+    int i;
+
+    for (i = 0; i < WARMUP + MESSAGES; i++) {
+        if (i == WARMUP)
+            start = allocations;
+
+        pthread_mutex_lock(&reply_lock);
+        int expected = replies + 1;
+        pthread_mutex_unlock(&reply_lock);
+
+        if (send(arg)) {
+            fprintf(stderr, "%s: send failed: %i\n", what, en50221_tl_get_error(tl));
+            exit(1);
+        }
+
+        pthread_mutex_lock(&reply_lock);
+        while (replies != expected)
+            pthread_cond_wait(&reply_cond, &reply_lock);
+        pthread_mutex_unlock(&reply_lock);
+    }
+
+    printf("%-10s %6.2f allocations per message\n", what,
+           (double) (allocations - start) / MESSAGES);
+}
+
+static int send_ca_pmt(void *arg)
+{
+    struct en50221_app_ca *ca = arg;
+    uint8_t capmt[1024];
+    int size;
+
+    if ((size = en50221_ca_format_pmt(pmt, capmt, sizeof(capmt), 0,
+                                      CA_LIST_MANAGEMENT_ONLY,
+                                      CA_PMT_CMD_ID_OK_DESCRAMBLING)) < 0)
+        return -1;
+
+    return en50221_app_ca_pmt(ca, 1, capmt, size);
+}
+
+static int send_menu(void *arg)
+{
+    (void) arg;
+
+    return en50221_tl_send_data(tl, cam_slot_id, cam_connection_id, menu, sizeof(menu));
+}
+
+static int send_datetime(void *arg)
+{
+    struct en50221_app_datetime *datetime = arg;
+
+    return en50221_app_datetime_send(datetime, 1, time(NULL), 60);
+}
+
+int main(int argc, char * argv[])
+{
+    (void)argc;
+    (void)argv;
+
+    int fds[2];
+    pthread_t modulethread;
+    pthread_t stackthread;
+    struct en50221_app_send_functions funcs;
+
+    if (socketpair(AF_UNIX, SOCK_SEQPACKET, 0, fds)) {
+        perror("socketpair");
+        exit(1);
+    }
+
+    // transport layer, talking to the module
+    tl = en50221_tl_create(1, 16);
+    if (tl == NULL) {
+        fprintf(stderr, "Failed to create transport layer\n");
+        exit(1);
+    }
+    en50221_tl_set_event_driven(tl, 1, -1);
+    en50221_tl_register_callback(tl, test_callback, NULL);
+    pthread_create(&modulethread, NULL, modulethread_func, &fds[1]);
+    pthread_create(&stackthread, NULL, stackthread_func, NULL);
+
+    cam_slot_id = en50221_tl_register_slot(tl, fds[0], 0, 1000, 100);
+    cam_connection_id = en50221_tl_new_tc(tl, cam_slot_id);
+    pthread_mutex_lock(&reply_lock);
+    while (!connection_open)
+        pthread_cond_wait(&reply_cond, &reply_lock);
+    pthread_mutex_unlock(&reply_lock);
+
+    // the PMT is decoded in place, so only once
+    struct section *section = section_codec(pmt_section, sizeof(pmt_section));
+    struct section_ext *section_ext = section_ext_decode(section, 0);
+    if ((section_ext == NULL) || ((pmt = mpeg_pmt_section_codec(section_ext)) == NULL)) {
+        fprintf(stderr, "Failed to decode PMT\n");
+        exit(1);
+    }
+
+    // the resources send straight down the connection
+    funcs.arg = NULL;
+    funcs.send_data = send_data;
+    funcs.send_datav = send_datav;
+    struct en50221_app_ca *ca = en50221_app_ca_create(&funcs);
+    struct en50221_app_datetime *datetime = en50221_app_datetime_create(&funcs);
+    mmi = en50221_app_mmi_create(&funcs);
+    en50221_app_mmi_register_menu_callback(mmi, test_menu_callback, NULL);
+
+    measure("CA PMT", send_ca_pmt, ca);
+    measure("MMI menu", send_menu, NULL);
+    measure("date-time", send_datetime, datetime);
+    if (menus != WARMUP + MESSAGES) {
+        fprintf(stderr, "Only %i of the menus were parsed\n", menus);
+        exit(1);
+    }
+
+    shutdown_threads = 1;
+    en50221_tl_wakeup(tl);
+    pthread_join(stackthread, NULL);
+    en50221_tl_destroy_slot(tl, cam_slot_id);
+    close(fds[0]);
+    pthread_join(modulethread, NULL);
+    close(fds[1]);
+
+    en50221_app_mmi_destroy(mmi);
+    en50221_app_datetime_destroy(datetime);
+    en50221_app_ca_destroy(ca);
+    en50221_tl_destroy(tl);
+
+    return 0;
+}
+
+void test_callback(void *arg, int reason,
+                   uint8_t *data, uint32_t data_length,
+                   uint8_t slot_id, uint8_t connection_id)
+{
+    (void) arg;
+    (void) connection_id;
+
+    if ((reason == T_CALLBACK_REASON_DATA) && (data_length == sizeof(menu)) &&
+        (data[0] == 0x9f) && (data[1] == 0x88) && (data[2] == 0x09)) {
+        en50221_app_mmi_message(mmi, slot_id, 1, MKRID(64, 1, 1), data, data_length);
+    }
+
+    pthread_mutex_lock(&reply_lock);
+    switch(reason) {
+    case T_CALLBACK_REASON_CONNECTIONOPEN:
+        connection_open = 1;
+        break;
+
+    case T_CALLBACK_REASON_DATA:
+        replies++;
+        break;
+    }
+    pthread_cond_signal(&reply_cond);
+    pthread_mutex_unlock(&reply_lock);
+}
+
+int test_menu_callback(void *arg, uint8_t slot_id, uint16_t session_number,
+                       struct en50221_app_mmi_text *title,
+                       struct en50221_app_mmi_text *sub_title,
+                       struct en50221_app_mmi_text *bottom,
+                       uint32_t item_count, struct en50221_app_mmi_text *items,
+                       uint32_t item_raw_length, uint8_t *items_raw)
+{
+    (void) arg;
+    (void) slot_id;
+    (void) session_number;
+    (void) sub_title;
+    (void) bottom;
+    (void) items;
+    (void) item_raw_length;
+    (void) items_raw;
+
+    if ((title->text_length == 8) && !memcmp(title->text, "CA Menu ", 8) && (item_count == 2))
+        menus++;
+    return 0;
+}
+
+void *modulethread_func(void* arg)
+{
+    int fd = *(int *) arg;
+    uint8_t buf[4096];
+    uint8_t reply[4096];
+    uint8_t pending[4096];
+    int pending_length = -1;
+    int size;
+
+    while((size = read(fd, buf, sizeof(buf))) >= 5) {
+        // the length field is one byte for a poll or T_RCV, and up to three for data
+        int header = (buf[3] & 0x80) ? 4 + (buf[3] & 0x7f) : 4;
+        uint8_t connection_id = buf[header];
+        int pos = 2;
+
+        reply[0] = buf[0];
+        reply[1] = buf[1];
+
+        switch(buf[2]) {
+        case T_CREATE_T_C:
+            reply[pos++] = T_C_T_C_REPLY;
+            reply[pos++] = 1;
+            reply[pos++] = connection_id;
+            break;
+
+        case T_DATA_LAST:
+            // anything other than a poll gets echoed back
+            if (size > header + 1) {
+                pending_length = size - (header + 1);
+                memcpy(pending, buf + header + 1, pending_length);
+            }
+            break;
+
+        case T_RCV:
+            if (pending_length > CHAIN_FRAGMENT) {
+                reply[pos++] = T_DATA_MORE;
+                reply[pos++] = CHAIN_FRAGMENT + 1;
+                reply[pos++] = connection_id;
+                memcpy(reply + pos, pending, CHAIN_FRAGMENT);
+                pos += CHAIN_FRAGMENT;
+                pending_length -= CHAIN_FRAGMENT;
+                memmove(pending, pending + CHAIN_FRAGMENT, pending_length);
+            }
+            reply[pos++] = T_DATA_LAST;
+            reply[pos++] = pending_length + 1;
+            reply[pos++] = connection_id;
+            memcpy(reply + pos, pending, pending_length);
+            pos += pending_length;
+            pending_length = -1;
+            break;
+        }
+
+        // every response ends with the module status
+        reply[pos++] = T_SB;
+        reply[pos++] = 2;
+        reply[pos++] = connection_id;
+        reply[pos++] = (pending_length != -1) ? 0x80 : 0x00;
+        if (write(fd, reply, pos) != pos)
+            break;
+    }
+
+    return 0;
+}
+
+void *stackthread_func(void* arg) {
+    (void) arg;
+
+    while(!shutdown_threads) {
+        if (en50221_tl_poll(tl)) {
+            fprintf(stderr, "Error reported by stack slot:%i error:%i\n",
+                    en50221_tl_get_error_slot(tl),
+                    en50221_tl_get_error(tl));
+            exit(1);
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,201 @@
+/*
+    en50221 encoder An implementation for libdvb
+    CA PMT list management: what reaches the CAM as programs come and go
+
+    This library is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation; either version 2.1 of
+    the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <sys/uio.h>
+#include <libdvben50221/en50221_ca_pmt_list.h>
+#include <libucsi/section.h>
+#include <libucsi/mpeg/section.h>
+
+#define MAX_SENT 16
+
+struct sent {
+    uint8_t list_management;
+    uint16_t program_number;
+    uint8_t version;
+    uint8_t cmd_id;
+};
+
+int send_data(void *arg, uint16_t session_number, uint8_t *data, uint16_t data_length);
+int send_datav(void *arg, uint16_t session_number, struct iovec *vector, int iov_count);
+
+struct sent sent[MAX_SENT];
+int sent_count = 0;
+int failed = 0;
+
+int send_data(void *arg, uint16_t session_number, uint8_t *data, uint16_t data_length)
+{
+    (void) arg;
+    (void) session_number;
+    (void) data;
+    (void) data_length;
+
+    fprintf(stderr, "Unexpected send_data\n");
+    exit(1);
+}
+
+int send_datav(void *arg, uint16_t session_number, struct iovec *vector, int iov_count)
+{
+    uint8_t *ca_pmt;
+    (void) arg;
+    (void) session_number;
+
+    // the CA PMT APDU header, then the CA PMT itself
+    if ((iov_count != 2) || (sent_count == MAX_SENT)) {
+        fprintf(stderr, "Unexpected send_datav\n");
+        exit(1);
+    }
+    ca_pmt = vector[1].iov_base;
+    sent[sent_count].list_management = ca_pmt[0];
+    sent[sent_count].program_number = (ca_pmt[1] << 8) | ca_pmt[2];
+    sent[sent_count].version = (ca_pmt[3] >> 1) & 0x1f;
+    sent[sent_count].cmd_id = ca_pmt[6];
+    sent_count++;
+    return 0;
+}
+
+// set a program with one CA descriptor and two streams
+static void set(struct en50221_ca_pmt_list *list, uint16_t program_number, uint8_t version)
+{
+    uint8_t buf[] = {
+        0x02, 0xb0, 29, program_number >> 8, program_number & 0xff,
+        0xc1 | (version << 1), 0x00, 0x00, 0xe1, 0x00, 0xf0, 0x06,
+        0x09, 0x04, 0x0b, 0x00, 0xe1, 0x00,
+        0x02, 0xe1, 0x01, 0xf0, 0x00,
+        0x04, 0xe1, 0x02, 0xf0, 0x00,
+        0x00, 0x00, 0x00, 0x00,
+    };
+    struct section *section;
+    struct section_ext *section_ext;
+    struct mpeg_pmt_section *pmt;
+
+    if (((section = section_codec(buf, sizeof(buf))) == NULL) ||
+        ((section_ext = section_ext_decode(section, 0)) == NULL) ||
+        ((pmt = mpeg_pmt_section_codec(section_ext)) == NULL)) {
+        fprintf(stderr, "Failed to decode PMT\n");
+        exit(1);
+    }
+    if (en50221_ca_pmt_list_set(list, pmt)) {
+        fprintf(stderr, "Failed to set program %i\n", program_number);
+        exit(1);
+    }
+}
+
+// check what was sent since the last check
+static void expect(const char *what, int count, ...)
+{
+    va_list ap;
+    int i;
+
+    va_start(ap, count);
+    if (sent_count != count) {
+        fprintf(stderr, "%s: %i CA PMTs sent, expected %i\n", what, sent_count, count);
+        failed = 1;
+    }
+    for (i = 0; (i < count) && (i < sent_count); i++) {
+        int list_management = va_arg(ap, int);
+        int program_number = va_arg(ap, int);
+        int version = va_arg(ap, int);
+        int cmd_id = va_arg(ap, int);
+
+        if ((sent[i].list_management != list_management) ||
+            (sent[i].program_number != program_number) ||
+            (sent[i].version != version) ||
+            (sent[i].cmd_id != cmd_id)) {
+            fprintf(stderr, "%s: CA PMT %i is %i/%i/v%i/%i, expected %i/%i/v%i/%i\n", what, i,
+                    sent[i].list_management, sent[i].program_number, sent[i].version,
+                    sent[i].cmd_id, list_management, program_number, version, cmd_id);
+            failed = 1;
+        }
+    }
+    va_end(ap);
+    sent_count = 0;
+}
+
+int main(int argc, char * argv[])
+{
+    struct en50221_app_send_functions funcs;
+    struct en50221_app_ca *ca;
+    struct en50221_ca_pmt_list *list;
+    (void)argc;
+    (void)argv;
+
+    funcs.arg = NULL;
+    funcs.send_data = send_data;
+    funcs.send_datav = send_datav;
+    ca = en50221_app_ca_create(&funcs);
+    list = en50221_ca_pmt_list_create(ca, 0, CA_PMT_CMD_ID_OK_DESCRAMBLING);
+
+    // nothing goes out until there is a session
+    set(list, 100, 1);
+    expect("no session", 0);
+    en50221_ca_pmt_list_set_session(list, 5);
+    expect("new session", 1,
+           CA_LIST_MANAGEMENT_ONLY, 100, 1, CA_PMT_CMD_ID_OK_DESCRAMBLING);
+
+    // a second program is added beside the first
+    set(list, 200, 3);
+    expect("second program", 1,
+           CA_LIST_MANAGEMENT_ADD, 200, 3, CA_PMT_CMD_ID_OK_DESCRAMBLING);
+
+    // repeats of an unchanged PMT are not sent
+    set(list, 100, 1);
+    set(list, 200, 3);
+    expect("unchanged", 0);
+
+    // a new version only updates that program
+    set(list, 100, 2);
+    expect("new version", 1,
+           CA_LIST_MANAGEMENT_UPDATE, 100, 2, CA_PMT_CMD_ID_OK_DESCRAMBLING);
+
+    // a new session (CAM reinserted) gets the whole list
+    en50221_ca_pmt_list_set_session(list, -1);
+    set(list, 300, 7);
+    expect("no session again", 0);
+    en50221_ca_pmt_list_set_session(list, 9);
+    expect("whole list", 3,
+           CA_LIST_MANAGEMENT_FIRST, 100, 2, CA_PMT_CMD_ID_OK_DESCRAMBLING,
+           CA_LIST_MANAGEMENT_MORE, 200, 3, CA_PMT_CMD_ID_OK_DESCRAMBLING,
+           CA_LIST_MANAGEMENT_LAST, 300, 7, CA_PMT_CMD_ID_OK_DESCRAMBLING);
+
+    // removing one leaves the others alone
+    if (en50221_ca_pmt_list_remove(list, 200) || (en50221_ca_pmt_list_count(list) != 2))
+        failed = 1;
+    expect("remove", 1,
+           CA_LIST_MANAGEMENT_UPDATE, 200, 3, CA_PMT_CMD_ID_NOT_SELECTED);
+    if (en50221_ca_pmt_list_remove(list, 200) != -1)
+        failed = 1;
+    expect("remove again", 0);
+
+    // once the CAM has nothing, the next program replaces its list
+    en50221_ca_pmt_list_remove(list, 100);
+    en50221_ca_pmt_list_remove(list, 300);
+    sent_count = 0;
+    set(list, 400, 0);
+    expect("after emptying", 1,
+           CA_LIST_MANAGEMENT_ONLY, 400, 0, CA_PMT_CMD_ID_OK_DESCRAMBLING);
+
+    en50221_ca_pmt_list_destroy(list);
+    en50221_app_ca_destroy(ca);
+
+    return failed;
+}
@@ -0,0 +1,427 @@
+/*
+    en50221 encoder An implementation for libdvb
+    the host stack against emulated CAMs, and CA PMT update throughput
+
+    This library is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation; either version 2.1 of
+    the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <libdvben50221/en50221_stdcam.h>
+#include <libdvben50221/en50221_app_ai.h>
+#include <libdvben50221/en50221_app_ca.h>
+#include <libdvben50221/en50221_app_mmi.h>
+#include <libdvbapi/dvbca.h>
+#include <libdvbapi/dvbcamemu.h>
+#include <pthread.h>
+
+#define DEFAULT_CAMS 4
+#define DEFAULT_SECONDS 2
+
+// CA PMT queries in flight per CAM
+#define WINDOW 8
+
+#define SETUP_TIMEOUT_SECONDS 5
+#define CAMTHREAD_MAX_WAIT_MS 100
+
+struct cam {
+    struct dvbcamemu *emu;
+    int fd;
+    struct en50221_transport_layer *tl;
+    struct en50221_session_layer *sl;
+    struct en50221_stdcam *stdcam;
+    pthread_t thread;
+
+    int app_info;
+    int ca_info;
+    int menu;           // session number of the menu, -1 => none
+    int menu_closed;
+    unsigned long sent;
+    unsigned long replies;
+};
+
+void *camthread_func(void* arg);
+int ai_callback(void *arg, uint8_t slot_id, uint16_t session_number,
+                uint8_t application_type, uint16_t application_manufacturer,
+                uint16_t manufacturer_code, uint8_t menu_string_length,
+                uint8_t *menu_string);
+int ca_info_callback(void *arg, uint8_t slot_id, uint16_t session_number,
+                     uint32_t ca_id_count, uint16_t *ca_ids);
+int ca_pmt_reply_callback(void *arg, uint8_t slot_id, uint16_t session_number,
+                          struct en50221_app_pmt_reply *reply, uint32_t reply_size);
+int mmi_menu_callback(void *arg, uint8_t slot_id, uint16_t session_number,
+                      struct en50221_app_mmi_text *title,
+                      struct en50221_app_mmi_text *sub_title,
+                      struct en50221_app_mmi_text *bottom,
+                      uint32_t item_count, struct en50221_app_mmi_text *items,
+                      uint32_t item_raw_length, uint8_t *items_raw);
+int mmi_close_callback(void *arg, uint8_t slot_id, uint16_t session_number,
+                       uint8_t cmd_id, uint8_t delay);
+
+int shutdown_threads = 0;
+
+pthread_mutex_t cam_lock = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t cam_cond = PTHREAD_COND_INITIALIZER;
+
+// CA PMT body: a program with a CA descriptor, one scrambled and one clear stream
+uint8_t ca_pmt[] = {
+    0x03, 0x01, 0x02, 0x01, 0x00, 0x07,
+    0x03, 0x09, 0x04, 0x0b, 0x00, 0xe1, 0x00,
+    0x02, 0xe1, 0x01, 0x00, 0x07,
+    0x03, 0x09, 0x04, 0x0b, 0x00, 0xe1, 0x01,
+    0x04, 0xe1, 0x02, 0x00, 0x01,
+    0x03,
+};
+
+static double now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + (ts.tv_nsec / 1e9);
+}
+
+static int cam_ready(struct cam *cam)
+{
+    return cam->app_info && cam->ca_info && (cam->stdcam->ca_session_number != -1);
+}
+
+static int cam_menu(struct cam *cam)
+{
+    return cam->menu != -1;
+}
+
+static int cam_menu_closed(struct cam *cam)
+{
+    return cam->menu_closed;
+}
+
+static int cam_idle(struct cam *cam)
+{
+    return cam->replies == cam->sent;
+}
+
+// wait until cond holds for every CAM, or the timeout passes
+static int wait_all(struct cam *cams, int count, int (*cond)(struct cam *cam))
+{
+    double deadline = now() + SETUP_TIMEOUT_SECONDS;
+    struct timespec ts;
+    int i, ok = 0;
+
+    pthread_mutex_lock(&cam_lock);
+    while(!ok && (now() < deadline)) {
+        ok = 1;
+        for(i = 0; i < count; i++)
+            if (!cond(&cams[i]))
+                ok = 0;
+        if (!ok) {
+            clock_gettime(CLOCK_REALTIME, &ts);
+            ts.tv_nsec += 10000000;
+            if (ts.tv_nsec >= 1000000000) {
+                ts.tv_sec++;
+                ts.tv_nsec -= 1000000000;
+            }
+            pthread_cond_timedwait(&cam_cond, &cam_lock, &ts);
+        }
+    }
+    pthread_mutex_unlock(&cam_lock);
+
+    return ok;
+}
+
+static int cam_start(struct cam *cam)
+{
+    memset(cam, 0, sizeof(struct cam));
+    cam->menu = -1;
+
+    if ((cam->emu = dvbcamemu_create(1, &cam->fd)) == NULL) {
+        fprintf(stderr, "Failed to create CAM emulator\n");
+        return -1;
+    }
+    if (dvbca_get_interface_type(cam->fd, 0) != DVBCA_INTERFACE_LINK) {
+        fprintf(stderr, "Emulated slot is not a link layer interface\n");
+        return -1;
+    }
+
+    cam->tl = en50221_tl_create(1, 16);
+    cam->sl = en50221_sl_create(cam->tl, 16);
+    if ((cam->tl == NULL) || (cam->sl == NULL)) {
+        fprintf(stderr, "Failed to create stack\n");
+        return -1;
+    }
+    en50221_tl_set_event_driven(cam->tl, 1, CAMTHREAD_MAX_WAIT_MS);
+
+    cam->stdcam = en50221_stdcam_llci_create(cam->fd, 0, cam->tl, cam->sl);
+    if (cam->stdcam == NULL) {
+        fprintf(stderr, "Failed to create stdcam\n");
+        return -1;
+    }
+    en50221_app_ai_register_callback(cam->stdcam->ai_resource, ai_callback, cam);
+    en50221_app_ca_register_info_callback(cam->stdcam->ca_resource, ca_info_callback, cam);
+    en50221_app_ca_register_pmt_reply_callback(cam->stdcam->ca_resource, ca_pmt_reply_callback, cam);
+    en50221_app_mmi_register_menu_callback(cam->stdcam->mmi_resource, mmi_menu_callback, cam);
+    en50221_app_mmi_register_close_callback(cam->stdcam->mmi_resource, mmi_close_callback, cam);
+
+    pthread_create(&cam->thread, NULL, camthread_func, cam);
+    return 0;
+}
+
+static void cam_stop(struct cam *cam)
+{
+    pthread_join(cam->thread, NULL);
+    cam->stdcam->destroy(cam->stdcam, 1);
+    en50221_sl_destroy(cam->sl);
+    en50221_tl_destroy(cam->tl);
+    dvbcamemu_destroy(cam->emu);
+}
+
+int main(int argc, char * argv[])
+{
+    struct dvbcamemu_stats stats;
+    struct cam *cams;
+    int count = DEFAULT_CAMS;
+    int seconds = DEFAULT_SECONDS;
+    unsigned long updates = 0;
+    double start, elapsed;
+    int failed = 0;
+    int i;
+
+    if (argc > 1)
+        count = atoi(argv[1]);
+    if (argc > 2)
+        seconds = atoi(argv[2]);
+    if ((count < 1) || (seconds < 1)) {
+        fprintf(stderr, "Usage: test-camemu [<cams> [<seconds>]]\n");
+        exit(1);
+    }
+
+    cams = calloc(count, sizeof(struct cam));
+    for(i = 0; i < count; i++) {
+        if (cam_start(&cams[i]))
+            exit(1);
+    }
+
+    // the module opens its sessions and answers the stdcam's enquiries
+    if (!wait_all(cams, count, cam_ready)) {
+        fprintf(stderr, "CAMs did not come up\n");
+        exit(1);
+    }
+
+    // enter the menu, pick an item and have the module close it again
+    for(i = 0; i < count; i++)
+        en50221_app_ai_entermenu(cams[i].stdcam->ai_resource, cams[i].stdcam->ai_session_number);
+    if (!wait_all(cams, count, cam_menu)) {
+        fprintf(stderr, "MMI menu did not arrive\n");
+        exit(1);
+    }
+    for(i = 0; i < count; i++)
+        en50221_app_mmi_menu_answ(cams[i].stdcam->mmi_resource, cams[i].menu, 1);
+    if (!wait_all(cams, count, cam_menu_closed)) {
+        fprintf(stderr, "MMI was not closed\n");
+        exit(1);
+    }
+
+    // CA PMT queries, keeping WINDOW in flight on every CAM
+    start = now();
+    pthread_mutex_lock(&cam_lock);
+    while((elapsed = now() - start) < seconds) {
+        int waiting = 1;
+
+        for(i = 0; i < count; i++) {
+            struct cam *c = &cams[i];
+
+            while(c->sent - c->replies < WINDOW) {
+                ca_pmt[3] = (ca_pmt[3] & 0xc1) | ((c->sent & 0x1f) << 1);
+                if (en50221_app_ca_pmt(c->stdcam->ca_resource, c->stdcam->ca_session_number,
+                                       ca_pmt, sizeof(ca_pmt))) {
+                    fprintf(stderr, "Failed to send CA PMT\n");
+                    exit(1);
+                }
+                c->sent++;
+                waiting = 0;
+            }
+        }
+        if (waiting)
+            pthread_cond_wait(&cam_cond, &cam_lock);
+    }
+    pthread_mutex_unlock(&cam_lock);
+
+    // let the last ones arrive
+    wait_all(cams, count, cam_idle);
+
+    shutdown_threads = 1;
+    for(i = 0; i < count; i++) {
+        en50221_tl_wakeup(cams[i].tl);
+        updates += cams[i].replies;
+
+        dvbcamemu_get_stats(cams[i].emu, &stats);
+        if ((cams[i].replies != cams[i].sent) ||
+            (stats.ca_pmts != cams[i].sent) ||
+            (stats.ca_pmt_replies != cams[i].sent) ||
+            (stats.menu_answers != 1) ||
+            (stats.date_times < 1) ||
+            stats.errors) {
+            fprintf(stderr, "CAM %i: sent %lu, replies %lu; module saw %lu CA PMTs, "
+                    "sent %lu replies, %lu menu answers, %lu date-times, %lu errors\n",
+                    i, cams[i].sent, cams[i].replies, stats.ca_pmts,
+                    stats.ca_pmt_replies, stats.menu_answers, stats.date_times,
+                    stats.errors);
+            failed = 1;
+        }
+    }
+    for(i = 0; i < count; i++)
+        cam_stop(&cams[i]);
+    free(cams);
+
+    printf("%i CAMs: %lu CA PMT updates in %.1f s, %.0f updates/s (%.2f ms per update per CAM)\n",
+           count, updates, elapsed, updates / elapsed,
+           (elapsed * 1000 * count) / (updates ? updates : 1));
+
+    return failed;
+}
+
+void *camthread_func(void* arg)
+{
+    struct cam *cam = arg;
+
+    while(!shutdown_threads)
+        cam->stdcam->poll(cam->stdcam);
+
+    return 0;
+}
+
+int ai_callback(void *arg, uint8_t slot_id, uint16_t session_number,
+                uint8_t application_type, uint16_t application_manufacturer,
+                uint16_t manufacturer_code, uint8_t menu_string_length,
+                uint8_t *menu_string)
+{
+    struct cam *cam = arg;
+    (void) slot_id;
+    (void) session_number;
+    (void) application_type;
+    (void) application_manufacturer;
+    (void) manufacturer_code;
+
+    if ((menu_string_length != 9) || memcmp(menu_string, "dvbcamemu", 9)) {
+        fprintf(stderr, "Bad application info\n");
+        exit(1);
+    }
+
+    pthread_mutex_lock(&cam_lock);
+    cam->app_info = 1;
+    pthread_cond_broadcast(&cam_cond);
+    pthread_mutex_unlock(&cam_lock);
+    return 0;
+}
+
+int ca_info_callback(void *arg, uint8_t slot_id, uint16_t session_number,
+                     uint32_t ca_id_count, uint16_t *ca_ids)
+{
+    struct cam *cam = arg;
+    (void) slot_id;
+    (void) session_number;
+
+    if ((ca_id_count != 2) ||
+        (ca_ids[0] != DVBCAMEMU_CA_SYSTEM_ID_1) ||
+        (ca_ids[1] != DVBCAMEMU_CA_SYSTEM_ID_2)) {
+        fprintf(stderr, "Bad CA info\n");
+        exit(1);
+    }
+
+    pthread_mutex_lock(&cam_lock);
+    cam->ca_info = 1;
+    pthread_cond_broadcast(&cam_cond);
+    pthread_mutex_unlock(&cam_lock);
+    return 0;
+}
+
+int ca_pmt_reply_callback(void *arg, uint8_t slot_id, uint16_t session_number,
+                          struct en50221_app_pmt_reply *reply, uint32_t reply_size)
+{
+    struct cam *cam = arg;
+    struct en50221_app_pmt_stream *pos;
+    int streams = 0;
+    (void) slot_id;
+    (void) session_number;
+
+    if ((reply->program_number != 0x0102) ||
+        (reply->CA_enable_flag != 1) || (reply->CA_enable != 1))
+        goto bad;
+    en50221_app_pmt_reply_streams_for_each(reply, pos, reply_size) {
+        // the program's CA descriptor covers every stream
+        if ((streams == 2) || (pos->es_pid != 0x101 + streams) ||
+            (pos->CA_enable_flag != 1) || (pos->CA_enable != 1))
+            goto bad;
+        streams++;
+    }
+    if (streams != 2)
+        goto bad;
+
+    pthread_mutex_lock(&cam_lock);
+    cam->replies++;
+    pthread_cond_broadcast(&cam_cond);
+    pthread_mutex_unlock(&cam_lock);
+    return 0;
+
+bad:
+    fprintf(stderr, "Bad CA PMT reply\n");
+    exit(1);
+}
+
+int mmi_menu_callback(void *arg, uint8_t slot_id, uint16_t session_number,
+                      struct en50221_app_mmi_text *title,
+                      struct en50221_app_mmi_text *sub_title,
+                      struct en50221_app_mmi_text *bottom,
+                      uint32_t item_count, struct en50221_app_mmi_text *items,
+                      uint32_t item_raw_length, uint8_t *items_raw)
+{
+    struct cam *cam = arg;
+    (void) slot_id;
+    (void) sub_title;
+    (void) bottom;
+    (void) items;
+    (void) item_raw_length;
+    (void) items_raw;
+
+    if ((item_count != DVBCAMEMU_MENU_ITEMS) || (title->text_length != 9)) {
+        fprintf(stderr, "Bad menu\n");
+        exit(1);
+    }
+
+    pthread_mutex_lock(&cam_lock);
+    cam->menu = session_number;
+    pthread_cond_broadcast(&cam_cond);
+    pthread_mutex_unlock(&cam_lock);
+    return 0;
+}
+
+int mmi_close_callback(void *arg, uint8_t slot_id, uint16_t session_number,
+                       uint8_t cmd_id, uint8_t delay)
+{
+    struct cam *cam = arg;
+    (void) slot_id;
+    (void) session_number;
+    (void) cmd_id;
+    (void) delay;
+
+    pthread_mutex_lock(&cam_lock);
+    cam->menu_closed = 1;
+    pthread_cond_broadcast(&cam_cond);
+    pthread_mutex_unlock(&cam_lock);
+    return 0;
+}
@@ -0,0 +1,271 @@
+/*
+    en50221 encoder An implementation for libdvb
+    transport layer CA PMT round trip latency, against a simulated module
+
+    This library is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation; either version 2.1 of
+    the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <sys/resource.h>
+#include <libdvben50221/en50221_transport.h>
+#include <pthread.h>
+
+#define ROUND_TRIPS 200
+#define IDLE_SECONDS 1
+
+// the module end of the link speaks just enough of EN 50221 A.4.1 to
+// open a connection, answer polls and echo back whatever it is sent
+#define T_SB                0x80
+#define T_RCV               0x81
+#define T_CREATE_T_C        0x82
+#define T_C_T_C_REPLY       0x83
+#define T_DATA_LAST         0xA0
+
+void *modulethread_func(void* arg);
+void *stackthread_func(void* arg);
+void test_callback(void *arg, int reason,
+                   uint8_t *data, uint32_t data_length,
+                   uint8_t slot_id, uint8_t connection_id);
+
+int shutdown_threads = 0;
+unsigned long poll_count = 0;
+
+pthread_mutex_t reply_lock = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t reply_cond = PTHREAD_COND_INITIALIZER;
+int connection_open = 0;
+int replies = 0;
+
+// a CA PMT with one elementary stream and a CA descriptor
+uint8_t ca_pmt[] = {
+    0x9f, 0x80, 0x32, 0x1a,
+    0x03, 0x01, 0x02, 0x01, 0x00, 0x0b,
+    0x01, 0x09, 0x06, 0x01, 0x00, 0xe1, 0x00,
+    0x02, 0x01, 0x00, 0x00, 0x06,
+    0x01, 0x09, 0x04, 0x01, 0x00, 0xe1, 0x01,
+};
+
+static double now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + (ts.tv_nsec / 1e9);
+}
+
+static double cpu_time(void)
+{
+    struct rusage usage;
+
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_utime.tv_sec + (usage.ru_utime.tv_usec / 1e6) +
+           usage.ru_stime.tv_sec + (usage.ru_stime.tv_usec / 1e6);
+}
+
+static int run(int event_driven)
+{
+    int fds[2];
+    pthread_t modulethread;
+    pthread_t stackthread;
+    double total = 0, worst = 0;
+    double start, cpu_start;
+    unsigned long idle_polls;
+    int i;
+
+    if (socketpair(AF_UNIX, SOCK_SEQPACKET, 0, fds)) {
+        perror("socketpair");
+        return -1;
+    }
+
+    struct en50221_transport_layer *tl = en50221_tl_create(1, 16);
+    if (tl == NULL) {
+        fprintf(stderr, "Failed to create transport layer\n");
+        return -1;
+    }
+    if (event_driven && en50221_tl_set_event_driven(tl, 1, -1)) {
+        fprintf(stderr, "Failed to enable event driven mode\n");
+        return -1;
+    }
+    en50221_tl_register_callback(tl, test_callback, tl);
+
+    shutdown_threads = 0;
+    connection_open = 0;
+    replies = 0;
+    poll_count = 0;
+    pthread_create(&modulethread, NULL, modulethread_func, &fds[1]);
+    pthread_create(&stackthread, NULL, stackthread_func, tl);
+
+    int slot_id = en50221_tl_register_slot(tl, fds[0], 0, 1000, 100);
+    int connection_id = en50221_tl_new_tc(tl, slot_id);
+    pthread_mutex_lock(&reply_lock);
+    while (!connection_open)
+        pthread_cond_wait(&reply_cond, &reply_lock);
+    pthread_mutex_unlock(&reply_lock);
+
+    // round trips, at irregular times like a real zapping application
+    srandom(1);
+    for (i = 0; i < ROUND_TRIPS; i++) {
+        usleep(random() % 20000);
+
+        start = now();
+        pthread_mutex_lock(&reply_lock);
+        if (en50221_tl_send_data(tl, slot_id, connection_id, ca_pmt, sizeof(ca_pmt))) {
+            fprintf(stderr, "Send failed: %i\n", en50221_tl_get_error(tl));
+            pthread_mutex_unlock(&reply_lock);
+            return -1;
+        }
+        while (replies == i)
+            pthread_cond_wait(&reply_cond, &reply_lock);
+        pthread_mutex_unlock(&reply_lock);
+
+        double elapsed = now() - start;
+        total += elapsed;
+        if (elapsed > worst)
+            worst = elapsed;
+    }
+
+    // and what it costs to do nothing
+    idle_polls = poll_count;
+    cpu_start = cpu_time();
+    sleep(IDLE_SECONDS);
+    idle_polls = poll_count - idle_polls;
+
+    printf("%-14s CA PMT round trip mean %6.2f ms, worst %6.2f ms; idle: %5lu polls/s, %5.1f%% CPU\n",
+           event_driven ? "event driven" : "fixed 10ms",
+           total * 1000 / ROUND_TRIPS, worst * 1000,
+           idle_polls / IDLE_SECONDS,
+           (cpu_time() - cpu_start) * 100 / IDLE_SECONDS);
+
+    shutdown_threads = 1;
+    en50221_tl_wakeup(tl);
+    pthread_join(stackthread, NULL);
+    en50221_tl_destroy_slot(tl, slot_id);
+    en50221_tl_destroy(tl);
+    close(fds[0]);
+    pthread_join(modulethread, NULL);
+    close(fds[1]);
+
+    return 0;
+}
+
+int main(int argc, char * argv[])
+{
+    (void)argc;
+    (void)argv;
+
+    if (run(0) || run(1))
+        exit(1);
+
+    return 0;
+}
+
+void test_callback(void *arg, int reason,
+                   uint8_t *data, uint32_t data_length,
+                   uint8_t slot_id, uint8_t connection_id)
+{
+    (void) arg;
+    (void) slot_id;
+    (void) connection_id;
+
+    pthread_mutex_lock(&reply_lock);
+    switch(reason) {
+    case T_CALLBACK_REASON_CONNECTIONOPEN:
+        connection_open = 1;
+        break;
+
+    case T_CALLBACK_REASON_DATA:
+        if ((data_length != sizeof(ca_pmt)) || memcmp(data, ca_pmt, data_length)) {
+            fprintf(stderr, "Bad reply from module\n");
+            exit(1);
+        }
+        replies++;
+        break;
+    }
+    pthread_cond_signal(&reply_cond);
+    pthread_mutex_unlock(&reply_lock);
+}
+
+void *modulethread_func(void* arg)
+{
+    int fd = *(int *) arg;
+    uint8_t buf[4096];
+    uint8_t reply[4096];
+    uint8_t pending[4096];
+    int pending_length = -1;
+    int size;
+
+    while((size = read(fd, buf, sizeof(buf))) >= 5) {
+        uint8_t connection_id = buf[4];
+        int pos = 2;
+
+        reply[0] = buf[0];
+        reply[1] = buf[1];
+
+        switch(buf[2]) {
+        case T_CREATE_T_C:
+            reply[pos++] = T_C_T_C_REPLY;
+            reply[pos++] = 1;
+            reply[pos++] = connection_id;
+            break;
+
+        case T_DATA_LAST:
+            // anything other than a poll gets echoed back
+            if (size > 5) {
+                pending_length = size - 5;
+                memcpy(pending, buf + 5, pending_length);
+            }
+            break;
+
+        case T_RCV:
+            reply[pos++] = T_DATA_LAST;
+            reply[pos++] = pending_length + 1;
+            reply[pos++] = connection_id;
+            memcpy(reply + pos, pending, pending_length);
+            pos += pending_length;
+            pending_length = -1;
+            break;
+        }
+
+        // every response ends with the module status
+        reply[pos++] = T_SB;
+        reply[pos++] = 2;
+        reply[pos++] = connection_id;
+        reply[pos++] = (pending_length != -1) ? 0x80 : 0x00;
+        if (write(fd, reply, pos) != pos)
+            break;
+    }
+
+    return 0;
+}
+
+void *stackthread_func(void* arg) {
+    struct en50221_transport_layer *tl = arg;
+
+    while(!shutdown_threads) {
+        if (en50221_tl_poll(tl)) {
+            fprintf(stderr, "Error reported by stack slot:%i error:%i\n",
+                    en50221_tl_get_error_slot(tl),
+                    en50221_tl_get_error(tl));
+            exit(1);
+        }
+        poll_count++;
+    }
+
+    return 0;
+}
@@ -0,0 +1,311 @@
+/*
+ * ATSC huffman text decoder benchmark.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ */
+
+/* the trees and decoders are private to the library */
+#include "../../lib/libucsi/atsc/atsc_text.c"
+
+#include <stdio.h>
+#include <sys/time.h>
+
+#define STRINGS 2000
+#define MAX_ENCODED 512
+#define ITERATIONS 50
+#define GARBAGE 50000
+
+struct huffcode {
+	uint32_t bits;
+	uint8_t len;
+};
+
+struct encoded {
+	uint8_t buf[MAX_ENCODED];
+	size_t len;
+};
+
+static const char *words[] = {
+	"the", "news", "at", "ten", "weather", "sports", "tonight", "movie",
+	"Chicago", "Hope", "Law", "and", "Order", "special", "victims", "unit",
+	"a", "detective", "investigates", "murder", "of", "wealthy", "family",
+	"Jeopardy!", "Wheel", "Fortune", "live", "from", "New", "York", "(CC)",
+	"Season", "finale", "2007", "HD", "kids", "cartoon", "show", "with",
+	"friends", "learn", "about", "colours", "Mr.", "Smith's", "garden",
+};
+
+static struct huffcode title_codes[128][128];
+static struct huffcode description_codes[128][128];
+
+/* the decoder as it was: one bit at a time */
+static int huffman_decode_bitwise(uint8_t *src, size_t srclen,
+				  uint8_t **destbuf, size_t *destbuflen, size_t *destbufpos,
+				  struct hufftree_entry hufftree[][128])
+{
+	struct huffbuff hbuf;
+	int bit;
+	struct hufftree_entry *tree = hufftree[0];
+	uint8_t treeidx = 0;
+	uint8_t treeval;
+	int tmp;
+
+	huffbuff_init(&hbuf, src, srclen);
+
+	while(hbuf.cur_byte < hbuf.buf_len) {
+		if ((bit = huffbuff_bits(&hbuf, 1)) < 0)
+			return *destbufpos;
+
+		if (!bit) {
+			treeval = tree[treeidx].left_idx;
+		} else {
+			treeval = tree[treeidx].right_idx;
+		}
+
+		if (treeval & HUFFTREE_LITERAL_MASK) {
+			switch(treeval & ~HUFFTREE_LITERAL_MASK) {
+			case HUFFSTRING_END:
+				return 0;
+
+			case HUFFSTRING_ESCAPE:
+				if ((tmp =
+					huffman_decode_uncompressed(&hbuf,
+							destbuf, destbuflen, destbufpos)) < 0)
+					return tmp;
+				if (tmp == 0)
+					return *destbufpos;
+
+				tree = hufftree[tmp];
+				treeidx = 0;
+				break;
+
+			default:
+				if (append_unicode_char(destbuf, destbuflen, destbufpos,
+							treeval & ~HUFFTREE_LITERAL_MASK))
+					return -1;
+				tree = hufftree[treeval & ~HUFFTREE_LITERAL_MASK];
+				treeidx = 0;
+				break;
+			}
+		} else {
+			treeidx = treeval;
+		}
+	}
+
+	return *destbufpos;
+}
+
+static void build_codes(struct hufftree_entry *tree, struct huffcode *codes,
+			uint8_t node, uint32_t bits, uint8_t len)
+{
+	uint8_t child[2] = { tree[node].left_idx, tree[node].right_idx };
+	int i;
+
+	for(i = 0; i < 2; i++) {
+		if (child[i] & HUFFTREE_LITERAL_MASK) {
+			struct huffcode *code = &codes[child[i] & ~HUFFTREE_LITERAL_MASK];
+			if (code->len == 0) {
+				code->bits = (bits << 1) | i;
+				code->len = len + 1;
+			}
+		} else if (len < 31) {
+			build_codes(tree, codes, child[i], (bits << 1) | i, len + 1);
+		}
+	}
+}
+
+static int put_bits(struct encoded *out, size_t *bitpos, uint32_t bits, uint8_t len)
+{
+	while(len--) {
+		if ((*bitpos >> 3) >= MAX_ENCODED)
+			return -1;
+		if (bits & (1 << len))
+			out->buf[*bitpos >> 3] |= 0x80 >> (*bitpos & 7);
+		(*bitpos)++;
+	}
+
+	return 0;
+}
+
+static int encode(struct huffcode codes[][128], const char *text, struct encoded *out)
+{
+	size_t bitpos = 0;
+	uint8_t context = 0;
+	const char *c;
+
+	memset(out, 0, sizeof(struct encoded));
+	for(c = text; ; c++) {
+		uint8_t sym = *c;
+		struct huffcode *code = &codes[context][sym];
+
+		if (code->len) {
+			if (put_bits(out, &bitpos, code->bits, code->len))
+				return -1;
+		} else {
+			code = &codes[context][HUFFSTRING_ESCAPE];
+			if ((code->len == 0) ||
+			    put_bits(out, &bitpos, code->bits, code->len) ||
+			    put_bits(out, &bitpos, sym, 8))
+				return -1;
+		}
+
+		if (sym == HUFFSTRING_END)
+			break;
+		context = sym;
+	}
+	out->len = (bitpos + 7) >> 3;
+
+	return 0;
+}
+
+static double now(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + (tv.tv_usec / 1000000.0);
+}
+
+static int compare(const char *what, struct hufftree_entry hufftree[][128],
+		   struct hufflut *lut, uint8_t *src, size_t srclen)
+{
+	uint8_t *dest1 = NULL, *dest2 = NULL;
+	size_t destlen1 = 0, destlen2 = 0;
+	size_t destpos1 = 0, destpos2 = 0;
+	int ret1, ret2;
+	int failed = 0;
+
+	ret1 = huffman_decode_bitwise(src, srclen, &dest1, &destlen1, &destpos1, hufftree);
+	ret2 = huffman_decode(src, srclen, &dest2, &destlen2, &destpos2, hufftree, lut);
+	if ((ret1 != ret2) || (destpos1 != destpos2) ||
+	    (destpos1 && memcmp(dest1, dest2, destpos1))) {
+		fprintf(stderr, "%s: bitwise returned %i (%zu bytes), table returned %i (%zu bytes)\n",
+			what, ret1, destpos1, ret2, destpos2);
+		failed = 1;
+	}
+
+	free(dest1);
+	free(dest2);
+	return failed;
+}
+
+static void bench(const char *what, struct hufftree_entry hufftree[][128],
+		  struct hufflut *lut, struct encoded *strings)
+{
+	uint8_t *dest = NULL;
+	size_t destlen = 0;
+	size_t destpos;
+	size_t bytes = 0;
+	double start, bitwise_time, table_time;
+	int i, j;
+
+	for(j = 0; j < STRINGS; j++)
+		bytes += strings[j].len;
+	bytes *= ITERATIONS;
+
+	start = now();
+	for(i = 0; i < ITERATIONS; i++) {
+		for(j = 0; j < STRINGS; j++) {
+			destpos = 0;
+			huffman_decode_bitwise(strings[j].buf, strings[j].len,
+					       &dest, &destlen, &destpos, hufftree);
+		}
+	}
+	bitwise_time = now() - start;
+
+	start = now();
+	for(i = 0; i < ITERATIONS; i++) {
+		for(j = 0; j < STRINGS; j++) {
+			destpos = 0;
+			huffman_decode(strings[j].buf, strings[j].len,
+				       &dest, &destlen, &destpos, hufftree, lut);
+		}
+	}
+	table_time = now() - start;
+
+	printf("%-12s bitwise %7.1f MB/s, table %7.1f MB/s (%.1fx)\n", what,
+	       bytes / bitwise_time / 1e6, bytes / table_time / 1e6,
+	       bitwise_time / table_time);
+
+	free(dest);
+}
+
+int main(void)
+{
+	static struct encoded titles[STRINGS];
+	static struct encoded descriptions[STRINGS];
+	char text[MAX_ENCODED];
+	uint8_t garbage[64];
+	int failed = 0;
+	int i, j;
+
+	srandom(1);
+	for(i = 0; i < 128; i++) {
+		build_codes(program_title_hufftree[i], title_codes[i], 0, 0, 0);
+		build_codes(program_description_hufftree[i], description_codes[i], 0, 0, 0);
+	}
+
+	// titles of a few words, descriptions of a few dozen
+	for(i = 0; i < STRINGS; i++) {
+		int nwords = 1 + (random() % 5);
+		text[0] = 0;
+		for(j = 0; j < nwords; j++) {
+			strcat(text, words[random() % (sizeof(words) / sizeof(words[0]))]);
+			strcat(text, " ");
+		}
+		if (encode(title_codes, text, &titles[i])) {
+			fprintf(stderr, "Failed to encode title \"%s\"\n", text);
+			exit(1);
+		}
+		failed |= compare("title", program_title_hufftree, &program_title_hufflut,
+				  titles[i].buf, titles[i].len);
+
+		nwords = 10 + (random() % 30);
+		text[0] = 0;
+		for(j = 0; j < nwords; j++) {
+			strcat(text, words[random() % (sizeof(words) / sizeof(words[0]))]);
+			strcat(text, " ");
+		}
+		if (encode(description_codes, text, &descriptions[i])) {
+			fprintf(stderr, "Failed to encode description \"%s\"\n", text);
+			exit(1);
+		}
+		failed |= compare("description", program_description_hufftree,
+				  &program_description_hufflut,
+				  descriptions[i].buf, descriptions[i].len);
+
+		// every truncation of a string behaves the same way too
+		for(j = 0; j < (int) titles[i].len; j++)
+			failed |= compare("truncated title", program_title_hufftree,
+					  &program_title_hufflut, titles[i].buf, j);
+	}
+
+	for(i = 0; i < GARBAGE; i++) {
+		int len = random() % sizeof(garbage);
+		for(j = 0; j < len; j++)
+			garbage[j] = random();
+		failed |= compare("random title", program_title_hufftree,
+				  &program_title_hufflut, garbage, len);
+		failed |= compare("random description", program_description_hufftree,
+				  &program_description_hufflut, garbage, len);
+	}
+	if (failed)
+		return 1;
+
+	bench("titles", program_title_hufftree, &program_title_hufflut, titles);
+	bench("descriptions", program_description_hufftree, &program_description_hufflut,
+	      descriptions);
+
+	return 0;
+}
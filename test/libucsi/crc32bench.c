@@ -0,0 +1,132 @@
+/*
+ * crc32 engine verification and benchmark.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ */
+
+#include <libucsi/crc32.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+#define BUF_SIZE (1024*1024)
+#define MAX_CHECK_LEN 4096
+
+static struct {
+	enum crc32_engine engine;
+	char *name;
+} engines[] = {
+	{ CRC32_ENGINE_BYTEWISE, "bytewise" },
+	{ CRC32_ENGINE_SLICE8, "slice8" },
+	{ CRC32_ENGINE_CLMUL, "clmul" },
+};
+#define NUM_ENGINES (sizeof(engines) / sizeof(engines[0]))
+
+static double now(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + (tv.tv_usec / 1000000.0);
+}
+
+static int check_engine(enum crc32_engine engine, uint8_t *buf)
+{
+	size_t len;
+	size_t offset;
+
+	for (len = 0; len <= MAX_CHECK_LEN; len++) {
+		offset = rand() % 16;
+		uint32_t init = (len & 1) ? (uint32_t) CRC32_INIT : (uint32_t) rand();
+		uint32_t ref = crc32_engine_calc(CRC32_ENGINE_BYTEWISE, init, buf + offset, len);
+		uint32_t val = crc32_engine_calc(engine, init, buf + offset, len);
+
+		if (ref != val) {
+			fprintf(stderr, "Mismatch at length %zu: %08x != %08x\n", len, val, ref);
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+static void bench_engine(char *name, enum crc32_engine engine, uint8_t *buf, size_t chunk)
+{
+	size_t total = 0;
+	uint32_t crc = 0;
+	double start = now();
+	double elapsed;
+
+	do {
+		size_t pos;
+
+		for (pos = 0; pos + chunk <= BUF_SIZE; pos += chunk)
+			crc += crc32_engine_calc(engine, CRC32_INIT, buf + pos, chunk);
+		total += BUF_SIZE;
+		elapsed = now() - start;
+	} while (elapsed < 0.5);
+
+	printf("%-10s chunk %5zu: %7.3f GB/s (%08x)\n", name, chunk,
+	       (total / elapsed) / 1e9, crc);
+}
+
+int main(int argc, char *argv[])
+{
+	static const size_t chunks[] = { 188, 1024, 4096, BUF_SIZE };
+	uint8_t *buf;
+	unsigned int i, j;
+
+	(void) argv;
+
+	if ((buf = malloc(BUF_SIZE)) == NULL) {
+		fprintf(stderr, "Out of memory\n");
+		exit(1);
+	}
+	srand(1);
+	for (i = 0; i < BUF_SIZE; i++)
+		buf[i] = rand();
+
+	printf("Selected engine: %i\n", crc32_get_engine());
+
+	for (i = 0; i < NUM_ENGINES; i++) {
+		if ((engines[i].engine == CRC32_ENGINE_CLMUL) &&
+		    (crc32_set_engine(CRC32_ENGINE_CLMUL) != 0)) {
+			printf("%-10s not supported on this CPU\n", engines[i].name);
+			engines[i].engine = CRC32_ENGINE_AUTO;
+			continue;
+		}
+		if (check_engine(engines[i].engine, buf)) {
+			fprintf(stderr, "%s engine FAILED verification\n", engines[i].name);
+			exit(1);
+		}
+		printf("%-10s verified\n", engines[i].name);
+	}
+	crc32_set_engine(CRC32_ENGINE_AUTO);
+
+	/* with any argument, only verify */
+	if (argc > 1)
+		exit(0);
+
+	for (i = 0; i < NUM_ENGINES; i++) {
+		if (engines[i].engine == CRC32_ENGINE_AUTO)
+			continue;
+		for (j = 0; j < sizeof(chunks) / sizeof(chunks[0]); j++)
+			bench_engine(engines[i].name, engines[i].engine, buf, chunks[j]);
+	}
+
+	free(buf);
+	return 0;
+}
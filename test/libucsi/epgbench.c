@@ -0,0 +1,381 @@
+/*
+ * dvb_epg_store benchmark.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ */
+
+#include <libucsi/dvb/epg_store.h>
+#include <libucsi/dvb/types.h>
+#include <libucsi/ts_demux.h>
+#include <libucsi/crc32.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+
+#define EIT_PID 0x12
+#define MAX_SECTIONS (4*1024*1024)
+#define QUERIES 1000000
+
+#define SYNTH_ONID 0x0001
+#define SYNTH_TSID 0x0400
+#define SYNTH_SERVICES 500
+#define SYNTH_DAYS 7
+#define SYNTH_EVENT_SECS 1800
+#define SYNTH_EVENTS_PER_SECTION 6
+#define SYNTH_TITLES 2000
+#define SYNTH_START 1700006400	/* a midnight, UTC */
+
+struct bench_section {
+	uint16_t len;
+	uint8_t *data;
+};
+
+/* services seen, for the queries */
+struct bench_service {
+	uint16_t onid;
+	uint16_t tsid;
+	uint16_t sid;
+};
+
+static struct bench_section *sections;
+static int section_count;
+static size_t section_bytes;
+static struct bench_service services[65536];
+static int service_count;
+static time_t first_start = -1;
+static time_t last_start;
+
+static double now(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + (tv.tv_usec / 1000000.0);
+}
+
+static void add_section(const uint8_t *data, int len)
+{
+	uint16_t onid, tsid, sid;
+	int i;
+
+	if ((section_count == MAX_SECTIONS) || (len < 18) || ((data[0] & 0xf0) < 0x40))
+		return;
+	if ((sections[section_count].data = malloc(len)) == NULL) {
+		fprintf(stderr, "Out of memory\n");
+		exit(1);
+	}
+	memcpy(sections[section_count].data, data, len);
+	sections[section_count].len = len;
+	section_count++;
+	section_bytes += len;
+
+	sid = (data[3] << 8) | data[4];
+	tsid = (data[8] << 8) | data[9];
+	onid = (data[10] << 8) | data[11];
+	for (i = 0; i < service_count; i++) {
+		if ((services[i].onid == onid) && (services[i].tsid == tsid) && (services[i].sid == sid))
+			return;
+	}
+	if (service_count < 65536) {
+		services[service_count].onid = onid;
+		services[service_count].tsid = tsid;
+		services[service_count].sid = sid;
+		service_count++;
+	}
+}
+
+static void demux_cb(void *arg, struct ts_demux_section *demuxed, int count)
+{
+	int i;
+
+	(void) arg;
+
+	for (i = 0; i < count; i++)
+		add_section(demuxed[i].data, demuxed[i].len);
+}
+
+static void load_file(const char *filename)
+{
+	struct ts_demux *demux;
+	struct stat st;
+	uint8_t *buf;
+	int fd;
+
+	if ((fd = open(filename, O_RDONLY)) < 0) {
+		fprintf(stderr, "Unable to open file %s\n", filename);
+		exit(1);
+	}
+	if (fstat(fd, &st)) {
+		perror("fstat");
+		exit(1);
+	}
+	buf = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (buf == MAP_FAILED) {
+		perror("mmap");
+		exit(1);
+	}
+	close(fd);
+
+	if ((demux = ts_demux_create(0, demux_cb, NULL)) == NULL) {
+		fprintf(stderr, "Failed to create demux\n");
+		exit(1);
+	}
+	ts_demux_add_pid(demux, EIT_PID, 0);
+	ts_demux_feed(demux, buf, st.st_size);
+	ts_demux_destroy(demux);
+	munmap(buf, st.st_size);
+}
+
+/* append a short_event and an extended_event descriptor */
+static int synth_descriptors(uint8_t *buf, int title, int episode)
+{
+	char name[64], text[256], extended[256];
+	int pos = 0, len;
+
+	sprintf(name, "Programme title number %i", title);
+	sprintf(text, "Short synopsis of programme %i, which is repeated on many services.", title);
+	sprintf(extended, "Episode %i of programme %i. A longer description of the episode, "
+		"differing from one episode to the next.", episode, title);
+
+	buf[pos++] = 0x4d;
+	buf[pos++] = 5 + strlen(name) + strlen(text);
+	memcpy(buf + pos, "eng", 3);
+	pos += 3;
+	buf[pos++] = strlen(name);
+	memcpy(buf + pos, name, strlen(name));
+	pos += strlen(name);
+	buf[pos++] = strlen(text);
+	memcpy(buf + pos, text, strlen(text));
+	pos += strlen(text);
+
+	len = strlen(extended);
+	buf[pos++] = 0x4e;
+	buf[pos++] = 6 + len;
+	buf[pos++] = 0x00;
+	memcpy(buf + pos, "eng", 3);
+	pos += 3;
+	buf[pos++] = 0;
+	buf[pos++] = len;
+	memcpy(buf + pos, extended, len);
+	pos += len;
+
+	return pos;
+}
+
+static void synth_section(int sid, int table_id, int section_number, int version, time_t start)
+{
+	uint8_t buf[4096];
+	int pos = 14, i, len;
+	uint32_t crc;
+
+	for (i = 0; i < SYNTH_EVENTS_PER_SECTION; i++) {
+		time_t event_start = start + (i * SYNTH_EVENT_SECS);
+		int event_id = (event_start - SYNTH_START) / SYNTH_EVENT_SECS;
+
+		buf[pos] = event_id >> 8;
+		buf[pos+1] = event_id;
+		unixtime_to_dvbdate(event_start, buf + pos + 2);
+		seconds_to_dvbduration(SYNTH_EVENT_SECS, buf + pos + 7);
+		len = synth_descriptors(buf + pos + 12, (event_id * 7 + sid) % SYNTH_TITLES, event_id);
+		buf[pos+10] = 0x80 | (len >> 8);
+		buf[pos+11] = len;
+		pos += 12 + len;
+	}
+
+	len = pos + 4;
+	buf[0] = table_id;
+	buf[1] = 0xf0 | ((len - 3) >> 8);
+	buf[2] = len - 3;
+	buf[3] = sid >> 8;
+	buf[4] = sid;
+	buf[5] = 0xc1 | (version << 1);
+	buf[6] = section_number;
+	buf[7] = 0xff;
+	buf[8] = SYNTH_TSID >> 8;
+	buf[9] = SYNTH_TSID & 0xff;
+	buf[10] = SYNTH_ONID >> 8;
+	buf[11] = SYNTH_ONID & 0xff;
+	buf[12] = section_number;
+	buf[13] = table_id;
+	crc = crc32(CRC32_INIT, buf, len - 4);
+	buf[len-4] = crc >> 24;
+	buf[len-3] = crc >> 16;
+	buf[len-2] = crc >> 8;
+	buf[len-1] = crc;
+
+	add_section(buf, len);
+}
+
+/*
+ * A 7 day schedule of half hour events on each service, one section per 3
+ * hour segment, sent twice as a carousel would.
+ */
+static void synth_schedule(int version)
+{
+	int pass, sid, segment;
+
+	for (pass = 0; pass < 2; pass++) {
+		for (segment = 0; segment < SYNTH_DAYS * 8; segment++) {
+			for (sid = 1; sid <= SYNTH_SERVICES; sid++) {
+				synth_section(sid, 0x50 + (segment / 32), (segment % 32) * 8, version,
+					      SYNTH_START + (segment * 3 * 3600));
+			}
+		}
+	}
+}
+
+static void print_stats(struct dvb_epg_store *store)
+{
+	struct dvb_epg_store_stats stats;
+	size_t total;
+
+	dvb_epg_store_get_stats(store, &stats);
+	total = stats.arena_bytes + stats.event_bytes + stats.index_bytes;
+	printf("store:      %u services, %u events, %llu sections (%llu unchanged, %llu invalid)\n",
+	       stats.services, stats.events,
+	       (unsigned long long) stats.sections,
+	       (unsigned long long) stats.unchanged,
+	       (unsigned long long) stats.invalid);
+	printf("strings:    %u distinct of %llu, %zu bytes\n",
+	       stats.strings, (unsigned long long) stats.string_refs, stats.string_bytes);
+	printf("memory:     %zu KB (arena %zu, events %zu, index %zu), %.0f bytes/event\n",
+	       total / 1024, stats.arena_bytes / 1024, stats.event_bytes / 1024,
+	       stats.index_bytes / 1024, stats.events ? (double) total / stats.events : 0.0);
+}
+
+int main(int argc, char *argv[])
+{
+	struct dvb_epg_store *store;
+	const struct dvb_epg_event *now_event, *next_event, *events;
+	double start, elapsed;
+	time_t span;
+	int i, found, total;
+	int failed = 0;
+
+	if ((argc > 2) || ((argc > 1) && !strcmp(argv[1], "-h"))) {
+		fprintf(stderr, "Syntax: epgbench [<recorded ts file>]\n");
+		exit(1);
+	}
+
+	if ((sections = malloc(MAX_SECTIONS * sizeof(struct bench_section))) == NULL) {
+		fprintf(stderr, "Out of memory\n");
+		exit(1);
+	}
+	if (argc > 1) {
+		load_file(argv[1]);
+	} else {
+		printf("No file specified, using a synthetic %i service, %i day schedule\n",
+		       SYNTH_SERVICES, SYNTH_DAYS);
+		synth_schedule(1);
+	}
+	printf("input:      %i EIT sections, %zu KB\n", section_count, section_bytes / 1024);
+
+	if ((store = dvb_epg_store_create()) == NULL) {
+		fprintf(stderr, "Failed to create store\n");
+		exit(1);
+	}
+
+	/* ingest */
+	start = now();
+	for (i = 0; i < section_count; i++)
+		dvb_epg_store_add_section(store, sections[i].data, sections[i].len);
+	elapsed = now() - start;
+	printf("ingest:     %.3f s (%.0f ns/section)\n", elapsed, elapsed * 1e9 / section_count);
+	print_stats(store);
+
+	/* the time span covered, for the queries */
+	for (i = 0; i < service_count; i++) {
+		if (dvb_epg_store_window(store, services[i].onid, services[i].tsid, services[i].sid,
+					 0, 0x7fffffff, &events) > 0) {
+			int count = dvb_epg_store_window(store, services[i].onid, services[i].tsid,
+							 services[i].sid, 0, 0x7fffffff, &events);
+			if ((first_start < 0) || (events[0].start < first_start))
+				first_start = events[0].start;
+			if (events[count - 1].start > last_start)
+				last_start = events[count - 1].start;
+		}
+	}
+	if ((service_count == 0) || (first_start < 0)) {
+		printf("No events\n");
+		return 1;
+	}
+	span = (last_start - first_start) + 1;
+
+	/* now/next */
+	srand(1);
+	found = 0;
+	start = now();
+	for (i = 0; i < QUERIES; i++) {
+		struct bench_service *s = &services[rand() % service_count];
+
+		dvb_epg_store_now_next(store, s->onid, s->tsid, s->sid,
+				       first_start + (rand() % span), &now_event, &next_event);
+		if (now_event != NULL)
+			found++;
+	}
+	elapsed = now() - start;
+	printf("now/next:   %.0f ns/query, %i of %i running\n", elapsed * 1e9 / QUERIES, found, QUERIES);
+
+	/* a 3 hour grid */
+	total = 0;
+	start = now();
+	for (i = 0; i < QUERIES; i++) {
+		struct bench_service *s = &services[rand() % service_count];
+		time_t from = first_start + (rand() % span);
+
+		total += dvb_epg_store_window(store, s->onid, s->tsid, s->sid,
+					      from, from + (3 * 3600), &events);
+	}
+	elapsed = now() - start;
+	printf("window:     %.0f ns/query, %.1f events/query\n",
+	       elapsed * 1e9 / QUERIES, (double) total / QUERIES);
+
+	if (argc == 1) {
+		/* check the synthetic schedule came out as generated */
+		dvb_epg_store_now_next(store, SYNTH_ONID, SYNTH_TSID, 7,
+				       SYNTH_START + (10 * SYNTH_EVENT_SECS) + 60,
+				       &now_event, &next_event);
+		if ((now_event == NULL) || (now_event->event_id != 10) ||
+		    (next_event == NULL) || (next_event->event_id != 11) ||
+		    (now_event->title == NULL) || (now_event->extended == NULL)) {
+			fprintf(stderr, "now/next returned the wrong events\n");
+			failed = 1;
+		}
+
+		/* a new version of the schedule replaces the events section by section */
+		section_count = 0;
+		synth_schedule(2);
+		start = now();
+		for (i = 0; i < section_count; i++)
+			dvb_epg_store_add_section(store, sections[i].data, sections[i].len);
+		elapsed = now() - start;
+		printf("update:     %.3f s (%.0f ns/section)\n", elapsed, elapsed * 1e9 / section_count);
+		print_stats(store);
+
+		i = dvb_epg_store_window(store, SYNTH_ONID, SYNTH_TSID, 1, 0, 0x7fffffff, &events);
+		if (i != SYNTH_DAYS * 48) {
+			fprintf(stderr, "expected %i events, got %i\n", SYNTH_DAYS * 48, i);
+			failed = 1;
+		}
+	}
+
+	dvb_epg_store_destroy(store);
+	return failed;
+}
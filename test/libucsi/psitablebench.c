@@ -0,0 +1,257 @@
+/*
+ * psi_table_collector benchmark.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ */
+
+#include <libucsi/psi_table.h>
+#include <libucsi/ts_demux.h>
+#include <libucsi/section.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+
+#define MAX_SECTIONS (1024*1024)
+#define SYNTH_CAROUSELS 20000
+#define SYNTH_PMTS 8
+
+/* the sections to replay, in stream order */
+struct bench_section {
+	uint16_t pid;
+	uint16_t len;
+	uint8_t *data;
+};
+
+static struct bench_section *sections;
+static int section_count;
+
+static uint64_t decoded;
+static uint64_t tables;
+
+static double now(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + (tv.tv_usec / 1000000.0);
+}
+
+static void add_section(int pid, const uint8_t *data, int len)
+{
+	if (section_count == MAX_SECTIONS)
+		return;
+	sections[section_count].pid = pid;
+	sections[section_count].len = len;
+	if ((sections[section_count].data = malloc(len)) == NULL) {
+		fprintf(stderr, "Out of memory\n");
+		exit(1);
+	}
+	memcpy(sections[section_count].data, data, len);
+	section_count++;
+}
+
+/* what a consumer does with every section it wants to look at */
+static void decode(const uint8_t *data, int len)
+{
+	uint8_t buf[DVB_MAX_SECTION_BYTES];
+	struct section *section;
+
+	memcpy(buf, data, len);
+	if ((section = section_codec(buf, len)) == NULL)
+		return;
+	if (section_ext_decode(section, 1) == NULL)
+		return;
+	decoded++;
+}
+
+static void table_cb(void *arg, struct psi_table *table)
+{
+	int i;
+
+	(void) arg;
+
+	tables++;
+	for (i = 0; i <= table->last_section_number; i++)
+		decode(table->sections[i].data, table->sections[i].len);
+}
+
+static void demux_cb(void *arg, struct ts_demux_section *demuxed, int count)
+{
+	int i;
+
+	(void) arg;
+
+	for (i = 0; i < count; i++) {
+		if (demuxed[i].data[1] & 0x80)
+			add_section(demuxed[i].pid, demuxed[i].data, demuxed[i].len);
+	}
+}
+
+static void load_file(const char *filename)
+{
+	struct ts_demux *demux;
+	struct stat st;
+	uint8_t *buf;
+	int fd, pid;
+
+	if ((fd = open(filename, O_RDONLY)) < 0) {
+		fprintf(stderr, "Unable to open file %s\n", filename);
+		exit(1);
+	}
+	if (fstat(fd, &st)) {
+		perror("fstat");
+		exit(1);
+	}
+	buf = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (buf == MAP_FAILED) {
+		perror("mmap");
+		exit(1);
+	}
+	close(fd);
+
+	/* all the DVB SI PIDs */
+	if ((demux = ts_demux_create(0, demux_cb, NULL)) == NULL) {
+		fprintf(stderr, "Failed to create demux\n");
+		exit(1);
+	}
+	for (pid = 0; pid < 0x20; pid++)
+		ts_demux_add_pid(demux, pid, 0);
+	ts_demux_feed(demux, buf, st.st_size);
+	ts_demux_destroy(demux);
+	munmap(buf, st.st_size);
+}
+
+static int synth_section(uint8_t *buf, int table_id, int table_id_ext, int version,
+			 int section_number, int last_section_number, int payload_len)
+{
+	int len = 8 + payload_len + 4;
+	uint32_t crc;
+
+	buf[0] = table_id;
+	buf[1] = 0xb0 | ((len - 3) >> 8);
+	buf[2] = (len - 3);
+	buf[3] = table_id_ext >> 8;
+	buf[4] = table_id_ext;
+	buf[5] = 0xc1 | (version << 1);
+	buf[6] = section_number;
+	buf[7] = last_section_number;
+	memset(buf + 8, section_number, payload_len);
+	crc = crc32(CRC32_INIT, buf, len - 4);
+	buf[len-4] = crc >> 24;
+	buf[len-3] = crc >> 16;
+	buf[len-2] = crc >> 8;
+	buf[len-1] = crc;
+	return len;
+}
+
+/*
+ * A carousel of a PAT, SYNTH_PMTS PMTs, a four section SDT and a two
+ * section NIT. Every table changes version once, half way through.
+ */
+static void synth_sections(void)
+{
+	uint8_t buf[DVB_MAX_SECTION_BYTES];
+	int i, j, len, version;
+
+	for (i = 0; i < SYNTH_CAROUSELS; i++) {
+		version = (i < SYNTH_CAROUSELS / 2) ? 1 : 2;
+
+		len = synth_section(buf, 0x00, 1, version, 0, 0, SYNTH_PMTS * 4);
+		add_section(0x00, buf, len);
+		for (j = 0; j < SYNTH_PMTS; j++) {
+			len = synth_section(buf, 0x02, j + 1, version, 0, 0, 60);
+			add_section(0x100 + j, buf, len);
+		}
+		for (j = 0; j < 4; j++) {
+			len = synth_section(buf, 0x42, 1, version, j, 3, 900);
+			add_section(0x11, buf, len);
+		}
+		for (j = 0; j < 2; j++) {
+			len = synth_section(buf, 0x40, 1, version, j, 1, 600);
+			add_section(0x10, buf, len);
+		}
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	struct psi_table_collector *collector;
+	const struct psi_table_stats *stats;
+	double start, decode_all, collect;
+	int i;
+
+	if ((argc > 2) || ((argc > 1) && !strcmp(argv[1], "-h"))) {
+		fprintf(stderr, "Syntax: psitablebench [<recorded ts file>]\n");
+		exit(1);
+	}
+
+	if ((sections = malloc(MAX_SECTIONS * sizeof(struct bench_section))) == NULL) {
+		fprintf(stderr, "Out of memory\n");
+		exit(1);
+	}
+	if (argc > 1) {
+		load_file(argv[1]);
+	} else {
+		printf("No file specified, using a synthetic section carousel\n");
+		synth_sections();
+	}
+
+	/* decode every section received, as the utilities used to */
+	start = now();
+	for (i = 0; i < section_count; i++)
+		decode(sections[i].data, sections[i].len);
+	decode_all = now() - start;
+	printf("decode all: %i sections decoded in %.3f s (%.0f ns/section)\n",
+	       (int) decoded, decode_all, decode_all * 1e9 / section_count);
+
+	/* only decode complete new table versions */
+	if ((collector = psi_table_collector_create(PSI_TABLE_CHECK_CRC, table_cb, NULL)) == NULL) {
+		fprintf(stderr, "Failed to create collector\n");
+		exit(1);
+	}
+	decoded = 0;
+	start = now();
+	for (i = 0; i < section_count; i++)
+		psi_table_collector_feed(collector, sections[i].pid, sections[i].data, sections[i].len);
+	collect = now() - start;
+
+	stats = psi_table_collector_get_stats(collector);
+	printf("collector:  %i sections decoded in %.3f s (%.0f ns/section, %.1fx)\n",
+	       (int) decoded, collect, collect * 1e9 / section_count, decode_all / collect);
+	printf("tables:     %llu delivered, %llu version changes\n",
+	       (unsigned long long) stats->tables,
+	       (unsigned long long) stats->version_changes);
+	printf("sections:   %llu fed, %llu repeats, %llu ignored, %llu crc errors, %llu invalid\n",
+	       (unsigned long long) stats->sections,
+	       (unsigned long long) stats->repeats,
+	       (unsigned long long) stats->ignored,
+	       (unsigned long long) stats->crc_errors,
+	       (unsigned long long) stats->invalid);
+
+	/* each synthetic table exists in exactly two versions */
+	if ((argc == 1) && (tables != 2 * (1 + SYNTH_PMTS + 2))) {
+		fprintf(stderr, "Expected %i tables, got %llu\n",
+			2 * (1 + SYNTH_PMTS + 2), (unsigned long long) tables);
+		return 1;
+	}
+
+	psi_table_collector_destroy(collector);
+	return 0;
+}
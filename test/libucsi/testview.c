@@ -0,0 +1,340 @@
+/*
+ * read-only section view test application.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ */
+
+#include <libucsi/mpeg/section.h>
+#include <libucsi/dvb/section.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define CHECK(cond) \
+	do { \
+		if (!(cond)) { \
+			fprintf(stderr, "%s:%i: check failed: %s\n", __FILE__, __LINE__, #cond); \
+			exit(1); \
+		} \
+	} while(0)
+
+/* section builder */
+static uint8_t sbuf[4096];
+static size_t spos;
+
+static void put8(int v)
+{
+	sbuf[spos++] = v;
+}
+
+static void put16(int v)
+{
+	put8(v >> 8);
+	put8(v);
+}
+
+static void put_descriptor(int tag, char *data)
+{
+	put8(tag);
+	put8(strlen(data));
+	memcpy(sbuf + spos, data, strlen(data));
+	spos += strlen(data);
+}
+
+static void start_section(int table_id, int table_id_ext)
+{
+	spos = 0;
+	put8(table_id);
+	put16(0);
+	put16(table_id_ext);
+	put8(0xc0 | (7 << 1) | 1);
+	put8(0);
+	put8(0);
+}
+
+static size_t end_section(void)
+{
+	uint32_t crc;
+
+	sbuf[1] = 0xb0 | ((spos + 4 - 3) >> 8);
+	sbuf[2] = (spos + 4 - 3) & 0xff;
+	crc = crc32(CRC32_INIT, sbuf, spos);
+	put16(crc >> 16);
+	put16(crc);
+	return spos;
+}
+
+static const struct section_ext_view *view_ext(uint8_t *buf, size_t len)
+{
+	const struct section_view *section;
+	const struct section_ext_view *ext;
+
+	CHECK((section = section_view_decode(buf, len)) != NULL);
+	CHECK((ext = section_ext_view_decode(section, 1)) != NULL);
+	CHECK(section_ext_view_version_number(ext) == 7);
+	CHECK(section_ext_view_current_next_indicator(ext) == 1);
+	return ext;
+}
+
+static struct section_ext *codec_ext(uint8_t *buf, size_t len)
+{
+	struct section *section;
+	struct section_ext *ext;
+
+	CHECK((section = section_codec(buf, len)) != NULL);
+	CHECK((ext = section_ext_decode(section, 1)) != NULL);
+	return ext;
+}
+
+static void test_pat(void)
+{
+	uint8_t copy[4096];
+	size_t len;
+	const struct mpeg_pat_view *pat;
+	const struct mpeg_pat_program_view *vprog;
+	struct mpeg_pat_section *cpat;
+	struct mpeg_pat_program *cprog;
+	int count = 0;
+
+	start_section(stag_mpeg_program_association, 0x1234);
+	put16(0);
+	put16(0xe010);
+	put16(0x0101);
+	put16(0xe100);
+	put16(0x0102);
+	put16(0xf1ff);
+	len = end_section();
+	memcpy(copy, sbuf, len);
+
+	CHECK((pat = mpeg_pat_view_decode(view_ext(sbuf, len))) != NULL);
+	CHECK(mpeg_pat_view_transport_stream_id(pat) == 0x1234);
+
+	CHECK((cpat = mpeg_pat_section_codec(codec_ext(copy, len))) != NULL);
+	cprog = mpeg_pat_section_programs_first(cpat);
+	mpeg_pat_view_programs_for_each(pat, vprog) {
+		CHECK(cprog != NULL);
+		CHECK(mpeg_pat_program_view_program_number(vprog) == cprog->program_number);
+		CHECK(mpeg_pat_program_view_pid(vprog) == cprog->pid);
+		cprog = mpeg_pat_section_programs_next(cpat, cprog);
+		count++;
+	}
+	CHECK(cprog == NULL);
+	CHECK(count == 3);
+
+	/* the view must be decodable again from the untouched buffer */
+	CHECK(mpeg_pat_view_decode(view_ext(sbuf, len)) == pat);
+}
+
+static void test_pmt(void)
+{
+	uint8_t copy[4096];
+	size_t len;
+	const struct mpeg_pmt_view *pmt;
+	const struct mpeg_pmt_stream_view *vstream;
+	const struct descriptor *vdesc;
+	struct mpeg_pmt_section *cpmt;
+	struct mpeg_pmt_stream *cstream;
+	int count = 0;
+
+	start_section(stag_mpeg_program_map, 0x0101);
+	put16(0xe100);
+	put16(0xf000 | 5);
+	put_descriptor(0x09, "abc");
+	put8(0x02);
+	put16(0xe100);
+	put16(0xf000);
+	put8(0x04);
+	put16(0xe101);
+	put16(0xf000 | 5);
+	put_descriptor(0x0a, "eng");
+	len = end_section();
+	memcpy(copy, sbuf, len);
+
+	CHECK((pmt = mpeg_pmt_view_decode(view_ext(sbuf, len))) != NULL);
+	CHECK((cpmt = mpeg_pmt_section_codec(codec_ext(copy, len))) != NULL);
+	CHECK(mpeg_pmt_view_program_number(pmt) == 0x0101);
+	CHECK(mpeg_pmt_view_pcr_pid(pmt) == cpmt->pcr_pid);
+	CHECK(mpeg_pmt_view_program_info_length(pmt) == cpmt->program_info_length);
+	CHECK((vdesc = mpeg_pmt_view_descriptors_first(pmt)) != NULL);
+	CHECK(vdesc->tag == 0x09);
+
+	cstream = mpeg_pmt_section_streams_first(cpmt);
+	mpeg_pmt_view_streams_for_each(pmt, vstream) {
+		CHECK(cstream != NULL);
+		CHECK(mpeg_pmt_stream_view_stream_type(vstream) == cstream->stream_type);
+		CHECK(mpeg_pmt_stream_view_pid(vstream) == cstream->pid);
+		CHECK(mpeg_pmt_stream_view_es_info_length(vstream) == cstream->es_info_length);
+		cstream = mpeg_pmt_section_streams_next(cpmt, cstream);
+		count++;
+	}
+	CHECK(cstream == NULL);
+	CHECK(count == 2);
+
+	/* a truncated descriptor loop must be rejected */
+	sbuf[sizeof(struct mpeg_pmt_view) - 1] = 0xff;
+	CHECK(mpeg_pmt_view_decode((const struct section_ext_view *) sbuf) == NULL);
+}
+
+static void test_sdt(void)
+{
+	uint8_t copy[4096];
+	size_t len;
+	const struct dvb_sdt_view *sdt;
+	const struct dvb_sdt_service_view *vsvc;
+	struct dvb_sdt_section *csdt;
+	struct dvb_sdt_service *csvc;
+	int count = 0;
+
+	start_section(stag_dvb_service_description_actual, 0x1234);
+	put16(0x0055);
+	put8(0xff);
+	put16(0x0101);
+	put8(0xfd);
+	put16(0x8000 | 0x1000 | 7);
+	put_descriptor(0x48, "xyzzy");
+	put16(0x0102);
+	put8(0xfe);
+	put16(0x2000);
+	len = end_section();
+	memcpy(copy, sbuf, len);
+
+	CHECK((sdt = dvb_sdt_view_decode(view_ext(sbuf, len))) != NULL);
+	CHECK((csdt = dvb_sdt_section_codec(codec_ext(copy, len))) != NULL);
+	CHECK(dvb_sdt_view_transport_stream_id(sdt) == 0x1234);
+	CHECK(dvb_sdt_view_original_network_id(sdt) == csdt->original_network_id);
+
+	csvc = dvb_sdt_section_services_first(csdt);
+	dvb_sdt_view_services_for_each(sdt, vsvc) {
+		CHECK(csvc != NULL);
+		CHECK(dvb_sdt_service_view_service_id(vsvc) == csvc->service_id);
+		CHECK(dvb_sdt_service_view_eit_schedule_flag(vsvc) == csvc->eit_schedule_flag);
+		CHECK(dvb_sdt_service_view_eit_present_following_flag(vsvc) == csvc->eit_present_following_flag);
+		CHECK(dvb_sdt_service_view_running_status(vsvc) == csvc->running_status);
+		CHECK(dvb_sdt_service_view_free_ca_mode(vsvc) == csvc->free_ca_mode);
+		CHECK(dvb_sdt_service_view_descriptors_loop_length(vsvc) == csvc->descriptors_loop_length);
+		csvc = dvb_sdt_section_services_next(csdt, csvc);
+		count++;
+	}
+	CHECK(csvc == NULL);
+	CHECK(count == 2);
+}
+
+static void test_nit(void)
+{
+	uint8_t copy[4096];
+	size_t len;
+	const struct dvb_nit_view *nit;
+	const struct dvb_nit_transport_view *vt;
+	const struct descriptor *vdesc;
+	struct dvb_nit_section *cnit;
+	struct dvb_nit_section_part2 *part2;
+	struct dvb_nit_transport *ct;
+	int count = 0;
+
+	start_section(stag_dvb_network_information_actual, 0x0055);
+	put16(0xf000 | 6);
+	put_descriptor(0x40, "test");
+	put16(0xf000 | 16);
+	put16(0x1234);
+	put16(0x0055);
+	put16(0xf000 | 4);
+	put_descriptor(0x41, "ab");
+	put16(0x1235);
+	put16(0x0055);
+	put16(0xf000);
+	len = end_section();
+	memcpy(copy, sbuf, len);
+
+	CHECK((nit = dvb_nit_view_decode(view_ext(sbuf, len))) != NULL);
+	CHECK((cnit = dvb_nit_section_codec(codec_ext(copy, len))) != NULL);
+	CHECK(dvb_nit_view_network_id(nit) == 0x0055);
+	CHECK(dvb_nit_view_network_descriptors_length(nit) == cnit->network_descriptors_length);
+	count = 0;
+	dvb_nit_view_descriptors_for_each(nit, vdesc)
+		count++;
+	CHECK(count == 1);
+
+	part2 = dvb_nit_section_part2(cnit);
+	CHECK(dvb_nit_view_transport_stream_loop_length(nit) == part2->transport_stream_loop_length);
+	ct = dvb_nit_section_transports_first(part2);
+	count = 0;
+	dvb_nit_view_transports_for_each(nit, vt) {
+		CHECK(ct != NULL);
+		CHECK(dvb_nit_transport_view_transport_stream_id(vt) == ct->transport_stream_id);
+		CHECK(dvb_nit_transport_view_original_network_id(vt) == ct->original_network_id);
+		CHECK(dvb_nit_transport_view_descriptors_length(vt) == ct->transport_descriptors_length);
+		ct = dvb_nit_section_transports_next(part2, ct);
+		count++;
+	}
+	CHECK(ct == NULL);
+	CHECK(count == 2);
+}
+
+static void test_eit(void)
+{
+	uint8_t copy[4096];
+	size_t len;
+	const struct dvb_eit_view *eit;
+	const struct dvb_eit_event_view *vev;
+	struct dvb_eit_section *ceit;
+	struct dvb_eit_event *cev;
+	int count = 0;
+
+	start_section(stag_dvb_event_information_nownext_actual, 0x0101);
+	put16(0x1234);
+	put16(0x0055);
+	put8(0);
+	put8(0x4e);
+	put16(0x4000);
+	put16(0xd5a6); put8(0x12); put8(0x30); put8(0x00);
+	put8(0x01); put8(0x30); put8(0x00);
+	put16(0x8000 | 5);
+	put_descriptor(0x4d, "eng");
+	len = end_section();
+	memcpy(copy, sbuf, len);
+
+	CHECK((eit = dvb_eit_view_decode(view_ext(sbuf, len))) != NULL);
+	CHECK((ceit = dvb_eit_section_codec(codec_ext(copy, len))) != NULL);
+	CHECK(dvb_eit_view_service_id(eit) == 0x0101);
+	CHECK(dvb_eit_view_transport_stream_id(eit) == ceit->transport_stream_id);
+	CHECK(dvb_eit_view_original_network_id(eit) == ceit->original_network_id);
+	CHECK(dvb_eit_view_last_table_id(eit) == ceit->last_table_id);
+
+	cev = dvb_eit_section_events_first(ceit);
+	dvb_eit_view_events_for_each(eit, vev) {
+		CHECK(cev != NULL);
+		CHECK(dvb_eit_event_view_event_id(vev) == cev->event_id);
+		CHECK(!memcmp(dvb_eit_event_view_start_time(vev), cev->start_time, 5));
+		CHECK(!memcmp(dvb_eit_event_view_duration(vev), cev->duration, 3));
+		CHECK(dvb_eit_event_view_running_status(vev) == cev->running_status);
+		CHECK(dvb_eit_event_view_descriptors_loop_length(vev) == cev->descriptors_loop_length);
+		cev = dvb_eit_section_events_next(ceit, cev);
+		count++;
+	}
+	CHECK(cev == NULL);
+	CHECK(count == 1);
+}
+
+int main(void)
+{
+	test_pat();
+	test_pmt();
+	test_sdt();
+	test_nit();
+	test_eit();
+
+	printf("All section view tests passed\n");
+	return 0;
+}
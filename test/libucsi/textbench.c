@@ -0,0 +1,163 @@
+/*
+ * dvb_text_decoder benchmark.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ */
+
+#include <libucsi/dvb/text.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <iconv.h>
+#include <sys/time.h>
+
+#define ITERATIONS 200000
+
+/* DVB strings, and the UTF-8 they should decode to */
+struct text_case {
+	const char *name;
+	const char *in;
+	int inlen;
+	const char *expected;
+	const char *iconv_charset;	/* for the per-string iconv comparison */
+};
+
+#define TEXT(s) s, sizeof(s) - 1
+
+static struct text_case cases[] = {
+	{ "ascii service name", TEXT("BBC ONE Lon"), "BBC ONE Lon", "ISO_6937" },
+	{ "ascii event title",
+	  TEXT("The News at Ten, followed by the weather forecast for your region"),
+	  "The News at Ten, followed by the weather forecast for your region", "ISO_6937" },
+	{ "ISO 6937 diacritics", TEXT("Das Erste \xc8u\xc8o \xc2""e"),
+	  "Das Erste \xc3\xbc\xc3\xb6 \xc3\xa9", "ISO_6937" },
+	{ "ISO 6937 euro sign", TEXT("Preis 5\xa4"), "Preis 5\xe2\x82\xac", NULL },
+	{ "ISO 8859-5", TEXT("\x01\xbf\xd5\xe0\xd2\xeb\xd9"),
+	  "\xd0\x9f\xd0\xb5\xd1\x80\xd0\xb2\xd1\x8b\xd0\xb9", "ISO-8859-5" },
+	{ "ISO 8859-2 via 0x10", TEXT("\x10\x00\x02\xc8T 1"), "\xc4\x8cT 1", "ISO-8859-2" },
+	{ "ISO 8859-15", TEXT("\x0b""Caf\xe9 \xa4"), "Caf\xc3\xa9 \xe2\x82\xac", "ISO-8859-15" },
+	{ "UTF-8", TEXT("\x15""Caf\xc3\xa9 TV"), "Caf\xc3\xa9 TV", "UTF-8" },
+	{ "control codes", TEXT("Film\x8a""Drama \x86Premiere\x87"), "FilmDrama Premiere", NULL },
+	{ NULL, NULL, 0, NULL, NULL },
+};
+
+static double now(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + (tv.tv_usec / 1000000.0);
+}
+
+/* what the utilities used to do for each string */
+static char *iconv_each(const char *charset, const char *in, int inlen)
+{
+	char *dest = malloc((inlen * 3) + 1);
+	char *tmp = malloc(inlen + 2);
+	char *inp, *outp;
+	size_t inleft, outleft;
+	iconv_t cd;
+	int skip = 0;
+
+	if ((unsigned char) in[0] < 0x20)
+		skip = (in[0] == 0x10) ? 3 : 1;
+	memcpy(tmp, in + skip, inlen - skip);
+	inp = tmp;
+	inleft = inlen - skip;
+	outp = dest;
+	outleft = inlen * 3;
+
+	if ((cd = iconv_open("UTF-8", charset)) != (iconv_t) -1) {
+		iconv(cd, &inp, &inleft, &outp, &outleft);
+		iconv_close(cd);
+	}
+	*outp = 0;
+	free(tmp);
+	return dest;
+}
+
+int main(void)
+{
+	struct dvb_text_decoder *decoder;
+	struct text_case *c;
+	char out[1024];
+	double start, decode_time, iconv_time;
+	int failed = 0;
+	int i;
+
+	if ((decoder = dvb_text_decoder_create(NULL, NULL, 0)) == NULL) {
+		fprintf(stderr, "Failed to create decoder\n");
+		exit(1);
+	}
+
+	for (c = cases; c->name; c++) {
+		dvb_text_decode(decoder, (const uint8_t *) c->in, c->inlen, out, sizeof(out));
+		if (strcmp(out, c->expected)) {
+			fprintf(stderr, "%s: decoded as \"%s\"\n", c->name, out);
+			failed = 1;
+		}
+	}
+
+	/* truncation stays on a character boundary */
+	i = dvb_text_decode(decoder, (const uint8_t *) cases[2].in, cases[2].inlen, out, 12);
+	if ((i != 10) || strcmp(out, "Das Erste ")) {
+		fprintf(stderr, "truncated to %i bytes: \"%s\"\n", i, out);
+		failed = 1;
+	}
+
+	/* emphasis, and conversion to another output charset */
+	dvb_text_decoder_destroy(decoder);
+	decoder = dvb_text_decoder_create("ISO-8859-1", NULL, DVB_TEXT_EMPHASIS | DVB_TEXT_NEWLINES);
+	if (decoder == NULL) {
+		fprintf(stderr, "Failed to create ISO-8859-1 decoder\n");
+		exit(1);
+	}
+	dvb_text_decode(decoder, (const uint8_t *) cases[8].in, cases[8].inlen, out, sizeof(out));
+	if (strcmp(out, "Film\nDrama *Premiere*")) {
+		fprintf(stderr, "control codes decoded as \"%s\"\n", out);
+		failed = 1;
+	}
+	dvb_text_decode(decoder, (const uint8_t *) cases[2].in, cases[2].inlen, out, sizeof(out));
+	if (strcmp(out, "Das Erste \xfc\xf6 \xe9")) {
+		fprintf(stderr, "ISO-8859-1 output decoded as \"%s\"\n", out);
+		failed = 1;
+	}
+	dvb_text_decoder_destroy(decoder);
+
+	/* speed, against opening iconv for every string */
+	decoder = dvb_text_decoder_create(NULL, NULL, 0);
+	printf("%-22s %12s %12s\n", "", "decoder", "iconv each");
+	for (c = cases; c->name; c++) {
+		if (c->iconv_charset == NULL)
+			continue;
+
+		start = now();
+		for (i = 0; i < ITERATIONS; i++)
+			dvb_text_decode(decoder, (const uint8_t *) c->in, c->inlen, out, sizeof(out));
+		decode_time = now() - start;
+
+		start = now();
+		for (i = 0; i < ITERATIONS / 10; i++)
+			free(iconv_each(c->iconv_charset, c->in, c->inlen));
+		iconv_time = (now() - start) * 10;
+
+		printf("%-22s %9.0f ns %9.0f ns  (%.0fx)\n", c->name,
+		       decode_time * 1e9 / ITERATIONS, iconv_time * 1e9 / ITERATIONS,
+		       iconv_time / decode_time);
+	}
+	dvb_text_decoder_destroy(decoder);
+
+	return failed;
+}
@@ -0,0 +1,306 @@
+/*
+ * ts_demux benchmark.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ */
+
+#include <libucsi/ts_demux.h>
+#include <libucsi/mpeg/pat_view.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+
+#define CHUNK_SIZE (1024*1024)
+#define SYNTH_SIZE (64*1024*1024)
+#define SYNTH_PMT_PID 0x100
+#define SYNTH_VIDEO_PID 0x200
+
+static struct ts_demux *demux;
+static uint64_t bad_crc;
+
+static double now(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + (tv.tv_usec / 1000000.0);
+}
+
+static void sections_cb(void *arg, struct ts_demux_section *sections, int count)
+{
+	const struct section_view *section;
+	const struct section_ext_view *ext;
+	const struct mpeg_pat_view *pat;
+	const struct mpeg_pat_program_view *program;
+	int i;
+
+	(void) arg;
+
+	for (i = 0; i < count; i++) {
+		if ((section = section_view_decode(sections[i].data, sections[i].len)) == NULL)
+			continue;
+		if (!section_view_syntax_indicator(section))
+			continue;
+		if ((ext = section_ext_view_decode(section, 1)) == NULL) {
+			bad_crc++;
+			continue;
+		}
+
+		/* follow the PAT so PMTs are demultiplexed too */
+		if ((sections[i].pid != 0) || (section_view_table_id(section) != 0))
+			continue;
+		if ((pat = mpeg_pat_view_decode(ext)) == NULL)
+			continue;
+		mpeg_pat_view_programs_for_each(pat, program) {
+			if (mpeg_pat_program_view_program_number(program))
+				ts_demux_add_pid(demux, mpeg_pat_program_view_pid(program), 0);
+		}
+	}
+}
+
+/* synthetic stream generation */
+static uint8_t *synth_pos;
+static uint8_t synth_cc[TRANSPORT_MAX_PIDS];
+
+static void synth_packetize(int pid, uint8_t *section, int len)
+{
+	int first = 1;
+
+	while (len > 0) {
+		uint8_t *pkt = synth_pos;
+		int space = TRANSPORT_PACKET_LENGTH - 4 - first;
+		int copy = (len < space) ? len : space;
+
+		pkt[0] = TRANSPORT_PACKET_SYNC;
+		pkt[1] = (first ? 0x40 : 0) | (pid >> 8);
+		pkt[2] = pid;
+		pkt[3] = 0x10 | (synth_cc[pid]++ & 0x0f);
+		if (first)
+			pkt[4] = 0;
+		memcpy(pkt + 4 + first, section, copy);
+		memset(pkt + 4 + first + copy, 0xff, space - copy);
+		section += copy;
+		len -= copy;
+		first = 0;
+		synth_pos += TRANSPORT_PACKET_LENGTH;
+	}
+}
+
+static void synth_payload(int pid, int count)
+{
+	while (count--) {
+		synth_pos[0] = TRANSPORT_PACKET_SYNC;
+		synth_pos[1] = pid >> 8;
+		synth_pos[2] = pid;
+		synth_pos[3] = 0x10 | (synth_cc[pid]++ & 0x0f);
+		memset(synth_pos + 4, 0x55, TRANSPORT_PACKET_LENGTH - 4);
+		synth_pos += TRANSPORT_PACKET_LENGTH;
+	}
+}
+
+static int synth_section(uint8_t *buf, int table_id, int table_id_ext, int section_number,
+			 int payload_len)
+{
+	int len = 8 + payload_len + 4;
+	uint32_t crc;
+
+	buf[0] = table_id;
+	buf[1] = 0xb0 | ((len - 3) >> 8);
+	buf[2] = (len - 3);
+	buf[3] = table_id_ext >> 8;
+	buf[4] = table_id_ext;
+	buf[5] = 0xc1;
+	buf[6] = section_number;
+	buf[7] = 0xff;
+	crc = crc32(CRC32_INIT, buf, len - 4);
+	buf[len-4] = crc >> 24;
+	buf[len-3] = crc >> 16;
+	buf[len-2] = crc >> 8;
+	buf[len-1] = crc;
+	return len;
+}
+
+static uint8_t *synth_stream(size_t *len)
+{
+	uint8_t *buf = malloc(SYNTH_SIZE + (1024 * TRANSPORT_PACKET_LENGTH));
+	uint8_t section[DVB_MAX_SECTION_BYTES];
+	int slen;
+	int i = 0;
+
+	if (buf == NULL) {
+		fprintf(stderr, "Out of memory\n");
+		exit(1);
+	}
+	synth_pos = buf;
+
+	while ((synth_pos - buf) < SYNTH_SIZE) {
+		/* PAT */
+		memset(section + 8, 0, 8);
+		section[8 + 2] = 0xe0 | (SYNTH_PMT_PID >> 8);
+		section[8 + 3] = SYNTH_PMT_PID & 0xff;
+		section[8 + 1] = 1;
+		slen = synth_section(section, 0x00, 1, 0, 4);
+		synth_packetize(0, section, slen);
+
+		/* PMT */
+		memset(section + 8, 0, 4);
+		section[8] = 0xe0 | (SYNTH_VIDEO_PID >> 8);
+		section[8 + 1] = SYNTH_VIDEO_PID & 0xff;
+		section[8 + 2] = 0xf0;
+		slen = synth_section(section, 0x02, 1, 0, 4);
+		synth_packetize(SYNTH_PMT_PID, section, slen);
+
+		/* a batch of EIT schedule sections of varying size */
+		for (i = 0; i < 16; i++) {
+			memset(section + 8, 0x20 + i, 1024);
+			slen = synth_section(section, 0x50, i, 0, 16 + (i * 97) % 1000);
+			synth_packetize(0x12, section, slen);
+		}
+
+		synth_payload(SYNTH_VIDEO_PID, 200);
+	}
+
+	*len = synth_pos - buf;
+	return buf;
+}
+
+/* a callback which disables its PID each time the batch fills */
+static struct ts_demux *remove_demux;
+static int remove_sections;
+
+static void remove_cb(void *arg, struct ts_demux_section *sections, int count)
+{
+	(void) arg;
+
+	remove_sections += count;
+	ts_demux_remove_pid(remove_demux, sections[0].pid);
+}
+
+static void check_remove_in_callback(void)
+{
+	uint8_t stream[64 * TRANSPORT_PACKET_LENGTH];
+	uint8_t section[DVB_MAX_SECTION_BYTES];
+	int i;
+
+	/* back to back sections, so the next completes while the PID is gone */
+	synth_pos = stream;
+	memset(section + 8, 0x20, 100);
+	for (i = 0; i < 8; i++)
+		synth_packetize(0x12, section, synth_section(section, 0x50, i, 0, 100));
+
+	if ((remove_demux = ts_demux_create(1, remove_cb, NULL)) == NULL) {
+		fprintf(stderr, "Failed to create demux\n");
+		exit(1);
+	}
+	ts_demux_add_pid(remove_demux, 0x12, 0);
+	ts_demux_feed(remove_demux, stream, synth_pos - stream);
+	ts_demux_destroy(remove_demux);
+	memset(synth_cc, 0, sizeof(synth_cc));
+
+	if (remove_sections != 1) {
+		fprintf(stderr, "%i sections delivered after the PID was removed, expected 1\n",
+			remove_sections);
+		exit(1);
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	uint8_t *buf;
+	size_t len;
+	size_t pos;
+	int batch = 0;
+	int passes = 0;
+	int pid;
+	double start;
+	double elapsed;
+	const struct ts_demux_stats *stats;
+
+	if ((argc > 3) || ((argc > 1) && !strcmp(argv[1], "-h"))) {
+		fprintf(stderr, "Syntax: tsdemuxbench [<recorded ts file> [<batch size>]]\n");
+		exit(1);
+	}
+	if (argc == 3)
+		batch = atoi(argv[2]);
+
+	check_remove_in_callback();
+
+	if (argc > 1) {
+		struct stat st;
+		int fd;
+
+		if ((fd = open(argv[1], O_RDONLY)) < 0) {
+			fprintf(stderr, "Unable to open file %s\n", argv[1]);
+			exit(1);
+		}
+		if (fstat(fd, &st)) {
+			perror("fstat");
+			exit(1);
+		}
+		len = st.st_size;
+		buf = mmap(NULL, len, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd, 0);
+		if (buf == MAP_FAILED) {
+			perror("mmap");
+			exit(1);
+		}
+		close(fd);
+	} else {
+		printf("No file specified, using a synthetic stream\n");
+		buf = synth_stream(&len);
+	}
+
+	if ((demux = ts_demux_create(batch, sections_cb, NULL)) == NULL) {
+		fprintf(stderr, "Failed to create demux\n");
+		exit(1);
+	}
+
+	start = now();
+	do {
+		/* PSI/SI PIDs; PMT PIDs are added as the PAT is seen */
+		for (pid = 0; pid < 0x20; pid++)
+			ts_demux_add_pid(demux, pid, 0);
+
+		for (pos = 0; pos < len; pos += CHUNK_SIZE)
+			ts_demux_feed(demux, buf + pos, (len - pos) < CHUNK_SIZE ? (len - pos) : CHUNK_SIZE);
+
+		ts_demux_reset(demux);
+		passes++;
+		elapsed = now() - start;
+	} while (elapsed < 1.0);
+
+	stats = ts_demux_get_stats(demux);
+	printf("%i passes over %zu bytes in %.3f s\n", passes, len, elapsed);
+	printf("packets:   %llu (%.2f Mpackets/s, %.1f MB/s)\n",
+	       (unsigned long long) stats->packets, stats->packets / elapsed / 1e6,
+	       stats->packets * (double) TRANSPORT_PACKET_LENGTH / elapsed / 1e6);
+	printf("filtered:  %llu\n", (unsigned long long) stats->filtered_packets);
+	printf("sections:  %llu (%.0f sections/s) in %llu batches\n",
+	       (unsigned long long) stats->sections, stats->sections / elapsed,
+	       (unsigned long long) stats->batches);
+	printf("errors:    sync %llu tei %llu cc %llu section %llu crc %llu\n",
+	       (unsigned long long) stats->sync_errors,
+	       (unsigned long long) stats->tei_errors,
+	       (unsigned long long) stats->cc_errors,
+	       (unsigned long long) stats->section_errors,
+	       (unsigned long long) bad_crc);
+
+	ts_demux_destroy(demux);
+	return 0;
+}
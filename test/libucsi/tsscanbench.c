@@ -0,0 +1,190 @@
+/*
+ * ts_scan verification and benchmark.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ */
+
+#include <libucsi/ts_scan.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+#define NUM_PACKETS 100000
+#define CHUNK_SIZE (1024*1024)
+#define MAX_PACKETS (CHUNK_SIZE / TRANSPORT_PACKET_LENGTH)
+
+static struct {
+	enum ts_scan_engine engine;
+	char *name;
+} engines[] = {
+	{ TS_SCAN_ENGINE_SCALAR, "scalar" },
+	{ TS_SCAN_ENGINE_SSE2, "sse2" },
+	{ TS_SCAN_ENGINE_AVX2, "avx2" },
+};
+#define NUM_ENGINES (sizeof(engines) / sizeof(engines[0]))
+
+static double now(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + (tv.tv_usec / 1000000.0);
+}
+
+/**
+ * Build a stream of packets with the given stride, with some garbage
+ * inserted every so often if corrupt is set.
+ */
+static uint8_t *make_stream(int stride, int corrupt, size_t *len)
+{
+	uint8_t *buf = malloc((size_t) NUM_PACKETS * (stride + 16));
+	uint8_t *pos = buf;
+	int i;
+
+	if (buf == NULL) {
+		fprintf(stderr, "Out of memory\n");
+		exit(1);
+	}
+
+	for (i = 0; i < NUM_PACKETS; i++) {
+		uint8_t *pkt = pos + ((stride == TS_SCAN_STRIDE_192) ? 4 : 0);
+
+		memset(pos, 0xaa, stride);
+		pkt[0] = TRANSPORT_PACKET_SYNC;
+		pkt[1] = ((i % 97) == 0 ? 0x80 : 0) | ((i & 1) << 6) | ((i >> 8) & 0x1f);
+		pkt[2] = i;
+		pkt[3] = ((i & 3) << 6) | (((i % 3) + 1) << 4) | (i & 0x0f);
+		pos += stride;
+
+		if (corrupt && ((i % 1000) == 999)) {
+			memset(pos, 0x00, 13);
+			pos += 13;
+		}
+	}
+
+	*len = pos - buf;
+	return buf;
+}
+
+/**
+ * Scan a whole stream in CHUNK_SIZE pieces, carrying unconsumed data over.
+ */
+static struct ts_scan *scan_stream(enum ts_scan_engine engine, uint8_t *buf, size_t len,
+				   uint64_t *pidsum)
+{
+	struct ts_scan *scan = ts_scan_create(MAX_PACKETS, engine);
+	size_t pos = 0;
+	size_t i;
+
+	*pidsum = 0;
+	while (pos < len) {
+		size_t chunk = (len - pos) < CHUNK_SIZE ? (len - pos) : CHUNK_SIZE;
+		size_t used = ts_scan_buffer(scan, buf + pos, chunk);
+
+		for (i = 0; i < scan->count; i++)
+			*pidsum += (scan->pid[i] * 31 + scan->flags[i] * 7 + scan->cc[i]) ^
+				   (pos + scan->offset[i]);
+		if ((used == 0) && (chunk == (len - pos)))
+			break;
+		pos += used;
+	}
+
+	return scan;
+}
+
+int main(int argc, char *argv[])
+{
+	static const int strides[] = { TS_SCAN_STRIDE_188, TS_SCAN_STRIDE_192, TS_SCAN_STRIDE_204 };
+	unsigned int e, s;
+	int corrupt;
+
+	(void) argv;
+
+	/* check all engines produce identical results */
+	for (s = 0; s < 3; s++) {
+		for (corrupt = 0; corrupt < 2; corrupt++) {
+			uint64_t refsum = 0;
+			uint64_t refpackets = 0;
+			size_t len;
+			uint8_t *buf = make_stream(strides[s], corrupt, &len);
+
+			for (e = 0; e < NUM_ENGINES; e++) {
+				struct ts_scan *scan;
+				uint64_t pidsum;
+
+				if (!ts_scan_engine_supported(engines[e].engine))
+					continue;
+
+				scan = scan_stream(engines[e].engine, buf, len, &pidsum);
+				if (e == 0) {
+					refsum = pidsum;
+					refpackets = scan->packets;
+					if ((scan->packets != NUM_PACKETS) ||
+					    (scan->tei_packets != (NUM_PACKETS + 96) / 97)) {
+						fprintf(stderr, "stride %i: found %llu packets %llu TEI\n", strides[s],
+							(unsigned long long) scan->packets,
+							(unsigned long long) scan->tei_packets);
+						exit(1);
+					}
+				} else if ((pidsum != refsum) || (scan->packets != refpackets)) {
+					fprintf(stderr, "%s engine FAILED verification (stride %i)\n",
+						engines[e].name, strides[s]);
+					exit(1);
+				}
+				printf("%-7s stride %i%s: %llu packets, %llu sync losses\n",
+				       engines[e].name, strides[s], corrupt ? " corrupt" : "",
+				       (unsigned long long) scan->packets,
+				       (unsigned long long) scan->sync_losses);
+				ts_scan_destroy(scan);
+			}
+			free(buf);
+		}
+	}
+
+	/* with any argument, only verify */
+	if (argc > 1)
+		exit(0);
+
+	for (e = 0; e < NUM_ENGINES; e++) {
+		size_t len;
+		uint8_t *buf;
+		uint64_t packets = 0;
+		uint64_t pidsum;
+		double start, elapsed;
+
+		if (!ts_scan_engine_supported(engines[e].engine)) {
+			printf("%-7s not supported on this CPU\n", engines[e].name);
+			continue;
+		}
+
+		buf = make_stream(TS_SCAN_STRIDE_188, 0, &len);
+		start = now();
+		do {
+			struct ts_scan *scan = scan_stream(engines[e].engine, buf, len, &pidsum);
+
+			packets += scan->packets;
+			ts_scan_destroy(scan);
+			elapsed = now() - start;
+		} while (elapsed < 0.5);
+
+		printf("%-7s %7.2f Mpackets/s (%.2f Gbit/s)\n", engines[e].name,
+		       packets / elapsed / 1e6,
+		       packets * TRANSPORT_PACKET_LENGTH * 8.0 / elapsed / 1e9);
+		free(buf);
+	}
+
+	return 0;
+}
@@ -6,10 +6,18 @@
 #include "help.h"
 
 
-static inline int hash(int pgno)
+static inline struct cache_pgno * pgno_ent(struct cache *ca, int pgno)
 {
-    // very simple...
-    return pgno % HASH_SIZE;
+    if (pgno < CACHE_FIRST_PGNO || pgno > CACHE_LAST_PGNO)
+	return 0;
+    return ca->pg + pgno - CACHE_FIRST_PGNO;
+}
+
+
+static inline int help_page(int pgno)
+{
+    // help pages stay in the cache and are not in the lru list
+    return pgno / 256 == 9;
 }
 
 
@@ -33,35 +41,102 @@ static void do_erc(struct vt_page *ovtp, struct vt_page *nvtp)
 }
 
 
-static void cache_close(struct cache *ca)
+static int grow_sub(struct cache *ca, struct cache_pgno *pg, int subno)
+{
+    struct cache_page **sub;
+    int n = pg->nsub ? pg->nsub : 8;
+
+    while (n <= subno)
+	n *= 2;
+    if (not(sub = realloc(pg->sub, n * sizeof(*sub))))
+	return -1;
+    memset(sub + pg->nsub, 0, (n - pg->nsub) * sizeof(*sub));
+    ca->mem += (n - pg->nsub) * sizeof(*sub);
+    pg->sub = sub;
+    pg->nsub = n;
+    return 0;
+}
+
+
+static void remove_page(struct cache *ca, struct cache_page *cp)
+{
+    struct cache_pgno *pg = pgno_ent(ca, cp->page->pgno);
+    int pgno = cp->page->pgno;
+    int i;
+
+    if (not help_page(pgno))
+	dl_remove(cp->node);
+    pg->sub[cp->page->subno] = 0;
+    if (pg->newest == cp)
+    {
+	// find the next newest, if there is any left
+	pg->newest = 0;
+	for (i = 0; i < pg->nsub; ++i)
+	    if (pg->sub[i])
+		if (pg->newest == 0 || pg->sub[i]->stamp > pg->newest->stamp)
+		    pg->newest = pg->sub[i];
+    }
+    if (pg->newest == 0)
+    {
+	ca->mem -= pg->nsub * sizeof(*pg->sub);
+	free(pg->sub);
+	pg->sub = 0;
+	pg->nsub = 0;
+	ca->hi_subno[pgno] = 0;
+    }
+    free(cp);
+    ca->mem -= sizeof(*cp);
+    ca->npages--;
+}
+
+
+static void touch(struct cache *ca, struct cache_pgno *pg, struct cache_page *cp)
+{
+    cp->stamp = ++ca->stamp;
+    pg->newest = cp;
+    if (not help_page(cp->page->pgno))
+	dl_insert_first(&ca->lru, dl_remove(cp->node));
+}
+
+
+static void evict(struct cache *ca, struct cache_page *keep)
 {
     struct cache_page *cp;
+
+    if (ca->maxmem == 0)
+	return;
+
+    while (ca->mem > ca->maxmem && not dl_empty(&ca->lru))
+    {
+	cp = PTR ca->lru.last;
+	if (cp == keep)
+	    break;
+	remove_page(ca, cp);
+	ca->evictions++;
+    }
+}
+
+
+static void cache_close(struct cache *ca)
+{
+    struct cache_pgno *pg;
     int i;
 
-    for (i = 0; i < HASH_SIZE; ++i)
-	while (not dl_empty(ca->hash + i))
-	{
-	    cp = PTR ca->hash[i].first;
-	    dl_remove(cp->node);
-	    free(cp);
-	}
+    for (pg = ca->pg; pg < ca->pg + NELEM(ca->pg); pg++)
+    {
+	for (i = 0; i < pg->nsub; ++i)
+	    free(pg->sub[i]);
+	free(pg->sub);
+    }
     free(ca);
 }
 
 
 static void cache_reset(struct cache *ca)
 {
-    struct cache_page *cp, *cpn;
-    int i;
-
-    for (i = 0; i < HASH_SIZE; ++i)
-	for (cp = PTR ca->hash[i].first; cpn = PTR cp->node->next; cp = cpn)
-	    if (cp->page->pgno / 256 != 9) // don't remove help pages
-	    {
-		dl_remove(cp->node);
-		free(cp);
-		ca->npages--;
-	    }
+    // don't remove help pages
+    while (not dl_empty(&ca->lru))
+	remove_page(ca, PTR ca->lru.first);
     memset(ca->hi_subno, 0, sizeof(ca->hi_subno[0]) * 0x900);
 }
 
@@ -71,52 +146,69 @@ static void cache_reset(struct cache *ca)
 
 static struct vt_page * cache_get(struct cache *ca, int pgno, int subno)
 {
-    struct cache_page *cp;
-    int h = hash(pgno);
-
-    for (cp = PTR ca->hash[h].first; cp->node->next; cp = PTR cp->node->next)
-	if (cp->page->pgno == pgno)
-	    if (subno == ANY_SUB || cp->page->subno == subno)
-	    {
-		// found, move to front (make it 'new')
-		dl_insert_first(ca->hash + h, dl_remove(cp->node));
-		return cp->page;
-	    }
-    return 0;
+    struct cache_pgno *pg = pgno_ent(ca, pgno);
+    struct cache_page *cp = 0;
+
+    if (pg)
+    {
+	if (subno == ANY_SUB)
+	    cp = pg->newest;
+	else if (subno >= 0 && subno < pg->nsub)
+	    cp = pg->sub[subno];
+    }
+    if (cp == 0)
+    {
+	ca->misses++;
+	return 0;
+    }
+    // found, make it 'new'
+    touch(ca, pg, cp);
+    ca->hits++;
+    return cp->page;
 }
 
 /*  Put a page in the cache.
-    If it's already there, it is updated. */
+    If it's already there, it is updated.
+    Least recently used pages are dropped to stay within maxmem. */
 
 
 static struct vt_page * cache_put(struct cache *ca, struct vt_page *vtp)
 {
-    struct cache_page *cp;
-    int h = hash(vtp->pgno);
-    
-    for (cp = PTR ca->hash[h].first; cp->node->next; cp = PTR cp->node->next)
-	if (cp->page->pgno == vtp->pgno && cp->page->subno == vtp->subno)
-	    break;
+    struct cache_pgno *pg = pgno_ent(ca, vtp->pgno);
+    struct cache_page *cp = 0;
+
+    if (pg == 0 || vtp->subno < 0 || vtp->subno > 0x3f7f)
+	return 0;
 
-    if (cp->node->next)
+    if (vtp->subno < pg->nsub)
+	cp = pg->sub[vtp->subno];
+
+    if (cp)
     {
-	// move to front.
-	dl_insert_first(ca->hash + h, dl_remove(cp->node));
+	touch(ca, pg, cp);
 	if (ca->erc)
 	    do_erc(cp->page, vtp);
     }
     else
     {
+	if (vtp->subno >= pg->nsub && grow_sub(ca, pg, vtp->subno))
+	    return 0;
 	cp = malloc(sizeof(*cp));
 	if (cp == 0)
 	    return 0;
 	if (vtp->subno >= ca->hi_subno[vtp->pgno])
 	    ca->hi_subno[vtp->pgno] = vtp->subno + 1;
+	pg->sub[vtp->subno] = cp;
+	ca->mem += sizeof(*cp);
 	ca->npages++;
-	dl_insert_first(ca->hash + h, cp->node);
+	cp->stamp = ++ca->stamp;
+	pg->newest = cp;
+	if (not help_page(vtp->pgno))
+	    dl_insert_first(&ca->lru, cp->node);
     }
 
     *cp->page = *vtp;
+    evict(ca, cp);
     return cp->page;
 }
 
@@ -125,13 +217,14 @@ static struct vt_page * cache_put(struct cache *ca, struct vt_page *vtp)
 
 static struct vt_page * cache_lookup(struct cache *ca, int pgno, int subno)
 {
-    struct cache_page *cp;
-    int h = hash(pgno);
+    struct cache_pgno *pg = pgno_ent(ca, pgno);
 
-    for (cp = PTR ca->hash[h].first; cp->node->next; cp = PTR cp->node->next)
-	if (cp->page->pgno == pgno)
-	    if (subno == ANY_SUB || cp->page->subno == subno)
-		return cp->page;
+    if (pg == 0)
+	return 0;
+    if (subno == ANY_SUB)
+	return pg->newest ? pg->newest->page : 0;
+    if (subno >= 0 && subno < pg->nsub && pg->sub[subno])
+	return pg->sub[subno]->page;
     return 0;
 }
 
@@ -184,6 +277,11 @@ static int cache_mode(struct cache *ca, int mode, int arg)
 	    res = ca->erc;
 	    ca->erc = arg ? 1 : 0;
 	    break;
+	case CACHE_MODE_MAXMEM:
+	    res = ca->maxmem / 1024;
+	    ca->maxmem = arg > 0 ? arg * 1024L : 0;
+	    evict(ca, 0);
+	    break;
     }
     return res;
 }
@@ -204,17 +302,13 @@ struct cache * cache_open(void)
 {
     struct cache *ca;
     struct vt_page *vtp;
-    int i;
 
-    if (not(ca = malloc(sizeof(*ca))))
+    if (not(ca = calloc(1, sizeof(*ca))))
 	goto fail1;
 
-    for (i = 0; i < HASH_SIZE; ++i)
-	dl_init(ca->hash + i);
-
-    memset(ca->hi_subno, 0, sizeof(ca->hi_subno));
+    dl_init(&ca->lru);
     ca->erc = 1;
-    ca->npages = 0;
+    ca->maxmem = CACHE_MAXMEM;
     ca->op = &cops;
 
     for (vtp = help_pages; vtp < help_pages + nr_help_pages; vtp++)
@@ -5,22 +5,38 @@
 #include "misc.h"
 #include "dllist.h"
 
-#define HASH_SIZE 113
+#define CACHE_FIRST_PGNO 0x100
+#define CACHE_LAST_PGNO 0x9ff	// 9xx are the help pages
+#define CACHE_MAXMEM (8 * 1024 * 1024)	// default memory budget
+
+
+struct cache_pgno
+{
+    struct cache_page **sub;	// indexed by subno
+    int nsub;			// size of sub
+    struct cache_page *newest;	// most recently used subpage
+};
 
 
 struct cache
 {
-    struct dl_head hash[HASH_SIZE];
+    struct cache_pgno pg[CACHE_LAST_PGNO + 1 - CACHE_FIRST_PGNO];
+    struct dl_head lru; // received pages, most recently used first
     int erc; // error reduction circuit on
     int npages;
     u16 hi_subno[0x9ff + 1]; // 0:pg not in cache, 1-3f80:highest subno + 1
     struct cache_ops *op;
+    long maxmem; // memory budget in bytes, 0: unlimited
+    long mem; // bytes used by pages and subpage tables
+    unsigned long hits, misses, evictions;
+    unsigned int stamp;
 };
 
 
 struct cache_page
 {
     struct dl_node node[1];
+    unsigned int stamp; // of the last use
     struct vt_page page[1];
 };
 
@@ -38,4 +54,5 @@ struct cache_ops
 
 struct cache *cache_open(void);
 #define CACHE_MODE_ERC 1
+#define CACHE_MODE_MAXMEM 2	// arg in kbytes, 0: unlimited
 #endif
@@ -23,6 +23,7 @@ struct vtwin
     int hold;
     int pgno, subno;
     struct vt_page *vtp;
+    struct vt_page page[1]; // copy of the page shown; the cache may drop it
     struct search *search;
     int searchdir;
     int status;
@@ -43,11 +43,12 @@
 #define MAX_NUM_EVENT_TABLES		128
 #define TITLE_BUFFER_LEN		4096
 #define MESSAGE_BUFFER_LEN		(16 * 1024)
-#define MAX_NUM_CHANNELS		16
-#define MAX_NUM_EVENTS_PER_CHANNEL	(4 * 24 * 7)
+#define SECTION_BUFFER_LEN		4096
 
 static int atsc_scan_table(int dmxfd, uint16_t pid, enum atsc_section_tag tag,
 	void **table_section);
+static int atsc_decode_table(unsigned char *sibuf, int size,
+	enum atsc_section_tag tag, void **table_section);
 
 static const char *program;
 static int adapter = 0;
@@ -60,13 +61,15 @@ static char separator[80];
 void (*old_handler)(int);
 
 struct atsc_string_buffer {
-	int buf_len;
-	int buf_pos;
+	size_t buf_len;
+	size_t buf_pos;
 	char *string;
 };
 
 struct atsc_event_info {
 	uint16_t id;
+	uint8_t has_etm;
+	uint8_t received_etm;
 	struct tm start;
 	struct tm end;
 	int title_pos;
@@ -80,11 +83,13 @@ struct atsc_eit_section_info {
 	uint8_t num_events;
 	uint8_t num_etms;
 	uint8_t num_received_etms;
-	struct atsc_event_info **events;
+	struct atsc_event_info *events;
 };
 
 struct atsc_eit_info {
-	int num_eit_sections;
+	int num_sections; /* 1 + last_section_number, 0 until known */
+	int num_eit_sections; /* received so far, sorted by section_num */
+	uint8_t section_pattern[32];
 	struct atsc_eit_section_info *section;
 };
 
@@ -98,20 +103,34 @@ struct atsc_channel_info {
 	uint16_t prog_num;
 	uint16_t src_id;
 	struct atsc_eit_info *eit;
-	struct atsc_event_info *last_event;
-	int event_info_index;
-	struct atsc_event_info e[MAX_NUM_EVENTS_PER_CHANNEL];
 	struct atsc_string_buffer title_buf;
 	struct atsc_string_buffer msg_buf;
 };
 
 struct atsc_virtual_channels_info {
 	int num_channels;
+	int max_channels;
 	uint16_t eit_pid[MAX_NUM_EVENT_TABLES];
 	uint16_t ett_pid[MAX_NUM_EVENT_TABLES];
-	struct atsc_channel_info ch[MAX_NUM_CHANNELS];
+	struct atsc_channel_info *ch;
 } guide;
 
+/* a section filter collecting one EIT-k or ETT-k */
+struct atsc_table_filter {
+	int fd;
+	int index;
+	enum atsc_section_tag tag;
+	time_t deadline; /* give up if no progress by then */
+	int done;
+};
+
+/* an EIT or ETT waiting for a section filter */
+struct atsc_queued_table {
+	int index;
+	enum atsc_section_tag tag;
+	uint16_t pid;
+};
+
 struct mgt_table_name {
 	uint16_t range;
 	const char *string;
@@ -392,12 +411,27 @@ static int parse_tvct(int dmxfd)
 		}
 		section_pattern |= 1 << tvct->head.ext_head.section_number;
 
-		if(MAX_NUM_CHANNELS < guide.num_channels +
+		if(guide.max_channels < guide.num_channels +
 			tvct->num_channels_in_section) {
-			fprintf(stderr, "%s(): no support for more than %d "
-				"virtual channels in a pyhsical channel\n",
-				__FUNCTION__, MAX_NUM_CHANNELS);
-			return -1;
+			int max_channels = guide.max_channels ?
+				guide.max_channels * 2 : 16;
+			struct atsc_channel_info *channels;
+
+			while(max_channels < guide.num_channels +
+				tvct->num_channels_in_section) {
+				max_channels *= 2;
+			}
+			if(NULL == (channels = realloc(guide.ch, max_channels *
+				sizeof(struct atsc_channel_info)))) {
+				fprintf(stderr, "%s(): error calling realloc()\n",
+					__FUNCTION__);
+				return -1;
+			}
+			memset(&channels[guide.max_channels], 0,
+				(max_channels - guide.max_channels) *
+				sizeof(struct atsc_channel_info));
+			guide.ch = channels;
+			guide.max_channels = max_channels;
 		}
 		curr_info = &guide.ch[guide.num_channels];
 		guide.num_channels += tvct->num_channels_in_section;
@@ -472,9 +506,8 @@ static int match_event(struct atsc_eit_info *eit, uint16_t event_id,
 		section = &eit->section[j];
 
 		for(k = 0; k < section->num_events; k++) {
-			if(section->events[k] && section->events[k]->id ==
-				event_id) {
-				*event = section->events[k];
+			if(section->events[k].id == event_id) {
+				*event = &section->events[k];
 				break;
 			}
 		}
@@ -507,8 +540,8 @@ static int parse_message(struct atsc_channel_info *channel,
 			event->msg_pos = channel->msg_buf.buf_pos;
 			if(0 > atsc_text_segment_decode(seg,
 				(uint8_t **)&channel->msg_buf.string,
-				(size_t *)&channel->msg_buf.buf_len,
-				(size_t *)&channel->msg_buf.buf_pos)) {
+				&channel->msg_buf.buf_len,
+				&channel->msg_buf.buf_pos)) {
 				fprintf(stderr, "%s(): error calling "
 					"atsc_text_segment_decode()\n",
 					__FUNCTION__);
@@ -522,86 +555,52 @@ static int parse_message(struct atsc_channel_info *channel,
 	return 0;
 }
 
-static int parse_ett(int dmxfd, int index, uint16_t pid)
+static struct atsc_channel_info *find_channel(uint16_t source_id)
+{
+	int c;
+
+	for(c = 0; c < guide.num_channels; c++) {
+		if(guide.ch[c].src_id == source_id) {
+			return &guide.ch[c];
+		}
+	}
+
+	return NULL;
+}
+
+static int store_ett_section(int index, struct atsc_ett_section *ett)
 {
 	uint8_t curr_index;
-	uint32_t section_pattern;
-	const enum atsc_section_tag tag = stag_atsc_extended_text;
-	struct atsc_eit_info *eit;
-	struct atsc_ett_section *ett;
 	struct atsc_channel_info *channel;
 	struct atsc_event_info *event;
-	struct atsc_eit_section_info *section;
-	uint16_t source_id, event_id;
-	int c, ret;
 
-	if(0xFFFF == guide.ett_pid[index]) {
+	if(NULL == (channel = find_channel(ett->ETM_source_id))) {
 		return 0;
 	}
 
-	for(c = 0; c < guide.num_channels; c++) {
-		channel = &guide.ch[c];
-		eit = &channel->eit[index];
-
-		section_pattern = 0;
-		while(section_pattern !=
-			(uint32_t)((1 << eit->num_eit_sections) - 1)) {
-			if(ctrl_c) {
-				return 0;
-			}
-			ret = atsc_scan_table(dmxfd, pid, tag, (void **)&ett);
-			fprintf(stdout, ".");
-			fflush(stdout);
-			if(0 > ret) {
-				fprintf(stderr, "%s(): error calling "
-					"atsc_scan_table()\n", __FUNCTION__);
-				return -1;
-			}
-			if(0 == ret) {
-				fprintf(stdout, "no ETT %d in %d seconds\n",
-					index, TIMEOUT);
-				return 0;
-			}
-
-			source_id = ett->ETM_source_id;
-			event_id = ett->ETM_sub_id;
-			if(source_id != channel->src_id) {
-				continue;
-			}
-
-			event = NULL;
-			if(match_event(eit, event_id, &event, &curr_index)) {
-				fprintf(stderr, "%s(): error calling "
-					"match_event()\n", __FUNCTION__);
-				return -1;
-			}
-			if(NULL == event) {
-				continue;
-			}
-			if(section_pattern & (1 << curr_index)) {
-				/* the section has been filled, so skip,
-				 * not consider version yet
-				 */
-				continue;
-			}
-			if(event->msg_len) {
-				/* the message has been filled */
-				continue;
-			}
+	event = NULL;
+	if(match_event(&channel->eit[index], ett->ETM_sub_id, &event,
+		&curr_index)) {
+		fprintf(stderr, "%s(): error calling match_event()\n",
+			__FUNCTION__);
+		return -1;
+	}
+	if(NULL == event || !event->has_etm || event->received_etm) {
+		/* unknown as yet, or the message has been filled,
+		 * not consider version yet
+		 */
+		return 0;
+	}
 
-			if(parse_message(channel, ett, event)) {
-				fprintf(stderr, "%s(): error calling "
-					"parse_message()\n", __FUNCTION__);
-				return -1;
-			}
-			section = &eit->section[curr_index];
-			if(++section->num_received_etms == section->num_etms) {
-				section_pattern |= 1 << curr_index;
-			}
-		}
+	if(parse_message(channel, ett, event)) {
+		fprintf(stderr, "%s(): error calling parse_message()\n",
+			__FUNCTION__);
+		return -1;
 	}
+	event->received_etm = 1;
+	channel->eit[index].section[curr_index].num_received_etms++;
 
-	return 0;
+	return 1;
 }
 
 static int parse_events(struct atsc_channel_info *curr_info,
@@ -619,20 +618,8 @@ static int parse_events(struct atsc_channel_info *curr_info,
 	atsc_eit_section_events_for_each(eit, e, i) {
 		struct atsc_text *title;
 		struct atsc_text_string *str;
-		struct atsc_event_info *e_info =
-			&curr_info->e[curr_info->event_info_index];
-
-		if(0 == i && curr_info->last_event) {
-			if(e->event_id == curr_info->last_event->id) {
-				section->events[i] = NULL;
-				/* skip if it's the same event spanning
-				 * over sections
-				 */
-				continue;
-			}
-		}
-		curr_info->event_info_index += 1;
-		section->events[i] = e_info;
+		struct atsc_event_info *e_info = &section->events[i];
+
 		e_info->id = e->event_id;
 		start_time = atsctime_to_unixtime(e->start_time);
 		end_time = start_time + e->length_in_seconds;
@@ -640,6 +627,7 @@ static int parse_events(struct atsc_channel_info *curr_info,
 		localtime_r(&end_time, &e_info->end);
 		if(0 != e->ETM_location && 3 != e->ETM_location) {
 			/* FIXME assume 1 and 2 is interchangable as of now */
+			e_info->has_etm = 1;
 			section->num_etms++;
 		}
 
@@ -653,8 +641,8 @@ static int parse_events(struct atsc_channel_info *curr_info,
 				e_info->title_pos = curr_info->title_buf.buf_pos;
 				if(0 > atsc_text_segment_decode(seg,
 					(uint8_t **)&curr_info->title_buf.string,
-					(size_t *)&curr_info->title_buf.buf_len,
-					(size_t *)&curr_info->title_buf.buf_pos)) {
+					&curr_info->title_buf.buf_len,
+					&curr_info->title_buf.buf_pos)) {
 					fprintf(stderr, "%s(): error calling "
 						"atsc_text_segment_decode()\n",
 						__FUNCTION__);
@@ -669,170 +657,299 @@ static int parse_events(struct atsc_channel_info *curr_info,
 	return 0;
 }
 
-static int parse_eit(int dmxfd, int index, uint16_t pid)
+static int store_eit_section(int index, struct atsc_eit_section *eit)
 {
-	int num_sections;
 	uint8_t section_num;
-	uint8_t curr_channel_index;
-	uint32_t section_pattern;
-	const enum atsc_section_tag tag = stag_atsc_event_information;
-	struct atsc_eit_section *eit;
 	struct atsc_channel_info *curr_info;
 	struct atsc_eit_info *eit_info;
 	struct atsc_eit_section_info *section;
-	uint16_t source_id;
-	uint32_t eit_instance_pattern = 0;
-	int i, k, ret;
+	int i;
 
-	while(eit_instance_pattern !=
-		(uint32_t)((1 << guide.num_channels) - 1)) {
-		source_id = 0xFFFF;
-		section_pattern = 0;
-		num_sections = -1;
+	if(NULL == (curr_info = find_channel(atsc_eit_section_source_id(eit)))) {
+		/* not a channel of this transport stream */
+		return 0;
+	}
+	eit_info = &curr_info->eit[index];
+
+	if(0 == eit_info->num_sections) {
+		eit_info->num_sections = 1 +
+			eit->head.ext_head.last_section_number;
+	} else if(eit_info->num_sections !=
+		1 + eit->head.ext_head.last_section_number) {
+		fprintf(stderr, "%s(): last section number does not match\n",
+			__FUNCTION__);
+		return -1;
+	}
+	section_num = eit->head.ext_head.section_number;
+	if(eit_info->section_pattern[section_num / 8] & (1 << (section_num % 8))) {
+		return 0;
+	}
+	eit_info->section_pattern[section_num / 8] |= 1 << (section_num % 8);
 
-		do {
-			ret = atsc_scan_table(dmxfd, pid, tag, (void **)&eit);
-			fprintf(stdout, ".");
-			fflush(stdout);
-			if(0 > ret) {
-				fprintf(stderr, "%s(): error calling "
-					"atsc_scan_table()\n", __FUNCTION__);
-				return -1;
-			}
-			if(0 == ret) {
-				fprintf(stdout, "no EIT %d in %d seconds\n",
-					index, TIMEOUT);
+	if(NULL == (section = realloc(eit_info->section,
+		(eit_info->num_eit_sections + 1) *
+		sizeof(struct atsc_eit_section_info)))) {
+		fprintf(stderr, "%s(): error calling realloc()\n",
+			__FUNCTION__);
+		return -1;
+	}
+	eit_info->section = section;
+
+	/* have to sort it into section order (temporal order) */
+	for(i = 0; i < eit_info->num_eit_sections; i++) {
+		if(eit_info->section[i].section_num > section_num) {
+			break;
+		}
+	}
+	memmove(&eit_info->section[i + 1], &eit_info->section[i],
+		(eit_info->num_eit_sections - i) *
+		sizeof(struct atsc_eit_section_info));
+	eit_info->num_eit_sections += 1;
+	section = &eit_info->section[i];
+
+	section->section_num = section_num;
+	section->num_events = eit->num_events_in_section;
+	section->num_etms = 0;
+	section->num_received_etms = 0;
+	if(NULL == (section->events = calloc(section->num_events ?
+		section->num_events : 1, sizeof(struct atsc_event_info)))) {
+		fprintf(stderr, "%s(): error calling calloc()\n",
+			__FUNCTION__);
+		return -1;
+	}
+	if(parse_events(curr_info, eit, section)) {
+		fprintf(stderr, "%s(): error calling parse_events()\n",
+			__FUNCTION__);
+		return -1;
+	}
+
+	return 1;
+}
+
+static int eit_complete(int index)
+{
+	int c;
+
+	for(c = 0; c < guide.num_channels; c++) {
+		struct atsc_eit_info *eit = &guide.ch[c].eit[index];
+
+		if(0 == eit->num_sections ||
+			eit->num_eit_sections < eit->num_sections) {
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+static int ett_complete(int index)
+{
+	int c, k;
+
+	if(!eit_complete(index)) {
+		return 0;
+	}
+	for(c = 0; c < guide.num_channels; c++) {
+		struct atsc_eit_info *eit = &guide.ch[c].eit[index];
+
+		for(k = 0; k < eit->num_eit_sections; k++) {
+			if(eit->section[k].num_received_etms <
+				eit->section[k].num_etms) {
 				return 0;
 			}
+		}
+	}
 
-			if(0xFFFF == source_id) {
-			source_id = atsc_eit_section_source_id(eit);
-			for(k = 0; k < guide.num_channels; k++) {
-				if(source_id == guide.ch[k].src_id) {
-					curr_info = &guide.ch[k];
-					curr_channel_index = k;
-					if(0 == index) {
-						curr_info->last_event = NULL;
-					}
-					break;
-				}
-			}
-			if(k == guide.num_channels) {
-				fprintf(stderr, "%s(): cannot find source_id "
-					"0x%04X in the EIT\n",
-					__FUNCTION__, source_id);
-				return -1;
-			}
-			} else {
-				if(source_id !=
-					atsc_eit_section_source_id(eit)) {
-					continue;
-				}
-			}
-			if(eit_instance_pattern & (1 << curr_channel_index)) {
-				/* we have received this instance,
-				 * so quit quick
-				 */
+	return 1;
+}
+
+static int open_table_filter(struct atsc_table_filter *f, int index,
+	enum atsc_section_tag tag, uint16_t pid)
+{
+	uint8_t filter[18];
+	uint8_t mask[18];
+
+	/* failing is not reported here: the demux may just be out of
+	 * filters, and the caller tries again when one is closed */
+	if((f->fd = dvbdemux_open_demux(adapter, 0, 0)) < 0) {
+		return -1;
+	}
+
+	memset(filter, 0, sizeof(filter));
+	memset(mask, 0, sizeof(mask));
+	filter[0] = tag;
+	mask[0] = 0xFF;
+	if(dvbdemux_set_section_filter(f->fd, pid, filter, mask, 1, 1)) {
+		close(f->fd);
+		return -1;
+	}
+
+	f->index = index;
+	f->tag = tag;
+	f->deadline = time(NULL) + TIMEOUT;
+	f->done = 0;
+
+	return 0;
+}
+
+static void close_table_filter(struct atsc_table_filter *f)
+{
+	dvbdemux_stop(f->fd);
+	close(f->fd);
+}
+
+static int read_table_filter(struct atsc_table_filter *f)
+{
+	unsigned char sibuf[SECTION_BUFFER_LEN];
+	void *table_section;
+	int size;
+
+	if((size = read(f->fd, sibuf, sizeof(sibuf))) < 0) {
+		if(EOVERFLOW == errno || EAGAIN == errno || EINTR == errno) {
+			return 0;
+		}
+		fprintf(stderr, "%s(): error calling read()\n", __FUNCTION__);
+		return -1;
+	}
+	if(atsc_decode_table(sibuf, size, f->tag, &table_section)) {
+		/* a damaged section; it will be repeated */
+		return 0;
+	}
+
+	if(stag_atsc_event_information == f->tag) {
+		return store_eit_section(f->index, table_section);
+	}
+	return store_ett_section(f->index, table_section);
+}
+
+/*
+ * Collect EIT-k and, if enabled, ETT-k for every table in the period at
+ * once: each gets its own section filter, and they are all polled
+ * together. A filter is closed as soon as its table is complete, or when
+ * it has made no progress for TIMEOUT seconds. If the demux runs out of
+ * filters, the remaining tables wait in order until one is closed.
+ */
+static int collect_events(void)
+{
+	struct atsc_table_filter filters[2 * MAX_NUM_EVENT_TABLES];
+	struct pollfd pollfds[2 * MAX_NUM_EVENT_TABLES];
+	struct atsc_queued_table queue[2 * MAX_NUM_EVENT_TABLES];
+	int num_filters = 0;
+	int num_queued = 0;
+	int next_queued = 0;
+	int open_queued = 1;
+	int num_eits;
+	int i, j, ret;
+	time_t now;
+	int timeout;
+
+	num_eits = guide.num_channels ? guide.ch[0].num_eits : 0;
+	for(i = 0; i < num_eits; i++) {
+		if(0xFFFF != guide.eit_pid[i]) {
+			queue[num_queued].index = i;
+			queue[num_queued].tag = stag_atsc_event_information;
+			queue[num_queued].pid = guide.eit_pid[i];
+			num_queued++;
+		}
+		if(enable_ett && 0xFFFF != guide.ett_pid[i]) {
+			queue[num_queued].index = i;
+			queue[num_queued].tag = stag_atsc_extended_text;
+			queue[num_queued].pid = guide.ett_pid[i];
+			num_queued++;
+		}
+	}
+
+	while((num_filters || next_queued < num_queued) && !ctrl_c) {
+		/* start as many waiting tables as the demux has filters for */
+		for(; open_queued && next_queued < num_queued; next_queued++) {
+			struct atsc_queued_table *q = &queue[next_queued];
+
+			if(open_table_filter(&filters[num_filters], q->index,
+				q->tag, q->pid)) {
 				break;
 			}
+			num_filters++;
+		}
+		open_queued = 0;
+		if(0 == num_filters) {
+			fprintf(stderr, "%s(): unable to open a section filter\n",
+				__FUNCTION__);
+			goto error;
+		}
 
-			if(-1 == num_sections) {
-				num_sections = 1 +
-					eit->head.ext_head.last_section_number;
-				if(32 < num_sections) {
-					fprintf(stderr,
-						"%s(): no support yet for "
-						"tables having more than "
-						"32 sections\n", __FUNCTION__);
-					return -1;
-				}
-			} else {
-				if(num_sections != 1 +
-					eit->head.ext_head.last_section_number) {
-					fprintf(stderr,
-						"%s(): last section number "
-						"does not match\n",
-						__FUNCTION__);
-					return -1;
-				}
+		now = time(NULL);
+		timeout = 0;
+		for(i = 0; i < num_filters; i++) {
+			pollfds[i].fd = filters[i].fd;
+			pollfds[i].events = POLLIN | POLLERR | POLLPRI;
+			pollfds[i].revents = 0;
+			if(0 == i || filters[i].deadline - now < timeout) {
+				timeout = filters[i].deadline - now;
 			}
-			if(section_pattern &
-				(1 << eit->head.ext_head.section_number)) {
+		}
+		if(timeout < 0) {
+			timeout = 0;
+		}
+
+		if((ret = poll(pollfds, num_filters, timeout * 1000)) < 0) {
+			if(EINTR == errno) {
 				continue;
 			}
-			section_pattern |= 1 << eit->head.ext_head.section_number;
+			fprintf(stderr, "%s(): error calling poll()\n",
+				__FUNCTION__);
+			goto error;
+		}
 
-			eit_info = &curr_info->eit[index];
-			if(NULL == (eit_info->section =
-				realloc(eit_info->section,
-				(eit_info->num_eit_sections + 1) *
-				sizeof(struct atsc_eit_section_info)))) {
-				fprintf(stderr,
-					"%s(): error calling realloc()\n",
-					__FUNCTION__);
-				return -1;
-			}
-			section_num = eit->head.ext_head.section_number;
-			if(0 == eit_info->num_eit_sections) {
-				eit_info->num_eit_sections = 1;
-				section = eit_info->section;
-			} else {
-				/* have to sort it into section order
-				 * (temporal order)
-				 */
-				for(i = 0; i < eit_info->num_eit_sections; i++) {
-					if(eit_info->section[i].section_num >
-						section_num) {
-						break;
-					}
+		now = time(NULL);
+		for(i = 0; i < num_filters; i++) {
+			struct atsc_table_filter *f = &filters[i];
+
+			if(pollfds[i].revents) {
+				if((ret = read_table_filter(f)) < 0) {
+					goto error;
+				}
+				if(ret) {
+					f->deadline = now + TIMEOUT;
+					fprintf(stdout, ".");
+					fflush(stdout);
 				}
-				memmove(&eit_info->section[i + 1],
-					&eit_info->section[i],
-					(eit_info->num_eit_sections - i) *
-					sizeof(struct atsc_eit_section_info));
-				section = &eit_info->section[i - 1];
-				section = &eit_info->section[i];
-				eit_info->num_eit_sections += 1;
 			}
 
-			section->section_num = section_num;
-			section->num_events = eit->num_events_in_section;
-			section->num_etms = 0;
-			section->num_received_etms = 0;
-			if(NULL == (section->events = calloc(section->num_events,
-				sizeof(struct atsc_event_info *)))) {
-				fprintf(stderr, "%s(): error calling calloc()\n",
-					__FUNCTION__);
-				return -1;
+			if(stag_atsc_event_information == f->tag) {
+				f->done = eit_complete(f->index);
+			} else {
+				f->done = ett_complete(f->index);
 			}
-			if(parse_events(curr_info, eit, section)) {
-				fprintf(stderr, "%s(): error calling "
-					"parse_events()\n", __FUNCTION__);
-				return -1;
+			if(!f->done && now >= f->deadline) {
+				fprintf(stdout, "no new %s %d sections in %d "
+					"seconds\n",
+					stag_atsc_event_information == f->tag ?
+					"EIT" : "ETT", f->index, TIMEOUT);
+				f->done = 1;
 			}
-		} while(section_pattern != (uint32_t)((1 << num_sections) - 1));
-		eit_instance_pattern |= 1 << curr_channel_index;
-	}
-
-	for(i = 0; i < guide.num_channels; i++) {
-		struct atsc_channel_info *channel = &guide.ch[i];
-		struct atsc_eit_info *ei = &channel->eit[index];
-		struct atsc_eit_section_info *s;
-
-		if(0 == ei->num_eit_sections) {
-			channel->last_event = NULL;
-			continue;
 		}
-		s = &ei->section[ei->num_eit_sections - 1];
-		/* BUG: it's incorrect when last section has no event */
-		if(0 == s->num_events) {
-			channel->last_event = NULL;
-			continue;
+
+		for(i = 0, j = 0; i < num_filters; i++) {
+			if(filters[i].done) {
+				close_table_filter(&filters[i]);
+				open_queued = 1;
+			} else {
+				filters[j++] = filters[i];
+			}
 		}
-		channel->last_event = s->events[s->num_events - 1];
+		num_filters = j;
 	}
 
+	for(i = 0; i < num_filters; i++) {
+		close_table_filter(&filters[i]);
+	}
 	return 0;
+
+error:
+	for(i = 0; i < num_filters; i++) {
+		close_table_filter(&filters[i]);
+	}
+	return -1;
 }
 
 static int parse_mgt(int dmxfd)
@@ -905,63 +1022,46 @@ static int cleanup_guide(void)
 			struct atsc_eit_info *eit = &channel->eit[j];
 
 			for(k = 0; k < eit->num_eit_sections; k++) {
-				struct atsc_eit_section_info *section =
-					&eit->section[k];
-				if(section->num_events) {
-					free(section->events);
-				}
+				free(eit->section[k].events);
 			}
-			if(k) {
-				free(eit->section);
-			}
-		}
-		if(j) {
-			free(channel->eit);
+			free(eit->section);
 		}
+		free(channel->eit);
 	}
+	free(guide.ch);
 
 	return 0;
 }
 
 static int print_events(struct atsc_channel_info *channel,
-	struct atsc_eit_section_info *section)
+	struct atsc_eit_section_info *section, int *last_event_id)
 {
 	int m;
-	char line[256];
 
 	if(NULL == section) {
 		fprintf(stderr, "%s(): NULL pointer detected", __FUNCTION__);
 		return -1;
 	}
 	for(m = 0; m < section->num_events; m++) {
-		struct atsc_event_info *event =
-			section->events[m];
+		struct atsc_event_info *event = &section->events[m];
 
-		if(NULL == event) {
+		if(event->id == *last_event_id) {
+			/* skip if it's the same event spanning over sections */
 			continue;
 		}
+		*last_event_id = event->id;
+
 		fprintf(stdout, "|%02d:%02d--%02d:%02d| ",
 			event->start.tm_hour, event->start.tm_min,
 			event->end.tm_hour, event->end.tm_min);
-		snprintf(line, event->title_len, "%s",
-			&channel->title_buf.string[event->title_pos]);
-		line[event->title_len] = '\0';
-		fprintf(stdout, "%s\n", line);
+		if(event->title_len) {
+			fprintf(stdout, "%.*s", event->title_len - 1,
+				&channel->title_buf.string[event->title_pos]);
+		}
+		fprintf(stdout, "\n");
 		if(event->msg_len) {
-			int len = event->msg_len;
-			int pos = event->msg_pos;
-			size_t part;
-
-			do {
-				part = len > 255 ? 255 : len;
-				snprintf(line, part, "%s",
-					&channel->msg_buf.string[pos]);
-				line[part] = '\0';
-				fprintf(stdout, "%s", line);
-				len -= part;
-				pos += part;
-			} while(0 < len);
-			fprintf(stdout, "\n");
+			fprintf(stdout, "%.*s\n", event->msg_len - 1,
+				&channel->msg_buf.string[event->msg_pos]);
 		}
 	}
 	return 0;
@@ -974,6 +1074,7 @@ static int print_guide(void)
 	fprintf(stdout, "%s\n", separator);
 	for(i = 0; i < guide.num_channels; i++) {
 		struct atsc_channel_info *channel = &guide.ch[i];
+		int last_event_id = -1;
 
 		fprintf(stdout, "%d.%d  %s\n", channel->major_num,
 			channel->minor_num, channel->short_name);
@@ -983,7 +1084,8 @@ static int print_guide(void)
 			for(k = 0; k < eit->num_eit_sections; k++) {
 				struct atsc_eit_section_info *section =
 					&eit->section[k];
-				if(print_events(channel, section)) {
+				if(print_events(channel, section,
+					&last_event_id)) {
 					fprintf(stderr, "%s(): error calling "
 						"print_events()\n", __FUNCTION__);
 					return -1;
@@ -1022,13 +1124,10 @@ static int atsc_scan_table(int dmxfd, uint16_t pid, enum atsc_section_tag tag,
 {
 	uint8_t filter[18];
 	uint8_t mask[18];
-	unsigned char sibuf[4096];
+	unsigned char sibuf[SECTION_BUFFER_LEN];
 	int size;
 	int ret;
 	struct pollfd pollfd;
-	struct section *section;
-	struct section_ext *section_ext;
-	struct atsc_section_psip *psip;
 
 	/* create a section filter for the table */
 	memset(filter, 0, sizeof(filter));
@@ -1062,7 +1161,21 @@ static int atsc_scan_table(int dmxfd, uint16_t pid, enum atsc_section_tag tag,
 		return -1;
 	}
 
-	/* parse section */
+	if(atsc_decode_table(sibuf, size, tag, table_section)) {
+		return -1;
+	}
+
+	return 1;
+}
+
+/* parse section, in place */
+static int atsc_decode_table(unsigned char *sibuf, int size,
+	enum atsc_section_tag tag, void **table_section)
+{
+	struct section *section;
+	struct section_ext *section_ext;
+	struct atsc_section_psip *psip;
+
 	section = section_codec(sibuf, size);
 	if(NULL == section) {
 		fprintf(stderr, "%s(): error calling section_codec()\n",
@@ -1092,12 +1205,12 @@ static int atsc_scan_table(int dmxfd, uint16_t pid, enum atsc_section_tag tag,
 		return -1;
 	}
 
-	return 1;
+	return 0;
 }
 
 int main(int argc, char *argv[])
 {
-	int i, dmxfd;
+	int dmxfd;
 	struct dvbfe_handle *fe;
 
 	program = argv[0];
@@ -1194,33 +1307,15 @@ int main(int argc, char *argv[])
 	}
 #endif
 
-	fprintf(stdout, "receiving EIT ");
-	for(i = 0; i < guide.ch[0].num_eits; i++) {
-		if(parse_eit(dmxfd, i, guide.eit_pid[i])) {
-			fprintf(stderr, "%s(): error calling parse_eit()\n",
-				__FUNCTION__);
-			return -1;
-		}
-	}
-	fprintf(stdout, "\n");
-
 	old_handler = signal(SIGINT, int_handler);
-	if(enable_ett) {
-		fprintf(stdout, "receiving ETT ");
-		for(i = 0; i < guide.ch[0].num_eits; i++) {
-			if(0xFFFF != guide.ett_pid[i]) {
-				if(parse_ett(dmxfd, i, guide.ett_pid[i])) {
-					fprintf(stderr, "%s(): error calling "
-						"parse_eit()\n", __FUNCTION__);
-					return -1;
-				}
-			}
-			if(ctrl_c) {
-				break;
-			}
-		}
-		fprintf(stdout, "\n");
+	fprintf(stdout, enable_ett ? "receiving EIT and ETT " : "receiving EIT ");
+	fflush(stdout);
+	if(collect_events()) {
+		fprintf(stderr, "%s(): error calling collect_events()\n",
+			__FUNCTION__);
+		return -1;
 	}
+	fprintf(stdout, "\n");
 	signal(SIGINT, old_handler);
 
 	if(print_guide()) {
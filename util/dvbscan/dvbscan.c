@@ -21,6 +21,7 @@
 
 #include <stdlib.h>
 #include <unistd.h>
+#include <errno.h>
 #include <stdio.h>
 #include <string.h>
 #include <time.h>
@@ -40,7 +41,7 @@
 #define SERVICE_FILTER_OTHER		4
 #define SERVICE_FILTER_ENCRYPTED	8
 
-#define TIMEOUT_WAIT_LOCK		2
+#define TIMEOUT_WAIT_LOCK		2	// seconds
 
 
 // transponders we have yet to scan
@@ -51,6 +52,10 @@ static struct transponder *toscan_end = NULL;
 static struct transponder *scanned = NULL;
 static struct transponder *scanned_end = NULL;
 
+// transponders which failed to tune
+static struct transponder *failed = NULL;
+static struct transponder *failed_end = NULL;
+
 
 static void usage(void)
 {
@@ -123,7 +128,7 @@ int main(int argc, char *argv[])
 	char *secid = NULL;
 	int satpos = 0;
 	int service_filter = -1;
-	int timeout = 5;
+	int timeout = 0;
 	char *scan_filename = NULL;
 	struct dvbsec_config sec;
 	int valid_sec = 0;
@@ -248,8 +253,8 @@ int main(int argc, char *argv[])
 		// get the first item on the toscan list
 		struct transponder *tmp = first_transponder(&toscan, &toscan_end);
 
-		// have we already seen this transponder?
-		if (seen_transponder(tmp, scanned)) {
+		// have we already seen this transponder, or failed to tune it?
+		if (seen_transponder(tmp, scanned) || listed_transponder(tmp, failed)) {
 			free_transponder(tmp);
 			continue;
 		}
@@ -261,53 +266,57 @@ int main(int argc, char *argv[])
 
 		// tune it
 		int tuned_ok = 0;
+		struct dvbfe_tune_timing timing;
 		for(i=0; i < tmp->frequency_count; i++) {
 			tmp->params.frequency = tmp->frequencies[i];
-			if (dvbsec_set(fe,
-					psec,
-					tmp->polarization,
-					(satpos & 0x01) ? DISEQC_SWITCH_B : DISEQC_SWITCH_A,
-					(satpos & 0x02) ? DISEQC_SWITCH_B : DISEQC_SWITCH_A,
-					&tmp->params,
-					0)) {
+			int res = dvbsec_set(fe,
+					     psec,
+					     tmp->polarization,
+					     (satpos & 0x01) ? DISEQC_SWITCH_B : DISEQC_SWITCH_A,
+					     (satpos & 0x02) ? DISEQC_SWITCH_B : DISEQC_SWITCH_A,
+					     &tmp->params,
+					     TIMEOUT_WAIT_LOCK * 1000);
+			// the lock wait is event driven, so this returns as soon as it locks
+			if (res == 0) {
+				tuned_ok = 1;
+				break;
+			}
+			if (res != -ETIMEDOUT) {
 				fprintf(stderr, "Failed to set frontend\n");
 				exit(1);
 			}
-
-			// wait for lock
-			time_t starttime = time(NULL);
-			while((time(NULL) - starttime) < TIMEOUT_WAIT_LOCK) {
-				if (dvbfe_get_info(fe, DVBFE_INFO_LOCKSTATUS, &feinfo,
-				    			DVBFE_INFO_QUERYTYPE_IMMEDIATE, 0) !=
-					DVBFE_INFO_QUERYTYPE_IMMEDIATE) {
-					fprintf(stderr, "Unable to query frontend status\n");
-					exit(1);
-				}
-				if (feinfo.lock) {
-					tuned_ok = 1;
-					break;
-				}
-				usleep(100000);
-			}
 		}
 		if (!tuned_ok) {
-			free_transponder(tmp);
+			append_transponder(tmp, &failed, &failed_end);
 			continue;
 		}
+		dvbfe_get_tune_timing(fe, &timing);
+		tmp->lock_ms = timing.lock_ms;
 
 		// scan it
 		switch(feinfo.type) {
 		case DVBFE_TYPE_DVBS:
 		case DVBFE_TYPE_DVBC:
 		case DVBFE_TYPE_DVBT:
-			dvbscan_scan_dvb(fe);
+			dvbscan_scan_dvb(fe, adapter_id, demux_id, timeout, tmp, &toscan, &toscan_end,
+					 scanned, failed);
 			break;
 
 		case DVBFE_TYPE_ATSC:
-			dvbscan_scan_atsc(fe);
+			dvbscan_scan_atsc(fe, adapter_id, demux_id, timeout, tmp, &toscan, &toscan_end,
+					  scanned, failed);
 			break;
 		}
 
+		// per-transponder timing, comparable with scan's tune statistics
+		struct service *s;
+		int service_count = 0;
+		for(s = tmp->services; s; s = s->next)
+			service_count++;
+		fprintf(stderr, "%u: lock %ims pat %ims pmt %ims sdt %ims nit %ims total %ims, %i services\n",
+			tmp->params.frequency, tmp->lock_ms, tmp->pat_ms, tmp->pmt_ms,
+			tmp->sdt_ms, tmp->nit_ms, tmp->scan_ms, service_count);
+
 		// add to scanned list.
 		append_transponder(tmp, &scanned, &scanned_end);
 	}
@@ -116,6 +116,17 @@ struct transponder
 	struct service *services;
 	struct service *services_end;
 
+	/**
+	 * Time taken to lock and to collect each table, in ms from the start
+	 * of the table scan (-1 if the table was not completely received).
+	 */
+	int lock_ms;
+	int pat_ms;
+	int pmt_ms;
+	int sdt_ms;
+	int nit_ms;
+	int scan_ms;
+
 	/**
 	 * Next item in list.
 	 */
@@ -126,11 +137,28 @@ extern void append_transponder(struct transponder *t, struct transponder **tlist
 extern struct transponder *new_transponder(void);
 extern void free_transponder(struct transponder *t);
 extern int seen_transponder(struct transponder *t, struct transponder *checklist);
+extern int listed_transponder(struct transponder *t, struct transponder *checklist);
 extern void add_frequency(struct transponder *t, uint32_t frequency);
 extern struct transponder *first_transponder(struct transponder **tlist, struct transponder **tlist_end);
 
 extern int create_section_filter(int adapter, int demux, uint16_t pid, uint8_t table_id);
-extern void dvbscan_scan_dvb(struct dvbfe_handle *fe);
-extern void dvbscan_scan_atsc(struct dvbfe_handle *fe);
+
+/**
+ * Collect the tables of the currently tuned transponder. Any new transponders
+ * found are appended to the toscan list, unless they are already on it or on
+ * the scanned or failed lists.
+ *
+ * @param timeout Filter timeout in seconds, or 0 to use the specced values.
+ * @param scanned Transponders already scanned.
+ * @param failed Transponders which could not be tuned.
+ */
+extern void dvbscan_scan_dvb(struct dvbfe_handle *fe, int adapter, int demux, int timeout,
+			     struct transponder *t,
+			     struct transponder **toscan, struct transponder **toscan_end,
+			     struct transponder *scanned, struct transponder *failed);
+extern void dvbscan_scan_atsc(struct dvbfe_handle *fe, int adapter, int demux, int timeout,
+			      struct transponder *t,
+			      struct transponder **toscan, struct transponder **toscan_end,
+			      struct transponder *scanned, struct transponder *failed);
 
 #endif
@@ -24,7 +24,18 @@
 #include <string.h>
 #include "dvbscan.h"
 
-void dvbscan_scan_atsc(struct dvbfe_handle *fe)
+void dvbscan_scan_atsc(struct dvbfe_handle *fe, int adapter, int demux, int timeout,
+		       struct transponder *t,
+		       struct transponder **toscan, struct transponder **toscan_end,
+		       struct transponder *scanned, struct transponder *failed)
 {
 	(void)fe; // FIXME
+	(void)adapter;
+	(void)demux;
+	(void)timeout;
+	(void)t;
+	(void)toscan;
+	(void)toscan_end;
+	(void)scanned;
+	(void)failed;
 }
@@ -22,9 +22,741 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/poll.h>
+#include <libucsi/section.h>
+#include <libucsi/mpeg/section.h>
+#include <libucsi/dvb/section.h>
+#include <libucsi/mpeg/descriptor.h>
+#include <libucsi/dvb/descriptor.h>
+#include <libucsi/dvb/types.h>
+#include <libucsi/dvb/text.h>
 #include "dvbscan.h"
 
-void dvbscan_scan_dvb(struct dvbfe_handle *fe)
+// specced maximum repetition intervals with some headroom, in seconds
+#define TIMEOUT_PAT		2
+#define TIMEOUT_PMT		2
+#define TIMEOUT_SDT		5
+#define TIMEOUT_NIT		15
+
+// PMT filters open at once; the rest wait for a free one
+#define MAX_PMT_FILTERS		16
+
+/**
+ * One table being collected. All of a transponder's filters are polled
+ * together, so the PAT, SDT, NIT and PMTs arrive concurrently.
+ */
+struct table_filter {
+	int fd;
+	uint16_t pid;
+	uint8_t table_id;
+	int table_id_ext;		// -1 => any
+	int version;			// -1 => nothing received yet
+	uint8_t sections_done[32];	// bitmap of section_numbers received
+	long long deadline;
+	int *done_ms;			// where to record the completion time
+
+	struct service *service;	// PMT filters only
+};
+
+struct scan_state {
+	int adapter;
+	int demux;
+	int timeout;
+	enum dvbfe_type fe_type;
+	struct transponder *t;
+	struct transponder **toscan;
+	struct transponder **toscan_end;
+	struct transponder *scanned;
+	struct transponder *failed;
+	long long start;
+
+	struct table_filter pat;
+	struct table_filter sdt;
+	struct table_filter nit;
+	struct table_filter pmts[MAX_PMT_FILTERS];
+	int pmts_running;
+
+	// PAT programs whose PMT filter is yet to start, in the order seen
+	struct service **pmt_queue;
+	int pmt_queue_len;
+	int pmt_queue_alloc;
+	int pmt_queue_pos;
+};
+
+static long long now_ms(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (long long) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static int start_table(struct scan_state *state, struct table_filter *f,
+		       uint16_t pid, uint8_t table_id, int table_id_ext,
+		       int timeout, int *done_ms)
+{
+	memset(f, 0, sizeof(struct table_filter));
+	f->pid = pid;
+	f->table_id = table_id;
+	f->table_id_ext = table_id_ext;
+	f->version = -1;
+	f->done_ms = done_ms;
+	if (state->timeout > 0)
+		timeout = state->timeout;
+	f->deadline = now_ms() + (timeout * 1000);
+
+	if ((f->fd = create_section_filter(state->adapter, state->demux, pid, table_id)) < 0) {
+		fprintf(stderr, "Failed to create section filter for pid 0x%04x table 0x%02x\n",
+			pid, table_id);
+		return -1;
+	}
+	return 0;
+}
+
+static void stop_table(struct table_filter *f)
+{
+	if (f->fd >= 0)
+		close(f->fd);
+	f->fd = -1;
+}
+
+/**
+ * Record a section of a table. @return 1 if the section is new, 0 if it
+ * has been seen before.
+ */
+static int table_section(struct table_filter *f, struct section_ext *section_ext)
 {
-	(void)fe; // FIXME
+	uint8_t sn = section_ext->section_number;
+
+	if (section_ext->version_number != f->version) {
+		memset(f->sections_done, 0, sizeof(f->sections_done));
+		f->version = section_ext->version_number;
+	}
+	if (f->sections_done[sn / 8] & (1 << (sn % 8)))
+		return 0;
+	f->sections_done[sn / 8] |= 1 << (sn % 8);
+	return 1;
+}
+
+/**
+ * @return 1 if all sections up to last_section_number have been received.
+ */
+static int table_complete(struct table_filter *f, struct section_ext *section_ext)
+{
+	int i;
+
+	for(i=0; i <= section_ext->last_section_number; i++) {
+		if (!(f->sections_done[i / 8] & (1 << (i % 8))))
+			return 0;
+	}
+	return 1;
+}
+
+static void table_done(struct scan_state *state, struct table_filter *f)
+{
+	if (f->done_ms && (*f->done_ms < 0))
+		*f->done_ms = now_ms() - state->start;
+	stop_table(f);
+}
+
+static char *dvb_text_to_utf8(uint8_t *text, int len)
+{
+	static struct dvb_text_decoder *decoder;
+	char *out;
+
+	if (decoder == NULL)
+		decoder = dvb_text_decoder_create(NULL, NULL, 0);
+	out = (char *) malloc((len * 3) + 2);
+	if ((decoder == NULL) || (out == NULL)) {
+		fprintf(stderr, "Out of memory\n");
+		exit(1);
+	}
+
+	dvb_text_decode(decoder, text, len, out, (len * 3) + 2);
+	return out;
+}
+
+static struct service *find_service(struct transponder *t, uint16_t service_id)
+{
+	struct service *s;
+
+	for(s = t->services; s; s = s->next) {
+		if (s->service_id == service_id)
+			return s;
+	}
+
+	s = (struct service *) malloc(sizeof(struct service));
+	if (s == NULL) {
+		fprintf(stderr, "Out of memory\n");
+		exit(1);
+	}
+	memset(s, 0, sizeof(struct service));
+	s->service_id = service_id;
+	s->bbc_channel_number = -1;
+
+	if (t->services_end == NULL)
+		t->services = s;
+	else
+		t->services_end->next = s;
+	t->services_end = s;
+
+	return s;
+}
+
+static void add_ca_id(struct service *s, uint16_t ca_id)
+{
+	uint16_t *tmp;
+	uint32_t i;
+
+	for(i=0; i < s->ca_ids_count; i++) {
+		if (s->ca_ids[i] == ca_id)
+			return;
+	}
+
+	tmp = (uint16_t *) realloc(s->ca_ids, sizeof(uint16_t) * (s->ca_ids_count + 1));
+	if (tmp == NULL) {
+		fprintf(stderr, "Out of memory\n");
+		exit(1);
+	}
+	tmp[s->ca_ids_count++] = ca_id;
+	s->ca_ids = tmp;
+}
+
+static void queue_pmt(struct scan_state *state, struct service *s)
+{
+	if (state->pmt_queue_len == state->pmt_queue_alloc) {
+		int alloc = state->pmt_queue_alloc ? state->pmt_queue_alloc * 2 : 64;
+		struct service **tmp = (struct service **)
+			realloc(state->pmt_queue, sizeof(struct service *) * alloc);
+		if (tmp == NULL) {
+			fprintf(stderr, "Out of memory\n");
+			exit(1);
+		}
+		state->pmt_queue = tmp;
+		state->pmt_queue_alloc = alloc;
+	}
+	state->pmt_queue[state->pmt_queue_len++] = s;
+}
+
+static int pmts_pending(struct scan_state *state)
+{
+	return (state->pmts_running != 0) || (state->pmt_queue_pos < state->pmt_queue_len);
+}
+
+static void free_streams(struct service *s)
+{
+	struct stream *st;
+
+	while (s->streams) {
+		st = s->streams;
+		s->streams = st->next;
+		free(st);
+	}
+	s->streams_end = NULL;
+}
+
+static void start_pmts(struct scan_state *state)
+{
+	int i;
+
+	while ((state->pmt_queue_pos < state->pmt_queue_len) &&
+	       (state->pmts_running < MAX_PMT_FILTERS)) {
+		struct service *s = state->pmt_queue[state->pmt_queue_pos++];
+
+		for(i=0; i < MAX_PMT_FILTERS; i++) {
+			if (state->pmts[i].service == NULL)
+				break;
+		}
+		if (start_table(state, &state->pmts[i], s->pmt_pid, stag_mpeg_program_map,
+				s->service_id, TIMEOUT_PMT, NULL))
+			continue;
+		state->pmts[i].service = s;
+		state->pmts_running++;
+	}
+}
+
+static void stop_pmt(struct scan_state *state, struct table_filter *f)
+{
+	stop_table(f);
+	f->service = NULL;
+	state->pmts_running--;
+	if (!pmts_pending(state) && (state->t->pmt_ms < 0))
+		state->t->pmt_ms = now_ms() - state->start;
+}
+
+static void process_pat(struct scan_state *state, struct section_ext *section_ext)
+{
+	struct transponder *t = state->t;
+	struct mpeg_pat_section *pat;
+	struct mpeg_pat_program *cur_program;
+
+	if ((pat = mpeg_pat_section_codec(section_ext)) == NULL)
+		return;
+	if (!table_section(&state->pat, section_ext))
+		return;
+
+	t->transport_stream_id = section_ext->table_id_ext;
+
+	mpeg_pat_section_programs_for_each(pat, cur_program) {
+		struct service *s;
+
+		if ((cur_program->program_number == 0) || (cur_program->pid == 0))
+			continue;
+
+		// SDT-only services have no PMT pid, and are never queued
+		s = find_service(t, cur_program->program_number);
+		if (s->pmt_pid == cur_program->pid)
+			continue;
+		s->pmt_pid = cur_program->pid;
+		queue_pmt(state, s);
+	}
+	start_pmts(state);
+
+	if (table_complete(&state->pat, section_ext)) {
+		table_done(state, &state->pat);
+		if (!pmts_pending(state))
+			t->pmt_ms = now_ms() - state->start;
+	}
+}
+
+static void process_pmt(struct scan_state *state, struct table_filter *f,
+			struct section_ext *section_ext)
+{
+	struct service *s = f->service;
+	struct mpeg_pmt_section *pmt;
+	struct mpeg_pmt_stream *cur_stream;
+	struct descriptor *curd;
+
+	// several programs may share a PMT pid
+	if (section_ext->table_id_ext != s->service_id)
+		return;
+	if ((pmt = mpeg_pmt_section_codec(section_ext)) == NULL)
+		return;
+
+	// a new version replaces the streams of the old one
+	if (section_ext->version_number != f->version)
+		free_streams(s);
+	if (!table_section(f, section_ext))
+		return;
+
+	s->pcr_pid = pmt->pcr_pid;
+
+	mpeg_pmt_section_descriptors_for_each(pmt, curd) {
+		if (curd->tag == dtag_mpeg_ca) {
+			struct mpeg_ca_descriptor *cad = mpeg_ca_descriptor_codec(curd);
+			if (cad)
+				add_ca_id(s, cad->ca_system_id);
+		}
+	}
+
+	mpeg_pmt_section_streams_for_each(pmt, cur_stream) {
+		struct stream *st = (struct stream *) malloc(sizeof(struct stream));
+		if (st == NULL) {
+			fprintf(stderr, "Out of memory\n");
+			exit(1);
+		}
+		memset(st, 0, sizeof(struct stream));
+		st->stream_type = cur_stream->stream_type;
+
+		mpeg_pmt_stream_descriptors_for_each(cur_stream, curd) {
+			if (curd->tag == dtag_mpeg_ca) {
+				struct mpeg_ca_descriptor *cad = mpeg_ca_descriptor_codec(curd);
+				if (cad)
+					add_ca_id(s, cad->ca_system_id);
+			} else if (curd->tag == dtag_mpeg_iso_639_language) {
+				struct mpeg_iso_639_language_descriptor *ld;
+				struct mpeg_iso_639_language_code *lc;
+
+				if ((ld = mpeg_iso_639_language_descriptor_codec(curd)) == NULL)
+					continue;
+				mpeg_iso_639_language_descriptor_languages_for_each(ld, lc) {
+					memcpy(st->language, lc->language_code, sizeof(iso639lang_t));
+					break;
+				}
+			}
+		}
+
+		if (s->streams_end == NULL)
+			s->streams = st;
+		else
+			s->streams_end->next = st;
+		s->streams_end = st;
+	}
+
+	if (table_complete(f, section_ext))
+		stop_pmt(state, f);
+}
+
+static void process_sdt(struct scan_state *state, struct section_ext *section_ext)
+{
+	struct dvb_sdt_section *sdt;
+	struct dvb_sdt_service *cur_service;
+	struct descriptor *curd;
+
+	if ((sdt = dvb_sdt_section_codec(section_ext)) == NULL)
+		return;
+	if (!table_section(&state->sdt, section_ext))
+		return;
+
+	state->t->original_network_id = sdt->original_network_id;
+
+	dvb_sdt_section_services_for_each(sdt, cur_service) {
+		struct service *s = find_service(state->t, cur_service->service_id);
+
+		s->is_scrambled = cur_service->free_ca_mode;
+
+		dvb_sdt_service_descriptors_for_each(cur_service, curd) {
+			struct dvb_service_descriptor *sd;
+			struct dvb_service_descriptor_part2 *part2;
+
+			if (curd->tag != dtag_dvb_service)
+				continue;
+			if ((sd = dvb_service_descriptor_codec(curd)) == NULL)
+				continue;
+			part2 = dvb_service_descriptor_part2(sd);
+
+			if (s->provider_name)
+				free(s->provider_name);
+			s->provider_name =
+				dvb_text_to_utf8(dvb_service_descriptor_service_provider_name(sd),
+						 sd->service_provider_name_length);
+			if (s->service_name)
+				free(s->service_name);
+			s->service_name =
+				dvb_text_to_utf8(dvb_service_descriptor_service_name(part2),
+						 part2->service_name_length);
+		}
+	}
+
+	if (table_complete(&state->sdt, section_ext))
+		table_done(state, &state->sdt);
+}
+
+static enum dvbfe_code_rate dvb_fec_inner(int fec)
+{
+	switch(fec) {
+	case 1: return DVBFE_FEC_1_2;
+	case 2: return DVBFE_FEC_2_3;
+	case 3: return DVBFE_FEC_3_4;
+	case 4: return DVBFE_FEC_5_6;
+	case 5: return DVBFE_FEC_7_8;
+	case 6: return DVBFE_FEC_8_9;
+	case 8: return DVBFE_FEC_4_5;
+	case 15: return DVBFE_FEC_NONE;
+	}
+	return DVBFE_FEC_AUTO;
+}
+
+static enum dvbfe_code_rate dvbt_code_rate(int code_rate)
+{
+	switch(code_rate) {
+	case 0: return DVBFE_FEC_1_2;
+	case 1: return DVBFE_FEC_2_3;
+	case 2: return DVBFE_FEC_3_4;
+	case 3: return DVBFE_FEC_5_6;
+	case 4: return DVBFE_FEC_7_8;
+	}
+	return DVBFE_FEC_AUTO;
+}
+
+/**
+ * Fill in a transponder from a NIT delivery system descriptor.
+ * @return 1 if it was one our frontend can tune, 0 otherwise.
+ */
+static int parse_delivery_descriptor(struct scan_state *state, struct descriptor *curd,
+				     struct transponder *t)
+{
+	switch(curd->tag) {
+	case dtag_dvb_satellite_delivery_system:
+	{
+		struct dvb_satellite_delivery_descriptor *dx;
+
+		if (state->fe_type != DVBFE_TYPE_DVBS)
+			return 0;
+		if ((dx = dvb_satellite_delivery_descriptor_codec(curd)) == NULL)
+			return 0;
+
+		t->params.frequency = bcd_to_integer(dx->frequency) * 10;
+		t->params.inversion = DVBFE_INVERSION_AUTO;
+		t->params.u.dvbs.symbol_rate = bcd_to_integer(dx->symbol_rate) * 100;
+		t->params.u.dvbs.fec_inner = dvb_fec_inner(dx->fec_inner);
+		switch(dx->polarization) {
+		case 0: t->polarization = DISEQC_POLARIZATION_H; break;
+		case 1: t->polarization = DISEQC_POLARIZATION_V; break;
+		case 2: t->polarization = DISEQC_POLARIZATION_L; break;
+		case 3: t->polarization = DISEQC_POLARIZATION_R; break;
+		}
+		t->oribital_position = bcd_to_integer(dx->orbital_position);
+		if (!dx->west_east_flag)
+			t->oribital_position = -t->oribital_position;
+		return 1;
+	}
+
+	case dtag_dvb_cable_delivery_system:
+	{
+		static const enum dvbfe_dvbc_mod mod_tab[] = {
+			DVBFE_DVBC_MOD_AUTO, DVBFE_DVBC_MOD_QAM_16, DVBFE_DVBC_MOD_QAM_32,
+			DVBFE_DVBC_MOD_QAM_64, DVBFE_DVBC_MOD_QAM_128, DVBFE_DVBC_MOD_QAM_256
+		};
+		struct dvb_cable_delivery_descriptor *dx;
+
+		if (state->fe_type != DVBFE_TYPE_DVBC)
+			return 0;
+		if ((dx = dvb_cable_delivery_descriptor_codec(curd)) == NULL)
+			return 0;
+
+		t->params.frequency = bcd_to_integer(dx->frequency) * 100;
+		t->params.inversion = DVBFE_INVERSION_AUTO;
+		t->params.u.dvbc.symbol_rate = bcd_to_integer(dx->symbol_rate) * 100;
+		t->params.u.dvbc.fec_inner = dvb_fec_inner(dx->fec_inner);
+		if (dx->modulation < (sizeof(mod_tab) / sizeof(mod_tab[0])))
+			t->params.u.dvbc.modulation = mod_tab[dx->modulation];
+		else
+			t->params.u.dvbc.modulation = DVBFE_DVBC_MOD_AUTO;
+		return 1;
+	}
+
+	case dtag_dvb_terrestial_delivery_system:
+	{
+		static const enum dvbfe_dvbt_bandwidth bw_tab[] = {
+			DVBFE_DVBT_BANDWIDTH_8_MHZ, DVBFE_DVBT_BANDWIDTH_7_MHZ,
+			DVBFE_DVBT_BANDWIDTH_6_MHZ
+		};
+		static const enum dvbfe_dvbt_const const_tab[] = {
+			DVBFE_DVBT_CONST_QPSK, DVBFE_DVBT_CONST_QAM_16, DVBFE_DVBT_CONST_QAM_64
+		};
+		static const enum dvbfe_dvbt_hierarchy hier_tab[] = {
+			DVBFE_DVBT_HIERARCHY_NONE, DVBFE_DVBT_HIERARCHY_1,
+			DVBFE_DVBT_HIERARCHY_2, DVBFE_DVBT_HIERARCHY_4
+		};
+		static const enum dvbfe_dvbt_guard_interval guard_tab[] = {
+			DVBFE_DVBT_GUARD_INTERVAL_1_32, DVBFE_DVBT_GUARD_INTERVAL_1_16,
+			DVBFE_DVBT_GUARD_INTERVAL_1_8, DVBFE_DVBT_GUARD_INTERVAL_1_4
+		};
+		struct dvb_terrestrial_delivery_descriptor *dx;
+
+		if (state->fe_type != DVBFE_TYPE_DVBT)
+			return 0;
+		if ((dx = dvb_terrestrial_delivery_descriptor_codec(curd)) == NULL)
+			return 0;
+
+		t->params.frequency = dx->centre_frequency * 10;
+		t->params.inversion = DVBFE_INVERSION_AUTO;
+		if (dx->bandwidth < 3)
+			t->params.u.dvbt.bandwidth = bw_tab[dx->bandwidth];
+		else
+			t->params.u.dvbt.bandwidth = DVBFE_DVBT_BANDWIDTH_AUTO;
+		if (dx->constellation < 3)
+			t->params.u.dvbt.constellation = const_tab[dx->constellation];
+		else
+			t->params.u.dvbt.constellation = DVBFE_DVBT_CONST_AUTO;
+		t->params.u.dvbt.hierarchy_information = hier_tab[dx->hierarchy_information & 3];
+		t->params.u.dvbt.code_rate_HP = dvbt_code_rate(dx->code_rate_hp_stream);
+		t->params.u.dvbt.code_rate_LP = dvbt_code_rate(dx->code_rate_lp_stream);
+		t->params.u.dvbt.guard_interval = guard_tab[dx->guard_interval];
+		switch(dx->transmission_mode) {
+		case 0: t->params.u.dvbt.transmission_mode = DVBFE_DVBT_TRANSMISSION_MODE_2K; break;
+		case 1: t->params.u.dvbt.transmission_mode = DVBFE_DVBT_TRANSMISSION_MODE_8K; break;
+		default: t->params.u.dvbt.transmission_mode = DVBFE_DVBT_TRANSMISSION_MODE_AUTO; break;
+		}
+		return 1;
+	}
+	}
+
+	return 0;
+}
+
+static void process_nit(struct scan_state *state, struct section_ext *section_ext)
+{
+	struct dvb_nit_section *nit;
+	struct dvb_nit_section_part2 *part2;
+	struct dvb_nit_transport *cur_transport;
+	struct descriptor *curd;
+
+	if ((nit = dvb_nit_section_codec(section_ext)) == NULL)
+		return;
+	if (!table_section(&state->nit, section_ext))
+		return;
+
+	state->t->network_id = section_ext->table_id_ext;
+
+	part2 = dvb_nit_section_part2(nit);
+	dvb_nit_section_transports_for_each(nit, part2, cur_transport) {
+		struct transponder *t = new_transponder();
+		int usable = 0;
+
+		t->network_id = section_ext->table_id_ext;
+		t->original_network_id = cur_transport->original_network_id;
+		t->transport_stream_id = cur_transport->transport_stream_id;
+
+		dvb_nit_transport_descriptors_for_each(cur_transport, curd) {
+			if (parse_delivery_descriptor(state, curd, t)) {
+				add_frequency(t, t->params.frequency);
+				usable = 1;
+			} else if (curd->tag == dtag_dvb_frequency_list) {
+				struct dvb_frequency_list_descriptor *dx;
+				uint32_t *freqs;
+				int count, i;
+
+				if ((dx = dvb_frequency_list_descriptor_codec(curd)) == NULL)
+					continue;
+				freqs = dvb_frequency_list_descriptor_centre_frequencies(dx);
+				count = dvb_frequency_list_descriptor_centre_frequencies_count(dx);
+				for(i=0; i < count; i++) {
+					switch(dx->coding_type) {
+					case DVB_CODING_TYPE_SATELLITE:
+						add_frequency(t, bcd_to_integer(freqs[i]) * 10);
+						break;
+					case DVB_CODING_TYPE_CABLE:
+						add_frequency(t, bcd_to_integer(freqs[i]) * 100);
+						break;
+					case DVB_CODING_TYPE_TERRESTRIAL:
+						add_frequency(t, freqs[i] * 10);
+						break;
+					}
+				}
+			}
+		}
+
+		// only queue transponders we can tune and do not know yet; one
+		// which failed to tune would cost another lock timeout each time
+		if (!usable || listed_transponder(t, *state->toscan) ||
+		    seen_transponder(t, state->t) || seen_transponder(t, state->scanned) ||
+		    listed_transponder(t, state->failed)) {
+			free_transponder(t);
+			continue;
+		}
+		t->params.frequency = 0;
+		append_transponder(t, state->toscan, state->toscan_end);
+	}
+
+	if (table_complete(&state->nit, section_ext))
+		table_done(state, &state->nit);
+}
+
+static void read_table(struct scan_state *state, struct table_filter *f)
+{
+	uint8_t sibuf[4096];
+	struct section *section;
+	struct section_ext *section_ext;
+	int size;
+
+	if ((size = read(f->fd, sibuf, sizeof(sibuf))) < 0)
+		return;
+	if ((section = section_codec(sibuf, size)) == NULL)
+		return;
+	if ((section_ext = section_ext_decode(section, 0)) == NULL)
+		return;
+	if (!section_ext->current_next_indicator)
+		return;
+
+	switch(f->table_id) {
+	case stag_mpeg_program_association:
+		process_pat(state, section_ext);
+		break;
+	case stag_mpeg_program_map:
+		process_pmt(state, f, section_ext);
+		break;
+	case stag_dvb_service_description_actual:
+		process_sdt(state, section_ext);
+		break;
+	case stag_dvb_network_information_actual:
+		process_nit(state, section_ext);
+		break;
+	}
+}
+
+void dvbscan_scan_dvb(struct dvbfe_handle *fe, int adapter, int demux, int timeout,
+		      struct transponder *t,
+		      struct transponder **toscan, struct transponder **toscan_end,
+		      struct transponder *scanned, struct transponder *failed)
+{
+	struct scan_state state;
+	struct dvbfe_info feinfo;
+	struct pollfd pollfds[3 + MAX_PMT_FILTERS];
+	struct table_filter *filters[3 + MAX_PMT_FILTERS];
+	int count, i;
+
+	memset(&state, 0, sizeof(state));
+	state.adapter = adapter;
+	state.demux = demux;
+	state.timeout = timeout;
+	state.t = t;
+	state.toscan = toscan;
+	state.toscan_end = toscan_end;
+	state.scanned = scanned;
+	state.failed = failed;
+	state.start = now_ms();
+	dvbfe_get_info(fe, 0, &feinfo, DVBFE_INFO_QUERYTYPE_IMMEDIATE, 0);
+	state.fe_type = feinfo.type;
+
+	t->pat_ms = t->pmt_ms = t->sdt_ms = t->nit_ms = -1;
+
+	// start collecting all the tables at once
+	state.pat.fd = state.sdt.fd = state.nit.fd = -1;
+	start_table(&state, &state.pat, TRANSPORT_PAT_PID, stag_mpeg_program_association,
+		    -1, TIMEOUT_PAT, &t->pat_ms);
+	start_table(&state, &state.sdt, TRANSPORT_SDT_PID, stag_dvb_service_description_actual,
+		    -1, TIMEOUT_SDT, &t->sdt_ms);
+	start_table(&state, &state.nit, TRANSPORT_NIT_PID, stag_dvb_network_information_actual,
+		    -1, TIMEOUT_NIT, &t->nit_ms);
+	for(i=0; i < MAX_PMT_FILTERS; i++)
+		state.pmts[i].fd = -1;
+
+	while(1) {
+		long long now = now_ms();
+		long long next_deadline = -1;
+
+		// gather the running filters, expiring any which have timed out
+		count = 0;
+		for(i=0; i < 3 + MAX_PMT_FILTERS; i++) {
+			struct table_filter *f;
+
+			if (i == 0)
+				f = &state.pat;
+			else if (i == 1)
+				f = &state.sdt;
+			else if (i == 2)
+				f = &state.nit;
+			else
+				f = &state.pmts[i - 3];
+			if (f->fd < 0)
+				continue;
+
+			if (now >= f->deadline) {
+				if (f->service)
+					stop_pmt(&state, f);
+				else
+					stop_table(f);
+				continue;
+			}
+			if ((next_deadline < 0) || (f->deadline < next_deadline))
+				next_deadline = f->deadline;
+
+			filters[count] = f;
+			pollfds[count].fd = f->fd;
+			pollfds[count].events = POLLIN | POLLPRI | POLLERR;
+			pollfds[count].revents = 0;
+			count++;
+		}
+		start_pmts(&state);
+		if (count == 0) {
+			if (!pmts_pending(&state))
+				break;
+			continue;
+		}
+
+		if (poll(pollfds, count, next_deadline - now) < 0)
+			continue;
+
+		for(i=0; i < count; i++) {
+			if (pollfds[i].revents & (POLLIN | POLLPRI))
+				read_table(&state, filters[i]);
+		}
+	}
+
+	t->scan_ms = now_ms() - state.start;
+	free(state.pmt_queue);
 }
@@ -74,6 +74,28 @@ int seen_transponder(struct transponder *t, struct transponder *checklist)
 	return 0;
 }
 
+/**
+ * Like seen_transponder(), but matches any of the checklist entries'
+ * frequencies, for entries which have not been tuned (or failed to tune)
+ * and so have only their frequency list filled in.
+ */
+int listed_transponder(struct transponder *t, struct transponder *checklist)
+{
+	struct transponder *cur_check;
+	uint32_t i, j;
+
+	for(cur_check = checklist; cur_check; cur_check = cur_check->next) {
+		for(i=0; i < cur_check->frequency_count; i++) {
+			for(j=0; j < t->frequency_count; j++) {
+				if ((cur_check->frequencies[i] / 2000) == (t->frequencies[j] / 2000))
+					return 1;
+			}
+		}
+	}
+
+	return 0;
+}
+
 void add_frequency(struct transponder *t, uint32_t frequency)
 {
 	uint32_t *tmp;
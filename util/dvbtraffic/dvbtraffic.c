@@ -12,11 +12,82 @@
 #include <sys/time.h>
 #include <string.h>
 #include <limits.h>
+#include <errno.h>
 #include <libdvbapi/dvbdemux.h>
+#include <libucsi/ts_scan.h>
+#include <libucsi/transport_packet.h>
 
-#define BSIZE 188
+/* read up to this much at once; a full transponder delivers several MB/s */
+#define BSIZE (TRANSPORT_PACKET_LENGTH * 1024)
+
+/* analyzer defaults and limits */
+#define DEFAULT_INTERVAL 1000
+#define DEFAULT_WINDOW 10
+#define DEFAULT_FILE_RATE 38000
+#define MAX_WINDOW 60
+#define PCR_CLOCK 27000000ULL
+#define PCR_WRAP ((1ULL << 33) * 300)
+
+#define OUTPUT_JSON 0
+#define OUTPUT_CSV 1
 
 static int pidt[0x2001];
+static unsigned char buffer[BSIZE];
+
+/**
+ * Per-PID analyzer state. Counters suffixed _int cover the current
+ * reporting interval; the window ring holds per-interval packet counts
+ * for the rolling bitrate.
+ */
+struct pid_analysis {
+	int active;
+	unsigned char cstate;
+	uint8_t scrambling;
+
+	uint32_t packets_int;
+	uint32_t cc_errors_int;
+	uint32_t tei_int;
+	uint32_t scrambled_int;
+	uint32_t adaptation_errors_int;
+	uint64_t cc_errors_total;
+	uint64_t tei_total;
+	uint64_t adaptation_errors_total;
+
+	uint32_t window[MAX_WINDOW];
+
+	/* PCR tracking: ticks are 27MHz, positions are mux packet numbers */
+	int have_pcr;
+	uint64_t last_pcr;
+	uint64_t last_pcr_pos;
+	uint32_t pcr_count_int;
+	uint64_t pcr_interval_min_int;
+	uint64_t pcr_interval_max_int;
+	int64_t pcr_jitter_max_int;
+
+	/* mux rate estimate (27MHz ticks per packet) from the previous interval */
+	double ticks_per_packet;
+	int have_rate_start;
+	uint64_t rate_start_pcr;
+	uint64_t rate_start_pos;
+};
+
+static struct pid_analysis *analysis;
+static uint64_t mux_packets;
+static int window_len = DEFAULT_WINDOW;
+static int window_slot;
+static int window_fill;
+static int window_ms[MAX_WINDOW];
+
+/**
+ * Stream clock for files, which are read far faster than real time. It
+ * follows the PCRs of the first PCR PID seen, and between PCRs (or in a
+ * stream with none) advances with the packet count at the mux rate.
+ */
+static int clock_pid = -1;
+static uint64_t clock_ticks;
+static uint64_t clock_pcr;
+static uint64_t clock_pcr_pos;
+static double clock_ticks_per_packet;
 
 static void usage(FILE *output)
 {
@@ -25,18 +96,250 @@ static void usage(FILE *output)
 		"Options:\n"
 		"	-a N	use dvb adapter N\n"
 		"	-d N	use demux N\n"
-		"	-h	display this help\n");
+		"	-f FILE	read a transport stream from FILE instead of the DVR device\n"
+		"	-s STR	only count packets containing STR\n"
+		"	-A	analyzer mode: per-PID bitrate, CC errors, TEI, scrambling and PCR jitter\n"
+		"	-o FMT	analyzer output format: json (default) or csv\n"
+		"	-i MS	analyzer reporting interval in milliseconds (default %i)\n"
+		"	-w N	analyzer rolling bitrate window in intervals (default %i, max %i)\n"
+		"	-r KBIT	mux rate of a FILE without PCRs, in kbit/s (default %i)\n"
+		"	-h	display this help\n",
+		DEFAULT_INTERVAL, DEFAULT_WINDOW, MAX_WINDOW, DEFAULT_FILE_RATE);
+}
+
+static uint64_t pcr_diff(uint64_t a, uint64_t b)
+{
+	return (a >= b) ? (a - b) : (a + PCR_WRAP - b);
+}
+
+static void clock_packet(unsigned char *buf)
+{
+	struct transport_packet *pkt = (struct transport_packet *) buf;
+	struct transport_values values;
+	int pid = transport_packet_pid(pkt);
+	uint64_t packets;
+	uint64_t interval;
+
+	if (((clock_pid != -1) && (pid != clock_pid)) ||
+	    !(pkt->adaptation_field_control & 2) || pkt->transport_error_indicator)
+		return;
+	if (transport_packet_values_extract(pkt, &values, transport_value_pcr) < 0)
+		return;
+	if (!(values.flags & transport_adaptation_flag_pcr))
+		return;
+
+	packets = mux_packets - clock_pcr_pos;
+	if (clock_pid == -1) {
+		clock_pid = pid;
+		clock_ticks = packets * clock_ticks_per_packet;
+	} else {
+		/* across a discontinuity, or a jump of over a second, the PCRs
+		 * do not measure elapsed time; count packets instead */
+		interval = pcr_diff(values.pcr, clock_pcr);
+		if ((values.flags & transport_adaptation_flag_discontinuity) ||
+		    (interval > PCR_CLOCK) || (packets == 0)) {
+			clock_ticks += packets * clock_ticks_per_packet;
+		} else {
+			clock_ticks += interval;
+			clock_ticks_per_packet = (double) interval / packets;
+		}
+	}
+	clock_pcr = values.pcr;
+	clock_pcr_pos = mux_packets;
+}
+
+static long long clock_ms(void)
+{
+	return (clock_ticks + (mux_packets - clock_pcr_pos) * clock_ticks_per_packet) *
+		1000 / PCR_CLOCK;
+}
+
+static long long wall_ms(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, 0);
+	return (long long) tv.tv_sec * 1000 + tv.tv_usec / 1000;
+}
+
+static void analyze_packet(unsigned char *buf)
+{
+	struct transport_packet *pkt = (struct transport_packet *) buf;
+	struct transport_values values;
+	struct pid_analysis *pa;
+	int pid = transport_packet_pid(pkt);
+	int discontinuity = 0;
+
+	pa = analysis + pid;
+	pa->active = 1;
+	pa->packets_int++;
+
+	if (pkt->transport_error_indicator) {
+		pa->tei_int++;
+		pa->tei_total++;
+		return;
+	}
+
+	pa->scrambling = pkt->transport_scrambling_control;
+	if (pa->scrambling)
+		pa->scrambled_int++;
+
+	/* only packets with an adaptation field carry PCRs or discontinuities */
+	if (pkt->adaptation_field_control & 2) {
+		/* a malformed adaptation field says nothing about continuity,
+		 * which is still checked from the header below */
+		if (transport_packet_values_extract(pkt, &values, transport_value_pcr) < 0) {
+			pa->adaptation_errors_int++;
+			pa->adaptation_errors_total++;
+			goto continuity;
+		}
+		discontinuity = values.flags & transport_adaptation_flag_discontinuity;
+		if (discontinuity) {
+			pa->have_pcr = 0;
+			pa->have_rate_start = 0;
+		}
+
+		if (values.flags & transport_adaptation_flag_pcr) {
+			if (pa->have_pcr) {
+				uint64_t interval = pcr_diff(values.pcr, pa->last_pcr);
+
+				if ((pa->pcr_interval_min_int == 0) || (interval < pa->pcr_interval_min_int))
+					pa->pcr_interval_min_int = interval;
+				if (interval > pa->pcr_interval_max_int)
+					pa->pcr_interval_max_int = interval;
+
+				/* compare the PCR progression against the packet arrival
+				 * position, using the mux rate seen in the last interval */
+				if (pa->ticks_per_packet > 0) {
+					int64_t jitter = (int64_t) interval -
+						(int64_t) ((mux_packets - pa->last_pcr_pos) * pa->ticks_per_packet);
+
+					if (jitter < 0)
+						jitter = -jitter;
+					if (jitter > pa->pcr_jitter_max_int)
+						pa->pcr_jitter_max_int = jitter;
+				}
+			}
+			if (!pa->have_rate_start) {
+				pa->rate_start_pcr = values.pcr;
+				pa->rate_start_pos = mux_packets;
+				pa->have_rate_start = 1;
+			}
+			pa->have_pcr = 1;
+			pa->last_pcr = values.pcr;
+			pa->last_pcr_pos = mux_packets;
+			pa->pcr_count_int++;
+		}
+	}
+
+continuity:
+	if (transport_packet_continuity_check(pkt, discontinuity, &pa->cstate)) {
+		pa->cc_errors_int++;
+		pa->cc_errors_total++;
+		pa->cstate = 0;
+	}
+}
+
+static void analyze_report(int format, long long timestamp_ms, int diff)
+{
+	int pid;
+	int window_total_ms = 0;
+	int i;
+
+	if (window_fill < window_len)
+		window_fill++;
+	window_ms[window_slot] = diff;
+	for (i = 0; i < window_fill; i++)
+		window_total_ms += window_ms[i];
+
+	for (pid = 0; pid < TRANSPORT_MAX_PIDS; pid++) {
+		struct pid_analysis *pa = analysis + pid;
+		uint64_t window_packets = 0;
+		double kbps, avg_kbps;
+
+		if (!pa->active)
+			continue;
+
+		pa->window[window_slot] = pa->packets_int;
+		for (i = 0; i < window_fill; i++)
+			window_packets += pa->window[i];
+
+		kbps = pa->packets_int * 188.0 * 8 / diff;
+		avg_kbps = window_packets * 188.0 * 8 / window_total_ms;
+
+		if (format == OUTPUT_CSV) {
+			printf("%lld,%i,%u,%.1f,%.1f,%u,%llu,%u,%llu,%u,%llu,%i,%u,%.3f,%.3f,%.3f\n",
+			       timestamp_ms, pid, pa->packets_int, kbps, avg_kbps,
+			       pa->cc_errors_int, (unsigned long long) pa->cc_errors_total,
+			       pa->tei_int, (unsigned long long) pa->tei_total,
+			       pa->adaptation_errors_int,
+			       (unsigned long long) pa->adaptation_errors_total,
+			       pa->scrambling, pa->pcr_count_int,
+			       pa->pcr_interval_min_int * 1000.0 / PCR_CLOCK,
+			       pa->pcr_interval_max_int * 1000.0 / PCR_CLOCK,
+			       pa->pcr_jitter_max_int * 1000000.0 / PCR_CLOCK);
+		} else {
+			printf("{\"time_ms\":%lld,\"pid\":%i,\"packets\":%u,\"kbps\":%.1f,\"avg_kbps\":%.1f,"
+			       "\"cc_errors\":%u,\"cc_errors_total\":%llu,\"tei\":%u,\"tei_total\":%llu,"
+			       "\"adaptation_errors\":%u,\"adaptation_errors_total\":%llu,"
+			       "\"scrambling\":%i,\"scrambled_packets\":%u",
+			       timestamp_ms, pid, pa->packets_int, kbps, avg_kbps,
+			       pa->cc_errors_int, (unsigned long long) pa->cc_errors_total,
+			       pa->tei_int, (unsigned long long) pa->tei_total,
+			       pa->adaptation_errors_int,
+			       (unsigned long long) pa->adaptation_errors_total,
+			       pa->scrambling, pa->scrambled_int);
+			if (pa->pcr_count_int)
+				printf(",\"pcr_count\":%u,\"pcr_interval_min_ms\":%.3f,"
+				       "\"pcr_interval_max_ms\":%.3f,\"pcr_jitter_max_us\":%.3f",
+				       pa->pcr_count_int,
+				       pa->pcr_interval_min_int * 1000.0 / PCR_CLOCK,
+				       pa->pcr_interval_max_int * 1000.0 / PCR_CLOCK,
+				       pa->pcr_jitter_max_int * 1000000.0 / PCR_CLOCK);
+			printf("}\n");
+		}
+
+		/* update the mux rate estimate for the next interval */
+		if (pa->have_rate_start && (pa->last_pcr_pos > pa->rate_start_pos)) {
+			pa->ticks_per_packet = (double) pcr_diff(pa->last_pcr, pa->rate_start_pcr) /
+					       (pa->last_pcr_pos - pa->rate_start_pos);
+			pa->rate_start_pcr = pa->last_pcr;
+			pa->rate_start_pos = pa->last_pcr_pos;
+		}
+
+		if (window_packets == 0)
+			pa->active = 0;
+		pa->packets_int = 0;
+		pa->cc_errors_int = 0;
+		pa->tei_int = 0;
+		pa->adaptation_errors_int = 0;
+		pa->scrambled_int = 0;
+		pa->pcr_count_int = 0;
+		pa->pcr_interval_min_int = 0;
+		pa->pcr_interval_max_int = 0;
+		pa->pcr_jitter_max_int = 0;
+	}
+
+	window_slot = (window_slot + 1) % window_len;
+	fflush(stdout);
 }
 
 int main(int argc, char **argv)
 {
-	struct timeval startt;
+	long long startt;
 	int adapter = 0, demux = 0;
 	char *search = NULL;
-	int fd, ffd, packets = 0;
+	char *filename = NULL;
+	int analyzer = 0;
+	int format = OUTPUT_JSON;
+	int interval = DEFAULT_INTERVAL;
+	int file_rate = DEFAULT_FILE_RATE;
+	int fd, ffd = -1;
 	int opt;
+	struct ts_scan *scan;
+	size_t buffill = 0;
 
-	while ((opt = getopt(argc, argv, "a:d:hs:")) != -1) {
+	while ((opt = getopt(argc, argv, "a:d:f:hs:Ao:i:w:r:")) != -1) {
 		switch (opt) {
 		case 'a':
 			adapter = atoi(optarg);
@@ -44,107 +347,201 @@ int main(int argc, char **argv)
 		case 'd':
 			demux = atoi(optarg);
 			break;
+		case 'f':
+			filename = optarg;
+			break;
 		case 'h':
 			usage(stdout);
 			exit(0);
 		case 's':
 			search = strdup(optarg);
 			break;
+		case 'A':
+			analyzer = 1;
+			break;
+		case 'o':
+			if (!strcmp(optarg, "json")) {
+				format = OUTPUT_JSON;
+			} else if (!strcmp(optarg, "csv")) {
+				format = OUTPUT_CSV;
+			} else {
+				usage(stderr);
+				exit(1);
+			}
+			break;
+		case 'i':
+			interval = atoi(optarg);
+			if (interval <= 0) {
+				usage(stderr);
+				exit(1);
+			}
+			break;
+		case 'w':
+			window_len = atoi(optarg);
+			if ((window_len <= 0) || (window_len > MAX_WINDOW)) {
+				usage(stderr);
+				exit(1);
+			}
+			break;
+		case 'r':
+			file_rate = atoi(optarg);
+			if (file_rate <= 0) {
+				usage(stderr);
+				exit(1);
+			}
+			break;
 		default:
 			usage(stderr);
 			exit(1);
 		}
 	}
 
-	// open the DVR device
-	fd = dvbdemux_open_dvr(adapter, demux, 1, 0);
-	if (fd < 0) {
- 		fprintf(stderr, "dvbtraffic: Could not open dvr device: %m\n");
-		exit(1);
+	if (filename) {
+		fd = open(filename, O_RDONLY);
+		if (fd < 0) {
+			fprintf(stderr, "dvbtraffic: Could not open %s: %m\n", filename);
+			exit(1);
+		}
+	} else {
+		// open the DVR device
+		fd = dvbdemux_open_dvr(adapter, demux, 1, 0);
+		if (fd < 0) {
+			fprintf(stderr, "dvbtraffic: Could not open dvr device: %m\n");
+			exit(1);
+		}
+		dvbdemux_set_buffer(fd, 1024 * 1024);
+
+		ffd = dvbdemux_open_demux(adapter, demux, 0);
+		if (ffd < 0) {
+			fprintf(stderr, "dvbtraffic: Could not open demux device: %m\n");
+			exit(1);
+		}
+
+		if (dvbdemux_set_pid_filter(ffd, -1, DVBDEMUX_INPUT_FRONTEND, DVBDEMUX_OUTPUT_DVR, 1)) {
+			perror("dvbdemux_set_pid_filter");
+			return -1;
+		}
 	}
-	dvbdemux_set_buffer(fd, 1024 * 1024);
 
-	ffd = dvbdemux_open_demux(adapter, demux, 0);
-	if (ffd < 0) {
-		fprintf(stderr, "dvbtraffic: Could not open demux device: %m\n");
+	if ((scan = ts_scan_create(BSIZE / TRANSPORT_PACKET_LENGTH, TS_SCAN_ENGINE_AUTO)) == NULL) {
+		fprintf(stderr, "dvbtraffic: Could not create packet scanner\n");
 		exit(1);
 	}
 
-	if (dvbdemux_set_pid_filter(ffd, -1, DVBDEMUX_INPUT_FRONTEND, DVBDEMUX_OUTPUT_DVR, 1)) {
-		perror("dvbdemux_set_pid_filter");
-		return -1;
+	if (analyzer) {
+		analysis = calloc(TRANSPORT_MAX_PIDS, sizeof(struct pid_analysis));
+		if (analysis == NULL) {
+			fprintf(stderr, "dvbtraffic: Out of memory\n");
+			exit(1);
+		}
+		if (format == OUTPUT_CSV)
+			printf("time_ms,pid,packets,kbps,avg_kbps,cc_errors,cc_errors_total,"
+			       "tei,tei_total,adaptation_errors,adaptation_errors_total,scrambling,pcr_count,pcr_interval_min_ms,"
+			       "pcr_interval_max_ms,pcr_jitter_max_us\n");
 	}
 
-	gettimeofday(&startt, 0);
+	clock_ticks_per_packet = (double) PCR_CLOCK * TRANSPORT_PACKET_LENGTH * 8 /
+				 (file_rate * 1000.0);
+	startt = filename ? clock_ms() : wall_ms();
 
 	while (1) {
-		unsigned char buffer[BSIZE];
-		int pid, ok;
 		ssize_t r;
+		size_t used;
+		uint64_t sync_losses;
+		long long now;
+		int diff;
+		size_t i;
+		int eof = 0;
 
-		if ((r = read(fd, buffer, BSIZE)) <= 0) {
-			perror("read");
-			break;
-		}
-		if (r != BSIZE) {
-			fprintf(stderr, "dvbtraffic: only read %zd bytes\n", r);
-			break;
-		}
-		if (buffer[0] != 0x47) {
-			continue;
-			printf("desync (%x)\n", buffer[0]);
-			while (buffer[0] != 0x47)
-				read(fd, buffer, 1);
-			continue;
-		}
-		ok = 1;
-		pid = ((((unsigned) buffer[1]) << 8) |
-		       ((unsigned) buffer[2])) & 0x1FFF;
-
-		if (search) {
-			int i, sl = strlen(search);
-			ok = 0;
-			if (pid != 0x1fff) {
-				for (i = 0; i < (188 - sl); ++i) {
-					if (!memcmp(buffer + i, search, sl))
-						ok = 1;
-				}
+		if ((r = read(fd, buffer + buffill, BSIZE - buffill)) <= 0) {
+			if ((r < 0) && (errno == EOVERFLOW)) {
+				fprintf(stderr, "dvbtraffic: buffer overflow\n");
+				continue;
 			}
+			if ((r < 0) || !analyzer || !filename) {
+				perror("read");
+				break;
+			}
+			/* flush the final partial interval of a file */
+			eof = 1;
+		} else {
+			buffill += r;
 		}
 
-		if (ok) {
-			pidt[pid]++;
-			pidt[0x2000]++;
-		}
+		sync_losses = scan->sync_losses;
+		used = ts_scan_buffer(scan, buffer, buffill);
+		if ((scan->sync_losses != sync_losses) && !analyzer)
+			printf("desync (%llu bytes skipped)\n",
+			       (unsigned long long) scan->skipped_bytes);
 
-		packets++;
-
-		if (!(packets & 0xFF)) {
-			struct timeval now;
-			int diff;
-			gettimeofday(&now, 0);
-			diff =
-			    (now.tv_sec - startt.tv_sec) * 1000 +
-			    (now.tv_usec - startt.tv_usec) / 1000;
-			if (diff > 1000) {
-				int _pid = 0;
-				for (_pid = 0; _pid < 0x2001; _pid++) {
-					if (pidt[_pid]) {
-						printf("%04x %5d p/s %5d kb/s %5d kbit\n",
-						     _pid,
-						     pidt[_pid] * 1000 / diff,
-						     pidt[_pid] * 1000 / diff * 188 / 1024,
-						     pidt[_pid] * 8 * 1000 / diff * 188 / 1000);
+		for (i = 0; i < scan->count; i++) {
+			int pid = scan->pid[i];
+			int ok = 1;
+
+			if (filename)
+				clock_packet(buffer + scan->offset[i]);
+			if (analyzer) {
+				analyze_packet(buffer + scan->offset[i]);
+				mux_packets++;
+				continue;
+			}
+			mux_packets++;
+
+			if (search) {
+				unsigned char *pkt = buffer + scan->offset[i];
+				int j, sl = strlen(search);
+				ok = 0;
+				if (pid != 0x1fff) {
+					for (j = 0; j < (188 - sl); ++j) {
+						if (!memcmp(pkt + j, search, sl))
+							ok = 1;
 					}
-					pidt[_pid] = 0;
 				}
-				printf("-PID--FREQ-----BANDWIDTH-BANDWIDTH-\n");
+			}
+
+			if (ok) {
+				pidt[pid]++;
+				pidt[0x2000]++;
+			}
+		}
+
+		/* keep any partial packet for the next read */
+		memmove(buffer, buffer + used, buffill - used);
+		buffill -= used;
+
+		/* a file is timed by its own clock, not by how fast it is read */
+		now = filename ? clock_ms() : wall_ms();
+		diff = now - startt;
+		if (analyzer) {
+			if ((diff >= interval) || eof) {
+				if (diff <= 0)
+					diff = 1;
+				analyze_report(format, now, diff);
 				startt = now;
 			}
+			if (eof)
+				break;
+		} else if (diff > 1000) {
+			int _pid = 0;
+			for (_pid = 0; _pid < 0x2001; _pid++) {
+				if (pidt[_pid]) {
+					printf("%04x %5d p/s %5d kb/s %5d kbit\n",
+					     _pid,
+					     pidt[_pid] * 1000 / diff,
+					     pidt[_pid] * 1000 / diff * 188 / 1024,
+					     pidt[_pid] * 8 * 1000 / diff * 188 / 1000);
+				}
+				pidt[_pid] = 0;
+			}
+			printf("-PID--FREQ-----BANDWIDTH-BANDWIDTH-\n");
+			startt = now;
 		}
 	}
 
-	close(ffd);
+	ts_scan_destroy(scan);
+	free(analysis);
+	if (ffd >= 0)
+		close(ffd);
 	close(fd);
 	return 0;
 }
@@ -31,6 +31,7 @@
 #include <libdvbapi/dvbdemux.h>
 #include <libdvbapi/dvbaudio.h>
 #include <libdvbsec/dvbsec_cfg.h>
+#include <libdvbcfg/dvbcfg_channeldb.h>
 #include <libucsi/mpeg/section.h>
 #include "gnutv.h"
 #include "gnutv_dvb.h"
@@ -55,6 +56,7 @@ void usage(void)
 		" -demux <id>		demux to use (default 0)\n"
 		" -caslotnum <id>	ca slot number to use (default 0)\n"
 		" -channels <filename>	channels.conf file.\n"
+		" -chancache <filename>	Optional cache of the parsed channels.conf, rebuilt when it changes.\n"
 		" -secfile <filename>	Optional sec.conf file.\n"
 		" -secid <secid>	ID of the SEC configuration to use, one of:\n"
 		"			 * UNIVERSAL (default) - Europe, 10800 to 11800 MHz and 11600 to 12700 Mhz,\n"
@@ -67,6 +69,11 @@ void usage(void)
 		"						Dual LO, H:5150MHz, V:5750MHz.\n"
 		"			 * One of the sec definitions from the secfile if supplied\n"
 		" -buffer <size>	Custom DVR buffer size\n"
+		" -batch <count>	Number of 7-packet blocks to read/write/send per syscall (default 64)\n"
+		" -gso			Use UDP segmentation offload for udp/rtp output when available\n"
+		" -stats		Print output syscall/drop counters on exit\n"
+		" -pace pcr|<kbit/s>	Pace udp/rtp output to the service's PCR clock or a fixed rate\n"
+		" -burst <count>	Maximum datagrams sent back to back when pacing (default 4)\n"
 		" -out decoder		Output to hardware decoder (default)\n"
 		"      decoderabypass	Output to hardware decoder using audio bypass\n"
 		"      dvr		Output stream to dvr device\n"
@@ -79,6 +86,10 @@ void usage(void)
 		"      rtp <address> <port>			Output stream to address:port using udp-rtp\n"
 		"      rtpif <address> <port> <interface> 	Output stream to address:port using udp-rtp\n"
 		"							forcing the specified interface\n"
+		" -record <channel name> file <filename>|udp <address> <port>|rtp <address> <port>\n"
+		"			Also record another channel from the same multiplex; may be\n"
+		"			repeated. The main output must then be file, stdout, udp or rtp.\n"
+		"			All channels are descrambled by the CAM.\n"
 		" -timeout <secs>	Number of seconds to output channel for\n"
 		"				(0=>exit immediately after successful tuning, default is to output forever)\n"
 		" -cammenu		Show the CAM menu\n"
@@ -89,16 +100,21 @@ void usage(void)
 	exit(1);
 }
 
-int find_channel(struct dvbcfg_zapchannel *channel, void *private_data)
+static struct addrinfo *resolve_output(char *outhost, char *outport)
 {
-	struct dvbcfg_zapchannel *tmpchannel = private_data;
-
-	if (strcmp(channel->name, tmpchannel->name) == 0) {
-		memcpy(tmpchannel, channel, sizeof(struct dvbcfg_zapchannel));
-		return 1;
+	struct addrinfo *outaddrs = NULL;
+	struct addrinfo hints;
+	int res;
+
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_DGRAM;
+	if ((res = getaddrinfo(outhost, outport, &hints, &outaddrs)) != 0) {
+		fprintf(stderr, "Unable to resolve requested address: %s\n", gai_strerror(res));
+		exit(1);
 	}
 
-	return 0;
+	return outaddrs;
 }
 
 int main(int argc, char *argv[])
@@ -108,6 +124,9 @@ int main(int argc, char *argv[])
 	int demux_id = 0;
 	int caslot_num = 0;
 	char *chanfile = "/etc/channels.conf";
+	char *chancache = NULL;
+	struct dvbcfg_channeldb *channeldb;
+	const struct dvbcfg_zapchannel *channel;
 	char *secfile = NULL;
 	char *secid = NULL;
 	char *channel_name = NULL;
@@ -126,6 +145,16 @@ int main(int argc, char *argv[])
 	int ffaudiofd = -1;
 	int usertp = 0;
 	int buffer_size = 0;
+	int i;
+	int batch_size = GNUTV_DATA_DEFAULT_BATCH;
+	int usegso = 0;
+	int showstats = 0;
+	int pace_mode = GNUTV_DATA_PACE_NONE;
+	int pace_rate = 0;
+	int pace_burst = 0;
+	char *record_names[GNUTV_MAX_SERVICES];
+	struct gnutv_data_output record_outputs[GNUTV_MAX_SERVICES];
+	int record_count = 0;
 
 	while(argpos != argc) {
 		if (!strcmp(argv[argpos], "-h")) {
@@ -159,6 +188,11 @@ int main(int argc, char *argv[])
 				usage();
 			chanfile = argv[argpos+1];
 			argpos+=2;
+		} else if (!strcmp(argv[argpos], "-chancache")) {
+			if ((argc - argpos) < 2)
+				usage();
+			chancache = argv[argpos+1];
+			argpos+=2;
 		} else if (!strcmp(argv[argpos], "-secfile")) {
 			if ((argc - argpos) < 2)
 				usage();
@@ -177,6 +211,37 @@ int main(int argc, char *argv[])
 			if (buffer_size < 0)
 				usage();
 			argpos+=2;
+		} else if (!strcmp(argv[argpos], "-batch")) {
+			if ((argc - argpos) < 2)
+				usage();
+			if (sscanf(argv[argpos+1], "%i", &batch_size) != 1)
+				usage();
+			if ((batch_size < 1) || (batch_size > 1024))
+				usage();
+			argpos+=2;
+		} else if (!strcmp(argv[argpos], "-gso")) {
+			usegso = 1;
+			argpos++;
+		} else if (!strcmp(argv[argpos], "-pace")) {
+			if ((argc - argpos) < 2)
+				usage();
+			if (!strcmp(argv[argpos+1], "pcr")) {
+				pace_mode = GNUTV_DATA_PACE_PCR;
+			} else {
+				if ((sscanf(argv[argpos+1], "%i", &pace_rate) != 1) || (pace_rate <= 0))
+					usage();
+				pace_mode = GNUTV_DATA_PACE_RATE;
+			}
+			argpos+=2;
+		} else if (!strcmp(argv[argpos], "-burst")) {
+			if ((argc - argpos) < 2)
+				usage();
+			if ((sscanf(argv[argpos+1], "%i", &pace_burst) != 1) || (pace_burst < 1))
+				usage();
+			argpos+=2;
+		} else if (!strcmp(argv[argpos], "-stats")) {
+			showstats = 1;
+			argpos++;
 		} else if (!strcmp(argv[argpos], "-out")) {
 			if ((argc - argpos) < 2)
 				usage();
@@ -223,6 +288,30 @@ int main(int argc, char *argv[])
 				usage();
 			}
 			argpos+=2;
+		} else if (!strcmp(argv[argpos], "-record")) {
+			struct gnutv_data_output *output = &record_outputs[record_count];
+			if ((argc - argpos) < 4)
+				usage();
+			if (record_count == (GNUTV_MAX_SERVICES - 1))
+				usage();
+			memset(output, 0, sizeof(struct gnutv_data_output));
+			record_names[record_count] = argv[argpos+1];
+			if (!strcmp(argv[argpos+2], "file")) {
+				output->output_type = OUTPUT_TYPE_FILE;
+				output->outfile = argv[argpos+3];
+				argpos+=4;
+			} else if ((!strcmp(argv[argpos+2], "udp")) ||
+				   (!strcmp(argv[argpos+2], "rtp"))) {
+				if ((argc - argpos) < 5)
+					usage();
+				output->output_type = OUTPUT_TYPE_UDP;
+				output->usertp = !strcmp(argv[argpos+2], "rtp");
+				output->outaddrs = resolve_output(argv[argpos+3], argv[argpos+4]);
+				argpos+=5;
+			} else {
+				usage();
+			}
+			record_count++;
 		} else if (!strcmp(argv[argpos], "-timeout")) {
 			if ((argc - argpos) < 2)
 				usage();
@@ -247,18 +336,16 @@ int main(int argc, char *argv[])
 	if ((channel_name == NULL) && (!cammenu))
 		usage();
 
+	// multi-service recording needs a stream output for the main channel
+	if (record_count &&
+	    (output_type != OUTPUT_TYPE_FILE) &&
+	    (output_type != OUTPUT_TYPE_STDOUT) &&
+	    (output_type != OUTPUT_TYPE_UDP))
+		usage();
+
 	// resolve host/port
-	if ((outhost != NULL) && (outport != NULL)) {
-		int res;
-		struct addrinfo hints;
-		memset(&hints, 0, sizeof(hints));
-		hints.ai_family = AF_UNSPEC;
-		hints.ai_socktype = SOCK_DGRAM;
-		if ((res = getaddrinfo(outhost, outport, &hints, &outaddrs)) != 0) {
-			fprintf(stderr, "Unable to resolve requested address: %s\n", gai_strerror(res));
-			exit(1);
-		}
-	}
+	if ((outhost != NULL) && (outport != NULL))
+		outaddrs = resolve_output(outhost, outport);
 
 	// setup any signals
 	signal(SIGINT, signal_handler);
@@ -273,22 +360,42 @@ int main(int argc, char *argv[])
 
 	// frontend setup if a channel name was supplied
 	if ((!cammenu) && (channel_name != NULL)) {
-		// find the requested channel
-		if (strlen(channel_name) >= sizeof(gnutv_dvb_params.channel.name)) {
-			fprintf(stderr, "Channel name is too long %s\n", channel_name);
-			exit(1);
-		}
-		FILE *channel_file = fopen(chanfile, "r");
-		if (channel_file == NULL) {
+		// load the channels; the main and any extra channels are looked up in it
+		if ((channeldb = dvbcfg_channeldb_load(chanfile, chancache)) == NULL) {
 			fprintf(stderr, "Could open channel file %s\n", chanfile);
 			exit(1);
 		}
-		memcpy(gnutv_dvb_params.channel.name, channel_name, strlen(channel_name) + 1);
-		if (dvbcfg_zapchannel_parse(channel_file, find_channel, &gnutv_dvb_params.channel) != 1) {
+
+		// find the requested channel
+		if ((channel = dvbcfg_channeldb_find_name(channeldb, channel_name)) == NULL) {
 			fprintf(stderr, "Unable to find requested channel %s\n", channel_name);
 			exit(1);
 		}
-		fclose(channel_file);
+		memcpy(&gnutv_dvb_params.channel, channel, sizeof(struct dvbcfg_zapchannel));
+
+		// find any extra channels; they must share the transponder
+		gnutv_dvb_params.service_ids[0] = gnutv_dvb_params.channel.service_id;
+		gnutv_dvb_params.service_count = 1;
+		for(i=0; i < record_count; i++) {
+			const struct dvbcfg_zapchannel *extra;
+
+			if ((extra = dvbcfg_channeldb_find_name(channeldb, record_names[i])) == NULL) {
+				fprintf(stderr, "Unable to find requested channel %s\n", record_names[i]);
+				exit(1);
+			}
+
+			if ((extra->fe_type != gnutv_dvb_params.channel.fe_type) ||
+			    (extra->fe_params.frequency != gnutv_dvb_params.channel.fe_params.frequency) ||
+			    (extra->polarization != gnutv_dvb_params.channel.polarization)) {
+				fprintf(stderr, "Channel %s is not on the same transponder as %s\n",
+					record_names[i], channel_name);
+				exit(1);
+			}
+
+			gnutv_dvb_params.service_ids[gnutv_dvb_params.service_count++] = extra->service_id;
+			gnutv_data_add_service(&record_outputs[i]);
+		}
+		dvbcfg_channeldb_free(channeldb);
 
 		// default SEC with a DVBS card
 		if ((secid == NULL) && (gnutv_dvb_params.channel.fe_type == DVBFE_TYPE_DVBS))
@@ -330,7 +437,9 @@ int main(int argc, char *argv[])
 		gnutv_dvb_start(&gnutv_dvb_params);
 
 		// start the data stuff
-		gnutv_data_start(output_type, ffaudiofd, adapter_id, demux_id, buffer_size, outfile, outif, outaddrs, usertp);
+		gnutv_data_set_pacing(pace_mode, pace_rate, pace_burst);
+		gnutv_data_start(output_type, ffaudiofd, adapter_id, demux_id, buffer_size, outfile, outif, outaddrs, usertp,
+				 batch_size, usegso);
 	}
 
 	// the UI
@@ -353,6 +462,22 @@ int main(int argc, char *argv[])
 
 	// stop data handling
 	gnutv_data_stop();
+	if (showstats) {
+		struct gnutv_data_stats stats;
+		gnutv_data_get_stats(&stats);
+		fprintf(stderr, "read calls: %llu (%llu bytes)\n",
+			(unsigned long long) stats.read_calls, (unsigned long long) stats.read_bytes);
+		fprintf(stderr, "write calls: %llu (%llu bytes, %llu datagrams)\n",
+			(unsigned long long) stats.write_calls, (unsigned long long) stats.written_bytes,
+			(unsigned long long) stats.datagrams);
+		fprintf(stderr, "dropped datagrams: %llu, DVR overflows: %llu\n",
+			(unsigned long long) stats.dropped_datagrams, (unsigned long long) stats.dvr_overflows);
+		if (pace_mode != GNUTV_DATA_PACE_NONE)
+			fprintf(stderr, "pacing: target %llu bit/s, achieved %llu bit/s, %llu resyncs\n",
+				(unsigned long long) stats.target_bitrate,
+				(unsigned long long) stats.achieved_bitrate,
+				(unsigned long long) stats.pacing_resyncs);
+	}
 
 	// shutdown DVB stuff
 	if (channel_name != NULL)
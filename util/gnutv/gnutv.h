@@ -34,4 +34,6 @@
 #define OUTPUT_TYPE_UDP 5
 #define OUTPUT_TYPE_STDOUT 6
 
+#define GNUTV_MAX_SERVICES 32
+
 #endif
@@ -26,6 +26,7 @@
 #include <sys/poll.h>
 #include <pthread.h>
 #include <libdvben50221/en50221_stdcam.h>
+#include <libdvben50221/en50221_ca_pmt_list.h>
 #include "gnutv.h"
 #include "gnutv_ca.h"
 
@@ -36,6 +37,9 @@
 #define MMI_STATE_ENQ 2
 #define MMI_STATE_MENU 3
 
+// how often the cam thread checks the CAM state when nothing else happens
+#define CAMTHREAD_MAX_WAIT_MS 100
+
 static int gnutv_ca_info_callback(void *arg, uint8_t slot_id, uint16_t session_number, uint32_t ca_id_count, uint16_t *ca_ids);
 static int gnutv_ai_callback(void *arg, uint8_t slot_id, uint16_t session_number,
 			     uint8_t application_type, uint16_t application_manufacturer,
@@ -60,6 +64,7 @@ static void *camthread_func(void* arg);
 static struct en50221_transport_layer *tl = NULL;
 static struct en50221_session_layer *sl = NULL;
 static struct en50221_stdcam *stdcam = NULL;
+static struct en50221_ca_pmt_list *ca_pmt_list = NULL;
 
 static int ca_resource_connected = 0;
 static int mmi_state = MMI_STATE_CLOSED;
@@ -69,7 +74,6 @@ static int mmi_enq_length;
 static int camthread_shutdown = 0;
 static pthread_t camthread;
 int moveca = 0;
-int seenpmt = 0;
 int cammenu = 0;
 
 char ui_line[256];
@@ -85,6 +89,9 @@ void gnutv_ca_start(struct gnutv_ca_params *params)
 		return;
 	}
 
+	// sleep until there is something to do rather than spinning
+	en50221_tl_set_event_driven(tl, 1, CAMTHREAD_MAX_WAIT_MS);
+
 	// create session layer
 	sl = en50221_sl_create(tl, 16);
 	if (sl == NULL) {
@@ -106,9 +113,13 @@ void gnutv_ca_start(struct gnutv_ca_params *params)
 		en50221_app_ai_register_callback(stdcam->ai_resource, gnutv_ai_callback, stdcam);
 	}
 
-	// hook up the CA callbacks
+	// hook up the CA callbacks, and keep the list of programs the CAM is to descramble
 	if (stdcam->ca_resource) {
 		en50221_app_ca_register_info_callback(stdcam->ca_resource, gnutv_ca_info_callback, stdcam);
+		ca_pmt_list = en50221_ca_pmt_list_create(stdcam->ca_resource, params->moveca,
+							 CA_PMT_CMD_ID_OK_DESCRAMBLING);
+		if (ca_pmt_list == NULL)
+			fprintf(stderr, "Failed to create CA PMT list; nothing will be descrambled\n");
 	}
 
 	// hook up the MMI callbacks
@@ -140,12 +151,17 @@ void gnutv_ca_stop(void)
 
 	// shutdown the cam thread
 	camthread_shutdown = 1;
+	en50221_tl_wakeup(tl);
 	pthread_join(camthread, NULL);
 
 	// destroy the stdcam
 	if (stdcam->destroy)
 		stdcam->destroy(stdcam, 1);
 
+	// destroy the CA PMT list
+	if (ca_pmt_list)
+		en50221_ca_pmt_list_destroy(ca_pmt_list);
+
 	// destroy session layer
 	en50221_sl_destroy(sl);
 
@@ -212,39 +228,17 @@ void gnutv_ca_ui(void)
 
 int gnutv_ca_new_pmt(struct mpeg_pmt_section *pmt)
 {
-	uint8_t capmt[4096];
-	int size;
-
-	if (stdcam == NULL)
+	if (ca_pmt_list == NULL)
 		return -1;
 
-	if (ca_resource_connected) {
-		fprintf(stderr, "Received new PMT - sending to CAM...\n");
-
-		// translate it into a CA PMT
-		int listmgmt = CA_LIST_MANAGEMENT_ONLY;
-		if (seenpmt) {
-			listmgmt = CA_LIST_MANAGEMENT_UPDATE;
-		}
-		seenpmt = 1;
-
-		if ((size = en50221_ca_format_pmt(pmt, capmt, sizeof(capmt), moveca, listmgmt,
-						  CA_PMT_CMD_ID_OK_DESCRAMBLING)) < 0) {
-			fprintf(stderr, "Failed to format PMT\n");
-			return -1;
-		}
-
-		// set it
-		if (en50221_app_ca_pmt(stdcam->ca_resource, stdcam->ca_session_number, capmt, size)) {
-			fprintf(stderr, "Failed to send PMT\n");
-			return -1;
-		}
-
-		// we've seen this PMT
-		return 1;
+	// the list only sends the CAM what changed, once it has a CA session
+	if (en50221_ca_pmt_list_set(ca_pmt_list, pmt)) {
+		fprintf(stderr, "Failed to send PMT\n");
+		return -1;
 	}
 
-	return 0;
+	// we've seen this PMT
+	return 1;
 }
 
 void gnutv_ca_new_dvbtime(time_t dvb_time)
@@ -294,7 +288,6 @@ static int gnutv_ca_info_callback(void *arg, uint8_t slot_id, uint16_t session_n
 {
 	(void) arg;
 	(void) slot_id;
-	(void) session_number;
 
 	fprintf(stderr, "CAM supports the following ca system ids:\n");
 	uint32_t i;
@@ -302,6 +295,12 @@ static int gnutv_ca_info_callback(void *arg, uint8_t slot_id, uint16_t session_n
 		fprintf(stderr, "  0x%04x\n", ca_ids[i]);
 	}
 	ca_resource_connected = 1;
+
+	// a new CA session: send it every program we have
+	if (ca_pmt_list) {
+		fprintf(stderr, "Sending PMTs to CAM...\n");
+		en50221_ca_pmt_list_set_session(ca_pmt_list, session_number);
+	}
 	return 0;
 }
 
@@ -23,8 +23,10 @@
 #define _FILE_OFFSET_BITS 64
 #define _LARGEFILE_SOURCE 1
 #define _LARGEFILE64_SOURCE 1
+#define _GNU_SOURCE
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <unistd.h>
 #include <limits.h>
 #include <string.h>
@@ -33,17 +35,66 @@
 #include <pthread.h>
 #include <errno.h>
 #include <sys/poll.h>
+#include <sys/time.h>
+#include <sys/uio.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
+#include <netinet/udp.h>
 #include <arpa/inet.h>
 #include <libdvbapi/dvbdemux.h>
 #include <libdvbapi/dvbaudio.h>
 #include <libucsi/mpeg/section.h>
+#include <libucsi/transport_packet.h>
+#include <libucsi/crc32.h>
 #include "gnutv.h"
 #include "gnutv_dvb.h"
 #include "gnutv_ca.h"
 #include "gnutv_data.h"
 
+#ifndef UDP_SEGMENT
+#define UDP_SEGMENT 103
+#endif
+
+#define TS_PAYLOAD_SIZE (188*7)
+#define OUTPUT_FLUSH_MS 100
+#define UDP_RING_BATCHES 4
+#define UDP_GSO_MAX_BYTES 65000
+
+#define PCR_CLOCK 27000000LL
+#define PCR_WRAP ((1LL << 33) * 300)
+#define PACE_MAX_AHEAD 1.0
+#define PACE_MAX_LATE 0.5
+
+/**
+ * Stream clock recovered from the PCRs of one PID. Positions are byte
+ * offsets into the output stream, so the clock can be extrapolated to any
+ * datagram.
+ */
+struct pcr_clock {
+	int pid;
+	int valid;
+	uint64_t pcr;
+	uint64_t pos;
+	double ticks_per_byte;
+};
+
+/**
+ * UDP output pacing: either locked to the stream clock or a token bucket
+ * at a fixed rate (bytes/s); burst is in datagrams.
+ */
+struct udp_pacer {
+	int mode;
+	int burst;
+	double rate;
+	int locked;
+	double wall_base;
+	uint64_t pcr_base;
+	double tokens;
+	double last;
+	double start;
+	uint64_t sent_bytes;
+};
+
 static void *fileoutputthread_func(void* arg);
 static void *udpoutputthread_func(void* arg);
 
@@ -56,6 +107,12 @@ static void gnutv_data_dvr_pmt(struct mpeg_pmt_section *pmt);
 static void gnutv_data_append_pid_fd(int pid, int fd);
 static void gnutv_data_free_pid_fds(void);
 
+static void gnutv_data_split_start(struct gnutv_data_output *primary, int buffer_size);
+static void gnutv_data_split_stop(void);
+static void gnutv_data_split_new_pat(int service, uint16_t transport_stream_id,
+				     uint16_t program_number, int pmt_pid);
+static void gnutv_data_split_new_pmt(int service, struct mpeg_pmt_section *pmt);
+
 static pthread_t outputthread;
 static int outfd = -1;
 static int dvrfd = -1;
@@ -64,10 +121,17 @@ static int pmt_fd_dvrout = -1;
 static int outputthread_shutdown = 0;
 
 static int usertp = 0;
+static int usegso = 0;
+static int batch_size = GNUTV_DATA_DEFAULT_BATCH;
+static struct gnutv_data_stats data_stats;
 static int adapter_id = -1;
 static int demux_id = -1;
 static int output_type = 0;
 static struct addrinfo *outaddrs = NULL;
+static volatile int pcr_pid = -1;
+static int pace_mode = GNUTV_DATA_PACE_NONE;
+static int pace_burst = GNUTV_DATA_DEFAULT_BURST;
+static double pace_rate = 0;
 
 struct pid_fd {
 	int pid;
@@ -76,15 +140,82 @@ struct pid_fd {
 static struct pid_fd *pid_fds = NULL;
 static int pid_fds_count = 0;
 
+/**
+ * Multi-service recording: one DVR stream is split in user space into a
+ * sink per service. A sink buffers packets for one file or UDP output.
+ */
+struct data_sink {
+	int output_type;
+	int fd;
+	struct addrinfo *addrs;
+	int usertp;
+	int hdrsize;
+	int slotsize;
+	uint8_t *buf;
+	int bufcount;
+	struct timeval pending_since;
+	uint16_t rtpseq;
+	int gso_max;
+	struct iovec *iovs;
+	struct mmsghdr *msgs;
+	struct pcr_clock clock;
+	uint64_t stream_pos;
+};
+
+struct data_service {
+	struct data_sink sink;
+	int pmt_pid;
+	uint16_t program_number;
+	uint8_t pat[TRANSPORT_PACKET_LENGTH];
+	int pat_valid;
+	uint8_t pat_cc;
+	uint8_t pat_version;
+};
+
+static struct gnutv_data_output service_outputs[GNUTV_MAX_SERVICES];
+static struct data_service services[GNUTV_MAX_SERVICES];
+static int service_count = 1;
+static uint32_t split_pids[TRANSPORT_MAX_PIDS];
+static int split_pid_fd[TRANSPORT_MAX_PIDS];
+static pthread_mutex_t split_lock = PTHREAD_MUTEX_INITIALIZER;
+
+int gnutv_data_add_service(struct gnutv_data_output *output)
+{
+	if (service_count == GNUTV_MAX_SERVICES)
+		return -1;
+
+	service_outputs[service_count] = *output;
+	return service_count++;
+}
+
 void gnutv_data_start(int _output_type,
 		    int ffaudiofd, int _adapter_id, int _demux_id, int buffer_size,
 		    char *outfile,
-		    char* outif, struct addrinfo *_outaddrs, int _usertp)
+		    char* outif, struct addrinfo *_outaddrs, int _usertp,
+		    int _batch_size, int _usegso)
 {
 	usertp = _usertp;
+	usegso = _usegso;
+	if (_batch_size > 0)
+		batch_size = _batch_size;
 	demux_id = _demux_id;
 	adapter_id = _adapter_id;
 	output_type = _output_type;
+	srandom(time(NULL));
+
+	// several services from the one multiplex
+	if (service_count > 1) {
+		struct gnutv_data_output primary;
+
+		primary.output_type = output_type;
+		primary.outfile = outfile;
+		primary.outif = outif;
+		primary.outaddrs = _outaddrs;
+		primary.usertp = usertp;
+		outaddrs = _outaddrs;
+		gnutv_data_split_start(&primary, buffer_size);
+		return;
+	}
 
 	// setup output
 	switch(output_type) {
@@ -107,8 +238,8 @@ void gnutv_data_start(int _output_type,
 			outfd = STDOUT_FILENO;
 		}
 
-		// open dvr device
-		dvrfd = dvbdemux_open_dvr(adapter_id, 0, 1, 0);
+		// open dvr device; nonblocking, so a read returns what has arrived
+		dvrfd = dvbdemux_open_dvr(adapter_id, 0, 1, 1);
 		if (dvrfd < 0) {
 			fprintf(stderr, "Failed to open DVR device\n");
 			exit(1);
@@ -143,8 +274,8 @@ void gnutv_data_start(int _output_type,
 			}
 		}
 
-		// open dvr device
-		dvrfd = dvbdemux_open_dvr(adapter_id, 0, 1, 0);
+		// open dvr device; nonblocking, so a read returns what has arrived
+		dvrfd = dvbdemux_open_dvr(adapter_id, 0, 1, 1);
 		if (dvrfd < 0) {
 			fprintf(stderr, "Failed to open DVR device\n");
 			exit(1);
@@ -179,6 +310,8 @@ void gnutv_data_stop()
 		outputthread_shutdown = 1;
 		pthread_join(outputthread, NULL);
 	}
+	if (service_count > 1)
+		gnutv_data_split_stop();
 	gnutv_data_free_pid_fds();
 	if (pat_fd_dvrout != -1)
 		close(pat_fd_dvrout);
@@ -188,8 +321,27 @@ void gnutv_data_stop()
 		freeaddrinfo(outaddrs);
 }
 
-void gnutv_data_new_pat(int pmt_pid)
+void gnutv_data_get_stats(struct gnutv_data_stats *stats)
+{
+	*stats = data_stats;
+}
+
+void gnutv_data_set_pacing(int mode, int rate_kbps, int burst)
 {
+	pace_mode = mode;
+	pace_rate = rate_kbps * 1000.0 / 8;
+	if (burst > 0)
+		pace_burst = burst;
+}
+
+void gnutv_data_new_pat(int service, uint16_t transport_stream_id,
+			uint16_t program_number, int pmt_pid)
+{
+	if (service_count > 1) {
+		gnutv_data_split_new_pat(service, transport_stream_id, program_number, pmt_pid);
+		return;
+	}
+
 	// output PMT to DVR if requested
 	switch(output_type) {
 	case OUTPUT_TYPE_DVR:
@@ -202,8 +354,13 @@ void gnutv_data_new_pat(int pmt_pid)
 	}
 }
 
-int gnutv_data_new_pmt(struct mpeg_pmt_section *pmt)
+int gnutv_data_new_pmt(int service, struct mpeg_pmt_section *pmt)
 {
+	if (service_count > 1) {
+		gnutv_data_split_new_pmt(service, pmt);
+		return 1;
+	}
+
 	// close all old PID FDs
 	gnutv_data_free_pid_fds();
 
@@ -225,141 +382,1011 @@ int gnutv_data_new_pmt(struct mpeg_pmt_section *pmt)
 	return 1;
 }
 
+static int output_write(int fd, uint8_t *buf, int size)
+{
+	int written = 0;
+
+	while(written < size) {
+		int tmp = write(fd, buf + written, size - written);
+		data_stats.write_calls++;
+		if (tmp == -1) {
+			if (errno != EINTR) {
+				fprintf(stderr, "Write error: %m\n");
+				return -1;
+			}
+		} else {
+			written += tmp;
+		}
+	}
+	data_stats.written_bytes += written;
+
+	return 0;
+}
+
+static int elapsed_ms(struct timeval *since)
+{
+	struct timeval now;
+
+	gettimeofday(&now, NULL);
+	return ((now.tv_sec - since->tv_sec) * 1000) +
+		((now.tv_usec - since->tv_usec) / 1000);
+}
+
 static void *fileoutputthread_func(void* arg)
 {
 	(void)arg;
-	uint8_t buf[4096];
+	int threshold = batch_size * TS_PAYLOAD_SIZE;
+	int bufsize = threshold * 2;
+	uint8_t *buf;
+	int bufcount = 0;
+	struct timeval pending_since;
 	struct pollfd pollfd;
-	int written;
+
+	// data is accumulated and written out in large blocks; anything
+	// buffered for longer than OUTPUT_FLUSH_MS is written regardless so
+	// low bitrate streams are not held back.
+	if ((buf = malloc(bufsize)) == NULL) {
+		fprintf(stderr, "Out of memory allocating output buffer\n");
+		return 0;
+	}
 
 	pollfd.fd = dvrfd;
 	pollfd.events = POLLIN|POLLPRI|POLLERR;
 
 	while(!outputthread_shutdown) {
-		if (poll(&pollfd, 1, 1000) == -1) {
+		int timeout = 1000;
+
+		if (bufcount) {
+			timeout = OUTPUT_FLUSH_MS - elapsed_ms(&pending_since);
+			if (timeout < 0)
+				timeout = 0;
+		}
+
+		if (poll(&pollfd, 1, timeout) == -1) {
 			if (errno == EINTR)
 				continue;
 			fprintf(stderr, "DVR device poll failure\n");
-			return 0;
+			break;
+		}
+
+		if (pollfd.revents) {
+			int size = read(dvrfd, buf + bufcount, bufsize - bufcount);
+			data_stats.read_calls++;
+			if (size < 0) {
+				if (errno == EINTR)
+					continue;
+
+				// nothing more has arrived: write out what is buffered
+				if (errno == EAGAIN) {
+					if (bufcount && output_write(outfd, buf, bufcount))
+						break;
+					bufcount = 0;
+					continue;
+				}
+
+				if (errno == EOVERFLOW) {
+					// The error flag has been cleared, next read should succeed.
+					fprintf(stderr, "DVR overflow\n");
+					data_stats.dvr_overflows++;
+					continue;
+				}
+
+				fprintf(stderr, "DVR device read failure\n");
+				break;
+			}
+			data_stats.read_bytes += size;
+
+			if ((bufcount == 0) && (size > 0))
+				gettimeofday(&pending_since, NULL);
+			bufcount += size;
+		}
+
+		if ((bufcount >= threshold) ||
+		    (bufcount && (elapsed_ms(&pending_since) >= OUTPUT_FLUSH_MS))) {
+			if (output_write(outfd, buf, bufcount))
+				break;
+			bufcount = 0;
 		}
+	}
+
+	if (bufcount)
+		output_write(outfd, buf, bufcount);
+	free(buf);
+
+	return 0;
+}
+
+static double monotonic_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + (ts.tv_nsec / 1000000000.0);
+}
+
+static int64_t pcr_delta(uint64_t a, uint64_t b)
+{
+	int64_t diff = (int64_t) a - (int64_t) b;
+
+	// take the shorter way round the wrap
+	if (diff > (int64_t) (PCR_WRAP / 2))
+		diff -= PCR_WRAP;
+	else if (diff < -(int64_t) (PCR_WRAP / 2))
+		diff += PCR_WRAP;
+	return diff;
+}
+
+static void pcr_clock_init(struct pcr_clock *clock)
+{
+	memset(clock, 0, sizeof(struct pcr_clock));
+	clock->pid = -1;
+}
+
+/**
+ * Feed a packet at byte position pos of the output stream into the clock;
+ * only PCRs on the clock's PID are used.
+ */
+static void pcr_clock_packet(struct pcr_clock *clock, uint8_t *buf, uint64_t pos)
+{
+	struct transport_packet *pkt = (struct transport_packet *) buf;
+	struct transport_values values;
+	int64_t ticks;
+
+	if ((clock->pid < 0) || (transport_packet_pid(pkt) != clock->pid) ||
+	    !(pkt->adaptation_field_control & 2))
+		return;
+	if (transport_packet_values_extract(pkt, &values, transport_value_pcr) < 0)
+		return;
+	if (!(values.flags & transport_adaptation_flag_pcr))
+		return;
+
+	if (clock->valid && !(values.flags & transport_adaptation_flag_discontinuity)) {
+		ticks = pcr_delta(values.pcr, clock->pcr);
+
+		// more than a second between PCRs is a discontinuity
+		if ((ticks > 0) && (ticks < PCR_CLOCK) && (pos > clock->pos)) {
+			double rate = (double) ticks / (pos - clock->pos);
+			if (clock->ticks_per_byte > 0)
+				clock->ticks_per_byte = ((clock->ticks_per_byte * 7) + rate) / 8;
+			else
+				clock->ticks_per_byte = rate;
+		}
+	}
+
+	clock->pcr = values.pcr;
+	clock->pos = pos;
+	clock->valid = 1;
+}
 
-		if (pollfd.revents == 0)
+/**
+ * The 27MHz stream time at byte position pos, extrapolated from the last
+ * PCR at the measured rate.
+ */
+static uint64_t pcr_clock_at(struct pcr_clock *clock, uint64_t pos)
+{
+	int64_t bytes = (int64_t) (pos - clock->pos);
+
+	return (clock->pcr + PCR_WRAP + (int64_t) (bytes * clock->ticks_per_byte)) % PCR_WRAP;
+}
+
+static uint32_t rtp_timestamp(struct pcr_clock *clock, uint64_t pos)
+{
+	// 90kHz media clock: PCR base when we have one, otherwise wall time
+	if (clock->valid)
+		return pcr_clock_at(clock, pos) / 300;
+	return (uint32_t) (uint64_t) (monotonic_now() * 90000);
+}
+
+static void pacer_init(struct udp_pacer *pacer)
+{
+	pacer->mode = pace_mode;
+	pacer->burst = pace_burst;
+	pacer->rate = pace_rate;
+	pacer->locked = 0;
+	pacer->tokens = 0;
+	pacer->last = 0;
+	pacer->start = 0;
+	pacer->sent_bytes = 0;
+}
+
+static void pacer_sleep(double seconds)
+{
+	struct timespec ts;
+
+	ts.tv_sec = (time_t) seconds;
+	ts.tv_nsec = (long) ((seconds - ts.tv_sec) * 1000000000.0);
+	while(nanosleep(&ts, &ts) == -1 && errno == EINTR)
+		;
+}
+
+/**
+ * Wait until a group of datagrams starting at stream position pos and
+ * totalling bytes may leave.
+ */
+static void pacer_wait(struct udp_pacer *pacer, struct pcr_clock *clock, uint64_t pos, int bytes)
+{
+	double now = monotonic_now();
+	double delay = 0;
+
+	if (pacer->start == 0)
+		pacer->start = now;
+
+	switch(pacer->mode) {
+	case GNUTV_DATA_PACE_PCR: {
+		uint64_t pcr;
+
+		// no stream clock yet: pass data straight through
+		if (!clock->valid || (clock->ticks_per_byte <= 0))
+			break;
+
+		pcr = pcr_clock_at(clock, pos);
+		if (!pacer->locked) {
+			pacer->wall_base = now;
+			pacer->pcr_base = pcr;
+			pacer->locked = 1;
+		}
+		delay = pacer->wall_base +
+			((double) pcr_delta(pcr, pacer->pcr_base) / PCR_CLOCK) - now;
+
+		// too far ahead (stream discontinuity) or behind (DVR stall):
+		// relock to the current position rather than sleep or burst
+		if ((delay > PACE_MAX_AHEAD) || (delay < -PACE_MAX_LATE)) {
+			pacer->wall_base = now;
+			pacer->pcr_base = pcr;
+			data_stats.pacing_resyncs++;
+			delay = 0;
+		}
+		data_stats.target_bitrate = (uint64_t) ((PCR_CLOCK * 8) / clock->ticks_per_byte);
+		break;
+	}
+
+	case GNUTV_DATA_PACE_RATE: {
+		double max_tokens = (double) pacer->burst * TS_PAYLOAD_SIZE;
+
+		if (pacer->last == 0)
+			pacer->last = now;
+		pacer->tokens += (now - pacer->last) * pacer->rate;
+		if (pacer->tokens > max_tokens)
+			pacer->tokens = max_tokens;
+		pacer->last = now;
+
+		if (pacer->tokens < bytes)
+			delay = (bytes - pacer->tokens) / pacer->rate;
+		pacer->tokens -= bytes;
+		data_stats.target_bitrate = (uint64_t) (pacer->rate * 8);
+		break;
+	}
+	}
+
+	if (delay > 0)
+		pacer_sleep(delay);
+
+	pacer->sent_bytes += bytes;
+	now = monotonic_now();
+	if (now > pacer->start)
+		data_stats.achieved_bitrate = (uint64_t) ((pacer->sent_bytes * 8) / (now - pacer->start));
+}
+
+static void udp_rtp_header(uint8_t *hdr, uint16_t rtpseq, uint32_t timestamp)
+{
+	hdr[2] = rtpseq >> 8;
+	hdr[3] = rtpseq;
+	hdr[4] = timestamp >> 24;
+	hdr[5] = timestamp >> 16;
+	hdr[6] = timestamp >> 8;
+	hdr[7] = timestamp;
+}
+
+static int udp_send_gso(int fd, struct addrinfo *addrs, uint8_t *slots, int slotsize, int count)
+{
+	char control[CMSG_SPACE(sizeof(uint16_t))];
+	struct cmsghdr *cmsg;
+	struct msghdr msg;
+	struct iovec iov;
+
+	memset(&msg, 0, sizeof(msg));
+	memset(control, 0, sizeof(control));
+	iov.iov_base = slots;
+	iov.iov_len = slotsize * count;
+	msg.msg_name = addrs->ai_addr;
+	msg.msg_namelen = addrs->ai_addrlen;
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = control;
+	msg.msg_controllen = sizeof(control);
+
+	cmsg = CMSG_FIRSTHDR(&msg);
+	cmsg->cmsg_level = SOL_UDP;
+	cmsg->cmsg_type = UDP_SEGMENT;
+	cmsg->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+	*((uint16_t *) CMSG_DATA(cmsg)) = slotsize;
+
+	while(1) {
+		data_stats.write_calls++;
+		if (sendmsg(fd, &msg, 0) >= 0)
+			break;
+		if (errno == EINTR)
 			continue;
+		return -1;
+	}
 
-		int size = read(dvrfd, buf, sizeof(buf));
-		if (size < 0) {
+	data_stats.datagrams += count;
+	data_stats.written_bytes += slotsize * count;
+	return 0;
+}
+
+static int udp_send_batch(int fd, struct addrinfo *addrs,
+			  struct mmsghdr *msgs, struct iovec *iovs,
+			  uint8_t *slots, int slotsize, int count)
+{
+	int i;
+	int done = 0;
+
+	for(i=0; i < count; i++) {
+		iovs[i].iov_base = slots + (i * slotsize);
+		iovs[i].iov_len = slotsize;
+		memset(&msgs[i], 0, sizeof(struct mmsghdr));
+		msgs[i].msg_hdr.msg_name = addrs->ai_addr;
+		msgs[i].msg_hdr.msg_namelen = addrs->ai_addrlen;
+		msgs[i].msg_hdr.msg_iov = &iovs[i];
+		msgs[i].msg_hdr.msg_iovlen = 1;
+	}
+
+	while(done < count) {
+		int tmp = sendmmsg(fd, msgs + done, count - done, 0);
+		data_stats.write_calls++;
+		if (tmp < 0) {
 			if (errno == EINTR)
 				continue;
-
-			if (errno == EOVERFLOW) {
-				// The error flag has been cleared, next read should succeed.
-				fprintf(stderr, "DVR overflow\n");
+			if ((errno == ENOBUFS) || (errno == EAGAIN) || (errno == ECONNREFUSED)) {
+				// transient; drop the datagram which failed and carry on
+				data_stats.dropped_datagrams++;
+				done++;
 				continue;
 			}
-
-			fprintf(stderr, "DVR device read failure\n");
-			return 0;
+			fprintf(stderr, "Socket send failure: %m\n");
+			return -1;
 		}
+		done += tmp;
+		data_stats.datagrams += tmp;
+		data_stats.written_bytes += tmp * slotsize;
+	}
 
-		written = 0;
-		while(written < size) {
-			int tmp = write(outfd, buf + written, size - written);
-			if (tmp == -1) {
-				if (errno != EINTR) {
-					fprintf(stderr, "Write error: %m\n");
-					break;
+	return 0;
+}
+
+static int udp_send_slots(int fd, struct addrinfo *addrs,
+			  struct mmsghdr *msgs, struct iovec *iovs,
+			  uint8_t *slots, int slotsize, int count, int *gso_max)
+{
+	while(count) {
+		int n = count;
+
+		if (*gso_max) {
+			if (n > *gso_max)
+				n = *gso_max;
+			if (udp_send_gso(fd, addrs, slots, slotsize, n)) {
+				if ((errno == EIO) || (errno == EINVAL) ||
+				    (errno == EOPNOTSUPP) || (errno == ENOPROTOOPT)) {
+					fprintf(stderr, "UDP GSO unavailable, using sendmmsg\n");
+					*gso_max = 0;
+					continue;
+				}
+				if ((errno == ENOBUFS) || (errno == EAGAIN) || (errno == ECONNREFUSED)) {
+					data_stats.dropped_datagrams += n;
+				} else {
+					fprintf(stderr, "Socket send failure: %m\n");
+					return -1;
 				}
-			} else {
-				written += tmp;
 			}
+		} else if (udp_send_batch(fd, addrs, msgs, iovs, slots, slotsize, n)) {
+			return -1;
 		}
+
+		slots += n * slotsize;
+		count -= n;
 	}
 
 	return 0;
 }
 
-#define TS_PAYLOAD_SIZE (188*7)
+static uint16_t udp_rtp_init(uint8_t *slots, int nslots, int slotsize)
+{
+	int ssrc = random();
+	int i;
+
+	for(i=0; i < nslots; i++) {
+		uint8_t *buf = slots + (i * slotsize);
+		memset(buf, 0, 12);
+		buf[0x0] = 0x80;
+		buf[0x1] = 0x21;
+		buf[0x8] = ssrc >> 24;
+		buf[0x9] = ssrc >> 16;
+		buf[0xa] = ssrc >> 8;
+		buf[0xb] = ssrc;
+	}
+
+	return random();
+}
+
+static int udp_gso_max(int slotsize)
+{
+	int gso_max = 0;
+
+	if (usegso) {
+		gso_max = UDP_GSO_MAX_BYTES / slotsize;
+		if (gso_max > batch_size)
+			gso_max = batch_size;
+	}
+	return gso_max;
+}
 
 static void *udpoutputthread_func(void* arg)
 {
 	(void)arg;
-	uint8_t buf[12 + TS_PAYLOAD_SIZE];
+	int hdrsize = usertp ? 12 : 0;
+	int slotsize = hdrsize + TS_PAYLOAD_SIZE;
+	int nslots = batch_size * UDP_RING_BATCHES;
+	int gso_max = 0;
+	uint8_t *ring;
+	struct iovec *iovs;
+	struct mmsghdr *msgs;
 	struct pollfd pollfd;
-	int bufsize = 0;
-	int bufbase = 0;
-	int readsize;
+	int fill_slot = 0;
+	int fill_off = 0;
+	int send_slot = 0;
+	uint64_t send_pos = 0;
 	uint16_t rtpseq = 0;
+	struct pcr_clock clock;
+	struct udp_pacer pacer;
+	int i, j;
+
+	pcr_clock_init(&clock);
+	pacer_init(&pacer);
+
+	// The ring is an array of datagram slots, each laid out as
+	// [rtp header] [7 TS packets]. DVR data is scattered straight into the
+	// slot payloads with readv(), and completed slots are sent in one
+	// sendmmsg() call (or one GSO send, as slots are contiguous).
+	ring = malloc(nslots * slotsize);
+	iovs = malloc(batch_size * sizeof(struct iovec));
+	msgs = malloc(batch_size * sizeof(struct mmsghdr));
+	if ((ring == NULL) || (iovs == NULL) || (msgs == NULL)) {
+		fprintf(stderr, "Out of memory allocating output buffer\n");
+		goto exit;
+	}
+
+	gso_max = udp_gso_max(slotsize);
 
 	pollfd.fd = dvrfd;
 	pollfd.events = POLLIN|POLLPRI|POLLERR;
 
-	if (usertp) {
-		srandom(time(NULL));
-		int ssrc = random();
-		rtpseq = random();
-		buf[0x0] = 0x80;
-		buf[0x1] = 0x21;
-		buf[0x4] = 0x00; // }
-		buf[0x5] = 0x00; // } FIXME: should really be a valid stamp
-		buf[0x6] = 0x00; // }
-		buf[0x7] = 0x00; // }
-		buf[0x8] = ssrc >> 24;
-		buf[0x9] = ssrc >> 16;
-		buf[0xa] = ssrc >> 8;
-		buf[0xb] = ssrc;
-		bufbase = 12;
-	}
+	if (usertp)
+		rtpseq = udp_rtp_init(ring, nslots, slotsize);
 
 	while(!outputthread_shutdown) {
+		int iovcnt;
+		int readsize;
+		int count;
+
 		if (poll(&pollfd, 1, 1000) != 1)
 			continue;
 		if (pollfd.revents & POLLERR) {
 			if (errno == EINTR)
 				continue;
 			fprintf(stderr, "DVR device read failure\n");
-			return 0;
+			goto exit;
 		}
 
-		readsize = TS_PAYLOAD_SIZE - bufsize;
-		readsize = read(dvrfd, buf + bufbase + bufsize, readsize);
+		// scatter the read across the free slots up to the end of the ring
+		iovcnt = nslots - fill_slot;
+		if (iovcnt > batch_size)
+			iovcnt = batch_size;
+		for(i=0; i < iovcnt; i++) {
+			iovs[i].iov_base = ring + ((fill_slot + i) * slotsize) + hdrsize;
+			iovs[i].iov_len = TS_PAYLOAD_SIZE;
+		}
+		iovs[0].iov_base = (uint8_t *) iovs[0].iov_base + fill_off;
+		iovs[0].iov_len -= fill_off;
+
+		readsize = readv(dvrfd, iovs, iovcnt);
+		data_stats.read_calls++;
 		if (readsize < 0) {
-			if (errno == EINTR)
+			// completed slots have been sent; a partial one waits for more
+			if ((errno == EINTR) || (errno == EAGAIN))
+				continue;
+			if (errno == EOVERFLOW) {
+				data_stats.dvr_overflows++;
 				continue;
+			}
 			fprintf(stderr, "DVR device read failure\n");
-			return 0;
+			goto exit;
 		}
-		bufsize += readsize;
+		data_stats.read_bytes += readsize;
+
+		fill_off += readsize;
+		fill_slot += fill_off / TS_PAYLOAD_SIZE;
+		fill_off %= TS_PAYLOAD_SIZE;
 
-		if (bufsize == TS_PAYLOAD_SIZE) {
-			if (usertp) {
-				buf[2] = rtpseq >> 8;
-				buf[3] = rtpseq;
+		// follow the service's PCRs for timestamps and pacing
+		count = fill_slot - send_slot;
+		if (clock.pid != pcr_pid) {
+			pcr_clock_init(&clock);
+			clock.pid = pcr_pid;
+		}
+		if (usertp || (pacer.mode == GNUTV_DATA_PACE_PCR)) {
+			for(i=0; i < count; i++) {
+				uint8_t *payload = ring + ((send_slot + i) * slotsize) + hdrsize;
+				for(j=0; j < TS_PAYLOAD_SIZE; j+=TRANSPORT_PACKET_LENGTH)
+					pcr_clock_packet(&clock, payload + j,
+							 send_pos + (i * TS_PAYLOAD_SIZE) + j);
 			}
-			if (sendto(outfd, buf, bufbase + bufsize, 0, outaddrs->ai_addr, outaddrs->ai_addrlen) < 0) {
-				if (errno != EINTR) {
-					fprintf(stderr, "Socket send failure: %m\n");
-					return 0;
-				}
+		}
+		if (usertp) {
+			for(i=0; i < count; i++)
+				udp_rtp_header(ring + ((send_slot + i) * slotsize), rtpseq++,
+					       rtp_timestamp(&clock, send_pos + (i * TS_PAYLOAD_SIZE)));
+		}
+
+		// send every completed slot, in paced bursts if requested
+		while(count) {
+			int n = count;
+
+			if (pacer.mode != GNUTV_DATA_PACE_NONE) {
+				if (n > pacer.burst)
+					n = pacer.burst;
+				pacer_wait(&pacer, &clock, send_pos, n * slotsize);
 			}
-			rtpseq++;
-			bufsize = 0;
+			if (udp_send_slots(outfd, outaddrs, msgs, iovs,
+					   ring + (send_slot * slotsize), slotsize, n, &gso_max))
+				goto exit;
+			send_slot += n;
+			send_pos += n * TS_PAYLOAD_SIZE;
+			count -= n;
 		}
-	}
 
-	if (bufsize) {
-		if (usertp) {
-			buf[2] = rtpseq >> 8;
-			buf[3] = rtpseq;
+		if (fill_slot == nslots) {
+			fill_slot = 0;
+			send_slot = 0;
 		}
-		if (sendto(outfd, buf, bufbase + bufsize, 0, outaddrs->ai_addr, outaddrs->ai_addrlen) < 0) {
+	}
+
+	// send any final partial datagram
+	if (fill_off) {
+		uint8_t *buf = ring + (fill_slot * slotsize);
+		if (usertp)
+			udp_rtp_header(buf, rtpseq, rtp_timestamp(&clock, send_pos));
+		if (sendto(outfd, buf, hdrsize + fill_off, 0, outaddrs->ai_addr, outaddrs->ai_addrlen) < 0) {
 			if (errno != EINTR)
 				fprintf(stderr, "Socket send failure: %m\n");
+		} else {
+			data_stats.datagrams++;
+			data_stats.written_bytes += hdrsize + fill_off;
+		}
+		data_stats.write_calls++;
+	}
+
+exit:
+	free(ring);
+	free(iovs);
+	free(msgs);
+	return 0;
+}
+
+static int sink_open(struct data_sink *sink, struct gnutv_data_output *output)
+{
+	sink->output_type = output->output_type;
+	sink->addrs = output->outaddrs;
+	sink->usertp = output->usertp;
+	sink->hdrsize = sink->usertp ? 12 : 0;
+	sink->slotsize = sink->hdrsize + TS_PAYLOAD_SIZE;
+	sink->bufcount = 0;
+	sink->stream_pos = 0;
+	pcr_clock_init(&sink->clock);
+
+	switch(sink->output_type) {
+	case OUTPUT_TYPE_FILE:
+		sink->fd = open(output->outfile, O_WRONLY|O_CREAT|O_LARGEFILE|O_TRUNC, 0644);
+		if (sink->fd < 0) {
+			fprintf(stderr, "Failed to open output file %s\n", output->outfile);
+			return -1;
+		}
+		break;
+
+	case OUTPUT_TYPE_STDOUT:
+		sink->fd = STDOUT_FILENO;
+		break;
+
+	case OUTPUT_TYPE_UDP:
+		sink->fd = socket(sink->addrs->ai_family, sink->addrs->ai_socktype, sink->addrs->ai_protocol);
+		if (sink->fd < 0) {
+			fprintf(stderr, "Failed to open output socket\n");
+			return -1;
+		}
+		if (output->outif != NULL) {
+			if (setsockopt(sink->fd, SOL_SOCKET, SO_BINDTODEVICE, output->outif, strlen(output->outif)) < 0) {
+				fprintf(stderr, "Failed to bind to interface %s\n", output->outif);
+				return -1;
+			}
+		}
+		sink->gso_max = udp_gso_max(sink->slotsize);
+		break;
+
+	default:
+		fprintf(stderr, "Unsupported output type for multi-service recording\n");
+		return -1;
+	}
+
+	// files buffer up to two batches; UDP holds one batch of datagram slots
+	if (sink->output_type == OUTPUT_TYPE_UDP) {
+		sink->buf = malloc(batch_size * sink->slotsize);
+		sink->iovs = malloc(batch_size * sizeof(struct iovec));
+		sink->msgs = malloc(batch_size * sizeof(struct mmsghdr));
+		if ((sink->buf == NULL) || (sink->iovs == NULL) || (sink->msgs == NULL))
+			return -1;
+		if (sink->usertp)
+			sink->rtpseq = udp_rtp_init(sink->buf, batch_size, sink->slotsize);
+	} else {
+		sink->buf = malloc(batch_size * TS_PAYLOAD_SIZE * 2);
+		if (sink->buf == NULL)
+			return -1;
+	}
+
+	return 0;
+}
+
+static void sink_close(struct data_sink *sink)
+{
+	if ((sink->fd >= 0) && (sink->fd != STDOUT_FILENO))
+		close(sink->fd);
+	free(sink->buf);
+	free(sink->iovs);
+	free(sink->msgs);
+	memset(sink, 0, sizeof(struct data_sink));
+	sink->fd = -1;
+}
+
+static int sink_flush(struct data_sink *sink, int final)
+{
+	int complete;
+	int remainder;
+	int i;
+
+	if (sink->bufcount == 0)
+		return 0;
+
+	if (sink->output_type != OUTPUT_TYPE_UDP) {
+		if (!final &&
+		    (sink->bufcount < batch_size * TS_PAYLOAD_SIZE) &&
+		    (elapsed_ms(&sink->pending_since) < OUTPUT_FLUSH_MS))
+			return 0;
+		if (output_write(sink->fd, sink->buf, sink->bufcount))
+			return -1;
+		sink->bufcount = 0;
+		return 0;
+	}
+
+	// send the completed datagrams, keeping a partial one for later
+	complete = sink->bufcount / TS_PAYLOAD_SIZE;
+	remainder = sink->bufcount % TS_PAYLOAD_SIZE;
+	if (sink->usertp) {
+		uint64_t pos = sink->stream_pos - sink->bufcount;
+		for(i=0; i < complete; i++)
+			udp_rtp_header(sink->buf + (i * sink->slotsize), sink->rtpseq++,
+				       rtp_timestamp(&sink->clock, pos + (i * TS_PAYLOAD_SIZE)));
+	}
+	if (complete) {
+		if (udp_send_slots(sink->fd, sink->addrs, sink->msgs, sink->iovs,
+				   sink->buf, sink->slotsize, complete, &sink->gso_max))
+			return -1;
+		memmove(sink->buf + sink->hdrsize,
+			sink->buf + (complete * sink->slotsize) + sink->hdrsize,
+			remainder);
+	}
+	sink->bufcount = remainder;
+
+	if (final && remainder) {
+		if (sink->usertp)
+			udp_rtp_header(sink->buf, sink->rtpseq++,
+				       rtp_timestamp(&sink->clock, sink->stream_pos - remainder));
+		data_stats.write_calls++;
+		if (sendto(sink->fd, sink->buf, sink->hdrsize + remainder, 0,
+			   sink->addrs->ai_addr, sink->addrs->ai_addrlen) < 0) {
+			fprintf(stderr, "Socket send failure: %m\n");
+			return -1;
+		}
+		data_stats.datagrams++;
+		data_stats.written_bytes += sink->hdrsize + remainder;
+		sink->bufcount = 0;
+	}
+
+	return 0;
+}
+
+static void sink_put(struct data_sink *sink, uint8_t *pkt)
+{
+	uint8_t *dest;
+
+	if (sink->output_type == OUTPUT_TYPE_UDP) {
+		int slot = sink->bufcount / TS_PAYLOAD_SIZE;
+		dest = sink->buf + (slot * sink->slotsize) + sink->hdrsize +
+			(sink->bufcount % TS_PAYLOAD_SIZE);
+	} else {
+		dest = sink->buf + sink->bufcount;
+	}
+	if (sink->bufcount == 0)
+		gettimeofday(&sink->pending_since, NULL);
+
+	memcpy(dest, pkt, TRANSPORT_PACKET_LENGTH);
+	if (sink->usertp)
+		pcr_clock_packet(&sink->clock, pkt, sink->stream_pos);
+	sink->bufcount += TRANSPORT_PACKET_LENGTH;
+	sink->stream_pos += TRANSPORT_PACKET_LENGTH;
+
+	// a full batch is written out straight away
+	if (sink->bufcount == batch_size * TS_PAYLOAD_SIZE)
+		sink_flush(sink, 1);
+}
+
+static void split_build_pat(struct data_service *service, uint16_t transport_stream_id)
+{
+	uint8_t *pkt = service->pat;
+	uint8_t *sec = pkt + 5;
+	uint32_t crc;
+
+	service->pat_version = (service->pat_version + 1) & 0x1f;
+
+	// one packet, one section, one program
+	memset(pkt, 0xff, TRANSPORT_PACKET_LENGTH);
+	pkt[0] = TRANSPORT_PACKET_SYNC;
+	pkt[1] = 0x40 | (TRANSPORT_PAT_PID >> 8);
+	pkt[2] = TRANSPORT_PAT_PID & 0xff;
+	pkt[3] = 0x10;
+	pkt[4] = 0;
+
+	sec[0] = stag_mpeg_program_association;
+	sec[1] = 0xb0;
+	sec[2] = 13;
+	sec[3] = transport_stream_id >> 8;
+	sec[4] = transport_stream_id;
+	sec[5] = 0xc1 | (service->pat_version << 1);
+	sec[6] = 0;
+	sec[7] = 0;
+	sec[8] = service->program_number >> 8;
+	sec[9] = service->program_number;
+	sec[10] = 0xe0 | (service->pmt_pid >> 8);
+	sec[11] = service->pmt_pid;
+	crc = crc32(CRC32_INIT, sec, 12);
+	sec[12] = crc >> 24;
+	sec[13] = crc >> 16;
+	sec[14] = crc >> 8;
+	sec[15] = crc;
+
+	service->pat_valid = 1;
+}
+
+static void split_update_filters(void)
+{
+	int pid;
+
+	// one kernel filter per PID, however many services share it
+	for(pid=0; pid < TRANSPORT_MAX_PIDS; pid++) {
+		if (pid == TRANSPORT_PAT_PID)
+			continue;
+
+		if (split_pids[pid] && (split_pid_fd[pid] < 0)) {
+			split_pid_fd[pid] = gnutv_data_create_dvr_filter(adapter_id, demux_id, pid);
+			if (split_pid_fd[pid] < 0)
+				fprintf(stderr, "Unable to create dvr filter for PID %i\n", pid);
+		} else if (!split_pids[pid] && (split_pid_fd[pid] >= 0)) {
+			close(split_pid_fd[pid]);
+			split_pid_fd[pid] = -1;
+		}
+	}
+}
+
+static void split_packet(uint8_t *pkt)
+{
+	int pid = ((pkt[1] & 0x1f) << 8) | pkt[2];
+	uint32_t mask;
+	int i;
+
+	// each output gets its own single-program PAT, sent whenever the
+	// original one starts
+	if (pid == TRANSPORT_PAT_PID) {
+		if (!(pkt[1] & 0x40))
+			return;
+		for(i=0; i < service_count; i++) {
+			struct data_service *service = &services[i];
+			if (!service->pat_valid)
+				continue;
+			service->pat[3] = 0x10 | (service->pat_cc++ & 0x0f);
+			sink_put(&service->sink, service->pat);
 		}
+		return;
 	}
 
+	mask = split_pids[pid];
+	while(mask) {
+		i = __builtin_ctz(mask);
+		mask &= mask - 1;
+		sink_put(&services[i].sink, pkt);
+	}
+}
+
+static void *splitoutputthread_func(void* arg)
+{
+	(void)arg;
+	int bufsize = batch_size * TS_PAYLOAD_SIZE;
+	uint8_t *buf;
+	int bufcount = 0;
+	struct pollfd pollfd;
+	int i;
+
+	if ((buf = malloc(bufsize)) == NULL) {
+		fprintf(stderr, "Out of memory allocating output buffer\n");
+		return 0;
+	}
+
+	pollfd.fd = dvrfd;
+	pollfd.events = POLLIN|POLLPRI|POLLERR;
+
+	while(!outputthread_shutdown) {
+		int pos = 0;
+
+		if (poll(&pollfd, 1, OUTPUT_FLUSH_MS) == -1) {
+			if (errno == EINTR)
+				continue;
+			fprintf(stderr, "DVR device poll failure\n");
+			break;
+		}
+
+		if (pollfd.revents) {
+			int size = read(dvrfd, buf + bufcount, bufsize - bufcount);
+			data_stats.read_calls++;
+			if (size < 0) {
+				if (errno == EINTR)
+					continue;
+
+				if (errno == EOVERFLOW) {
+					fprintf(stderr, "DVR overflow\n");
+					data_stats.dvr_overflows++;
+					continue;
+				}
+
+				// nothing more has arrived: flush the services below
+				if (errno != EAGAIN) {
+					fprintf(stderr, "DVR device read failure\n");
+					break;
+				}
+				size = 0;
+			}
+			data_stats.read_bytes += size;
+			bufcount += size;
+		}
+
+		pthread_mutex_lock(&split_lock);
+		while((bufcount - pos) >= TRANSPORT_PACKET_LENGTH) {
+			if (buf[pos] != TRANSPORT_PACKET_SYNC) {
+				pos++;
+				continue;
+			}
+			split_packet(buf + pos);
+			pos += TRANSPORT_PACKET_LENGTH;
+		}
+		pthread_mutex_unlock(&split_lock);
+
+		// keep any partial packet for the next read
+		memmove(buf, buf + pos, bufcount - pos);
+		bufcount -= pos;
+
+		for(i=0; i < service_count; i++)
+			sink_flush(&services[i].sink, 0);
+	}
+
+	for(i=0; i < service_count; i++)
+		sink_flush(&services[i].sink, 1);
+	free(buf);
+
 	return 0;
 }
 
+static void gnutv_data_split_start(struct gnutv_data_output *primary, int buffer_size)
+{
+	int i;
+
+	// the primary channel's output becomes service 0
+	if (sink_open(&services[0].sink, primary)) {
+		exit(1);
+	}
+	for(i=0; i < service_count; i++) {
+		services[i].pmt_pid = -1;
+		if ((i > 0) && sink_open(&services[i].sink, &service_outputs[i]))
+			exit(1);
+	}
+
+	memset(split_pids, 0, sizeof(split_pids));
+	for(i=0; i < TRANSPORT_MAX_PIDS; i++)
+		split_pid_fd[i] = -1;
+
+	// one DVR stream carries every service; nonblocking, as a blocking
+	// read would hold back the OUTPUT_FLUSH_MS flushes until it filled
+	dvrfd = dvbdemux_open_dvr(adapter_id, 0, 1, 1);
+	if (dvrfd < 0) {
+		fprintf(stderr, "Failed to open DVR device\n");
+		exit(1);
+	}
+	if (buffer_size > 0) {
+		if (dvbdemux_set_buffer(dvrfd, buffer_size) != 0) {
+			fprintf(stderr, "Failed to set DVR buffer size\n");
+			exit(1);
+		}
+	}
+
+	pthread_create(&outputthread, NULL, splitoutputthread_func, NULL);
+	pat_fd_dvrout = gnutv_data_create_dvr_filter(adapter_id, demux_id, TRANSPORT_PAT_PID);
+}
+
+static void gnutv_data_split_stop(void)
+{
+	int i;
+
+	for(i=0; i < TRANSPORT_MAX_PIDS; i++) {
+		if (split_pid_fd[i] >= 0)
+			close(split_pid_fd[i]);
+		split_pid_fd[i] = -1;
+	}
+	for(i=0; i < service_count; i++) {
+		sink_close(&services[i].sink);
+		if ((i > 0) && service_outputs[i].outaddrs)
+			freeaddrinfo(service_outputs[i].outaddrs);
+	}
+}
+
+static void gnutv_data_split_new_pat(int service, uint16_t transport_stream_id,
+				     uint16_t program_number, int pmt_pid)
+{
+	struct data_service *svc = &services[service];
+	uint32_t bit = 1U << service;
+
+	pthread_mutex_lock(&split_lock);
+	if (svc->pmt_pid != -1)
+		split_pids[svc->pmt_pid] &= ~bit;
+	svc->pmt_pid = pmt_pid;
+	svc->program_number = program_number;
+	split_pids[pmt_pid] |= bit;
+	split_build_pat(svc, transport_stream_id);
+	pthread_mutex_unlock(&split_lock);
+
+	split_update_filters();
+}
+
+static void gnutv_data_split_new_pmt(int service, struct mpeg_pmt_section *pmt)
+{
+	struct data_service *svc = &services[service];
+	struct mpeg_pmt_stream *cur_stream;
+	uint32_t bit = 1U << service;
+	int pid;
+
+	pthread_mutex_lock(&split_lock);
+	for(pid=0; pid < TRANSPORT_MAX_PIDS; pid++) {
+		if (pid != svc->pmt_pid)
+			split_pids[pid] &= ~bit;
+	}
+	if (pmt->pcr_pid != TRANSPORT_NULL_PID)
+		split_pids[pmt->pcr_pid] |= bit;
+	if (svc->sink.clock.pid != pmt->pcr_pid) {
+		pcr_clock_init(&svc->sink.clock);
+		svc->sink.clock.pid = pmt->pcr_pid;
+	}
+	mpeg_pmt_section_streams_for_each(pmt, cur_stream) {
+		split_pids[cur_stream->pid] |= bit;
+	}
+	pthread_mutex_unlock(&split_lock);
+
+	split_update_filters();
+}
+
 static int gnutv_data_create_decoder_filter(int adapter, int demux, uint16_t pid, int pestype)
 {
 	int demux_fd = -1;
@@ -443,6 +1470,8 @@ static void gnutv_data_decoder_pmt(struct mpeg_pmt_section *pmt)
 
 static void gnutv_data_dvr_pmt(struct mpeg_pmt_section *pmt)
 {
+	pcr_pid = pmt->pcr_pid;
+
 	struct mpeg_pmt_stream *cur_stream;
 	mpeg_pmt_section_streams_for_each(pmt, cur_stream) {
 		int fd = gnutv_data_create_dvr_filter(adapter_id, demux_id, cur_stream->pid);
@@ -23,16 +23,91 @@
 #ifndef gnutv_DATA_H
 #define gnutv_DATA_H 1
 
+#include <stdint.h>
 #include <netdb.h>
 
+/**
+ * Default number of 7-packet blocks handled per output syscall.
+ */
+#define GNUTV_DATA_DEFAULT_BATCH 64
+
+/**
+ * UDP/RTP output pacing modes.
+ */
+#define GNUTV_DATA_PACE_NONE 0		/* send as the DVR delivers */
+#define GNUTV_DATA_PACE_PCR 1		/* follow the service's PCR clock */
+#define GNUTV_DATA_PACE_RATE 2		/* token bucket at a fixed rate */
+
+/**
+ * Default number of datagrams a paced output may send back to back.
+ */
+#define GNUTV_DATA_DEFAULT_BURST 4
+
+/**
+ * Output counters, maintained by the output thread.
+ */
+struct gnutv_data_stats {
+	uint64_t read_calls;
+	uint64_t read_bytes;
+	uint64_t write_calls;		/* write(), writev(), sendmsg() and sendmmsg() calls */
+	uint64_t written_bytes;
+	uint64_t datagrams;
+	uint64_t dropped_datagrams;	/* UDP datagrams the kernel refused */
+	uint64_t dvr_overflows;		/* DVR buffer overflows (data lost upstream) */
+	uint64_t target_bitrate;	/* paced output: bits/s wanted */
+	uint64_t achieved_bitrate;	/* paced output: bits/s actually sent */
+	uint64_t pacing_resyncs;	/* PCR pacing relocked after a jump or stall */
+};
+
+/**
+ * Output for an additional service recorded from the same multiplex.
+ * output_type is one of OUTPUT_TYPE_FILE, OUTPUT_TYPE_STDOUT or
+ * OUTPUT_TYPE_UDP.
+ */
+struct gnutv_data_output {
+	int output_type;
+	char *outfile;
+	char *outif;
+	struct addrinfo *outaddrs;
+	int usertp;
+};
+
+/**
+ * Register an additional service to record; must be called before
+ * gnutv_data_start(). The primary channel is always service 0. When any
+ * are registered, a single DVR stream is split in user space with each
+ * output receiving its own single-program PAT.
+ *
+ * @return The service index, or -1 if too many services were added.
+ */
+extern int gnutv_data_add_service(struct gnutv_data_output *output);
+
 extern void gnutv_data_start(int output_type,
 			   int ffaudiofd, int adapter_id, int demux_id, int buffer_size,
 			   char *outfile,
-			   char* outif, struct addrinfo *outaddrs, int usertp);
+			   char* outif, struct addrinfo *outaddrs, int usertp,
+			   int batch_size, int usegso);
 extern void gnutv_data_stop(void);
 
-extern void gnutv_data_new_pat(int pmt_pid);
-extern int gnutv_data_new_pmt(struct mpeg_pmt_section *pmt);
+/**
+ * Configure UDP/RTP output pacing; must be called before gnutv_data_start().
+ * Pacing applies to the single-service output.
+ *
+ * @param mode One of GNUTV_DATA_PACE_*.
+ * @param rate_kbps Rate for GNUTV_DATA_PACE_RATE, in kbit/s.
+ * @param burst Maximum datagrams sent back to back; <= 0 for the default.
+ */
+extern void gnutv_data_set_pacing(int mode, int rate_kbps, int burst);
+
+/**
+ * Retrieve the output counters. Only stable once gnutv_data_stop() has
+ * returned.
+ */
+extern void gnutv_data_get_stats(struct gnutv_data_stats *stats);
+
+extern void gnutv_data_new_pat(int service, uint16_t transport_stream_id,
+			       uint16_t program_number, int pmt_pid);
+extern int gnutv_data_new_pmt(int service, struct mpeg_pmt_section *pmt);
 
 
 
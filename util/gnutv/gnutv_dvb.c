@@ -30,6 +30,7 @@
 #include <sys/poll.h>
 #include <libdvbapi/dvbdemux.h>
 #include <libucsi/section.h>
+#include <libucsi/psi_table.h>
 #include <libucsi/mpeg/section.h>
 #include <libucsi/dvb/section.h>
 #include "gnutv.h"
@@ -43,15 +44,26 @@ static int dvbthread_shutdown = 0;
 static pthread_t dvbthread;
 static int tune_state = 0;
 
-static int pat_version = -1;
-static int ca_pmt_version = -1;
-static int data_pmt_version = -1;
+static int ca_pmt_version[GNUTV_MAX_SERVICES];
+static int data_pmt_version[GNUTV_MAX_SERVICES];
+static int pmt_pid[GNUTV_MAX_SERVICES];
+
+// complete PAT/PMT versions are handed to process_table() by the collector
+static struct psi_table_collector *psi_tables;
+
+struct table_context {
+	struct gnutv_dvb_params *params;
+	int *pmt_fd;
+	struct pollfd *pollfd;
+};
 
 static void *dvbthread_func(void* arg);
 
-static void process_pat(int pat_fd, struct gnutv_dvb_params *params, int *pmt_fd, struct pollfd *pollfd);
+static void read_section(int fd, int pid);
+static void process_table(void *arg, struct psi_table *table);
+static void process_pat(struct psi_table *table, struct gnutv_dvb_params *params, int *pmt_fd, struct pollfd *pollfd);
 static void process_tdt(int tdt_fd);
-static void process_pmt(int pmt_fd, struct gnutv_dvb_params *params);
+static void process_pmt(struct psi_table *table, int service);
 static int create_section_filter(int adapter, int demux, uint16_t pid, uint8_t table_id);
 
 
@@ -75,13 +87,28 @@ int gnutv_dvb_locked(void)
 static void *dvbthread_func(void* arg)
 {
 	int pat_fd = -1;
-	int pmt_fd = -1;
+	int pmt_fd[GNUTV_MAX_SERVICES];
 	int tdt_fd = -1;
-	struct pollfd pollfds[3];
+	struct pollfd pollfds[2 + GNUTV_MAX_SERVICES];
+	struct table_context context;
+	int i;
 
 	struct gnutv_dvb_params *params = (struct gnutv_dvb_params *) arg;
 
+	// the demux checks the CRCs for us
+	context.params = params;
+	context.pmt_fd = pmt_fd;
+	context.pollfd = &pollfds[2];
+	if ((psi_tables = psi_table_collector_create(0, process_table, &context)) == NULL) {
+		fprintf(stderr, "Failed to create PSI table collector\n");
+		exit(1);
+	}
+
 	tune_state = 0;
+	if (params->service_count < 1) {
+		params->service_ids[0] = params->channel.service_id;
+		params->service_count = 1;
+	}
 
 	// create PAT filter
 	if ((pat_fd = create_section_filter(params->adapter_id, params->demux_id,
@@ -100,9 +127,15 @@ static void *dvbthread_func(void* arg)
 	pollfds[1].fd = tdt_fd;
 	pollfds[1].events = POLLIN|POLLPRI|POLLERR;
 
-	// zero PMT filter
-	pollfds[2].fd = 0;
-	pollfds[2].events = 0;
+	// zero PMT filters
+	for(i=0; i < params->service_count; i++) {
+		pmt_fd[i] = -1;
+		pmt_pid[i] = -1;
+		data_pmt_version[i] = -1;
+		ca_pmt_version[i] = -1;
+		pollfds[2 + i].fd = 0;
+		pollfds[2 + i].events = 0;
+	}
 
 	// the DVB loop
 	while(!dvbthread_shutdown) {
@@ -181,7 +214,7 @@ static void *dvbthread_func(void* arg)
 		}
 
 		// is there SI data?
-		int count = poll(pollfds, 3, 100);
+		int count = poll(pollfds, 2 + params->service_count, 100);
 		if (count < 0) {
 			if (errno != EINTR)
 				fprintf(stderr, "Poll error: %m\n");
@@ -193,7 +226,7 @@ static void *dvbthread_func(void* arg)
 
 		// PAT
 		if (pollfds[0].revents & (POLLIN|POLLPRI)) {
-			process_pat(pat_fd, params, &pmt_fd, &pollfds[2]);
+			read_section(pat_fd, TRANSPORT_PAT_PID);
 		}
 
 		// TDT
@@ -201,81 +234,124 @@ static void *dvbthread_func(void* arg)
 			process_tdt(tdt_fd);
 		}
 
-		//  PMT
-		if (pollfds[2].revents & (POLLIN|POLLPRI)) {
-			process_pmt(pmt_fd, params);
+		//  PMTs
+		for(i=0; i < params->service_count; i++) {
+			if (pollfds[2 + i].revents & (POLLIN|POLLPRI)) {
+				read_section(pmt_fd[i], pmt_pid[i]);
+			}
 		}
 	}
 
 	// close demuxers
 	if (pat_fd != -1)
 		close(pat_fd);
-	if (pmt_fd != -1)
-		close(pmt_fd);
+	for(i=0; i < params->service_count; i++) {
+		if (pmt_fd[i] != -1)
+			close(pmt_fd[i]);
+	}
 	if (tdt_fd != -1)
 		close(tdt_fd);
+	psi_table_collector_destroy(psi_tables);
 
 	return 0;
 }
 
-static void process_pat(int pat_fd, struct gnutv_dvb_params *params, int *pmt_fd, struct pollfd *pollfd)
+static void read_section(int fd, int pid)
 {
 	int size;
 	uint8_t sibuf[4096];
 
-	// read the section
-	if ((size = read(pat_fd, sibuf, sizeof(sibuf))) < 0) {
+	// read the section; unchanged repeats are dropped by the collector
+	if ((size = read(fd, sibuf, sizeof(sibuf))) < 0) {
 		return;
 	}
+	psi_table_collector_feed(psi_tables, pid, sibuf, size);
+}
 
-	// parse section
-	struct section *section = section_codec(sibuf, size);
-	if (section == NULL) {
-		return;
+static void process_table(void *arg, struct psi_table *table)
+{
+	struct table_context *context = (struct table_context *) arg;
+	int i;
+
+	switch(table->table_id) {
+	case stag_mpeg_program_association:
+		process_pat(table, context->params, context->pmt_fd, context->pollfd);
+		break;
+
+	case stag_mpeg_program_map:
+		for(i=0; i < context->params->service_count; i++) {
+			if ((table->pid == pmt_pid[i]) &&
+			    (table->table_id_ext == context->params->service_ids[i]))
+				process_pmt(table, i);
+		}
+		break;
 	}
+}
 
-	// parse section_ext
-	struct section_ext *section_ext = section_ext_decode(section, 0);
-	if (section_ext == NULL) {
-		return;
-	}
-	if (pat_version == section_ext->version_number) {
-		return;
-	}
+static void process_pat(struct psi_table *table, struct gnutv_dvb_params *params, int *pmt_fd, struct pollfd *pollfd)
+{
+	uint8_t sibuf[4096];
+	int section_number;
 
-	// parse PAT
-	struct mpeg_pat_section *pat = mpeg_pat_section_codec(section_ext);
-	if (pat == NULL) {
-		return;
-	}
+	for(section_number=0; section_number <= table->last_section_number; section_number++) {
+		// the collector's copy must not be modified by the codecs
+		memcpy(sibuf, table->sections[section_number].data, table->sections[section_number].len);
 
-	// try and find the requested program
-	struct mpeg_pat_program *cur_program;
-	mpeg_pat_section_programs_for_each(pat, cur_program) {
-		if (cur_program->program_number == params->channel.service_id) {
-			// close old PMT fd
-			if (*pmt_fd != -1)
-				close(*pmt_fd);
-
-			// create PMT filter
-			if ((*pmt_fd = create_section_filter(params->adapter_id, params->demux_id,
-							     cur_program->pid, stag_mpeg_program_map)) < 0) {
-				return;
-			}
-			pollfd->fd = *pmt_fd;
-			pollfd->events = POLLIN|POLLPRI|POLLERR;
+		// parse section
+		struct section *section = section_codec(sibuf, table->sections[section_number].len);
+		if (section == NULL) {
+			continue;
+		}
 
-			gnutv_data_new_pat(cur_program->pid);
+		// parse section_ext
+		struct section_ext *section_ext = section_ext_decode(section, 0);
+		if (section_ext == NULL) {
+			continue;
+		}
 
-			// we have a new PMT pid
-			data_pmt_version = -1;
-			ca_pmt_version = -1;
-			break;
+		// parse PAT
+		struct mpeg_pat_section *pat = mpeg_pat_section_codec(section_ext);
+		if (pat == NULL) {
+			continue;
 		}
-	}
 
-	// remember the PAT version
-	pat_version = section_ext->version_number;
+		// try and find the requested programs
+		struct mpeg_pat_program *cur_program;
+		mpeg_pat_section_programs_for_each(pat, cur_program) {
+			int i;
+			for(i=0; i < params->service_count; i++) {
+				if (cur_program->program_number != params->service_ids[i])
+					continue;
+
+				// close old PMT fd
+				if (pmt_fd[i] != -1)
+					close(pmt_fd[i]);
+
+				// forget the old PMT, so the next one is processed even if unchanged
+				if (pmt_pid[i] != -1)
+					psi_table_collector_forget(psi_tables, pmt_pid[i],
+								   stag_mpeg_program_map, params->service_ids[i]);
+				pmt_pid[i] = cur_program->pid;
+
+				// create PMT filter
+				if ((pmt_fd[i] = create_section_filter(params->adapter_id, params->demux_id,
+								       cur_program->pid, stag_mpeg_program_map)) < 0) {
+					pollfd[i].fd = 0;
+					pollfd[i].events = 0;
+					continue;
+				}
+				pollfd[i].fd = pmt_fd[i];
+				pollfd[i].events = POLLIN|POLLPRI|POLLERR;
+
+				gnutv_data_new_pat(i, section_ext->table_id_ext,
+						   cur_program->program_number, cur_program->pid);
+
+				// we have a new PMT pid
+				data_pmt_version[i] = -1;
+				ca_pmt_version[i] = -1;
+			}
+		}
+	}
 }
 
 static void process_tdt(int tdt_fd)
@@ -304,18 +380,15 @@ static void process_tdt(int tdt_fd)
 	gnutv_ca_new_dvbtime(dvbdate_to_unixtime(tdt->utc_time));
 }
 
-static void process_pmt(int pmt_fd, struct gnutv_dvb_params *params)
+static void process_pmt(struct psi_table *table, int service)
 {
-	int size;
 	uint8_t sibuf[4096];
 
-	// read the section
-	if ((size = read(pmt_fd, sibuf, sizeof(sibuf))) < 0) {
-		return;
-	}
+	// a PMT is always a single section
+	memcpy(sibuf, table->sections[0].data, table->sections[0].len);
 
 	// parse section
-	struct section *section = section_codec(sibuf, size);
+	struct section *section = section_codec(sibuf, table->sections[0].len);
 	if (section == NULL) {
 		return;
 	}
@@ -325,11 +398,6 @@ static void process_pmt(int pmt_fd, struct gnutv_dvb_params *params)
 	if (section_ext == NULL) {
 		return;
 	}
-	if ((section_ext->table_id_ext != params->channel.service_id) ||
-	    ((section_ext->version_number == data_pmt_version) &&
-	     (section_ext->version_number == ca_pmt_version))) {
-		return;
-	}
 
 	// parse PMT
 	struct mpeg_pmt_section *pmt = mpeg_pmt_section_codec(section_ext);
@@ -338,16 +406,22 @@ static void process_pmt(int pmt_fd, struct gnutv_dvb_params *params)
 	}
 
 	// do data handling
-	if (section_ext->version_number != data_pmt_version) {
-		if (gnutv_data_new_pmt(pmt) == 1)
-			data_pmt_version = pmt->head.version_number;
+	if (section_ext->version_number != data_pmt_version[service]) {
+		if (gnutv_data_new_pmt(service, pmt) == 1)
+			data_pmt_version[service] = pmt->head.version_number;
 	}
 
-	// do ca handling
-	if (section_ext->version_number != ca_pmt_version) {
-		if (gnutv_ca_new_pmt(pmt) == 1)
-			ca_pmt_version = pmt->head.version_number;
+	// do ca handling; every service is descrambled. Only 0 (no CA session
+	// yet) is worth a retry: -1 (no CAM, or it failed) would fail again.
+	if (section_ext->version_number != ca_pmt_version[service]) {
+		if (gnutv_ca_new_pmt(pmt) != 0)
+			ca_pmt_version[service] = pmt->head.version_number;
 	}
+
+	// if either was not accepted, have the next repeat delivered again
+	if ((data_pmt_version[service] != table->version_number) ||
+	    (ca_pmt_version[service] != table->version_number))
+		psi_table_collector_forget(psi_tables, table->pid, table->table_id, table->table_id_ext);
 }
 
 static int create_section_filter(int adapter, int demux, uint16_t pid, uint8_t table_id)
@@ -25,6 +25,7 @@
 
 #include <libdvbcfg/dvbcfg_zapchannel.h>
 #include <libdvbsec/dvbsec_api.h>
+#include "gnutv.h"
 
 struct gnutv_dvb_params {
 	int adapter_id;
@@ -35,6 +36,10 @@ struct gnutv_dvb_params {
 	int valid_sec;
 	int output_type;
 	struct dvbfe_handle *fe;
+
+	/* services to follow; service_ids[0] is channel.service_id */
+	int service_count;
+	uint16_t service_ids[GNUTV_MAX_SERVICES];
 };
 
 extern int gnutv_dvb_start(struct gnutv_dvb_params *params);
@@ -25,6 +25,7 @@
 #include <sys/stat.h>
 #include <sys/ioctl.h>
 #include <sys/poll.h>
+#include <sys/epoll.h>
 #include <unistd.h>
 #include <fcntl.h>
 #include <time.h>
@@ -33,12 +34,13 @@
 #include <assert.h>
 #include <glob.h>
 #include <ctype.h>
-#include <iconv.h>
 #include <langinfo.h>
 
 #include <linux/dvb/frontend.h>
 #include <linux/dvb/dmx.h>
 
+#include <libucsi/dvb/text.h>
+
 #include "list.h"
 #include "diseqc.h"
 #include "dump-zap.h"
@@ -48,8 +50,6 @@
 
 #include "atsc_psip_section.h"
 
-static char demux_devname[80];
-
 static struct dvb_frontend_info fe_info = {
 	.type = -1
 };
@@ -130,8 +130,13 @@ struct service {
 	enum running_mode running;
 	void *priv;
 	int channel_num;
+	struct service *hash_next;	/* transponder service_id hash chain */
 };
 
+#define SERVICE_HASH_SIZE 64
+#define TP_HASH_SIZE 1024
+#define TP_FREQ_TOLERANCE 2000
+
 struct transponder {
 	struct list_head list;
 	struct list_head services;
@@ -149,12 +154,20 @@ struct transponder {
 	unsigned int wrong_frequency	  : 1;	/* DVB-T with other_frequency_flag */
 	int n_other_f;
 	uint32_t *other_f;			/* DVB-T freqeuency-list descriptor */
+	unsigned int scanned_list	  : 1;	/* on scanned_transponders */
+	int carrier_ms, sync_ms, lock_ms;	/* last tune, -1 if not reached */
+	unsigned int seq;			/* allocation order */
+	uint32_t indexed_frequency;
+	struct transponder *hash_next;		/* frequency bucket chain */
+	struct service *service_hash[SERVICE_HASH_SIZE];
 };
 
 
+struct scan_adapter;
+
 struct section_buf {
 	struct list_head list;
-	const char *dmx_devname;
+	struct scan_adapter *adapter;
 	unsigned int run_once  : 1;
 	unsigned int segmented : 1;	/* segmented by table_id_ext */
 	int fd;
@@ -166,8 +179,10 @@ struct section_buf {
 	int sectionfilter_done;
 	unsigned char buf[1024];
 	time_t timeout;
-	time_t start_time;
-	time_t running_time;
+	int priority;			/* lower starts first */
+	long long deadline;		/* monotonic ms */
+	int timer_index;
+	struct filter_slot *slot;
 	struct section_buf *next_seg;	/* this is used to handle
 					 * segmented tables (like NIT-other)
 					 */
@@ -176,11 +191,12 @@ struct section_buf {
 static LIST_HEAD(scanned_transponders);
 static LIST_HEAD(new_transponders);
 static struct transponder *current_tp;
+static struct scan_adapter *current_adapter;
 
 
 static void dump_dvb_parameters (FILE *f, struct transponder *p);
 
-static void setup_filter (struct section_buf* s, const char *dmx_devname,
+static void setup_filter (struct section_buf* s, struct scan_adapter *adapter,
 		          int pid, int tid, int tid_ext,
 			  int run_once, int segmented, int timeout);
 static void add_filter (struct section_buf *s);
@@ -195,17 +211,77 @@ static const char * fe_type2str(fe_type_t t);
  * one satellite sometimes list the same TP with slightly different
  * frequencies, so we have to search within some bandwidth.
  */
-static struct transponder *alloc_transponder(uint32_t frequency)
+/* Transponders are indexed by frequency in buckets one tolerance wide, so
+ * any frequency is_same_transponder() would match lies in the bucket of
+ * the looked up frequency or one of its two neighbours.
+ */
+static struct transponder *tp_hash[TP_HASH_SIZE];
+static unsigned int tp_seq;
+
+static unsigned int tp_bucket(uint32_t frequency)
+{
+	return (frequency / TP_FREQ_TOLERANCE) % TP_HASH_SIZE;
+}
+
+static void index_transponder(struct transponder *tp)
+{
+	unsigned int b = tp_bucket(tp->param.frequency);
+
+	tp->indexed_frequency = tp->param.frequency;
+	tp->hash_next = tp_hash[b];
+	tp_hash[b] = tp;
+}
+
+static void unindex_transponder(struct transponder *tp)
+{
+	struct transponder **pp = &tp_hash[tp_bucket(tp->indexed_frequency)];
+
+	while (*pp) {
+		if (*pp == tp) {
+			*pp = tp->hash_next;
+			tp->hash_next = NULL;
+			return;
+		}
+		pp = &(*pp)->hash_next;
+	}
+}
+
+static void set_transponder_frequency(struct transponder *tp, uint32_t frequency)
+{
+	tp->param.frequency = frequency;
+	if (tp->indexed_frequency != frequency) {
+		unindex_transponder(tp);
+		index_transponder(tp);
+	}
+}
+
+static struct transponder *new_transponder(uint32_t frequency)
 {
 	struct transponder *tp = calloc(1, sizeof(*tp));
 
 	tp->param.frequency = frequency;
+	tp->seq = tp_seq++;
 	INIT_LIST_HEAD(&tp->list);
 	INIT_LIST_HEAD(&tp->services);
+	index_transponder(tp);
+	return tp;
+}
+
+static struct transponder *alloc_transponder(uint32_t frequency)
+{
+	struct transponder *tp = new_transponder(frequency);
+
 	list_add_tail(&tp->list, &new_transponders);
 	return tp;
 }
 
+static void mark_scanned(struct transponder *tp)
+{
+	list_del_init(&tp->list);
+	list_add_tail(&tp->list, &scanned_transponders);
+	tp->scanned_list = 1;
+}
+
 static int is_same_transponder(uint32_t f1, uint32_t f2)
 {
 	uint32_t diff;
@@ -213,7 +289,7 @@ static int is_same_transponder(uint32_t f1, uint32_t f2)
 		return 1;
 	diff = (f1 > f2) ? (f1 - f2) : (f2 - f1);
 	//FIXME: use symbolrate etc. to estimate bandwidth
-	if (diff < 2000) {
+	if (diff < TP_FREQ_TOLERANCE) {
 		debug("f1 = %u is same TP as f2 = %u\n", f1, f2);
 		return 1;
 	}
@@ -222,22 +298,29 @@ static int is_same_transponder(uint32_t f1, uint32_t f2)
 
 static struct transponder *find_transponder(uint32_t frequency)
 {
-	struct list_head *pos;
-	struct transponder *tp;
+	struct transponder *tp, *best = NULL;
+	unsigned int b = frequency / TP_FREQ_TOLERANCE;
+	unsigned int i;
 
-	list_for_each(pos, &scanned_transponders) {
-		tp = list_entry(pos, struct transponder, list);
-		if (current_tp_only)
-			return tp;
-		if (is_same_transponder(tp->param.frequency, frequency))
-			return tp;
+	if (current_tp_only) {
+		if (list_empty(&scanned_transponders))
+			return NULL;
+		return list_entry(scanned_transponders.next, struct transponder, list);
 	}
-	list_for_each(pos, &new_transponders) {
-		tp = list_entry(pos, struct transponder, list);
-		if (is_same_transponder(tp->param.frequency, frequency))
-			return tp;
+
+	/* as the old list walk: scanned transponders first, then in the
+	 * order they were found */
+	for (i = (b ? b - 1 : 0); i <= b + 1; i++) {
+		for (tp = tp_hash[i % TP_HASH_SIZE]; tp; tp = tp->hash_next) {
+			if (!is_same_transponder(tp->param.frequency, frequency))
+				continue;
+			if (!best ||
+			    (tp->scanned_list > best->scanned_list) ||
+			    ((tp->scanned_list == best->scanned_list) && (tp->seq < best->seq)))
+				best = tp;
+		}
 	}
-	return NULL;
+	return best;
 }
 
 static void copy_transponder(struct transponder *d, struct transponder *s)
@@ -258,6 +341,10 @@ static void copy_transponder(struct transponder *d, struct transponder *s)
 	d->transport_stream_id = s->transport_stream_id;
 	d->type = s->type;
 	memcpy(&d->param, &s->param, sizeof(d->param));
+	if (d->indexed_frequency != d->param.frequency) {
+		unindex_transponder(d);
+		index_transponder(d);
+	}
 	d->polarisation = s->polarisation;
 	d->orbital_pos = s->orbital_pos;
 	d->we_flag = s->we_flag;
@@ -280,27 +367,28 @@ static void copy_transponder(struct transponder *d, struct transponder *s)
 static struct service *alloc_service(struct transponder *tp, int service_id)
 {
 	struct service *s = calloc(1, sizeof(*s));
+	unsigned int b = service_id % SERVICE_HASH_SIZE;
+
 	INIT_LIST_HEAD(&s->list);
 	s->service_id = service_id;
 	s->transport_stream_id = tp->transport_stream_id;
 	list_add_tail(&s->list, &tp->services);
+	s->hash_next = tp->service_hash[b];
+	tp->service_hash[b] = s;
 	return s;
 }
 
 static struct service *find_service(struct transponder *tp, int service_id)
 {
-	struct list_head *pos;
 	struct service *s;
 
-	list_for_each(pos, &tp->services) {
-		s = list_entry(pos, struct service, list);
+	for (s = tp->service_hash[service_id % SERVICE_HASH_SIZE]; s; s = s->hash_next) {
 		if (s->service_id == service_id)
 			return s;
 	}
 	return NULL;
 }
 
-
 static void parse_ca_identifier_descriptor (const unsigned char *buf,
 				     struct service *s)
 {
@@ -550,282 +638,14 @@ static void parse_frequency_list_descriptor (const unsigned char *buf,
 }
 
 /*
- * handle character set correctly (e.g. via iconv)
- *   c.f. EN 300 468 annex A
+ * handle character set correctly, c.f. EN 300 468 annex A
  */
-
-struct charset_conv {
-	unsigned len;
-	unsigned char  data[3];
-};
-
-/* This table is the Latin 00 table. Basically ISO-6937 + Euro sign */
-struct charset_conv en300468_latin_00_to_utf8[256] = {
-	[0x00] = { 1, {0x00, } },
-	[0x01] = { 1, {0x01, } },
-	[0x02] = { 1, {0x02, } },
-	[0x03] = { 1, {0x03, } },
-	[0x04] = { 1, {0x04, } },
-	[0x05] = { 1, {0x05, } },
-	[0x06] = { 1, {0x06, } },
-	[0x07] = { 1, {0x07, } },
-	[0x08] = { 1, {0x08, } },
-	[0x09] = { 1, {0x09, } },
-	[0x0a] = { 1, {0x0a, } },
-	[0x0b] = { 1, {0x0b, } },
-	[0x0c] = { 1, {0x0c, } },
-	[0x0d] = { 1, {0x0d, } },
-	[0x0e] = { 1, {0x0e, } },
-	[0x0f] = { 1, {0x0f, } },
-	[0x10] = { 1, {0x10, } },
-	[0x11] = { 1, {0x11, } },
-	[0x12] = { 1, {0x12, } },
-	[0x13] = { 1, {0x13, } },
-	[0x14] = { 1, {0x14, } },
-	[0x15] = { 1, {0x15, } },
-	[0x16] = { 1, {0x16, } },
-	[0x17] = { 1, {0x17, } },
-	[0x18] = { 1, {0x18, } },
-	[0x19] = { 1, {0x19, } },
-	[0x1a] = { 1, {0x1a, } },
-	[0x1b] = { 1, {0x1b, } },
-	[0x1c] = { 1, {0x1c, } },
-	[0x1d] = { 1, {0x1d, } },
-	[0x1e] = { 1, {0x1e, } },
-	[0x1f] = { 1, {0x1f, } },
-	[0x20] = { 1, {0x20, } },
-	[0x21] = { 1, {0x21, } },
-	[0x22] = { 1, {0x22, } },
-	[0x23] = { 1, {0x23, } },
-	[0x24] = { 1, {0x24, } },
-	[0x25] = { 1, {0x25, } },
-	[0x26] = { 1, {0x26, } },
-	[0x27] = { 1, {0x27, } },
-	[0x28] = { 1, {0x28, } },
-	[0x29] = { 1, {0x29, } },
-	[0x2a] = { 1, {0x2a, } },
-	[0x2b] = { 1, {0x2b, } },
-	[0x2c] = { 1, {0x2c, } },
-	[0x2d] = { 1, {0x2d, } },
-	[0x2e] = { 1, {0x2e, } },
-	[0x2f] = { 1, {0x2f, } },
-	[0x30] = { 1, {0x30, } },
-	[0x31] = { 1, {0x31, } },
-	[0x32] = { 1, {0x32, } },
-	[0x33] = { 1, {0x33, } },
-	[0x34] = { 1, {0x34, } },
-	[0x35] = { 1, {0x35, } },
-	[0x36] = { 1, {0x36, } },
-	[0x37] = { 1, {0x37, } },
-	[0x38] = { 1, {0x38, } },
-	[0x39] = { 1, {0x39, } },
-	[0x3a] = { 1, {0x3a, } },
-	[0x3b] = { 1, {0x3b, } },
-	[0x3c] = { 1, {0x3c, } },
-	[0x3d] = { 1, {0x3d, } },
-	[0x3e] = { 1, {0x3e, } },
-	[0x3f] = { 1, {0x3f, } },
-	[0x40] = { 1, {0x40, } },
-	[0x41] = { 1, {0x41, } },
-	[0x42] = { 1, {0x42, } },
-	[0x43] = { 1, {0x43, } },
-	[0x44] = { 1, {0x44, } },
-	[0x45] = { 1, {0x45, } },
-	[0x46] = { 1, {0x46, } },
-	[0x47] = { 1, {0x47, } },
-	[0x48] = { 1, {0x48, } },
-	[0x49] = { 1, {0x49, } },
-	[0x4a] = { 1, {0x4a, } },
-	[0x4b] = { 1, {0x4b, } },
-	[0x4c] = { 1, {0x4c, } },
-	[0x4d] = { 1, {0x4d, } },
-	[0x4e] = { 1, {0x4e, } },
-	[0x4f] = { 1, {0x4f, } },
-	[0x50] = { 1, {0x50, } },
-	[0x51] = { 1, {0x51, } },
-	[0x52] = { 1, {0x52, } },
-	[0x53] = { 1, {0x53, } },
-	[0x54] = { 1, {0x54, } },
-	[0x55] = { 1, {0x55, } },
-	[0x56] = { 1, {0x56, } },
-	[0x57] = { 1, {0x57, } },
-	[0x58] = { 1, {0x58, } },
-	[0x59] = { 1, {0x59, } },
-	[0x5a] = { 1, {0x5a, } },
-	[0x5b] = { 1, {0x5b, } },
-	[0x5c] = { 1, {0x5c, } },
-	[0x5d] = { 1, {0x5d, } },
-	[0x5e] = { 1, {0x5e, } },
-	[0x5f] = { 1, {0x5f, } },
-	[0x60] = { 1, {0x60, } },
-	[0x61] = { 1, {0x61, } },
-	[0x62] = { 1, {0x62, } },
-	[0x63] = { 1, {0x63, } },
-	[0x64] = { 1, {0x64, } },
-	[0x65] = { 1, {0x65, } },
-	[0x66] = { 1, {0x66, } },
-	[0x67] = { 1, {0x67, } },
-	[0x68] = { 1, {0x68, } },
-	[0x69] = { 1, {0x69, } },
-	[0x6a] = { 1, {0x6a, } },
-	[0x6b] = { 1, {0x6b, } },
-	[0x6c] = { 1, {0x6c, } },
-	[0x6d] = { 1, {0x6d, } },
-	[0x6e] = { 1, {0x6e, } },
-	[0x6f] = { 1, {0x6f, } },
-	[0x70] = { 1, {0x70, } },
-	[0x71] = { 1, {0x71, } },
-	[0x72] = { 1, {0x72, } },
-	[0x73] = { 1, {0x73, } },
-	[0x74] = { 1, {0x74, } },
-	[0x75] = { 1, {0x75, } },
-	[0x76] = { 1, {0x76, } },
-	[0x77] = { 1, {0x77, } },
-	[0x78] = { 1, {0x78, } },
-	[0x79] = { 1, {0x79, } },
-	[0x7a] = { 1, {0x7a, } },
-	[0x7b] = { 1, {0x7b, } },
-	[0x7c] = { 1, {0x7c, } },
-	[0x7d] = { 1, {0x7d, } },
-	[0x7e] = { 1, {0x7e, } },
-	[0x7f] = { 1, {0x7f, } },
-	[0x80] = { 2, {0xc2, 0x80, } },
-	[0x81] = { 2, {0xc2, 0x81, } },
-	[0x82] = { 2, {0xc2, 0x82, } },
-	[0x83] = { 2, {0xc2, 0x83, } },
-	[0x84] = { 2, {0xc2, 0x84, } },
-	[0x85] = { 2, {0xc2, 0x85, } },
-	[0x86] = { 2, {0xc2, 0x86, } },
-	[0x87] = { 2, {0xc2, 0x87, } },
-	[0x88] = { 2, {0xc2, 0x88, } },
-	[0x89] = { 2, {0xc2, 0x89, } },
-	[0x8a] = { 2, {0xc2, 0x8a, } },
-	[0x8b] = { 2, {0xc2, 0x8b, } },
-	[0x8c] = { 2, {0xc2, 0x8c, } },
-	[0x8d] = { 2, {0xc2, 0x8d, } },
-	[0x8e] = { 2, {0xc2, 0x8e, } },
-	[0x8f] = { 2, {0xc2, 0x8f, } },
-	[0x90] = { 2, {0xc2, 0x90, } },
-	[0x91] = { 2, {0xc2, 0x91, } },
-	[0x92] = { 2, {0xc2, 0x92, } },
-	[0x93] = { 2, {0xc2, 0x93, } },
-	[0x94] = { 2, {0xc2, 0x94, } },
-	[0x95] = { 2, {0xc2, 0x95, } },
-	[0x96] = { 2, {0xc2, 0x96, } },
-	[0x97] = { 2, {0xc2, 0x97, } },
-	[0x98] = { 2, {0xc2, 0x98, } },
-	[0x99] = { 2, {0xc2, 0x99, } },
-	[0x9a] = { 2, {0xc2, 0x9a, } },
-	[0x9b] = { 2, {0xc2, 0x9b, } },
-	[0x9c] = { 2, {0xc2, 0x9c, } },
-	[0x9d] = { 2, {0xc2, 0x9d, } },
-	[0x9e] = { 2, {0xc2, 0x9e, } },
-	[0x9f] = { 2, {0xc2, 0x9f, } },
-	[0xa0] = { 2, {0xc2, 0xa0, } },
-	[0xa1] = { 2, {0xc2, 0xa1, } },
-	[0xa2] = { 2, {0xc2, 0xa2, } },
-	[0xa3] = { 2, {0xc2, 0xa3, } },
-	[0xa4] = { 3, { 0xe2, 0x82, 0xac,} },		/* Euro sign. Addition over the ISO-6937 standard */
-	[0xa5] = { 2, {0xc2, 0xa5, } },
-	[0xa6] = { 0, {} },
-	[0xa7] = { 2, {0xc2, 0xa7, } },
-	[0xa8] = { 2, {0xc2, 0xa4, } },
-	[0xa9] = { 3, {0xe2, 0x80, 0x98, } },
-	[0xaa] = { 3, {0xe2, 0x80, 0x9c, } },
-	[0xab] = { 2, {0xc2, 0xab, } },
-	[0xac] = { 3, {0xe2, 0x86, 0x90, } },
-	[0xad] = { 3, {0xe2, 0x86, 0x91, } },
-	[0xae] = { 3, {0xe2, 0x86, 0x92, } },
-	[0xaf] = { 3, {0xe2, 0x86, 0x93, } },
-	[0xb0] = { 2, {0xc2, 0xb0, } },
-	[0xb1] = { 2, {0xc2, 0xb1, } },
-	[0xb2] = { 2, {0xc2, 0xb2, } },
-	[0xb3] = { 2, {0xc2, 0xb3, } },
-	[0xb4] = { 2, {0xc3, 0x97, } },
-	[0xb5] = { 2, {0xc2, 0xb5, } },
-	[0xb6] = { 2, {0xc2, 0xb6, } },
-	[0xb7] = { 2, {0xc2, 0xb7, } },
-	[0xb8] = { 2, {0xc3, 0xb7, } },
-	[0xb9] = { 3, {0xe2, 0x80, 0x99, } },
-	[0xba] = { 3, {0xe2, 0x80, 0x9d, } },
-	[0xbb] = { 2, {0xc2, 0xbb, } },
-	[0xbc] = { 2, {0xc2, 0xbc, } },
-	[0xbd] = { 2, {0xc2, 0xbd, } },
-	[0xbe] = { 2, {0xc2, 0xbe, } },
-	[0xbf] = { 2, {0xc2, 0xbf, } },
-	[0xc0] = { 0, {} },
-	[0xc1] = { 0, {} },
-	[0xc2] = { 0, {} },
-	[0xc3] = { 0, {} },
-	[0xc4] = { 0, {} },
-	[0xc5] = { 0, {} },
-	[0xc6] = { 0, {} },
-	[0xc7] = { 0, {} },
-	[0xc8] = { 0, {} },
-	[0xc9] = { 0, {} },
-	[0xca] = { 0, {} },
-	[0xcb] = { 0, {} },
-	[0xcc] = { 0, {} },
-	[0xcd] = { 0, {} },
-	[0xce] = { 0, {} },
-	[0xcf] = { 0, {} },
-	[0xd0] = { 3, {0xe2, 0x80, 0x94, } },
-	[0xd1] = { 2, {0xc2, 0xb9, } },
-	[0xd2] = { 2, {0xc2, 0xae, } },
-	[0xd3] = { 2, {0xc2, 0xa9, } },
-	[0xd4] = { 3, {0xe2, 0x84, 0xa2, } },
-	[0xd5] = { 3, {0xe2, 0x99, 0xaa, } },
-	[0xd6] = { 2, {0xc2, 0xac, } },
-	[0xd7] = { 2, {0xc2, 0xa6, } },
-	[0xd8] = { 0, {} },
-	[0xd9] = { 0, {} },
-	[0xda] = { 0, {} },
-	[0xdb] = { 0, {} },
-	[0xdc] = { 3, {0xe2, 0x85, 0x9b, } },
-	[0xdd] = { 3, {0xe2, 0x85, 0x9c, } },
-	[0xde] = { 3, {0xe2, 0x85, 0x9d, } },
-	[0xdf] = { 3, {0xe2, 0x85, 0x9e, } },
-	[0xe0] = { 3, {0xe2, 0x84, 0xa6, } },
-	[0xe1] = { 2, {0xc3, 0x86, } },
-	[0xe2] = { 2, {0xc3, 0x90, } },
-	[0xe3] = { 2, {0xc2, 0xaa, } },
-	[0xe4] = { 2, {0xc4, 0xa6, } },
-	[0xe5] = { 0, {} },
-	[0xe6] = { 2, {0xc4, 0xb2, } },
-	[0xe7] = { 2, {0xc4, 0xbf, } },
-	[0xe8] = { 2, {0xc5, 0x81, } },
-	[0xe9] = { 2, {0xc3, 0x98, } },
-	[0xea] = { 2, {0xc5, 0x92, } },
-	[0xeb] = { 2, {0xc2, 0xba, } },
-	[0xec] = { 2, {0xc3, 0x9e, } },
-	[0xed] = { 2, {0xc5, 0xa6, } },
-	[0xee] = { 2, {0xc5, 0x8a, } },
-	[0xef] = { 2, {0xc5, 0x89, } },
-	[0xf0] = { 2, {0xc4, 0xb8, } },
-	[0xf1] = { 2, {0xc3, 0xa6, } },
-	[0xf2] = { 2, {0xc4, 0x91, } },
-	[0xf3] = { 2, {0xc3, 0xb0, } },
-	[0xf4] = { 2, {0xc4, 0xa7, } },
-	[0xf5] = { 2, {0xc4, 0xb1, } },
-	[0xf6] = { 2, {0xc4, 0xb3, } },
-	[0xf7] = { 2, {0xc5, 0x80, } },
-	[0xf8] = { 2, {0xc5, 0x82, } },
-	[0xf9] = { 2, {0xc3, 0xb8, } },
-	[0xfa] = { 2, {0xc5, 0x93, } },
-	[0xfb] = { 2, {0xc3, 0x9f, } },
-	[0xfc] = { 2, {0xc3, 0xbe, } },
-	[0xfd] = { 2, {0xc5, 0xa7, } },
-	[0xfe] = { 2, {0xc5, 0x8b, } },
-	[0xff] = { 2, {0xc2, 0xad, } },
-};
+static struct dvb_text_decoder *text_decoder;
 
 static void descriptorcpy(char **dest, const unsigned char *src, size_t len)
 {
-	size_t destlen, i;
-	char *p, *type = default_charset;
-	unsigned char *tmp = NULL;
-	const unsigned char *s;
-	int emphasis = 0, need_conversion = 1;
+	/* room for the widest output charset */
+	char buf[(255 * 6) + 2];
 
 	if (*dest) {
 		free (*dest);
@@ -834,143 +654,21 @@ static void descriptorcpy(char **dest, const unsigned char *src, size_t len)
 	if (!len)
 		return;
 
-	if (*src < 0x20) {
-		switch (*src) {
-		case 0x00:	type = "ISO-6937";		break;
-		case 0x01:	type = "ISO-8859-5";		break;
-		case 0x02:	type = "ISO-8859-6";		break;
-		case 0x03:	type = "ISO-8859-7";		break;
-		case 0x04:	type = "ISO-8859-8";		break;
-		case 0x05:	type = "ISO-8859-9";		break;
-		case 0x06:	type = "ISO-8859-10";		break;
-		case 0x07:	type = "ISO-8859-11";		break;
-		case 0x09:	type = "ISO-8859-13";		break;
-		case 0x0a:	type = "ISO-8859-14";		break;
-		case 0x0b:	type = "ISO-8859-15";		break;
-		case 0x11:	type = "ISO-10646";		break;
-		case 0x12:	type = "ISO-2022-KR";		break;
-		case 0x13:	type = "GB2312";		break;
-		case 0x14:	type = "BIG5";			break;
-		case 0x15:	type = "ISO-10646/UTF-8";	break;
-		case 0x10: /* ISO8859 */
-			if ((*(src + 1) != 0) || *(src + 2) > 0x0f)
-				break;
-			src+=2;
-			len-=2;
-			switch(*src) {
-			case 0x01:	type = "ISO-8859-1";		break;
-			case 0x02:	type = "ISO-8859-2";		break;
-			case 0x03:	type = "ISO-8859-3";		break;
-			case 0x04:	type = "ISO-8859-4";		break;
-			case 0x05:	type = "ISO-8859-5";		break;
-			case 0x06:	type = "ISO-8859-6";		break;
-			case 0x07:	type = "ISO-8859-7";		break;
-			case 0x08:	type = "ISO-8859-8";		break;
-			case 0x09:	type = "ISO-8859-9";		break;
-			case 0x0a:	type = "ISO-8859-10";		break;
-			case 0x0b:	type = "ISO-8859-11";		break;
-			case 0x0d:	type = "ISO-8859-13";		break;
-			case 0x0e:	type = "ISO-8859-14";		break;
-			case 0x0f:	type = "ISO-8859-15";		break;
-			}
-		}
-		src++;
-		len--;
-	}
-
-	/*
-	 * Destination length should be bigger. As the worse case seems to
-	 * use 3 chars for one code, use it for destlen
-	 */
-	destlen = len * 3;
-	*dest = malloc(destlen + 1);
-
-	/* Remove special chars */
-	if (!strncasecmp(type, "ISO-8859", 8) || !strcasecmp(type, "ISO-6937")) {
-		/*
-		 * Handles the ISO/IEC 10646 1-byte control codes
-		 * (EN 300 468 v1.11.1 Table A.1)
-		 * Emphasis will be represented as: *emphased*
-		 */
-		tmp = malloc(len + 2);
-		p = (char *)tmp;
-		s = src;
-		for (i = 0; i < len; i++, s++) {
-			if (*s >= 0x20 && (*s < 0x80 || *s > 0x9f))
-				*p++ = *s;
-			else if (*s == 0x86) {
-				*p++ = '*';
-				emphasis = 1;
-			} else if (*s == 0x87 && emphasis) {
-				*p++ = '*';
-				emphasis = 0;
-			}
-		}
-		if (emphasis)
-			*p++ = '*';
-		*p = '\0';
-	} else {
-		/*
-		 * FIXME: need to handle the ISO/IEC 10646 2-byte control codes
-		 * (EN 300 468 v1.11.1 Table A.2)
-		 */
-	}
-
-	if (tmp)
-		s = tmp;
-	else
-		s = src;
-
-	p = *dest;
-	if (!strcasecmp(type, "ISO-6937")) {
-		unsigned char *p1, *p2;
-
-		/* Convert charset to UTF-8 using Code table 00 - Latin */
-		for (p1 = (unsigned char *)s; p1 < s + len; p1++)
-			for (p2 = en300468_latin_00_to_utf8[*p1].data;
-			     p2 < en300468_latin_00_to_utf8[*p1].data + en300468_latin_00_to_utf8[*p1].len;
-			     p2++)
-				*p++ = *p2;
-		*p = '\0';
-
-		/* If desired charset is not UTF-8, prepare for conversion */
-		if (strcasecmp(output_charset, "UTF-8")) {
-			if (tmp)
-				free(tmp);
-			tmp = (unsigned char *)*dest;
-			len = p - *dest;
-
-			*dest = malloc(destlen + 1);
-			type = "UTF-8";
-			s = tmp;
-		} else
-			need_conversion = 0;
-
-	}
-
-	/* Convert from original charset to the desired one */
-	if (need_conversion) {
-		char out_cs[strlen(output_charset) + 1 + sizeof(CS_OPTIONS)];
+	dvb_text_decode(text_decoder, src, len, buf, sizeof(buf));
+	*dest = strdup(buf);
+}
 
-		p = *dest;
-		strcpy(out_cs, output_charset);
-		strcat(out_cs, CS_OPTIONS);
+static void init_text_decoder(void)
+{
+	char out_cs[strlen(output_charset) + 1 + sizeof(CS_OPTIONS)];
 
-		iconv_t cd = iconv_open(out_cs, type);
-		if (cd == (iconv_t)(-1)) {
-			memcpy(p, s, len);
-			p[len] = '\0';
-			warning("Conversion from %s to %s not supported\n",
-				 type, output_charset);
-		} else {
-			iconv(cd, (char **)&s, &len, &p, &destlen);
-			iconv_close(cd);
-			*p = '\0';
-		}
+	strcpy(out_cs, output_charset);
+	strcat(out_cs, CS_OPTIONS);
+	text_decoder = dvb_text_decoder_create(out_cs, default_charset, DVB_TEXT_EMPHASIS);
+	if (text_decoder == NULL) {
+		warning("Conversion to %s not supported, using UTF-8\n", output_charset);
+		text_decoder = dvb_text_decoder_create(NULL, default_charset, DVB_TEXT_EMPHASIS);
 	}
-
-	if (tmp)
-		free(tmp);
 }
 
 static void parse_service_descriptor (const unsigned char *buf, struct service *s)
@@ -1118,7 +816,7 @@ static void parse_pat(const unsigned char *buf, int section_length,
 		s->pmt_pid = ((buf[2] & 0x1f) << 8) | buf[3];
 		if (!s->priv && s->pmt_pid) {
 			s->priv = malloc(sizeof(struct section_buf));
-			setup_filter(s->priv, demux_devname,
+			setup_filter(s->priv, current_adapter,
 				     s->pmt_pid, 0x02, s->service_id, 1, 0, 5);
 
 			add_filter (s->priv);
@@ -1659,22 +1357,239 @@ static int read_sections (struct section_buf *s)
 }
 
 
-static LIST_HEAD(running_filters);
-static LIST_HEAD(waiting_filters);
-static int n_running;
+/**
+ * Filter scheduler. Running filters sit on pooled demux fds registered
+ * with one epoll instance; their timeouts live in a min-heap keyed by a
+ * millisecond deadline. Filters that cannot start yet wait on a list
+ * ordered by priority, so the PAT and NIT which lead to further work are
+ * started before SDTs and PMTs.
+ *
+ * Each adapter has its own demux and hence its own filter pool and
+ * waiting list; the epoll instance and the timer heap are shared, so one
+ * loop drives all adapters. Frontends which are being tuned are
+ * registered with the same epoll instance to pick up their status
+ * change events.
+ */
 #define MAX_RUNNING 27
-static struct pollfd poll_fds[MAX_RUNNING];
-static struct section_buf* poll_section_bufs[MAX_RUNNING];
+#define MAX_ADAPTERS 16
+
+#define TUNE_TIMEOUT_MS 2000
+#define TUNE_POLL_MS 200
+
+struct filter_slot {
+	int fd;
+	struct section_buf *s;
+	struct scan_adapter *adapter;
+};
+
+enum adapter_state {
+	ADAPTER_IDLE,
+	ADAPTER_TUNING,
+	ADAPTER_SCANNING,
+};
+
+struct scan_adapter {
+	int adapter;
+	int frontend_fd;
+	char demux_devname[80];
+	enum adapter_state state;
+	struct transponder *tp;		/* transponder being tuned/scanned */
+	int tune_attempt;
+	long long tune_start;
+	long long tune_poll;		/* next FE_READ_STATUS */
+	struct filter_slot fe_slot;	/* frontend, while tuning */
+	int fe_registered;
+	int fe_events;			/* frontend queues status events */
+	int n_scanned;
+
+	struct list_head running_filters;
+	struct list_head waiting_filters;
+	int n_running;
+	struct filter_slot filter_slots[MAX_RUNNING];
+	int n_filter_slots;
+	struct filter_slot *free_slots[MAX_RUNNING];
+	int n_free_slots;
+	struct section_buf tables[4];	/* PAT, SDT, NIT, NIT-other / VCTs */
+};
+
+static struct scan_adapter adapters[MAX_ADAPTERS];
+static int n_adapters;
+
+static int epoll_fd = -1;
+static struct section_buf *timer_heap[MAX_ADAPTERS * MAX_RUNNING];
+static int n_timers;
+
+static struct {
+	int tunes;
+	int locked;
+	long long lock_ms;	/* sum of time-to-lock over locked tunes */
+	long long wait_ms;	/* sum of time spent waiting, all tunes */
+} tune_stats;
+
+
+static long long monotonic_ms(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (long long) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
 
+static int filter_priority(int table_id)
+{
+	switch (table_id) {
+	case 0x00:	/* PAT */
+	case 0x40:	/* NIT actual */
+	case 0x41:	/* NIT other */
+	case 0xc8:	/* ATSC VCTs */
+	case 0xc9:
+		return 0;
+	default:
+		return 1;
+	}
+}
+
+static void timer_swap(int a, int b)
+{
+	struct section_buf *tmp = timer_heap[a];
+
+	timer_heap[a] = timer_heap[b];
+	timer_heap[b] = tmp;
+	timer_heap[a]->timer_index = a;
+	timer_heap[b]->timer_index = b;
+}
+
+static void timer_sift_up(int i)
+{
+	while (i > 0) {
+		int parent = (i - 1) / 2;
+		if (timer_heap[parent]->deadline <= timer_heap[i]->deadline)
+			break;
+		timer_swap(i, parent);
+		i = parent;
+	}
+}
+
+static void timer_sift_down(int i)
+{
+	for (;;) {
+		int smallest = i;
+		int l = 2 * i + 1;
+		int r = l + 1;
+
+		if (l < n_timers && timer_heap[l]->deadline < timer_heap[smallest]->deadline)
+			smallest = l;
+		if (r < n_timers && timer_heap[r]->deadline < timer_heap[smallest]->deadline)
+			smallest = r;
+		if (smallest == i)
+			break;
+		timer_swap(i, smallest);
+		i = smallest;
+	}
+}
+
+static void timer_add(struct section_buf *s, long long deadline)
+{
+	s->deadline = deadline;
+	s->timer_index = n_timers;
+	timer_heap[n_timers++] = s;
+	timer_sift_up(s->timer_index);
+}
+
+static void timer_remove(struct section_buf *s)
+{
+	int i = s->timer_index;
+
+	if (i < 0)
+		return;
+	n_timers--;
+	if (i != n_timers) {
+		timer_heap[i] = timer_heap[n_timers];
+		timer_heap[i]->timer_index = i;
+		timer_sift_down(i);
+		timer_sift_up(i);
+	}
+	s->timer_index = -1;
+}
+
+static int open_epoll(void)
+{
+	if (epoll_fd < 0 && (epoll_fd = epoll_create(MAX_RUNNING)) < 0) {
+		errorn("epoll_create");
+		return -1;
+	}
+	return 0;
+}
+
+static struct filter_slot *get_filter_slot(struct scan_adapter *ad)
+{
+	struct filter_slot *slot;
+	struct epoll_event ev;
+
+	if (ad->n_free_slots)
+		return ad->free_slots[--ad->n_free_slots];
+
+	/* demux fds are opened once and reused for the whole scan */
+	if (ad->n_filter_slots >= MAX_RUNNING)
+		return NULL;
+	if (open_epoll() < 0)
+		return NULL;
+
+	slot = &ad->filter_slots[ad->n_filter_slots];
+	if ((slot->fd = open (ad->demux_devname, O_RDWR | O_NONBLOCK)) < 0)
+		return NULL;
+	slot->s = NULL;
+	slot->adapter = ad;
+
+	memset(&ev, 0, sizeof(ev));
+	ev.events = EPOLLIN;
+	ev.data.ptr = slot;
+	if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, slot->fd, &ev) < 0) {
+		errorn("epoll_ctl");
+		close(slot->fd);
+		return NULL;
+	}
+
+	ad->n_filter_slots++;
+	return slot;
+}
+
+static void put_filter_slot(struct filter_slot *slot)
+{
+	struct scan_adapter *ad = slot->adapter;
+
+	ioctl (slot->fd, DMX_STOP);
+	slot->s = NULL;
+	ad->free_slots[ad->n_free_slots++] = slot;
+}
+
+
+static void close_filter_slots(void)
+{
+	int i, j;
+
+	for (i = 0; i < n_adapters; i++) {
+		struct scan_adapter *ad = &adapters[i];
+
+		for (j = 0; j < ad->n_filter_slots; j++)
+			close(ad->filter_slots[j].fd);
+		ad->n_filter_slots = 0;
+		ad->n_free_slots = 0;
+	}
+	if (epoll_fd >= 0)
+		close(epoll_fd);
+	epoll_fd = -1;
+}
 
-static void setup_filter (struct section_buf* s, const char *dmx_devname,
+
+static void setup_filter (struct section_buf* s, struct scan_adapter *adapter,
 			  int pid, int tid, int tid_ext,
 			  int run_once, int segmented, int timeout)
 {
 	memset (s, 0, sizeof(struct section_buf));
 
 	s->fd = -1;
-	s->dmx_devname = dmx_devname;
+	s->adapter = adapter;
 	s->pid = pid;
 	s->table_id = tid;
 
@@ -1688,45 +1603,23 @@ static void setup_filter (struct section_buf* s, const char *dmx_devname,
 
 	s->table_id_ext = tid_ext;
 	s->section_version_number = -1;
+	s->priority = filter_priority(tid);
+	s->timer_index = -1;
 
 	INIT_LIST_HEAD (&s->list);
 }
 
-static void update_poll_fds(void)
-{
-	struct list_head *p;
-	struct section_buf* s;
-	int i;
-
-	memset(poll_section_bufs, 0, sizeof(poll_section_bufs));
-	for (i = 0; i < MAX_RUNNING; i++)
-		poll_fds[i].fd = -1;
-	i = 0;
-	list_for_each (p, &running_filters) {
-		if (i >= MAX_RUNNING)
-			fatal("too many poll_fds\n");
-		s = list_entry (p, struct section_buf, list);
-		if (s->fd == -1)
-			fatal("s->fd == -1 on running_filters\n");
-		verbosedebug("poll fd %d\n", s->fd);
-		poll_fds[i].fd = s->fd;
-		poll_fds[i].events = POLLIN;
-		poll_fds[i].revents = 0;
-		poll_section_bufs[i] = s;
-		i++;
-	}
-	if (i != n_running)
-		fatal("n_running is hosed\n");
-}
-
 static int start_filter (struct section_buf* s)
 {
+	struct scan_adapter *ad = s->adapter;
 	struct dmx_sct_filter_params f;
+	struct filter_slot *slot;
 
-	if (n_running >= MAX_RUNNING)
+	if (ad->n_running >= MAX_RUNNING)
 		goto err0;
-	if ((s->fd = open (s->dmx_devname, O_RDWR | O_NONBLOCK)) < 0)
+	if ((slot = get_filter_slot(ad)) == NULL)
 		goto err0;
+	s->fd = slot->fd;
 
 	verbosedebug("start filter pid 0x%04x table_id 0x%02x\n", s->pid, s->table_id);
 
@@ -1754,19 +1647,20 @@ static int start_filter (struct section_buf* s)
 	}
 
 	s->sectionfilter_done = 0;
-	time(&s->start_time);
+	s->slot = slot;
+	slot->s = s;
+	timer_add(s, monotonic_ms() + s->timeout * 1000LL);
 
 	list_del_init (&s->list);  /* might be in waiting filter list */
-	list_add (&s->list, &running_filters);
+	list_add (&s->list, &ad->running_filters);
 
-	n_running++;
-	update_poll_fds();
+	ad->n_running++;
 
 	return 0;
 
 err1:
-	ioctl (s->fd, DMX_STOP);
-	close (s->fd);
+	put_filter_slot(slot);
+	s->fd = -1;
 err0:
 	return -1;
 }
@@ -1775,64 +1669,146 @@ err0:
 static void stop_filter (struct section_buf *s)
 {
 	verbosedebug("stop filter pid 0x%04x\n", s->pid);
-	ioctl (s->fd, DMX_STOP);
-	close (s->fd);
+	put_filter_slot(s->slot);
+	s->slot = NULL;
 	s->fd = -1;
+	timer_remove(s);
 	list_del (&s->list);
-	s->running_time += time(NULL) - s->start_time;
 
-	n_running--;
-	update_poll_fds();
+	s->adapter->n_running--;
 }
 
 
 static void add_filter (struct section_buf *s)
 {
+	struct list_head *pos;
+
 	verbosedebug("add filter pid 0x%04x\n", s->pid);
-	if (start_filter (s))
-		list_add_tail (&s->list, &waiting_filters);
+	if (!start_filter (s))
+		return;
+
+	/* queue behind any waiting filters of the same or higher priority */
+	list_for_each (pos, &s->adapter->waiting_filters) {
+		struct section_buf *w = list_entry (pos, struct section_buf, list);
+		if (w->priority > s->priority)
+			break;
+	}
+	list_add_tail (&s->list, pos);
 }
 
 
 static void remove_filter (struct section_buf *s)
 {
+	struct scan_adapter *ad = s->adapter;
+
 	verbosedebug("remove filter pid 0x%04x\n", s->pid);
 	stop_filter (s);
 
-	while (!list_empty(&waiting_filters)) {
-		struct list_head *next = waiting_filters.next;
+	while (!list_empty(&ad->waiting_filters)) {
+		struct list_head *next = ad->waiting_filters.next;
 		s = list_entry (next, struct section_buf, list);
 		if (start_filter (s))
 			break;
 	};
 }
 
+static void check_lock(struct scan_adapter *ad);
+static void scan_tp(struct scan_adapter *ad);
+
 
 static void read_filters (void)
 {
+	struct epoll_event events[MAX_RUNNING];
 	struct section_buf *s;
-	int i, n, done;
+	long long now;
+	int timeout = 1000;
+	int i, n;
+
+	now = monotonic_ms();
+	if (n_timers) {
+		timeout = timer_heap[0]->deadline - now;
+		if (timeout < 0)
+			timeout = 0;
+	}
+	for (i = 0; i < n_adapters; i++) {
+		if (adapters[i].state != ADAPTER_TUNING)
+			continue;
+		if (adapters[i].tune_poll - now < timeout)
+			timeout = adapters[i].tune_poll - now;
+		if (timeout < 0)
+			timeout = 0;
+	}
 
-	n = poll(poll_fds, n_running, 1000);
-	if (n == -1)
-		errorn("poll");
+	n = epoll_wait(epoll_fd, events, MAX_RUNNING, timeout);
+	if (n == -1) {
+		if (errno != EINTR)
+			errorn("epoll_wait");
+		n = 0;
+	}
 
-	for (i = 0; i < n_running; i++) {
-		s = poll_section_bufs[i];
-		if (!s)
-			fatal("poll_section_bufs[%d] is NULL\n", i);
-		if (poll_fds[i].revents)
-			done = read_sections (s) == 1;
-		else
-			done = 0; /* timeout */
-		if (done || time(NULL) > s->start_time + s->timeout) {
-			if (s->run_once) {
-				if (done)
-					verbosedebug("filter done pid 0x%04x\n", s->pid);
-				else
-					warning("filter timeout pid 0x%04x\n", s->pid);
-				remove_filter (s);
+	for (i = 0; i < n; i++) {
+		struct filter_slot *slot = events[i].data.ptr;
+		struct scan_adapter *ad = slot->adapter;
+
+		if (slot == &ad->fe_slot) {
+			struct dvb_frontend_event ev;
+
+			if (ad->state != ADAPTER_TUNING)
+				continue;
+			/* EOVERFLOW just means older events were lost */
+			if (ioctl(ad->frontend_fd, FE_GET_EVENT, &ev) == 0 ||
+			    errno == EOVERFLOW) {
+				ad->tune_poll = 0;
+			} else {
+				/* no usable events, fall back to polling */
+				epoll_ctl(epoll_fd, EPOLL_CTL_DEL, ad->frontend_fd, NULL);
+				ad->fe_registered = 0;
+				ad->fe_events = 0;
 			}
+			continue;
+		}
+
+		/* the filter may have been stopped by an earlier event */
+		if ((s = slot->s) == NULL)
+			continue;
+		current_adapter = ad;
+		current_tp = ad->tp;
+		if (read_sections (s) == 1 && s->run_once) {
+			verbosedebug("filter done pid 0x%04x\n", s->pid);
+			remove_filter (s);
+		}
+	}
+
+	now = monotonic_ms();
+	for (i = 0; i < n_adapters; i++) {
+		if (adapters[i].state == ADAPTER_TUNING &&
+		    adapters[i].tune_poll <= now)
+			check_lock(&adapters[i]);
+	}
+
+	while (n_timers && timer_heap[0]->deadline <= now) {
+		s = timer_heap[0];
+		if (s->run_once) {
+			if (s->sectionfilter_done)
+				verbosedebug("filter done pid 0x%04x\n", s->pid);
+			else
+				warning("filter timeout pid 0x%04x\n", s->pid);
+			remove_filter (s);
+		} else {
+			timer_remove(s);
+			timer_add(s, now + s->timeout * 1000LL);
+		}
+	}
+
+	/* an adapter whose filters are all done has finished its transponder */
+	for (i = 0; i < n_adapters; i++) {
+		struct scan_adapter *ad = &adapters[i];
+
+		if (ad->state == ADAPTER_SCANNING &&
+		    list_empty(&ad->running_filters) &&
+		    list_empty(&ad->waiting_filters)) {
+			ad->state = ADAPTER_IDLE;
+			ad->tp = NULL;
 		}
 	}
 }
@@ -1854,13 +1830,20 @@ static int mem_is_zero (const void *mem, int size)
 
 static int switch_pos = 0;
 
-static int __tune_to_transponder (int frontend_fd, struct transponder *t)
+static void note_tune_status(struct transponder *t, fe_status_t s, int elapsed)
 {
-	struct dvb_frontend_parameters p;
-	fe_status_t s;
-	int i;
+	if ((s & FE_HAS_CARRIER) && t->carrier_ms < 0)
+		t->carrier_ms = elapsed;
+	if ((s & FE_HAS_SYNC) && t->sync_ms < 0)
+		t->sync_ms = elapsed;
+	if ((s & FE_HAS_LOCK) && t->lock_ms < 0)
+		t->lock_ms = elapsed;
+}
 
-	current_tp = t;
+static int __tune_to_transponder (struct scan_adapter *ad, struct transponder *t)
+{
+	struct dvb_frontend_parameters p;
+	int frontend_fd = ad->frontend_fd;
 
 	if (mem_is_zero (&t->param, sizeof(struct dvb_frontend_parameters)))
 		return -1;
@@ -1868,7 +1851,10 @@ static int __tune_to_transponder (int frontend_fd, struct transponder *t)
 	memcpy (&p, &t->param, sizeof(struct dvb_frontend_parameters));
 
 	if (verbosity >= 1) {
-		dprintf(1, ">>> tune to: ");
+		if (n_adapters > 1)
+			dprintf(1, ">>> adapter %d tune to: ", ad->adapter);
+		else
+			dprintf(1, ">>> tune to: ");
 		dump_dvb_parameters (stderr, t);
 		if (t->last_tuning_failed)
 			dprintf(1, " (tuning failed)");
@@ -1911,27 +1897,28 @@ static int __tune_to_transponder (int frontend_fd, struct transponder *t)
 		return -1;
 	}
 
-	for (i = 0; i < 10; i++) {
-		usleep (200000);
+	/* the lock is waited for by check_lock(), woken by the frontend's
+	 * status change events; FE_READ_STATUS is still checked at least
+	 * every TUNE_POLL_MS for drivers which do not queue events */
+	t->carrier_ms = t->sync_ms = t->lock_ms = -1;
+	tune_stats.tunes++;
+	ad->tune_start = monotonic_ms();
+	ad->tune_poll = ad->tune_start;
+	ad->state = ADAPTER_TUNING;
 
-		if (ioctl(frontend_fd, FE_READ_STATUS, &s) == -1) {
-			errorn("FE_READ_STATUS failed");
-			return -1;
-		}
+	if (ad->fe_events && !ad->fe_registered) {
+		struct epoll_event ev;
 
-		verbose(">>> tuning status == 0x%02x\n", s);
-
-		if (s & FE_HAS_LOCK) {
-			t->last_tuning_failed = 0;
-			return 0;
-		}
+		memset(&ev, 0, sizeof(ev));
+		ev.events = EPOLLIN | EPOLLPRI;
+		ev.data.ptr = &ad->fe_slot;
+		if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, frontend_fd, &ev) == 0)
+			ad->fe_registered = 1;
+		else
+			ad->fe_events = 0;
 	}
 
-	warning(">>> tuning failed!!!\n");
-
-	t->last_tuning_failed = 1;
-
-	return -1;
+	return 0;
 }
 
 static int set_delivery_system(int fd, unsigned type)
@@ -1966,17 +1953,17 @@ static int set_delivery_system(int fd, unsigned type)
 	return errno;
 }
 
-static int tune_to_transponder (int frontend_fd, struct transponder *t)
+static int tune_to_transponder (struct scan_adapter *ad, struct transponder *t)
 {
 	int rc;
 
 	/* move TP from "new" to "scanned" list */
-	list_del_init(&t->list);
-	list_add_tail(&t->list, &scanned_transponders);
+	mark_scanned(t);
 	t->scan_done = 1;
+	ad->tp = t;
 
 	if (t->type != fe_info.type) {
-		rc = set_delivery_system(frontend_fd, t->type);
+		rc = set_delivery_system(ad->frontend_fd, t->type);
 		if (!rc)
 			fe_info.type = t->type;
 	}
@@ -1989,49 +1976,125 @@ static int tune_to_transponder (int frontend_fd, struct transponder *t)
 		return -1;
 	}
 
-	if (__tune_to_transponder (frontend_fd, t) == 0)
+	ad->tune_attempt = 1;
+	if (__tune_to_transponder (ad, t) == 0)
 		return 0;
 
-	return __tune_to_transponder (frontend_fd, t);
+	ad->tune_attempt = 2;
+	return __tune_to_transponder (ad, t);
 }
 
-
-static int tune_to_next_transponder (int frontend_fd)
+/* Tuning to t failed: switch it to an alternative frequency from its
+ * frequency_list_descriptor we do not know yet, if there is one.
+ */
+static int next_other_frequency(struct transponder *t)
 {
-	struct list_head *pos, *tmp;
-	struct transponder *t, *to;
+	struct transponder *to;
 	uint32_t freq;
 
-	list_for_each_safe(pos, tmp, &new_transponders) {
-		t = list_entry (pos, struct transponder, list);
-retry:
-		if (tune_to_transponder (frontend_fd, t) == 0)
-			return 0;
-next:
-		if (t->other_frequency_flag && t->other_f && t->n_other_f) {
-			/* check if the alternate freqeuncy is really new to us */
-			freq = t->other_f[t->n_other_f - 1];
-			t->n_other_f--;
-			if (find_transponder(freq))
-				goto next;
-
-			/* remember tuning to the old frequency failed */
-			to = calloc(1, sizeof(*to));
-			to->param.frequency = t->param.frequency;
-			to->wrong_frequency = 1;
-			INIT_LIST_HEAD(&to->list);
-			INIT_LIST_HEAD(&to->services);
-			list_add_tail(&to->list, &scanned_transponders);
-			copy_transponder(to, t);
-
-			t->param.frequency = freq;
-			info("retrying with f=%d\n", t->param.frequency);
-			goto retry;
-		}
+	while (t->other_frequency_flag && t->other_f && t->n_other_f) {
+		/* check if the alternate freqeuncy is really new to us */
+		freq = t->other_f[t->n_other_f - 1];
+		t->n_other_f--;
+		if (find_transponder(freq))
+			continue;
+
+		/* remember tuning to the old frequency failed */
+		to = new_transponder(t->param.frequency);
+		to->wrong_frequency = 1;
+		mark_scanned(to);
+		copy_transponder(to, t);
+
+		set_transponder_frequency(t, freq);
+		info("retrying with f=%d\n", t->param.frequency);
+		return 0;
 	}
 	return -1;
 }
 
+/* Start tuning ad to the next transponder nobody has scanned yet; the
+ * adapter is left idle if there is none (or none could be tuned).
+ */
+static void tune_to_next_transponder (struct scan_adapter *ad)
+{
+	struct transponder *t;
+
+	ad->state = ADAPTER_IDLE;
+	ad->tp = NULL;
+
+	while (!list_empty(&new_transponders)) {
+		t = list_entry (new_transponders.next, struct transponder, list);
+		if (tune_to_transponder (ad, t) == 0)
+			return;
+		while (next_other_frequency(t) == 0) {
+			if (tune_to_transponder (ad, t) == 0)
+				return;
+		}
+	}
+	ad->tp = NULL;
+}
+
+/* Read the status of a frontend being tuned, and start scanning once it
+ * has locked or move on once it has given up.
+ */
+static void check_lock(struct scan_adapter *ad)
+{
+	struct transponder *t = ad->tp;
+	long long now = monotonic_ms();
+	fe_status_t s;
+	int failed = 0;
+
+	if (ioctl(ad->frontend_fd, FE_READ_STATUS, &s) == -1) {
+		errorn("FE_READ_STATUS failed");
+		s = 0;
+		failed = 1;
+	} else {
+		note_tune_status(t, s, now - ad->tune_start);
+		verbose(">>> tuning status == 0x%02x\n", s);
+	}
+
+	if (s & FE_HAS_LOCK) {
+		verbose(">>> lock after %d ms (carrier %d ms, sync %d ms)\n",
+			t->lock_ms, t->carrier_ms, t->sync_ms);
+		tune_stats.locked++;
+		tune_stats.lock_ms += t->lock_ms;
+		tune_stats.wait_ms += now - ad->tune_start;
+		t->last_tuning_failed = 0;
+	} else if (!failed && now - ad->tune_start < TUNE_TIMEOUT_MS) {
+		ad->tune_poll = now + TUNE_POLL_MS;
+		if (ad->tune_poll > ad->tune_start + TUNE_TIMEOUT_MS)
+			ad->tune_poll = ad->tune_start + TUNE_TIMEOUT_MS;
+		return;
+	} else {
+		tune_stats.wait_ms += now - ad->tune_start;
+		warning(">>> tuning failed!!!\n");
+		t->last_tuning_failed = 1;
+	}
+
+	if (ad->fe_registered) {
+		epoll_ctl(epoll_fd, EPOLL_CTL_DEL, ad->frontend_fd, NULL);
+		ad->fe_registered = 0;
+	}
+
+	if (s & FE_HAS_LOCK) {
+		ad->n_scanned++;
+		scan_tp(ad);
+		return;
+	}
+
+	/* second attempt on the same frequency, then the alternatives */
+	if (ad->tune_attempt < 2) {
+		ad->tune_attempt = 2;
+		if (__tune_to_transponder (ad, t) == 0)
+			return;
+	}
+	while (next_other_frequency(t) == 0) {
+		if (tune_to_transponder (ad, t) == 0)
+			return;
+	}
+	tune_to_next_transponder(ad);
+}
+
 struct strtab {
 	const char *str;
 	int val;
@@ -2155,7 +2218,7 @@ static const char * fe_type2str(fe_type_t t)
 	return enum2str(t, typetab, "UNK");
 }
 
-static int tune_initial (int frontend_fd, const char *initial)
+static int tune_initial (const char *initial)
 {
 	FILE *inif;
 	unsigned int f, sr;
@@ -2241,97 +2304,115 @@ static int tune_initial (int frontend_fd, const char *initial)
 
 	fclose(inif);
 
-	return tune_to_next_transponder(frontend_fd);
+	if (list_empty(&new_transponders))
+		return -1;
+	return 0;
 }
 
 
-static void scan_tp_atsc(void)
+static void scan_tp_atsc(struct scan_adapter *ad)
 {
-	struct section_buf s0,s1,s2;
+	struct section_buf *s = ad->tables;
 
 	if (no_ATSC_PSIP) {
-		setup_filter(&s0, demux_devname, 0x00, 0x00, -1, 1, 0, 5); /* PAT */
-		add_filter(&s0);
+		setup_filter(&s[0], ad, 0x00, 0x00, -1, 1, 0, 5); /* PAT */
+		add_filter(&s[0]);
 	} else {
 		if (ATSC_type & 0x1) {
-			setup_filter(&s0, demux_devname, 0x1ffb, 0xc8, -1, 1, 0, 5); /* terrestrial VCT */
-			add_filter(&s0);
+			setup_filter(&s[0], ad, 0x1ffb, 0xc8, -1, 1, 0, 5); /* terrestrial VCT */
+			add_filter(&s[0]);
 		}
 		if (ATSC_type & 0x2) {
-			setup_filter(&s1, demux_devname, 0x1ffb, 0xc9, -1, 1, 0, 5); /* cable VCT */
-			add_filter(&s1);
+			setup_filter(&s[1], ad, 0x1ffb, 0xc9, -1, 1, 0, 5); /* cable VCT */
+			add_filter(&s[1]);
 		}
-		setup_filter(&s2, demux_devname, 0x00, 0x00, -1, 1, 0, 5); /* PAT */
-		add_filter(&s2);
+		setup_filter(&s[2], ad, 0x00, 0x00, -1, 1, 0, 5); /* PAT */
+		add_filter(&s[2]);
 	}
-
-	do {
-		read_filters ();
-	} while (!(list_empty(&running_filters) &&
-		   list_empty(&waiting_filters)));
 }
 
-static void scan_tp_dvb (void)
+static void scan_tp_dvb (struct scan_adapter *ad)
 {
-	struct section_buf s0;
-	struct section_buf s1;
-	struct section_buf s2;
-	struct section_buf s3;
+	struct section_buf *s = ad->tables;
 
 	/**
 	 *  filter timeouts > min repetition rates specified in ETR211
 	 */
-	setup_filter (&s0, demux_devname, 0x00, 0x00, -1, 1, 0, 5); /* PAT */
-	setup_filter (&s1, demux_devname, 0x11, 0x42, -1, 1, 0, 5); /* SDT */
+	setup_filter (&s[0], ad, 0x00, 0x00, -1, 1, 0, 5); /* PAT */
+	setup_filter (&s[1], ad, 0x11, 0x42, -1, 1, 0, 5); /* SDT */
 
-	add_filter (&s0);
-	add_filter (&s1);
+	add_filter (&s[0]);
+	add_filter (&s[1]);
 
 	if (!current_tp_only || output_format != OUTPUT_PIDS) {
-		setup_filter (&s2, demux_devname, 0x10, 0x40, -1, 1, 0, 15); /* NIT */
-		add_filter (&s2);
+		setup_filter (&s[2], ad, 0x10, 0x40, -1, 1, 0, 15); /* NIT */
+		add_filter (&s[2]);
 		if (get_other_nits) {
 			/* get NIT-others
 			 * Note: There is more than one NIT-other: one per
 			 * network, separated by the network_id.
 			 */
-			setup_filter (&s3, demux_devname, 0x10, 0x41, -1, 1, 1, 15);
-			add_filter (&s3);
+			setup_filter (&s[3], ad, 0x10, 0x41, -1, 1, 1, 15);
+			add_filter (&s[3]);
 		}
 	}
-
-	do {
-		read_filters ();
-	} while (!(list_empty(&running_filters) &&
-		   list_empty(&waiting_filters)));
 }
 
-static void scan_tp(void)
+/* Start the section filters for the transponder ad is locked to; they
+ * are run by read_filters() along with those of the other adapters.
+ */
+static void scan_tp(struct scan_adapter *ad)
 {
+	ad->state = ADAPTER_SCANNING;
+
 	switch(fe_info.type) {
 		case FE_QPSK:
 		case FE_QAM:
 		case FE_OFDM:
-			scan_tp_dvb();
+			scan_tp_dvb(ad);
 			break;
 		case FE_ATSC:
-			scan_tp_atsc();
+			scan_tp_atsc(ad);
 			break;
 		default:
 			break;
 	}
 }
 
-static void scan_network (int frontend_fd, const char *initial)
+/* Run all adapters until every transponder has been scanned. An idle
+ * adapter takes the next transponder from the shared queue, which the
+ * NITs parsed on any adapter keep feeding.
+ */
+static void run_adapters(void)
+{
+	int i, busy;
+
+	for (;;) {
+		busy = 0;
+		for (i = 0; i < n_adapters; i++) {
+			if (adapters[i].state == ADAPTER_IDLE &&
+			    !current_tp_only)
+				tune_to_next_transponder(&adapters[i]);
+			if (adapters[i].state != ADAPTER_IDLE)
+				busy = 1;
+		}
+		if (!busy)
+			break;
+		read_filters ();
+	}
+}
+
+static void scan_network (const char *initial)
 {
-	if (tune_initial (frontend_fd, initial) < 0) {
+	if (tune_initial (initial) < 0) {
 		error("initial tuning failed\n");
 		return;
 	}
 
-	do {
-		scan_tp();
-	} while (tune_to_next_transponder(frontend_fd) == 0);
+	run_adapters();
+
+	if (!tune_stats.locked)
+		error("initial tuning failed\n");
 }
 
 
@@ -2509,6 +2590,117 @@ static void show_existing_tuning_data_files(void)
 	}
 }
 
+static long long monotonic_us(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (long long) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static void put_bcd32(unsigned char *buf, uint32_t v)
+{
+	int i;
+
+	for (i = 3; i >= 0; i--) {
+		buf[i] = (v % 10) | (((v / 10) % 10) << 4);
+		v /= 100;
+	}
+}
+
+/* Feed synthetic NIT/SDT sections describing n_tp DVB-S transponders with
+ * n_svc services each through the section parsers, without any hardware,
+ * and report how long the transponder and service lookups took.
+ */
+static void run_lookup_benchmark(int n_tp, int n_svc)
+{
+	const int entry_len = 6 + 13;
+	struct transponder **tps;
+	unsigned char *nit, *sdt, *b;
+	long long t0, t_nit, t_nit2, t_sdt, t_sdt2;
+	int nit_len = 4 + n_tp * entry_len;
+	int sdt_len = 3 + n_svc * 5;
+	int i, j, pass;
+
+	fe_info.type = FE_QPSK;
+	nit = calloc(1, nit_len);
+	sdt = calloc(1, sdt_len);
+	tps = calloc(n_tp, sizeof(*tps));
+	if (!nit || !sdt || !tps)
+		fatal("out of memory\n");
+
+	b = nit;
+	b[2] = 0xf0 | (((n_tp * entry_len) >> 8) & 0x0f);
+	b[3] = (n_tp * entry_len) & 0xff;
+	b += 4;
+	for (i = 0; i < n_tp; i++) {
+		b[0] = i >> 8;
+		b[1] = i & 0xff;
+		b[2] = 0x00;
+		b[3] = 0x01;
+		b[4] = 0xf0;
+		b[5] = 13;
+		b[6] = 0x43;
+		b[7] = 11;
+		/* 4 MHz apart, in units of 10 kHz */
+		put_bcd32(b + 8, 1070000 + i * 400);
+		b[12] = 0x01;
+		b[13] = 0x92;
+		b[14] = (i & 1) ? 0x21 : 0x41;
+		put_bcd32(b + 15, 2750000);
+		b[18] = (b[18] & 0xf0) | 0x03;
+		b += entry_len;
+	}
+
+	t0 = monotonic_us();
+	parse_nit(nit, nit_len, 1);
+	t_nit = monotonic_us() - t0;
+	/* NIT repetitions and NIT-other find the transponders again */
+	t0 = monotonic_us();
+	parse_nit(nit, nit_len, 1);
+	t_nit2 = monotonic_us() - t0;
+
+	for (i = 0; i < n_tp; i++) {
+		tps[i] = find_transponder(10 * (1070000 + i * 400));
+		if (!tps[i])
+			fatal("benchmark: transponder %d not found\n", i);
+	}
+
+	b = sdt + 3;
+	for (j = 0; j < n_svc; j++) {
+		b[0] = (j * 7 + 1) >> 8;
+		b[1] = (j * 7 + 1) & 0xff;
+		b[2] = 0xfc;
+		b[3] = 0x80;
+		b[4] = 0x00;
+		b += 5;
+	}
+
+	t_sdt = t_sdt2 = 0;
+	for (pass = 0; pass < 2; pass++) {
+		t0 = monotonic_us();
+		for (i = 0; i < n_tp; i++) {
+			current_tp = tps[i];
+			parse_sdt(sdt, sdt_len - 3, current_tp->transport_stream_id);
+		}
+		if (pass == 0)
+			t_sdt = monotonic_us() - t0;
+		else
+			t_sdt2 = monotonic_us() - t0;
+	}
+
+	info("lookup benchmark: %d transponders, %d services\n",
+	     n_tp, n_tp * n_svc);
+	info("  NIT first pass  %8lld us\n", t_nit);
+	info("  NIT second pass %8lld us\n", t_nit2);
+	info("  SDT first pass  %8lld us\n", t_sdt);
+	info("  SDT second pass %8lld us\n", t_sdt2);
+
+	free(tps);
+	free(sdt);
+	free(nit);
+}
+
 static void handle_sigint(int sig)
 {
 	(void)sig;
@@ -2524,7 +2716,8 @@ static const char *usage = "\n"
 	"	-c	scan on currently tuned transponder only\n"
 	"	-v 	verbose (repeat for more)\n"
 	"	-q 	quiet (repeat for less)\n"
-	"	-a N	use DVB /dev/dvb/adapterN/\n"
+	"	-a N	use DVB /dev/dvb/adapterN/; a comma separated list scans\n"
+	"		on several identical adapters in parallel\n"
 	"	-f N	use DVB /dev/dvb/adapter?/frontendN\n"
 	"	-d N	use DVB /dev/dvb/adapter?/demuxN\n"
 	"	-s N	use DiSEqC switch position N (DVB-S only)\n"
@@ -2552,6 +2745,8 @@ static const char *usage = "\n"
 	"	-U	Uniquely name unknown services\n"
 	"	-C cs	Override default charset for service name/provider (default = ISO-6937)\n"
 	"	-D cs	Output charset (default = %s)\n"
+	"	-B N[,M] run a lookup benchmark on N synthetic transponders with\n"
+	"		M services each (default 20) and exit\n"
 	"Supported charsets by -C/-D parameters can be obtained via 'iconv -l' command\n";
 
 void
@@ -2587,12 +2782,14 @@ bad_usage(char *pname, int problem)
 int main (int argc, char **argv)
 {
 	char frontend_devname [80];
-	int adapter = 0, frontend = 0, demux = 0;
+	int adapter_ids[MAX_ADAPTERS] = { 0 };
+	int frontend = 0, demux = 0;
 	int opt, i;
-	int frontend_fd;
 	int fe_open_mode;
 	const char *initial = NULL;
 	char *charset;
+	char *endp;
+	int bench_transponders = 0, bench_services = 0;
 
 	if (argc <= 1) {
 	    bad_usage(argv[0], 2);
@@ -2621,10 +2818,18 @@ int main (int argc, char **argv)
 
 	/* start with default lnb type */
 	lnb_type = *lnb_enum(0);
-	while ((opt = getopt(argc, argv, "5cnpa:f:d:s:o:x:e:t:i:l:vquPA:UC:D:")) != -1) {
+	while ((opt = getopt(argc, argv, "5cnpa:f:d:s:o:x:e:t:i:l:vquPA:UC:D:B:")) != -1) {
 		switch (opt) {
 		case 'a':
-			adapter = strtoul(optarg, NULL, 0);
+			n_adapters = 0;
+			endp = optarg;
+			do {
+				if (n_adapters >= MAX_ADAPTERS) {
+					bad_usage(argv[0], 0);
+					return -1;
+				}
+				adapter_ids[n_adapters++] = strtoul(endp, &endp, 0);
+			} while (*endp++ == ',');
 			break;
 		case 'c':
 			current_tp_only = 1;
@@ -2707,12 +2912,23 @@ int main (int argc, char **argv)
 		case 'D':
 			output_charset = optarg;
 			break;
+		case 'B':
+			bench_transponders = strtoul(optarg, &endp, 0);
+			bench_services = 20;
+			if (*endp == ',')
+				bench_services = strtoul(endp + 1, NULL, 0);
+			break;
 		default:
 			bad_usage(argv[0], 0);
 			return -1;
 		};
 	}
 
+	if (bench_transponders > 0) {
+		run_lookup_benchmark(bench_transponders, bench_services);
+		return 0;
+	}
+
 	if (optind < argc)
 		initial = argv[optind];
 	if ((!initial && !current_tp_only) || (initial && current_tp_only) ||
@@ -2729,23 +2945,51 @@ int main (int argc, char **argv)
 	}
 	if (initial)
 		info("scanning %s\n", initial);
+	init_text_decoder();
 
-	snprintf (frontend_devname, sizeof(frontend_devname),
-		  "/dev/dvb/adapter%i/frontend%i", adapter, frontend);
-
-	snprintf (demux_devname, sizeof(demux_devname),
-		  "/dev/dvb/adapter%i/demux%i", adapter, demux);
-	info("using '%s' and '%s'\n", frontend_devname, demux_devname);
-
-	for (i = 0; i < MAX_RUNNING; i++)
-		poll_fds[i].fd = -1;
+	if (n_adapters == 0)
+		n_adapters = 1;
+	if (current_tp_only && n_adapters > 1) {
+		bad_usage(argv[0], 0);
+		return -1;
+	}
+	if (open_epoll() < 0)
+		return -1;
 
 	fe_open_mode = current_tp_only ? O_RDONLY : O_RDWR;
-	if ((frontend_fd = open (frontend_devname, fe_open_mode)) < 0)
-		fatal("failed to open '%s': %d %m\n", frontend_devname, errno);
-	/* determine FE type and caps */
-	if (ioctl(frontend_fd, FE_GET_INFO, &fe_info) == -1)
-		fatal("FE_GET_INFO failed: %d %m\n", errno);
+	for (i = 0; i < n_adapters; i++) {
+		struct scan_adapter *ad = &adapters[i];
+		struct dvb_frontend_info info;
+
+		ad->adapter = adapter_ids[i];
+		snprintf (frontend_devname, sizeof(frontend_devname),
+			  "/dev/dvb/adapter%i/frontend%i", ad->adapter, frontend);
+		snprintf (ad->demux_devname, sizeof(ad->demux_devname),
+			  "/dev/dvb/adapter%i/demux%i", ad->adapter, demux);
+		info("using '%s' and '%s'\n", frontend_devname, ad->demux_devname);
+
+		if ((ad->frontend_fd = open (frontend_devname, fe_open_mode)) < 0)
+			fatal("failed to open '%s': %d %m\n", frontend_devname, errno);
+		/* determine FE type and caps */
+		if (ioctl(ad->frontend_fd, FE_GET_INFO, &info) == -1)
+			fatal("FE_GET_INFO failed: %d %m\n", errno);
+		/* the adapters share one transponder queue, so they must
+		 * all be able to tune the same things */
+		if (i == 0)
+			fe_info = info;
+		else if (info.type != fe_info.type)
+			fatal("'%s' is not of the same type as the first frontend\n",
+			      frontend_devname);
+		else
+			fe_info.caps &= info.caps;
+
+		ad->state = ADAPTER_IDLE;
+		ad->fe_slot.fd = ad->frontend_fd;
+		ad->fe_slot.adapter = ad;
+		ad->fe_events = 1;
+		INIT_LIST_HEAD(&ad->running_filters);
+		INIT_LIST_HEAD(&ad->waiting_filters);
+	}
 
 	if ((spectral_inversion == INVERSION_AUTO ) &&
 	    !(fe_info.caps & FE_CAN_INVERSION_AUTO)) {
@@ -2758,15 +3002,30 @@ int main (int argc, char **argv)
 	if (current_tp_only) {
 		current_tp = alloc_transponder(0); /* dummy */
 		/* move TP from "new" to "scanned" list */
-		list_del_init(&current_tp->list);
-		list_add_tail(&current_tp->list, &scanned_transponders);
+		mark_scanned(current_tp);
 		current_tp->scan_done = 1;
-		scan_tp ();
+		adapters[0].tp = current_tp;
+		scan_tp (&adapters[0]);
+		run_adapters ();
 	}
 	else
-		scan_network (frontend_fd, initial);
-
-	close (frontend_fd);
+		scan_network (initial);
+
+	if (tune_stats.tunes)
+		info("tuned %d transponders, %d locked (average lock %lld ms), "
+		     "%lld ms spent waiting for lock\n",
+		     tune_stats.tunes, tune_stats.locked,
+		     tune_stats.locked ? tune_stats.lock_ms / tune_stats.locked : 0,
+		     tune_stats.wait_ms);
+	if (n_adapters > 1) {
+		for (i = 0; i < n_adapters; i++)
+			info("adapter %d scanned %d transponders\n",
+			     adapters[i].adapter, adapters[i].n_scanned);
+	}
+
+	for (i = 0; i < n_adapters; i++)
+		close (adapters[i].frontend_fd);
+	close_filter_slots();
 
 	dump_lists ();
 
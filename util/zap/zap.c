@@ -30,6 +30,7 @@
 #include <libdvbapi/dvbdemux.h>
 #include <libdvbapi/dvbaudio.h>
 #include <libdvbsec/dvbsec_cfg.h>
+#include <libdvbcfg/dvbcfg_channeldb.h>
 #include <libucsi/mpeg/section.h>
 #include "zap_dvb.h"
 #include "zap_ca.h"
@@ -52,6 +53,7 @@ void usage(void)
 		" -demux <id>		demux to use (default 0)\n"
 		" -caslotnum <id>	ca slot number to use (default 0)\n"
 		" -channels <filename>	channels.conf file.\n"
+		" -chancache <filename>	Optional cache of the parsed channels.conf, rebuilt when it changes.\n"
 		" -secfile <filename>	Optional sec.conf file.\n"
 		" -secid <secid>	ID of the SEC configuration to use, one of:\n"
 		" -nomoveca		Do not attempt to move CA descriptors from stream to programme level\n"
@@ -61,18 +63,6 @@ void usage(void)
 	exit(1);
 }
 
-int find_channel(struct dvbcfg_zapchannel *channel, void *private_data)
-{
-	struct dvbcfg_zapchannel *tmpchannel = private_data;
-
-	if (strcmp(channel->name, tmpchannel->name) == 0) {
-		memcpy(tmpchannel, channel, sizeof(struct dvbcfg_zapchannel));
-		return 1;
-	}
-
-	return 0;
-}
-
 int main(int argc, char *argv[])
 {
 	int adapter_id = 0;
@@ -80,6 +70,9 @@ int main(int argc, char *argv[])
 	int demux_id = 0;
 	int caslot_num = 0;
 	char *chanfile = "/etc/channels.conf";
+	char *chancache = NULL;
+	struct dvbcfg_channeldb *channeldb;
+	const struct dvbcfg_zapchannel *channel;
 	char *secfile = NULL;
 	char *secid = NULL;
 	char *channel_name = NULL;
@@ -120,6 +113,11 @@ int main(int argc, char *argv[])
 				usage();
 			chanfile = argv[argpos+1];
 			argpos+=2;
+		} else if (!strcmp(argv[argpos], "-chancache")) {
+			if ((argc - argpos) < 2)
+				usage();
+			chancache = argv[argpos+1];
+			argpos+=2;
 		} else if (!strcmp(argv[argpos], "-secfile")) {
 			if ((argc - argpos) < 2)
 				usage();
@@ -156,21 +154,16 @@ int main(int argc, char *argv[])
 	zap_ca_start(&zap_ca_params);
 
 	// find the requested channel
-	if (strlen(channel_name) >= sizeof(zap_dvb_params.channel.name)) {
-		fprintf(stderr, "Channel name is too long %s\n", channel_name);
-		exit(1);
-	}
-	FILE *channel_file = fopen(chanfile, "r");
-	if (channel_file == NULL) {
+	if ((channeldb = dvbcfg_channeldb_load(chanfile, chancache)) == NULL) {
 		fprintf(stderr, "Could open channel file %s\n", chanfile);
 		exit(1);
 	}
-	memcpy(zap_dvb_params.channel.name, channel_name, strlen(channel_name) + 1);
-	if (dvbcfg_zapchannel_parse(channel_file, find_channel, &zap_dvb_params.channel) != 1) {
+	if ((channel = dvbcfg_channeldb_find_name(channeldb, channel_name)) == NULL) {
 		fprintf(stderr, "Unable to find requested channel %s\n", channel_name);
 		exit(1);
 	}
-	fclose(channel_file);
+	memcpy(&zap_dvb_params.channel, channel, sizeof(struct dvbcfg_zapchannel));
+	dvbcfg_channeldb_free(channeldb);
 
 	// default SEC with a DVBS card
 	if ((secid == NULL) && (zap_dvb_params.channel.fe_type == DVBFE_TYPE_DVBS))
@@ -27,6 +27,9 @@
 #include <libdvben50221/en50221_stdcam.h>
 #include "zap_ca.h"
 
+// how often the cam thread checks the CAM state when nothing else happens
+#define CAMTHREAD_MAX_WAIT_MS 100
+
 
 static int zap_ca_info_callback(void *arg, uint8_t slot_id, uint16_t session_number, uint32_t ca_id_count, uint16_t *ca_ids);
 static int zap_ai_callback(void *arg, uint8_t slot_id, uint16_t session_number,
@@ -55,6 +58,9 @@ void zap_ca_start(struct zap_ca_params *params)
 		return;
 	}
 
+	// sleep until there is something to do rather than spinning
+	en50221_tl_set_event_driven(tl, 1, CAMTHREAD_MAX_WAIT_MS);
+
 	// create session layer
 	sl = en50221_sl_create(tl, 16);
 	if (sl == NULL) {
@@ -95,6 +101,7 @@ void zap_ca_stop(void)
 
 	// shutdown the cam thread
 	camthread_shutdown = 1;
+	en50221_tl_wakeup(tl);
 	pthread_join(camthread, NULL);
 
 	// destroy session layer
@@ -28,6 +28,7 @@
 #include <sys/poll.h>
 #include <libdvbapi/dvbdemux.h>
 #include <libucsi/section.h>
+#include <libucsi/psi_table.h>
 #include <libucsi/mpeg/section.h>
 #include <libucsi/dvb/section.h>
 #include "zap_dvb.h"
@@ -38,14 +39,24 @@
 static int dvbthread_shutdown = 0;
 static pthread_t dvbthread;
 
-static int pat_version = -1;
-static int ca_pmt_version = -1;
+static int pmt_pid = -1;
+
+// complete PAT/PMT versions are handed to process_table() by the collector
+static struct psi_table_collector *psi_tables;
+
+struct table_context {
+	struct zap_dvb_params *params;
+	int *pmt_fd;
+	struct pollfd *pollfd;
+};
 
 static void *dvbthread_func(void* arg);
 
-static void process_pat(int pat_fd, struct zap_dvb_params *params, int *pmt_fd, struct pollfd *pollfd);
+static void read_section(int fd, int pid);
+static void process_table(void *arg, struct psi_table *table);
+static void process_pat(struct psi_table *table, struct zap_dvb_params *params, int *pmt_fd, struct pollfd *pollfd);
 static void process_tdt(int tdt_fd);
-static void process_pmt(int pmt_fd, struct zap_dvb_params *params);
+static void process_pmt(struct psi_table *table);
 static int create_section_filter(int adapter, int demux, uint16_t pid, uint8_t table_id);
 
 
@@ -68,9 +79,19 @@ static void *dvbthread_func(void* arg)
 	int pmt_fd = -1;
 	int tdt_fd = -1;
 	struct pollfd pollfds[3];
+	struct table_context context;
 
 	struct zap_dvb_params *params = (struct zap_dvb_params *) arg;
 
+	// the demux checks the CRCs for us
+	context.params = params;
+	context.pmt_fd = &pmt_fd;
+	context.pollfd = &pollfds[2];
+	if ((psi_tables = psi_table_collector_create(0, process_table, &context)) == NULL) {
+		fprintf(stderr, "Failed to create PSI table collector\n");
+		exit(1);
+	}
+
 	// create PAT filter
 	if ((pat_fd = create_section_filter(params->adapter_id, params->demux_id,
 	     TRANSPORT_PAT_PID, stag_mpeg_program_association)) < 0) {
@@ -182,7 +203,7 @@ static void *dvbthread_func(void* arg)
 
 		// PAT
 		if (pollfds[0].revents & (POLLIN|POLLPRI)) {
-			process_pat(pat_fd, params, &pmt_fd, &pollfds[2]);
+			read_section(pat_fd, TRANSPORT_PAT_PID);
 		}
 
 		// TDT
@@ -192,7 +213,7 @@ static void *dvbthread_func(void* arg)
 
 		//  PMT
 		if (pollfds[2].revents & (POLLIN|POLLPRI)) {
-			process_pmt(pmt_fd, params);
+			read_section(pmt_fd, pmt_pid);
 		}
 	}
 
@@ -203,65 +224,95 @@ static void *dvbthread_func(void* arg)
 		close(pmt_fd);
 	if (tdt_fd != -1)
 		close(tdt_fd);
+	psi_table_collector_destroy(psi_tables);
 
 	return 0;
 }
 
-static void process_pat(int pat_fd, struct zap_dvb_params *params, int *pmt_fd, struct pollfd *pollfd)
+static void read_section(int fd, int pid)
 {
 	int size;
 	uint8_t sibuf[4096];
 
-	// read the section
-	if ((size = read(pat_fd, sibuf, sizeof(sibuf))) < 0) {
+	// read the section; unchanged repeats are dropped by the collector
+	if ((size = read(fd, sibuf, sizeof(sibuf))) < 0) {
 		return;
 	}
+	psi_table_collector_feed(psi_tables, pid, sibuf, size);
+}
 
-	// parse section
-	struct section *section = section_codec(sibuf, size);
-	if (section == NULL) {
-		return;
+static void process_table(void *arg, struct psi_table *table)
+{
+	struct table_context *context = (struct table_context *) arg;
+
+	switch(table->table_id) {
+	case stag_mpeg_program_association:
+		process_pat(table, context->params, context->pmt_fd, context->pollfd);
+		break;
+
+	case stag_mpeg_program_map:
+		if ((table->pid == pmt_pid) &&
+		    (table->table_id_ext == context->params->channel.service_id))
+			process_pmt(table);
+		break;
 	}
+}
 
-	// parse section_ext
-	struct section_ext *section_ext = section_ext_decode(section, 0);
-	if (section_ext == NULL) {
-		return;
-	}
-	if (pat_version == section_ext->version_number) {
-		return;
-	}
+static void process_pat(struct psi_table *table, struct zap_dvb_params *params, int *pmt_fd, struct pollfd *pollfd)
+{
+	uint8_t sibuf[4096];
+	int section_number;
 
-	// parse PAT
-	struct mpeg_pat_section *pat = mpeg_pat_section_codec(section_ext);
-	if (pat == NULL) {
-		return;
-	}
+	for(section_number=0; section_number <= table->last_section_number; section_number++) {
+		// the collector's copy must not be modified by the codecs
+		memcpy(sibuf, table->sections[section_number].data, table->sections[section_number].len);
+
+		// parse section
+		struct section *section = section_codec(sibuf, table->sections[section_number].len);
+		if (section == NULL) {
+			continue;
+		}
+
+		// parse section_ext
+		struct section_ext *section_ext = section_ext_decode(section, 0);
+		if (section_ext == NULL) {
+			continue;
+		}
+
+		// parse PAT
+		struct mpeg_pat_section *pat = mpeg_pat_section_codec(section_ext);
+		if (pat == NULL) {
+			continue;
+		}
 
-	// try and find the requested program
-	struct mpeg_pat_program *cur_program;
-	mpeg_pat_section_programs_for_each(pat, cur_program) {
-		if (cur_program->program_number == params->channel.service_id) {
-			// close old PMT fd
-			if (*pmt_fd != -1)
-				close(*pmt_fd);
-
-			// create PMT filter
-			if ((*pmt_fd = create_section_filter(params->adapter_id, params->demux_id,
-							     cur_program->pid, stag_mpeg_program_map)) < 0) {
+		// try and find the requested program
+		struct mpeg_pat_program *cur_program;
+		mpeg_pat_section_programs_for_each(pat, cur_program) {
+			if (cur_program->program_number == params->channel.service_id) {
+				// close old PMT fd
+				if (*pmt_fd != -1)
+					close(*pmt_fd);
+
+				// forget the old PMT, so the next one is processed even if unchanged
+				if (pmt_pid != -1)
+					psi_table_collector_forget(psi_tables, pmt_pid,
+								   stag_mpeg_program_map, params->channel.service_id);
+				pmt_pid = cur_program->pid;
+
+				// create PMT filter
+				if ((*pmt_fd = create_section_filter(params->adapter_id, params->demux_id,
+								     cur_program->pid, stag_mpeg_program_map)) < 0) {
+					// try again with the next PAT
+					psi_table_collector_forget(psi_tables, table->pid,
+								   table->table_id, table->table_id_ext);
+					return;
+				}
+				pollfd->fd = *pmt_fd;
+				pollfd->events = POLLIN|POLLPRI|POLLERR;
 				return;
 			}
-			pollfd->fd = *pmt_fd;
-			pollfd->events = POLLIN|POLLPRI|POLLERR;
-
-			// we have a new PMT pid
-			ca_pmt_version = -1;
-			break;
 		}
 	}
-
-	// remember the PAT version
-	pat_version = section_ext->version_number;
 }
 
 static void process_tdt(int tdt_fd)
@@ -290,18 +341,15 @@ static void process_tdt(int tdt_fd)
 	zap_ca_new_dvbtime(dvbdate_to_unixtime(tdt->utc_time));
 }
 
-static void process_pmt(int pmt_fd, struct zap_dvb_params *params)
+static void process_pmt(struct psi_table *table)
 {
-	int size;
 	uint8_t sibuf[4096];
 
-	// read the section
-	if ((size = read(pmt_fd, sibuf, sizeof(sibuf))) < 0) {
-		return;
-	}
+	// a PMT is always a single section
+	memcpy(sibuf, table->sections[0].data, table->sections[0].len);
 
 	// parse section
-	struct section *section = section_codec(sibuf, size);
+	struct section *section = section_codec(sibuf, table->sections[0].len);
 	if (section == NULL) {
 		return;
 	}
@@ -311,10 +359,6 @@ static void process_pmt(int pmt_fd, struct zap_dvb_params *params)
 	if (section_ext == NULL) {
 		return;
 	}
-	if ((section_ext->table_id_ext != params->channel.service_id) ||
-	    (section_ext->version_number == ca_pmt_version)) {
-		return;
-	}
 
 	// parse PMT
 	struct mpeg_pmt_section *pmt = mpeg_pmt_section_codec(section_ext);
@@ -322,9 +366,10 @@ static void process_pmt(int pmt_fd, struct zap_dvb_params *params)
 		return;
 	}
 
-	// do ca handling
-	if (zap_ca_new_pmt(pmt) == 1)
-		ca_pmt_version = pmt->head.version_number;
+	// do ca handling; if the CAM is not ready for it yet, have the next repeat
+	// delivered again. -1 (no CAM, or it failed) would fail again, so is final.
+	if (zap_ca_new_pmt(pmt) == 0)
+		psi_table_collector_forget(psi_tables, table->pid, table->table_id, table->table_id_ext);
 }
 
 static int create_section_filter(int adapter, int demux, uint16_t pid, uint8_t table_id)